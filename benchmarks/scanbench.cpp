@@ -0,0 +1,373 @@
+#include "portscanner.h"
+#include "simulatednetwork.h"
+#include "targetfarm.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QHash>
+#include <QTextStream>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Heap allocations made by probe threads. The main thread only drains
+// results and keeps this benchmark's books, and the target farm's thread
+// plays the other end of the wire, so neither is counted.
+static std::atomic<quint64> heapAllocations{0};
+thread_local bool uncountedThread = false;
+
+static inline void countAllocation()
+{
+    if (!uncountedThread) {
+        heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+#ifdef __GLIBC__
+// operator new and Qt's containers both end up in malloc, which the
+// executable overrides here and hands on to glibc's own.
+#define SCANBENCH_COUNTS_ALLOCATIONS
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+void __libc_free(void *pointer);
+
+void *malloc(size_t size)
+{
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+    countAllocation();
+    return __libc_realloc(pointer, size);
+}
+
+void free(void *pointer)
+{
+    __libc_free(pointer);
+}
+}
+#endif
+
+struct BenchResult
+{
+    QString scanType;
+    QString timing;
+    int ports = 0;
+    double seconds = 0;
+    double portsPerSecond = 0;
+    int p50 = 0;
+    int p99 = 0;
+    double cpuSeconds = 0;
+    double virtualSeconds = 0;
+    int misclassified = 0;
+    // Probe-thread heap allocations per port, or -1 where they can't be counted.
+    double allocsPerProbe = -1;
+};
+
+struct BenchSetup
+{
+    QString host;
+    PortSet ports;
+    std::function<QString(ScanType, int)> expected;
+    QSharedPointer<SimulatedNetwork> network;
+    // Non-empty: scan through this nmap (or a stub replaying its XML).
+    QString nmapProgram;
+};
+
+static double processCpuSeconds()
+{
+#ifdef Q_OS_WIN
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    auto toSeconds = [](const FILETIME &time) {
+        return ((quint64(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 1e7;
+    };
+    return toSeconds(kernel) + toSeconds(user);
+#else
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+           + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#endif
+}
+
+static int percentile(QList<int> samples, double fraction)
+{
+    if (samples.isEmpty()) {
+        return 0;
+    }
+    int index = qBound(0, int(fraction * (samples.size() - 1) + 0.5), samples.size() - 1);
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples.at(index);
+}
+
+static bool parseScanType(const QString &name, ScanType &type)
+{
+    static const QHash<QString, ScanType> types = {
+        { "connect", ScanType::TCP_CONNECT },
+        { "syn", ScanType::TCP_SYN },
+        { "udp", ScanType::UDP_SCAN },
+        { "fin", ScanType::TCP_FIN },
+        { "xmas", ScanType::TCP_XMAS },
+        { "null", ScanType::TCP_NULL },
+        { "ack", ScanType::TCP_ACK },
+        { "window", ScanType::TCP_WINDOW },
+    };
+    auto it = types.constFind(name.trimmed().toLower());
+    if (it == types.constEnd()) {
+        return false;
+    }
+    type = it.value();
+    return true;
+}
+
+static bool parseTiming(const QString &name, TimingTemplate &timing)
+{
+    static const QHash<QString, TimingTemplate> timings = {
+        { "t0", TimingTemplate::T0_PARANOID },
+        { "t1", TimingTemplate::T1_SNEAKY },
+        { "t2", TimingTemplate::T2_POLITE },
+        { "t3", TimingTemplate::T3_NORMAL },
+        { "t4", TimingTemplate::T4_AGGRESSIVE },
+        { "t5", TimingTemplate::T5_INSANE },
+    };
+    auto it = timings.constFind(name.trimmed().toLower());
+    if (it == timings.constEnd()) {
+        return false;
+    }
+    timing = it.value();
+    return true;
+}
+
+static QString expectedStatus(ScanType type, int port, const TargetFarm &farm)
+{
+    bool isOpen = farm.openPorts().contains(port);
+    switch (type) {
+    case ScanType::UDP_SCAN:
+        return isOpen ? "Open" : "Open|Filtered";
+    case ScanType::TCP_ACK:
+        return isOpen ? "Unfiltered" : "Filtered";
+    default:
+        if (isOpen) return "Open";
+        if (farm.closedPorts().contains(port)) return "Closed";
+        return "Filtered";
+    }
+}
+
+static BenchResult runBenchmark(const BenchSetup &setup, const QString &typeName, ScanType type,
+                                const QString &timingName, TimingTemplate timing, int repeat)
+{
+    BenchResult result;
+    result.scanType = typeName;
+    result.timing = timingName.toUpper();
+
+    QList<int> latencies;
+    latencies.reserve(setup.ports.size() * repeat);
+    quint64 allocations = 0;
+    QElapsedTimer wall;
+    double cpuStart = processCpuSeconds();
+    wall.start();
+
+    for (int run = 0; run < repeat; ++run) {
+        PortScanner scanner;
+        if (!setup.nmapProgram.isEmpty()) {
+            scanner.setScanEngine(ScanEngine::Nmap);
+            scanner.setNmapProgram(setup.nmapProgram);
+        }
+        if (setup.network) {
+            setup.network->clock().reset();
+            scanner.setTransport(setup.network);
+        }
+
+        QEventLoop loop;
+        QObject::connect(&scanner, &PortScanner::scanFinished, &loop, &QEventLoop::quit);
+        QObject::connect(&scanner, &PortScanner::portResults, [&](const QVector<ProbeResult> &results) {
+            for (const ProbeResult &probe : results) {
+                latencies.append(probe.responseTime);
+                if (setup.expected && portStateName(probe.state) != setup.expected(type, probe.port)) {
+                    result.misclassified++;
+                }
+            }
+        });
+
+        const quint64 allocationsBefore = heapAllocations.load(std::memory_order_relaxed);
+        scanner.startScan(setup.host, setup.ports, type, timing, false, false, false);
+        if (scanner.isScanning()) {
+            loop.exec();
+        }
+        allocations += heapAllocations.load(std::memory_order_relaxed) - allocationsBefore;
+        result.ports += setup.ports.size();
+        if (setup.network) {
+            result.virtualSeconds += setup.network->clock().now() / 1000.0;
+        }
+    }
+
+    result.seconds = wall.elapsed() / 1000.0;
+    result.cpuSeconds = processCpuSeconds() - cpuStart;
+    result.portsPerSecond = result.seconds > 0 ? result.ports / result.seconds : 0;
+    result.p50 = percentile(latencies, 0.50);
+    result.p99 = percentile(latencies, 0.99);
+#ifdef SCANBENCH_COUNTS_ALLOCATIONS
+    result.allocsPerProbe = result.ports > 0 ? double(allocations) / result.ports : 0;
+#else
+    Q_UNUSED(allocations);
+#endif
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    uncountedThread = true;
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("cyberscanner-bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Scans a loopback target farm and reports throughput, latency and CPU per scan type and timing template.");
+    parser.addHelpOption();
+    parser.addOption({ "open", "Number of open ports in the farm.", "count", "20" });
+    parser.addOption({ "closed", "Number of closed ports in the farm.", "count", "200" });
+    parser.addOption({ "filtered", "Number of filtered (blackholed) ports in the farm.", "count", "20" });
+    parser.addOption({ "scan-types", "Comma separated scan types (connect,syn,udp,fin,xmas,null,ack,window).", "list", "connect,syn" });
+    parser.addOption({ "timings", "Comma separated timing templates (T0-T5).", "list", "T3,T4,T5" });
+    parser.addOption({ "repeat", "Scans per combination.", "count", "3" });
+    parser.addOption({ "json", "Write results as JSON to this file for comparing runs.", "file" });
+    parser.addOption({ "simulate", "Scan an in-process simulated network instead of the loopback farm." });
+    parser.addOption({ "sim-ports", "Ports 1..N to scan on the simulated host.", "count", "65535" });
+    parser.addOption({ "sim-rtt", "Mean simulated round trip time in ms.", "ms", "40" });
+    parser.addOption({ "sim-jitter", "Simulated RTT jitter in ms.", "ms", "10" });
+    parser.addOption({ "sim-loss", "Simulated packet loss (0-1).", "fraction", "0.01" });
+    parser.addOption({ "sim-rate", "Simulated per-host response rate limit (responses/s, 0 = none).", "rate", "0" });
+    parser.addOption({ "sim-open", "Fraction of simulated ports that are open.", "fraction", "0.01" });
+    parser.addOption({ "seed", "Seed for the simulated network.", "seed", "1" });
+    parser.addOption({ "nmap", "Scan through this nmap binary, or a script replaying recorded -oX output.", "program" });
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    TargetFarm::Config config;
+    config.openPorts = parser.value("open").toInt();
+    config.closedPorts = parser.value("closed").toInt();
+    config.filteredPorts = parser.value("filtered").toInt();
+
+    TargetFarm farm(config);
+    BenchSetup setup;
+    setup.nmapProgram = parser.value("nmap");
+
+    if (parser.isSet("simulate")) {
+        SimulatedHost host;
+        host.rttMean = parser.value("sim-rtt").toDouble();
+        host.rttJitter = parser.value("sim-jitter").toDouble();
+        host.loss = parser.value("sim-loss").toDouble();
+        host.rateLimit = parser.value("sim-rate").toDouble();
+        host.openDensity = parser.value("sim-open").toDouble();
+        host.defaultState = SimulatedPortState::Filtered;
+
+        setup.network.reset(new SimulatedNetwork(parser.value("seed").toULongLong()));
+        setup.network->setDefaultHost(host);
+        setup.host = "10.0.0.1";
+        setup.ports = PortSet::range(1, qBound(1, parser.value("sim-ports").toInt(), 65535));
+
+        out << "Simulated host " << setup.host << ": " << setup.ports.size() << " ports, rtt "
+            << host.rttMean << "+-" << host.rttJitter << " ms, loss " << host.loss << Qt::endl;
+    } else {
+        QString error;
+        if (!farm.startFarm(&error)) {
+            err << "Could not start target farm: " << error << Qt::endl;
+            return 1;
+        }
+
+        setup.host = "127.0.0.1";
+        setup.ports = farm.allPorts();
+        setup.expected = [&farm](ScanType type, int port) {
+            return expectedStatus(type, port, farm);
+        };
+
+        out << "Target farm on 127.0.0.1: " << farm.openPorts().size() << " open, "
+            << farm.closedPorts().size() << " closed, " << farm.filteredPorts().size() << " filtered" << Qt::endl;
+    }
+
+    out << QString("%1 %2 %3 %4 %5 %6 %7 %8 %9 %10")
+               .arg("scan", -8).arg("timing", -6).arg("ports", 7).arg("ports/s", 10)
+               .arg("p50 ms", 7).arg("p99 ms", 7).arg("cpu s", 7).arg("wrong", 6).arg("virtual s", 10)
+               .arg("allocs/probe", 12) << Qt::endl;
+
+    const int repeat = qMax(1, parser.value("repeat").toInt());
+    QJsonArray json;
+
+    for (const QString &typeName : parser.value("scan-types").split(',', Qt::SkipEmptyParts)) {
+        ScanType type;
+        if (!parseScanType(typeName, type)) {
+            err << "Unknown scan type: " << typeName << Qt::endl;
+            return 1;
+        }
+
+        for (const QString &timingName : parser.value("timings").split(',', Qt::SkipEmptyParts)) {
+            TimingTemplate timing;
+            if (!parseTiming(timingName, timing)) {
+                err << "Unknown timing template: " << timingName << Qt::endl;
+                return 1;
+            }
+
+            BenchResult result = runBenchmark(setup, typeName.trimmed().toLower(), type, timingName, timing, repeat);
+            const QString allocs = result.allocsPerProbe < 0 ? QString("n/a") : QString::number(result.allocsPerProbe, 'f', 2);
+            out << QString("%1 %2 %3 %4 %5 %6 %7 %8 %9 %10")
+                       .arg(result.scanType, -8).arg(result.timing, -6).arg(result.ports, 7)
+                       .arg(result.portsPerSecond, 10, 'f', 1).arg(result.p50, 7).arg(result.p99, 7)
+                       .arg(result.cpuSeconds, 7, 'f', 2).arg(result.misclassified, 6)
+                       .arg(result.virtualSeconds, 10, 'f', 1).arg(allocs, 12) << Qt::endl;
+
+            QJsonObject entry;
+            entry["scanType"] = result.scanType;
+            entry["timing"] = result.timing;
+            entry["ports"] = result.ports;
+            entry["seconds"] = result.seconds;
+            entry["portsPerSecond"] = result.portsPerSecond;
+            entry["p50Ms"] = result.p50;
+            entry["p99Ms"] = result.p99;
+            entry["cpuSeconds"] = result.cpuSeconds;
+            entry["misclassified"] = result.misclassified;
+            entry["virtualSeconds"] = result.virtualSeconds;
+            if (result.allocsPerProbe >= 0) {
+                entry["allocsPerProbe"] = result.allocsPerProbe;
+            }
+            json.append(entry);
+        }
+    }
+
+    if (parser.isSet("json")) {
+        QFile file(parser.value("json"));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            err << "Could not write " << file.fileName() << ": " << file.errorString() << Qt::endl;
+            return 1;
+        }
+        file.write(QJsonDocument(json).toJson());
+    }
+
+    farm.stopFarm();
+    return 0;
+}
@@ -0,0 +1,212 @@
+#include "targetfarm.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUdpSocket>
+#include <QHostAddress>
+
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+// Set by threads whose allocations scanbench's allocs/probe leaves out.
+extern thread_local bool uncountedThread;
+
+TargetFarm::TargetFarm(const Config &config, QObject *parent)
+    : QThread(parent)
+    , config(config)
+{
+}
+
+TargetFarm::~TargetFarm()
+{
+    stopFarm();
+}
+
+bool TargetFarm::startFarm(QString *errorString)
+{
+    start();
+    ready.acquire();
+
+    if (!error.isEmpty()) {
+        if (errorString) *errorString = error;
+        stopFarm();
+        return false;
+    }
+    return true;
+}
+
+void TargetFarm::stopFarm()
+{
+    if (isRunning()) {
+        quit();
+        wait();
+    }
+}
+
+PortSet TargetFarm::openPorts() const
+{
+    return open;
+}
+
+PortSet TargetFarm::closedPorts() const
+{
+    return closed;
+}
+
+PortSet TargetFarm::filteredPorts() const
+{
+    return filtered;
+}
+
+PortSet TargetFarm::allPorts() const
+{
+    return open | closed | filtered;
+}
+
+void TargetFarm::run()
+{
+    uncountedThread = true;
+    if (setupOpenPorts() && setupFilteredPorts()) {
+        setupClosedPorts();
+    }
+    ready.release();
+
+    if (error.isEmpty()) {
+        exec();
+    }
+    teardown();
+}
+
+bool TargetFarm::setupOpenPorts()
+{
+    const QByteArray banner = config.banner;
+
+    for (int i = 0; i < config.openPorts; ++i) {
+        QTcpServer *server = new QTcpServer;
+        if (!server->listen(QHostAddress::LocalHost, 0)) {
+            error = QString("Could not open listener: %1").arg(server->errorString());
+            delete server;
+            return false;
+        }
+        servers.append(server);
+        open.insert(server->serverPort());
+
+        QObject::connect(server, &QTcpServer::newConnection, server, [server, banner]() {
+            while (QTcpSocket *socket = server->nextPendingConnection()) {
+                socket->write(banner);
+                QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            }
+        });
+
+        // Same port number over UDP so UDP scans also see open targets.
+        QUdpSocket *responder = new QUdpSocket;
+        if (responder->bind(QHostAddress::LocalHost, server->serverPort())) {
+            QObject::connect(responder, &QUdpSocket::readyRead, responder, [responder, banner]() {
+                while (responder->hasPendingDatagrams()) {
+                    QHostAddress sender;
+                    quint16 senderPort;
+                    QByteArray datagram(int(responder->pendingDatagramSize()), Qt::Uninitialized);
+                    responder->readDatagram(datagram.data(), datagram.size(), &sender, &senderPort);
+                    responder->writeDatagram(banner, sender, senderPort);
+                }
+            });
+            responders.append(responder);
+        } else {
+            delete responder;
+        }
+    }
+    return true;
+}
+
+bool TargetFarm::setupClosedPorts()
+{
+    // Ask the kernel for free ports and release them again; nothing listens
+    // there afterwards, so connects are refused.
+    while (closed.size() < config.closedPorts) {
+        QTcpServer probe;
+        if (!probe.listen(QHostAddress::LocalHost, 0)) {
+            error = QString("Could not reserve closed port: %1").arg(probe.errorString());
+            return false;
+        }
+        int port = probe.serverPort();
+        probe.close();
+
+        if (!open.contains(port) && !filtered.contains(port) && !closed.contains(port)) {
+            closed.insert(port);
+        }
+    }
+    return true;
+}
+
+bool TargetFarm::setupFilteredPorts()
+{
+#ifdef Q_OS_UNIX
+    for (int i = 0; i < config.filteredPorts; ++i) {
+        int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (listener < 0) {
+            error = "Could not create filtered listener";
+            return false;
+        }
+        nativeSockets.append(listener);
+
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0;
+
+        socklen_t length = sizeof(address);
+        if (::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0
+            || ::listen(listener, 0) < 0
+            || ::getsockname(listener, reinterpret_cast<sockaddr *>(&address), &length) < 0) {
+            error = "Could not bind filtered listener";
+            return false;
+        }
+
+        // Fill the accept queue and never accept. Once a connect stops
+        // completing, the kernel is dropping SYNs for this port.
+        for (int attempt = 0; attempt < 64; ++attempt) {
+            int client = ::socket(AF_INET, SOCK_STREAM, 0);
+            if (client < 0) {
+                break;
+            }
+            nativeSockets.append(client);
+            ::fcntl(client, F_SETFL, ::fcntl(client, F_GETFL) | O_NONBLOCK);
+            ::connect(client, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+
+            pollfd descriptor = {};
+            descriptor.fd = client;
+            descriptor.events = POLLOUT;
+            if (::poll(&descriptor, 1, 100) <= 0) {
+                break;
+            }
+        }
+
+        filtered.insert(ntohs(address.sin_port));
+    }
+#else
+    if (config.filteredPorts > 0) {
+        qWarning("Filtered targets need POSIX sockets; skipping on this platform");
+    }
+#endif
+    return true;
+}
+
+void TargetFarm::teardown()
+{
+    qDeleteAll(servers);
+    servers.clear();
+    qDeleteAll(responders);
+    responders.clear();
+
+#ifdef Q_OS_UNIX
+    for (qintptr descriptor : nativeSockets) {
+        ::close(int(descriptor));
+    }
+#endif
+    nativeSockets.clear();
+}
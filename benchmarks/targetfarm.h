@@ -0,0 +1,63 @@
+#ifndef TARGETFARM_H
+#define TARGETFARM_H
+#include <QThread>
+#include <QSemaphore>
+#include <QList>
+#include <QByteArray>
+#include <QString>
+#include "portset.h"
+
+class QTcpServer;
+class QUdpSocket;
+
+// Loopback targets for the benchmark. Open ports accept and send a banner,
+// closed ports have nothing bound so the kernel refuses them, and filtered
+// ports are listeners whose accept queue is kept full so new SYNs are
+// silently dropped. Everything runs on its own thread so the farm never
+// competes with the scanner for the main event loop.
+class TargetFarm : public QThread
+{
+    Q_OBJECT
+public:
+    struct Config
+    {
+        int openPorts = 20;
+        int closedPorts = 200;
+        int filteredPorts = 20;
+        QByteArray banner = "SSH-2.0-CyberScannerBench\r\n";
+    };
+
+    explicit TargetFarm(const Config &config, QObject *parent = nullptr);
+    ~TargetFarm();
+
+    bool startFarm(QString *errorString = nullptr);
+    void stopFarm();
+
+    PortSet openPorts() const;
+    PortSet closedPorts() const;
+    PortSet filteredPorts() const;
+    PortSet allPorts() const;
+
+protected:
+    void run() override;
+
+private:
+    Config config;
+    QSemaphore ready;
+    QString error;
+
+    PortSet open;
+    PortSet closed;
+    PortSet filtered;
+
+    QList<QTcpServer *> servers;
+    QList<QUdpSocket *> responders;
+    QList<qintptr> nativeSockets;
+
+    bool setupOpenPorts();
+    bool setupClosedPorts();
+    bool setupFilteredPorts();
+    void teardown();
+};
+
+#endif
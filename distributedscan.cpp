@@ -0,0 +1,799 @@
+#include "distributedscan.h"
+#include "probedispatcher.h"
+#include <QDataStream>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QHostAddress>
+#include <QHostInfo>
+#include <QRegularExpression>
+#include <QCoreApplication>
+#include <QTimer>
+#include <QtEndian>
+#include <algorithm>
+
+using namespace DistributedProtocol;
+
+static const int ConnectTimeoutMs = 5000;
+static const int HeartbeatMs = 2000;
+static const int MinLeaseMs = 3 * HeartbeatMs;
+static const int FlushIntervalMs = 100;
+static const int FlushBatch = 256;
+static const int MaxCapacity = 64;
+static const int MaxExhaustedRequeues = 3;
+
+QByteArray DistributedProtocol::frame(const QByteArray &payload)
+{
+    QByteArray out;
+    out.reserve(4 + payload.size());
+    uchar header[4];
+    qToBigEndian<quint32>(quint32(payload.size()), header);
+    out.append(reinterpret_cast<const char *>(header), 4);
+    out.append(payload);
+    return out;
+}
+
+bool DistributedProtocol::takeFrame(const QByteArray &buffer, int &offset, QByteArray &payload, bool &malformed)
+{
+    malformed = false;
+    if (buffer.size() - offset < 4) {
+        return false;
+    }
+    quint32 length = qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(buffer.constData() + offset));
+    if (length > MaxFrameSize) {
+        malformed = true;
+        return false;
+    }
+    if (quint32(buffer.size() - offset - 4) < length) {
+        return false;
+    }
+    payload = buffer.mid(offset + 4, int(length));
+    offset += 4 + int(length);
+    return true;
+}
+
+bool DistributedProtocol::parseTcpAddress(const QString &address, QString &host, quint16 &port)
+{
+    static const QRegularExpression pattern("^(?:(.*):)?(\\d{1,5})$");
+    QRegularExpressionMatch match = pattern.match(address.trimmed());
+    if (!match.hasMatch()) {
+        return false;
+    }
+    int value = match.captured(2).toInt();
+    if (value > 65535) {
+        return false;
+    }
+    host = match.captured(1);
+    if (host.startsWith('[') && host.endsWith(']')) {
+        host = host.mid(1, host.size() - 2);
+    }
+    port = quint16(value);
+    return true;
+}
+
+static QByteArray message(MessageType type)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_12);
+    out << quint8(type);
+    return payload;
+}
+
+// Takes as long whatever the token's first wrong byte, so its prefix can't be
+// guessed by timing the coordinator.
+static bool tokensMatch(const QByteArray &expected, const QByteArray &given)
+{
+    if (expected.size() != given.size()) {
+        return false;
+    }
+    int difference = 0;
+    for (int i = 0; i < expected.size(); ++i) {
+        difference |= expected.at(i) ^ given.at(i);
+    }
+    return difference == 0;
+}
+
+static void abortSocket(QIODevice *socket)
+{
+    if (QTcpSocket *tcp = qobject_cast<QTcpSocket *>(socket)) {
+        tcp->abort();
+    } else if (QLocalSocket *local = qobject_cast<QLocalSocket *>(socket)) {
+        local->abort();
+    }
+}
+
+ScanCoordinator::ScanCoordinator(QObject *parent)
+    : QObject(parent)
+    , tcpServer(nullptr)
+    , localServer(nullptr)
+    , leaseTimer(new QTimer(this))
+    , scanType(ScanType::TCP_CONNECT)
+    , timing(TimingTemplate::T3_NORMAL)
+    , leaseMs(15000)
+    , nextWorkerId(1)
+    , doneUnits(0)
+    , probeTotal(0)
+    , probesDone(0)
+{
+    clock.start();
+    leaseTimer->setInterval(1000);
+    connect(leaseTimer, &QTimer::timeout, this, &ScanCoordinator::checkLeases);
+}
+
+ScanCoordinator::~ScanCoordinator()
+{
+    close();
+}
+
+void ScanCoordinator::setScan(const QStringList &targets, const PortSet &ports, ScanType type,
+                              TimingTemplate timingTemplate, int unitSize)
+{
+    scanType = type;
+    timing = timingTemplate;
+    units.clear();
+    pendingUnits.clear();
+    doneUnits = 0;
+    probesDone = 0;
+    probeTotal = quint64(targets.size()) * quint64(ports.size());
+
+    const QVector<PortSet> slices = ports.split(unitSize);
+    for (const QString &target : targets) {
+        for (const PortSet &slice : slices) {
+            Unit unit;
+            unit.id = units.size();
+            unit.target = target;
+            unit.ports = slice;
+            pendingUnits.enqueue(unit.id);
+            units.append(unit);
+        }
+    }
+}
+
+void ScanCoordinator::setLeaseTimeout(int ms)
+{
+    leaseMs = qMax(MinLeaseMs, ms);
+}
+
+int ScanCoordinator::leaseTimeout() const
+{
+    return leaseMs;
+}
+
+void ScanCoordinator::setToken(const QByteArray &token)
+{
+    sharedToken = token;
+}
+
+bool ScanCoordinator::listen(const QString &address, QString *errorString)
+{
+    close();
+
+    QString host;
+    quint16 port = 0;
+    if (parseTcpAddress(address, host, port)) {
+        QHostAddress bindAddress = host.isEmpty() ? QHostAddress(QHostAddress::LocalHost) : QHostAddress(host);
+        if (!bindAddress.isNull() && !bindAddress.isLoopback() && sharedToken.isEmpty()) {
+            if (errorString) *errorString = "A shared token is required to accept workers beyond loopback";
+            return false;
+        }
+        tcpServer = new QTcpServer(this);
+        if (bindAddress.isNull() || !tcpServer->listen(bindAddress, port)) {
+            if (errorString) {
+                *errorString = bindAddress.isNull() ? QString("Invalid listen address %1").arg(host)
+                                                    : tcpServer->errorString();
+            }
+            delete tcpServer;
+            tcpServer = nullptr;
+            return false;
+        }
+        connect(tcpServer, &QTcpServer::newConnection, this, &ScanCoordinator::onTcpConnection);
+    } else {
+        localServer = new QLocalServer(this);
+        // A coordinator that crashed leaves its Unix socket file behind.
+        QLocalServer::removeServer(address);
+        if (!localServer->listen(address)) {
+            if (errorString) {
+                *errorString = localServer->errorString();
+            }
+            delete localServer;
+            localServer = nullptr;
+            return false;
+        }
+        connect(localServer, &QLocalServer::newConnection, this, &ScanCoordinator::onLocalConnection);
+    }
+
+    leaseTimer->start();
+    emit logMessage(QString("Coordinator listening on %1: %2 units, %3 probes")
+                        .arg(tcpServer ? QString("%1:%2").arg(tcpServer->serverAddress().toString()).arg(tcpServer->serverPort())
+                                       : address).arg(units.size()).arg(probeTotal));
+    if (units.isEmpty()) {
+        emit finished();
+    }
+    return true;
+}
+
+void ScanCoordinator::close()
+{
+    leaseTimer->stop();
+    const QList<int> ids = workers.keys();
+    for (int id : ids) {
+        dropWorker(id, "closed");
+    }
+    delete tcpServer;
+    tcpServer = nullptr;
+    delete localServer;
+    localServer = nullptr;
+}
+
+quint16 ScanCoordinator::serverPort() const
+{
+    return tcpServer ? tcpServer->serverPort() : 0;
+}
+
+int ScanCoordinator::unitCount() const
+{
+    return units.size();
+}
+
+int ScanCoordinator::completedUnits() const
+{
+    return doneUnits;
+}
+
+int ScanCoordinator::workerCount() const
+{
+    return workers.size();
+}
+
+quint64 ScanCoordinator::totalProbes() const
+{
+    return probeTotal;
+}
+
+quint64 ScanCoordinator::completedProbes() const
+{
+    return probesDone;
+}
+
+bool ScanCoordinator::isFinished() const
+{
+    return doneUnits == units.size();
+}
+
+void ScanCoordinator::onTcpConnection()
+{
+    while (tcpServer && tcpServer->hasPendingConnections()) {
+        QTcpSocket *socket = tcpServer->nextPendingConnection();
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        int id = addWorker(socket);
+        connect(socket, &QTcpSocket::disconnected, this, [this, id]() { dropWorker(id, "disconnected"); });
+    }
+}
+
+void ScanCoordinator::onLocalConnection()
+{
+    while (localServer && localServer->hasPendingConnections()) {
+        QLocalSocket *socket = localServer->nextPendingConnection();
+        int id = addWorker(socket);
+        connect(socket, &QLocalSocket::disconnected, this, [this, id]() { dropWorker(id, "disconnected"); });
+    }
+}
+
+int ScanCoordinator::addWorker(QIODevice *socket)
+{
+    Worker worker;
+    worker.id = nextWorkerId++;
+    worker.socket = socket;
+    socket->setParent(this);
+    workers.insert(worker.id, worker);
+
+    const int id = worker.id;
+    connect(socket, &QIODevice::readyRead, this, [this, id]() { readWorker(id); });
+    if (socket->bytesAvailable() > 0) {
+        QTimer::singleShot(0, this, [this, id]() { readWorker(id); });
+    }
+    return id;
+}
+
+void ScanCoordinator::readWorker(int workerId)
+{
+    auto it = workers.find(workerId);
+    if (it == workers.end()) return;
+
+    Worker &worker = it.value();
+    worker.buffer.append(worker.socket->readAll());
+
+    int offset = 0;
+    QByteArray payload;
+    bool malformed = false;
+    while (takeFrame(worker.buffer, offset, payload, malformed)) {
+        if (!handleMessage(worker, payload)) {
+            dropWorker(workerId, "sent a malformed message");
+            return;
+        }
+    }
+    if (malformed) {
+        dropWorker(workerId, "sent an oversized frame");
+        return;
+    }
+    worker.buffer.remove(0, offset);
+    renewLeases(worker);
+}
+
+void ScanCoordinator::dropWorker(int workerId, const QString &reason)
+{
+    auto it = workers.find(workerId);
+    if (it == workers.end()) return;
+
+    Worker worker = it.value();
+    workers.erase(it);
+
+    worker.socket->disconnect(this);
+    abortSocket(worker.socket);
+    worker.socket->deleteLater();
+
+    // Put the dropped units first in line, in their original order.
+    QList<int> requeue;
+    for (int unitId : qAsConst(worker.units)) {
+        Unit &unit = units[unitId];
+        if (!unit.done && unit.worker == workerId) {
+            unit.worker = 0;
+            requeue.append(unitId);
+        }
+    }
+    std::sort(requeue.begin(), requeue.end());
+    for (int i = requeue.size() - 1; i >= 0; --i) {
+        pendingUnits.prepend(requeue.at(i));
+    }
+
+    QString name = worker.name.isEmpty() ? QString::number(workerId) : worker.name;
+    if (requeue.isEmpty()) {
+        emit logMessage(QString("Worker %1 %2").arg(name).arg(reason));
+    } else {
+        emit logMessage(QString("Worker %1 %2; requeued %3 unit(s)").arg(name).arg(reason).arg(requeue.size()),
+                        LogLevel::Warning);
+    }
+    emit workersChanged(workers.size());
+
+    // The lease timer only runs while the scan is live; don't hand out work
+    // while closing.
+    if (leaseTimer->isActive()) {
+        for (Worker &other : workers) {
+            assignUnits(other);
+        }
+    }
+}
+
+bool ScanCoordinator::handleMessage(Worker &worker, const QByteArray &payload)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_5_12);
+    quint8 type = 0;
+    in >> type;
+
+    switch (type) {
+    case Hello: {
+        quint32 version = 0;
+        QByteArray token;
+        QString name;
+        qint32 capacity = 0;
+        in >> version;
+        if (in.status() != QDataStream::Ok || version != Version || worker.capacity > 0) {
+            return false;
+        }
+        in >> token >> name >> capacity;
+        if (in.status() != QDataStream::Ok) {
+            return false;
+        }
+        if (!tokensMatch(sharedToken, token)) {
+            emit logMessage(QString("Worker %1 failed authentication").arg(name), LogLevel::Warning);
+            return false;
+        }
+        worker.name = name;
+        worker.capacity = qBound(1, int(capacity), MaxCapacity);
+        emit logMessage(QString("Worker %1 joined with capacity %2").arg(worker.name).arg(worker.capacity));
+        emit workersChanged(workers.size());
+        assignUnits(worker);
+        return true;
+    }
+    case Results: {
+        // Nothing a worker says counts before its Hello has been accepted.
+        if (worker.capacity == 0) {
+            return false;
+        }
+        qint32 unitId = 0;
+        quint32 count = 0;
+        in >> unitId >> count;
+        if (in.status() != QDataStream::Ok || unitId < 0 || unitId >= units.size()) {
+            return false;
+        }
+        Unit &unit = units[unitId];
+        // A worker whose lease ran out may still be sending; the unit is
+        // someone else's now, so only its holder's results count.
+        if (unit.worker != worker.id) {
+            return true;
+        }
+        for (quint32 i = 0; i < count; ++i) {
+            quint16 port = 0;
+            quint8 state = 0;
+            qint32 responseTime = 0;
+            QString service;
+            QString banner;
+            in >> port >> state >> responseTime >> service >> banner;
+            if (in.status() != QDataStream::Ok || state > quint8(PortState::Exhausted)) {
+                return false;
+            }
+            if (unit.done || unit.reported.contains(port) || !unit.ports.contains(port)) {
+                continue;
+            }
+            // No probe went out; the port is still to be scanned.
+            if (PortState(state) == PortState::Exhausted) {
+                unit.exhausted.insert(port);
+                continue;
+            }
+            unit.exhausted.remove(port);
+            unit.reported.insert(port);
+            probesDone++;
+            emit result(unit.target, port, portStateName(PortState(state)), service, banner, responseTime);
+        }
+        emit progress(probesDone, probeTotal);
+        return true;
+    }
+    case UnitDone: {
+        if (worker.capacity == 0) {
+            return false;
+        }
+        qint32 unitId = 0;
+        in >> unitId;
+        if (in.status() != QDataStream::Ok || unitId < 0 || unitId >= units.size()) {
+            return false;
+        }
+        worker.units.remove(unitId);
+        Unit &unit = units[unitId];
+        if (unit.worker == worker.id && !unit.done) {
+            if (!unit.exhausted.isEmpty() && unit.requeues < MaxExhaustedRequeues) {
+                emit logMessage(QString("Unit %1 (%2): %3 port(s) ran out of sockets on %4; requeued")
+                                    .arg(unit.id).arg(unit.target).arg(unit.exhausted.size()).arg(worker.name),
+                                LogLevel::Warning);
+                ++unit.requeues;
+                unit.exhausted.clear();
+                unit.worker = 0;
+                pendingUnits.enqueue(unit.id);
+            } else {
+                // Out of retries: report them as they stand.
+                for (int port : qAsConst(unit.exhausted)) {
+                    unit.reported.insert(port);
+                    probesDone++;
+                    emit result(unit.target, port, portStateName(PortState::Exhausted), QString(), QString(), 0);
+                }
+                completeUnit(unit);
+            }
+        }
+        assignUnits(worker);
+        return true;
+    }
+    case Heartbeat:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void ScanCoordinator::assignUnits(Worker &worker)
+{
+    // No capacity until the worker has said hello.
+    while (worker.units.size() < worker.capacity && !pendingUnits.isEmpty()) {
+        Unit &unit = units[pendingUnits.dequeue()];
+        if (unit.done) continue;
+
+        const PortSet remaining = unit.ports - unit.reported;
+        if (remaining.isEmpty()) {
+            completeUnit(unit);
+            continue;
+        }
+
+        unit.worker = worker.id;
+        unit.leaseDeadline = clock.elapsed() + leaseMs;
+        worker.units.insert(unit.id);
+
+        QByteArray payload = message(Assign);
+        QDataStream out(&payload, QIODevice::Append);
+        out.setVersion(QDataStream::Qt_5_12);
+        out << qint32(unit.id) << unit.target << qint32(scanType) << qint32(timing) << remaining;
+        send(worker, payload);
+    }
+}
+
+void ScanCoordinator::completeUnit(Unit &unit)
+{
+    if (unit.done) return;
+
+    unit.done = true;
+    doneUnits++;
+    auto owner = workers.find(unit.worker);
+    if (owner != workers.end()) {
+        owner->units.remove(unit.id);
+    }
+
+    int missing = unit.ports.size() - unit.reported.size();
+    if (missing > 0) {
+        emit logMessage(QString("Unit %1 (%2) finished with %3 port(s) unreported")
+                            .arg(unit.id).arg(unit.target).arg(missing), LogLevel::Warning);
+        probesDone += quint64(missing);
+    }
+    emit progress(probesDone, probeTotal);
+
+    if (isFinished()) {
+        leaseTimer->stop();
+        for (Worker &worker : workers) {
+            send(worker, message(Shutdown));
+        }
+        emit logMessage(QString("Distributed scan complete: %1 units, %2 probes").arg(units.size()).arg(probeTotal));
+        emit finished();
+    }
+}
+
+void ScanCoordinator::renewLeases(const Worker &worker)
+{
+    qint64 deadline = clock.elapsed() + leaseMs;
+    for (int unitId : worker.units) {
+        units[unitId].leaseDeadline = deadline;
+    }
+}
+
+void ScanCoordinator::checkLeases()
+{
+    qint64 now = clock.elapsed();
+    QList<int> expired;
+    for (const Worker &worker : qAsConst(workers)) {
+        for (int unitId : worker.units) {
+            if (units.at(unitId).leaseDeadline < now) {
+                expired.append(worker.id);
+                break;
+            }
+        }
+    }
+    for (int workerId : qAsConst(expired)) {
+        dropWorker(workerId, "let its lease expire");
+    }
+}
+
+void ScanCoordinator::send(Worker &worker, const QByteArray &payload)
+{
+    worker.socket->write(frame(payload));
+}
+
+ScanWorker::ScanWorker(QObject *parent)
+    : QObject(parent)
+    , socket(nullptr)
+    , workerName(QString("%1:%2").arg(QHostInfo::localHostName()).arg(QCoreApplication::applicationPid()))
+    , capacity(2)
+    , engine(QSharedPointer<ProbeDispatcher>::create())
+    , flushTimer(new QTimer(this))
+    , heartbeatTimer(new QTimer(this))
+    , stopped(false)
+{
+    flushTimer->setInterval(FlushIntervalMs);
+    connect(flushTimer, &QTimer::timeout, this, [this]() { flushAllResults(); });
+    heartbeatTimer->setInterval(HeartbeatMs);
+    connect(heartbeatTimer, &QTimer::timeout, this, [this]() { send(message(Heartbeat)); });
+}
+
+ScanWorker::~ScanWorker()
+{
+    for (ActiveUnit &unit : units) {
+        unit.scanner->disconnect(this);
+        unit.scanner->stopScan();
+    }
+}
+
+void ScanWorker::setCapacity(int unitCount)
+{
+    capacity = qBound(1, unitCount, MaxCapacity);
+}
+
+void ScanWorker::setName(const QString &name)
+{
+    workerName = name;
+}
+
+void ScanWorker::setToken(const QByteArray &token)
+{
+    sharedToken = token;
+}
+
+void ScanWorker::setTransport(const QSharedPointer<ProbeTransport> &probeTransport)
+{
+    transport = probeTransport;
+}
+
+bool ScanWorker::connectTo(const QString &address, QString *errorString)
+{
+    QString host;
+    quint16 port = 0;
+    if (parseTcpAddress(address, host, port)) {
+        QTcpSocket *tcp = new QTcpSocket(this);
+        tcp->connectToHost(host.isEmpty() ? QString("127.0.0.1") : host, port);
+        if (!tcp->waitForConnected(ConnectTimeoutMs)) {
+            if (errorString) {
+                *errorString = tcp->errorString();
+            }
+            delete tcp;
+            return false;
+        }
+        tcp->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        connect(tcp, &QTcpSocket::disconnected, this, [this]() { shutdown(); });
+        socket = tcp;
+    } else {
+        QLocalSocket *local = new QLocalSocket(this);
+        local->connectToServer(address);
+        if (!local->waitForConnected(ConnectTimeoutMs)) {
+            if (errorString) {
+                *errorString = local->errorString();
+            }
+            delete local;
+            return false;
+        }
+        connect(local, &QLocalSocket::disconnected, this, [this]() { shutdown(); });
+        socket = local;
+    }
+    connect(socket, &QIODevice::readyRead, this, [this]() { readCoordinator(); });
+
+    QByteArray hello = message(Hello);
+    QDataStream out(&hello, QIODevice::Append);
+    out.setVersion(QDataStream::Qt_5_12);
+    out << Version << sharedToken << workerName << qint32(capacity);
+    send(hello);
+
+    flushTimer->start();
+    heartbeatTimer->start();
+    emit logMessage(QString("Worker %1 connected to %2").arg(workerName).arg(address));
+    return true;
+}
+
+void ScanWorker::readCoordinator()
+{
+    buffer.append(socket->readAll());
+
+    int offset = 0;
+    QByteArray payload;
+    bool malformed = false;
+    while (!stopped && takeFrame(buffer, offset, payload, malformed)) {
+        if (!handleMessage(payload)) {
+            malformed = true;
+            break;
+        }
+    }
+    if (malformed) {
+        emit logMessage("Coordinator sent a malformed message", LogLevel::Error);
+        shutdown();
+        return;
+    }
+    buffer.remove(0, offset);
+}
+
+bool ScanWorker::handleMessage(const QByteArray &payload)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_5_12);
+    quint8 type = 0;
+    in >> type;
+
+    switch (type) {
+    case Assign: {
+        qint32 unitId = 0;
+        QString target;
+        qint32 scanType = 0;
+        qint32 timing = 0;
+        PortSet ports;
+        in >> unitId >> target >> scanType >> timing >> ports;
+        if (in.status() != QDataStream::Ok || units.contains(unitId)
+            || scanType < int(ScanType::TCP_CONNECT) || scanType > int(ScanType::TCP_WINDOW)
+            || timing < int(TimingTemplate::T0_PARANOID) || timing > int(TimingTemplate::T5_INSANE)) {
+            return false;
+        }
+        startUnit(unitId, target, ports, ScanType(scanType), TimingTemplate(timing));
+        return true;
+    }
+    case Shutdown:
+        emit logMessage("Coordinator finished the scan");
+        shutdown();
+        return true;
+    default:
+        return false;
+    }
+}
+
+void ScanWorker::startUnit(int unitId, const QString &target, const PortSet &ports, ScanType scanType,
+                           TimingTemplate timing)
+{
+    PortScanner *scanner = new PortScanner(engine, this);
+    if (transport) {
+        scanner->setTransport(transport);
+    }
+
+    connect(scanner, &PortScanner::portResults, this, [this, unitId](const QVector<ProbeResult> &results) {
+        auto it = units.find(unitId);
+        if (it == units.end()) return;
+        it->results += results;
+        if (it->results.size() >= FlushBatch) {
+            flushResults(unitId);
+        }
+    });
+    connect(scanner, &PortScanner::scanFinished, this, [this, unitId]() { finishUnit(unitId); });
+    connect(scanner, &PortScanner::logMessage, this, [this, unitId](const QString &message, LogLevel level) {
+        emit logMessage(QString("[unit %1] %2").arg(unitId).arg(message), level);
+    });
+
+    ActiveUnit unit;
+    unit.scanner = scanner;
+    units.insert(unitId, unit);
+
+    scanner->startScan(target, ports, scanType, timing, false, false, false);
+}
+
+void ScanWorker::finishUnit(int unitId)
+{
+    auto it = units.find(unitId);
+    if (it == units.end()) return;
+
+    flushResults(unitId);
+    it->scanner->deleteLater();
+    units.erase(it);
+
+    QByteArray done = message(UnitDone);
+    QDataStream out(&done, QIODevice::Append);
+    out.setVersion(QDataStream::Qt_5_12);
+    out << qint32(unitId);
+    send(done);
+}
+
+void ScanWorker::flushResults(int unitId)
+{
+    auto it = units.find(unitId);
+    if (it == units.end() || it->results.isEmpty()) return;
+
+    QByteArray payload = message(Results);
+    QDataStream out(&payload, QIODevice::Append);
+    out.setVersion(QDataStream::Qt_5_12);
+    out << qint32(unitId) << quint32(it->results.size());
+    for (const ProbeResult &result : qAsConst(it->results)) {
+        out << quint16(result.port) << quint8(result.state) << qint32(result.responseTime) << result.service
+            << result.banner;
+    }
+    it->results.clear();
+    send(payload);
+}
+
+void ScanWorker::flushAllResults()
+{
+    const QList<int> ids = units.keys();
+    for (int unitId : ids) {
+        flushResults(unitId);
+    }
+}
+
+void ScanWorker::send(const QByteArray &payload)
+{
+    if (socket && !stopped) {
+        socket->write(frame(payload));
+    }
+}
+
+void ScanWorker::shutdown()
+{
+    if (stopped) return;
+
+    stopped = true;
+    flushTimer->stop();
+    heartbeatTimer->stop();
+    for (ActiveUnit &unit : units) {
+        unit.scanner->disconnect(this);
+        unit.scanner->stopScan();
+        unit.scanner->deleteLater();
+    }
+    units.clear();
+    emit finished();
+}
@@ -0,0 +1,214 @@
+#ifndef DISTRIBUTEDSCAN_H
+#define DISTRIBUTEDSCAN_H
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QList>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QQueue>
+#include <QElapsedTimer>
+#include <QSharedPointer>
+#include "portscanner.h"
+#include "resultstore.h"
+
+class QIODevice;
+class QTcpServer;
+class QLocalServer;
+class QTimer;
+class ProbeDispatcher;
+
+// Coordinator <-> worker wire format. Every message is a frame of a 4-byte
+// big-endian payload length followed by a QDataStream payload whose first
+// byte is the message type:
+//
+//   Hello      worker -> coordinator   version, token, worker name, unit capacity
+//   Assign     coordinator -> worker   unit id, target, scan type, timing, ports (as ranges)
+//   Results    worker -> coordinator   unit id, count x { port, state, rt, service, banner }
+//   UnitDone   worker -> coordinator   unit id
+//   Heartbeat  worker -> coordinator   (empty)
+//   Shutdown   coordinator -> worker   (empty)
+//
+// Addresses are "host:port" (or a bare port) for TCP; anything else names a
+// local socket, which is a Unix socket path or a Windows named pipe. A bare
+// port listens on loopback only. The Hello's token has to match the
+// coordinator's before a worker is given any work or believed about any
+// result; a coordinator reachable beyond loopback must have one.
+namespace DistributedProtocol {
+
+enum MessageType : quint8 {
+    Hello = 1,
+    Assign = 2,
+    Results = 3,
+    UnitDone = 4,
+    Heartbeat = 5,
+    Shutdown = 6
+};
+
+const quint32 Version = 3;
+const quint32 MaxFrameSize = 16 * 1024 * 1024;
+
+QByteArray frame(const QByteArray &payload);
+// Takes the frame starting at offset, if the buffer holds all of it. Sets
+// malformed when the length prefix is over MaxFrameSize.
+bool takeFrame(const QByteArray &buffer, int &offset, QByteArray &payload, bool &malformed);
+
+bool parseTcpAddress(const QString &address, QString &host, quint16 &port);
+
+}
+
+// Splits targets x ports into work units and leases them to workers that
+// connect over TCP or a local socket. Each worker keeps up to its advertised
+// capacity of units in flight, so adding workers adds probe slots. A lease is
+// renewed by any message from its worker; when it runs out, or the worker
+// disconnects, the worker is dropped and its unfinished units go back to the
+// front of the queue. Results are deduplicated per unit and port, so a unit
+// that ran twice is still reported once.
+class ScanCoordinator : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ScanCoordinator(QObject *parent = nullptr);
+    ~ScanCoordinator();
+
+    void setScan(const QStringList &targets, const PortSet &ports, ScanType scanType,
+                 TimingTemplate timing, int unitSize = 256);
+    void setLeaseTimeout(int ms);
+    int leaseTimeout() const;
+    void setToken(const QByteArray &token);
+
+    // Port 0 picks a free port; serverPort() tells which.
+    bool listen(const QString &address, QString *errorString = nullptr);
+    quint16 serverPort() const;
+    void close();
+
+    int unitCount() const;
+    int completedUnits() const;
+    int workerCount() const;
+    quint64 totalProbes() const;
+    quint64 completedProbes() const;
+    bool isFinished() const;
+
+signals:
+    void result(const QString &host, int port, const QString &status, const QString &service,
+                const QString &banner, int responseTime);
+    void progress(quint64 completed, quint64 total);
+    void workersChanged(int count);
+    void finished();
+    void logMessage(const QString &message, LogLevel level = LogLevel::Info);
+
+private slots:
+    void onTcpConnection();
+    void onLocalConnection();
+    void checkLeases();
+
+private:
+    struct Unit
+    {
+        int id = 0;
+        QString target;
+        PortSet ports;
+        PortSet reported;
+        // Ports its holder had no socket for; the unit goes back in line
+        // for them, up to MaxExhaustedRequeues times.
+        PortSet exhausted;
+        int requeues = 0;
+        int worker = 0;
+        qint64 leaseDeadline = 0;
+        bool done = false;
+    };
+
+    struct Worker
+    {
+        int id = 0;
+        QIODevice *socket = nullptr;
+        QByteArray buffer;
+        QString name;
+        int capacity = 0;
+        QSet<int> units;
+    };
+
+    int addWorker(QIODevice *socket);
+    void readWorker(int workerId);
+    void dropWorker(int workerId, const QString &reason);
+    bool handleMessage(Worker &worker, const QByteArray &payload);
+    void assignUnits(Worker &worker);
+    void completeUnit(Unit &unit);
+    void renewLeases(const Worker &worker);
+    void send(Worker &worker, const QByteArray &payload);
+
+    QTcpServer *tcpServer;
+    QLocalServer *localServer;
+    QTimer *leaseTimer;
+    QElapsedTimer clock;
+    QByteArray sharedToken;
+
+    ScanType scanType;
+    TimingTemplate timing;
+    int leaseMs;
+
+    QVector<Unit> units;
+    QQueue<int> pendingUnits;
+    QHash<int, Worker> workers;
+    int nextWorkerId;
+    int doneUnits;
+    quint64 probeTotal;
+    quint64 probesDone;
+};
+
+// Connects to a coordinator, runs every assigned unit as a PortScanner on one
+// shared engine, and streams results back in batches. Exits (emits finished)
+// when the coordinator says so or goes away.
+class ScanWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ScanWorker(QObject *parent = nullptr);
+    ~ScanWorker();
+
+    // Units kept in flight at once; two lets the next unit start while the
+    // last probes of the previous one are still out.
+    void setCapacity(int units);
+    void setName(const QString &name);
+    void setToken(const QByteArray &token);
+    void setTransport(const QSharedPointer<ProbeTransport> &transport);
+
+    bool connectTo(const QString &address, QString *errorString = nullptr);
+
+signals:
+    void finished();
+    void logMessage(const QString &message, LogLevel level = LogLevel::Info);
+
+private:
+    struct ActiveUnit
+    {
+        PortScanner *scanner = nullptr;
+        QVector<ProbeResult> results;
+    };
+
+    void readCoordinator();
+    bool handleMessage(const QByteArray &payload);
+    void startUnit(int unitId, const QString &target, const PortSet &ports, ScanType scanType,
+                   TimingTemplate timing);
+    void finishUnit(int unitId);
+    void flushResults(int unitId);
+    void flushAllResults();
+    void send(const QByteArray &payload);
+    void shutdown();
+
+    QIODevice *socket;
+    QByteArray buffer;
+    QString workerName;
+    QByteArray sharedToken;
+    int capacity;
+    QSharedPointer<ProbeDispatcher> engine;
+    QSharedPointer<ProbeTransport> transport;
+    QHash<int, ActiveUnit> units;
+    QTimer *flushTimer;
+    QTimer *heartbeatTimer;
+    bool stopped;
+};
+
+#endif
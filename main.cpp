@@ -1,9 +1,493 @@
 #include "mainwindow.h"
+#include "distributedscan.h"
+#include "probedispatcher.h"
+#include "resultstore.h"
+#include "scanimport.h"
+#include "scanjobqueue.h"
+#include "scanmonitor.h"
+#include "socketbudget.h"
+#include "targetgenerator.h"
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QProcess>
+#include <QSet>
+#include <QTextStream>
 #include <QIcon>
+#include <cstring>
+
+static bool parseScanType(const QString &name, ScanType &type)
+{
+    static const QHash<QString, ScanType> types = {
+        { "connect", ScanType::TCP_CONNECT },
+        { "syn", ScanType::TCP_SYN },
+        { "udp", ScanType::UDP_SCAN },
+        { "fin", ScanType::TCP_FIN },
+        { "xmas", ScanType::TCP_XMAS },
+        { "null", ScanType::TCP_NULL },
+        { "ack", ScanType::TCP_ACK },
+        { "window", ScanType::TCP_WINDOW },
+    };
+    auto it = types.constFind(name.trimmed().toLower());
+    if (it == types.constEnd()) {
+        return false;
+    }
+    type = it.value();
+    return true;
+}
+
+static bool parseTiming(const QString &name, TimingTemplate &timing)
+{
+    static const QHash<QString, TimingTemplate> timings = {
+        { "t0", TimingTemplate::T0_PARANOID },
+        { "t1", TimingTemplate::T1_SNEAKY },
+        { "t2", TimingTemplate::T2_POLITE },
+        { "t3", TimingTemplate::T3_NORMAL },
+        { "t4", TimingTemplate::T4_AGGRESSIVE },
+        { "t5", TimingTemplate::T5_INSANE },
+    };
+    auto it = timings.constFind(name.trimmed().toLower());
+    if (it == timings.constEnd()) {
+        return false;
+    }
+    timing = it.value();
+    return true;
+}
+
+static bool hasOption(int argc, char *argv[], const char *name)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static QByteArray sharedToken(const QCommandLineParser &parser)
+{
+    if (parser.isSet("token")) {
+        return parser.value("token").toUtf8();
+    }
+    return qgetenv("CYBERSCANNER_TOKEN");
+}
+
+static int runWorker(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("CyberScanner");
+    app.setApplicationVersion("1.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs work units handed out by a CyberScanner coordinator.");
+    parser.addHelpOption();
+    parser.addOption({ "worker", "Coordinator address: host:port, or a local socket name.", "address" });
+    parser.addOption({ "capacity", "Units to keep in flight at once.", "count", "2" });
+    parser.addOption({ "name", "Worker name shown in the coordinator log.", "name" });
+    parser.addOption({ "token", "Shared secret the coordinator expects; defaults to $CYBERSCANNER_TOKEN.", "token" });
+    parser.process(app);
+
+    QTextStream err(stderr);
+
+    ScanWorker worker;
+    worker.setCapacity(parser.value("capacity").toInt());
+    if (parser.isSet("name")) {
+        worker.setName(parser.value("name"));
+    }
+    worker.setToken(sharedToken(parser));
+    QObject::connect(&worker, &ScanWorker::logMessage, [&err](const QString &message, LogLevel level) {
+        if (level >= LogLevel::Info) {
+            err << message << Qt::endl;
+        }
+    });
+    QObject::connect(&worker, &ScanWorker::finished, &app, &QCoreApplication::quit, Qt::QueuedConnection);
+
+    QString error;
+    if (!worker.connectTo(parser.value("worker"), &error)) {
+        err << "Could not connect to coordinator: " << error << Qt::endl;
+        return 1;
+    }
+    err << SocketBudget::instance()->describe() << Qt::endl;
+    return app.exec();
+}
+
+static int runCoordinator(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("CyberScanner");
+    app.setApplicationVersion("1.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Splits a scan into work units and hands them to worker processes.");
+    parser.addHelpOption();
+    parser.addOption({ "coordinate", "Listen address: host:port, a bare port, or a local socket name.", "address" });
+    parser.addOption({ "targets", "Comma separated hosts, IPv4 blocks, IPv6 prefixes with a pattern "
+                                  "(2001:db8::/64@low) or hitlist:file.", "targets" });
+    parser.addOption({ "ports", "Ports to scan in nmap -p syntax, e.g. 1-1024,8080 or - for all.", "ports", "1-1024" });
+    parser.addOption({ "scan-type", "connect, syn, udp, fin, xmas, null, ack or window.", "type", "connect" });
+    parser.addOption({ "timing", "Timing template T0-T5.", "timing", "T3" });
+    parser.addOption({ "unit-size", "Ports per work unit.", "count", "256" });
+    parser.addOption({ "lease", "Milliseconds without word from a worker before its units are reassigned.", "ms", "15000" });
+    parser.addOption({ "spawn-workers", "Start this many local worker processes.", "count", "0" });
+    parser.addOption({ "output", "Write the merged results to this result store (.csr).", "file" });
+    parser.addOption({ "token", "Shared secret workers must present; defaults to $CYBERSCANNER_TOKEN. "
+                                "Required to listen on anything but loopback.", "token" });
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    QStringList targets;
+    QString targetError;
+    if (!TargetGenerator::expand(parser.value("targets"), targets, &targetError)) {
+        err << targetError << Qt::endl;
+        return 1;
+    }
+    PortSet ports;
+    QString portError;
+    ScanType scanType;
+    TimingTemplate timing;
+    if (!PortSet::parse(parser.value("ports"), ports, &portError)) {
+        err << portError << Qt::endl;
+        return 1;
+    }
+    if (targets.isEmpty() || ports.isEmpty()) {
+        err << "Nothing to scan: give --targets and a valid --ports list" << Qt::endl;
+        return 1;
+    }
+    if (!parseScanType(parser.value("scan-type"), scanType)) {
+        err << "Unknown scan type: " << parser.value("scan-type") << Qt::endl;
+        return 1;
+    }
+    if (!parseTiming(parser.value("timing"), timing)) {
+        err << "Unknown timing template: " << parser.value("timing") << Qt::endl;
+        return 1;
+    }
+
+    ScanCoordinator coordinator;
+    coordinator.setScan(targets, ports, scanType, timing, parser.value("unit-size").toInt());
+    coordinator.setLeaseTimeout(parser.value("lease").toInt());
+    const QByteArray token = sharedToken(parser);
+    coordinator.setToken(token);
+
+    ResultStoreWriter store;
+    const bool udp = scanType == ScanType::UDP_SCAN;
+    QObject::connect(&coordinator, &ScanCoordinator::result,
+                     [&out, &store, udp](const QString &host, int port, const QString &status, const QString &service,
+                                         const QString &banner, int responseTime) {
+        store.addResult(host, port, udp ? PortProtocol::UDP : PortProtocol::TCP, portStateFromString(status),
+                        banner, responseTime);
+        if (status == "Open") {
+            out << host << ' ' << port << '/' << (udp ? "udp" : "tcp") << ' ' << status << ' ' << service << Qt::endl;
+        }
+    });
+    QObject::connect(&coordinator, &ScanCoordinator::logMessage, [&err](const QString &message, LogLevel level) {
+        if (level >= LogLevel::Info) {
+            err << message << Qt::endl;
+        }
+    });
+    QObject::connect(&coordinator, &ScanCoordinator::finished, &app, &QCoreApplication::quit, Qt::QueuedConnection);
+
+    const QString address = parser.value("coordinate");
+    QString error;
+    if (!coordinator.listen(address, &error)) {
+        err << "Could not listen on " << address << ": " << error << Qt::endl;
+        return 1;
+    }
+
+    // Local workers reach a wildcard TCP listener through loopback, on the
+    // port it got.
+    QString workerAddress = address;
+    QString host;
+    quint16 port = 0;
+    if (DistributedProtocol::parseTcpAddress(address, host, port)) {
+        const QHostAddress bound(host);
+        const bool wildcard = host.isEmpty() || bound == QHostAddress::AnyIPv4 || bound == QHostAddress::AnyIPv6;
+        const QString workerHost = wildcard ? QString("127.0.0.1") : host.contains(':') ? QString("[%1]").arg(host) : host;
+        workerAddress = QString("%1:%2").arg(workerHost).arg(coordinator.serverPort());
+    }
+
+    // The token goes through the environment, not the command line, where
+    // any local user could read it.
+    QProcessEnvironment workerEnvironment = QProcessEnvironment::systemEnvironment();
+    workerEnvironment.insert("CYBERSCANNER_TOKEN", QString::fromUtf8(token));
+
+    QList<QProcess *> spawned;
+    for (int i = 0; i < parser.value("spawn-workers").toInt(); ++i) {
+        QProcess *process = new QProcess(&app);
+        process->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        process->setProcessEnvironment(workerEnvironment);
+        process->start(QCoreApplication::applicationFilePath(),
+                       { "--worker", workerAddress, "--name", QString("local-%1").arg(i + 1) });
+        spawned.append(process);
+    }
+
+    int status = app.exec();
+
+    for (QProcess *process : qAsConst(spawned)) {
+        if (!process->waitForFinished(3000)) {
+            process->kill();
+            process->waitForFinished(1000);
+        }
+    }
+
+    if (parser.isSet("output")) {
+        if (!store.write(parser.value("output"), &error)) {
+            err << "Could not write " << parser.value("output") << ": " << error << Qt::endl;
+            return 1;
+        }
+        err << "Wrote " << store.count() << " results to " << parser.value("output") << Qt::endl;
+    }
+    return status;
+}
+
+static int runVerify(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("CyberScanner");
+    app.setApplicationVersion("1.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Re-probes only the ports earlier nmap or masscan runs found open.");
+    parser.addHelpOption();
+    parser.addOption({ "verify", "nmap XML or masscan XML/JSON/list output; repeat to merge several.", "file" });
+    parser.addOption({ "protocol", "tcp or udp ports of the imported results.", "protocol", "tcp" });
+    parser.addOption({ "timing", "Timing template T0-T5, for timeouts.", "timing", "T4" });
+    parser.addOption({ "host-probes", "Probes in flight at any one host; 0 for no limit.", "count", "0" });
+    parser.addOption({ "host-delay", "Milliseconds from one probe to the next at the same host.", "ms", "0" });
+    parser.addOption({ "max-probes", "Probes in flight in total; 0 for all the socket budget allows.", "count", "0" });
+    parser.addOption({ "output", "Write the verified results to this result store (.csr).", "file" });
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    const QString protocolName = parser.value("protocol").toLower();
+    if (protocolName != "tcp" && protocolName != "udp") {
+        err << "Unknown protocol: " << parser.value("protocol") << Qt::endl;
+        return 1;
+    }
+    TimingTemplate timing;
+    if (!parseTiming(parser.value("timing"), timing)) {
+        err << "Unknown timing template: " << parser.value("timing") << Qt::endl;
+        return 1;
+    }
+
+    const PortProtocol protocol = protocolName == "udp" ? PortProtocol::UDP : PortProtocol::TCP;
+    ScanImport import(protocol);
+    for (const QString &file : parser.values("verify")) {
+        QString error;
+        if (!import.read(file, &error)) {
+            err << "Could not import " << file << ": " << error << Qt::endl;
+            return 1;
+        }
+    }
+    if (import.portCount() == 0) {
+        err << "No open " << protocolName << " ports in the imported results" << Qt::endl;
+        return 1;
+    }
+
+    // The engine gets every slot the socket budget allows, and enough jobs
+    // run at once to keep them busy when hosts have only a few ports each,
+    // or while each host is held to a trickle.
+    int concurrency = ScanImport::verificationConcurrency();
+    if (parser.value("max-probes").toInt() > 0) {
+        concurrency = qMin(concurrency, parser.value("max-probes").toInt());
+    }
+    QSharedPointer<ProbeDispatcher> engine = QSharedPointer<ProbeDispatcher>::create(concurrency);
+    HostPoliteness politeness;
+    politeness.maxInFlight = qMax(0, parser.value("host-probes").toInt());
+    politeness.minInterval = qMax(0, parser.value("host-delay").toInt());
+    engine->setHostPoliteness(politeness);
+    ScanJobQueue queue(engine);
+    queue.setMaxRunningJobs(concurrency);
+
+    err << "Verifying " << import.portCount() << " open ports on " << import.targetCount() << " hosts, "
+        << concurrency << " probes in flight (" << import.skipped() << " imported records skipped)" << Qt::endl;
+
+    ResultStoreWriter store;
+    int stillOpen = 0;
+    int gone = 0;
+    int unverified = 0;
+    QSet<int> done;
+    int jobCount = 0;
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    QObject::connect(&queue, &ScanJobQueue::jobResults,
+                     [&](int, const QString &host, const QVector<ProbeResult> &results) {
+        for (const ProbeResult &result : results) {
+            store.addResult(host, result.port, protocol, result.state, result.banner, result.responseTime);
+            if (result.state == PortState::Open) {
+                ++stillOpen;
+            } else if (result.state == PortState::Exhausted || result.state == PortState::Error) {
+                // No answer was had, so the port may well still be open.
+                ++unverified;
+            } else {
+                ++gone;
+                out << host << ' ' << result.port << '/' << protocolName << ' '
+                    << portStateName(result.state) << " (was Open)" << Qt::endl;
+            }
+        }
+    });
+    QObject::connect(&queue, &ScanJobQueue::jobChanged, [&](int id) {
+        const ScanJobState state = queue.job(id).state;
+        if (state != ScanJobState::Finished && state != ScanJobState::Cancelled) return;
+        done.insert(id);
+        if (done.size() == jobCount) {
+            QMetaObject::invokeMethod(&app, "quit", Qt::QueuedConnection);
+        }
+    });
+    QObject::connect(&queue, &ScanJobQueue::logMessage, [&err](const QString &message, LogLevel level) {
+        if (level >= LogLevel::Warning) {
+            err << message << Qt::endl;
+        }
+    });
+
+    const QList<ScanJobSpec> jobs = import.verificationJobs(timing);
+    jobCount = jobs.size();
+    for (const ScanJobSpec &spec : jobs) {
+        queue.addJob(spec);
+    }
+
+    int status = app.exec();
+
+    err << QString("Verified in %1 s: %2 still open, %3 no longer open")
+               .arg(elapsed.elapsed() / 1000.0, 0, 'f', 1).arg(stillOpen).arg(gone) << Qt::endl;
+    if (unverified > 0) {
+        err << QString("%1 ports not verified: out of local sockets or the probe failed; "
+                       "retry with a lower --max-probes").arg(unverified) << Qt::endl;
+    }
+
+    if (parser.isSet("output")) {
+        QString error;
+        if (!store.write(parser.value("output"), &error)) {
+            err << "Could not write " << parser.value("output") << ": " << error << Qt::endl;
+            return 1;
+        }
+        err << "Wrote " << store.count() << " results to " << parser.value("output") << Qt::endl;
+    }
+    return status;
+}
+
+static int runMonitor(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("CyberScanner");
+    app.setApplicationVersion("1.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Rescans targets on a schedule and prints only the ports that changed.");
+    parser.addHelpOption();
+    parser.addOption({ "monitor", "Run as a monitor instead of starting the GUI." });
+    parser.addOption({ "targets", "Comma separated hosts, IPv4 blocks, IPv6 prefixes with a pattern "
+                                  "(2001:db8::/64@low) or hitlist:file.", "targets" });
+    parser.addOption({ "ports", "Ports to watch in nmap -p syntax.", "ports", "1-65535" });
+    parser.addOption({ "scan-type", "connect, syn, udp, fin, xmas, null, ack or window.", "type", "connect" });
+    parser.addOption({ "timing", "Timing template T0-T5.", "timing", "T3" });
+    parser.addOption({ "interval", "Seconds from the start of one cycle to the next.", "seconds", "3600" });
+    parser.addOption({ "sweep", "Ports of the range each host gets swept per cycle, besides its known ones.",
+                       "count", QString::number(ScanMonitor::DefaultSweepSize) });
+    parser.addOption({ "hosts-at-once", "Hosts scanned side by side.", "count", "16" });
+    parser.addOption({ "host-probes", "Probes in flight at any one host; 0 for no limit.", "count", "0" });
+    parser.addOption({ "host-delay", "Milliseconds from one probe to the next at the same host.", "ms", "0" });
+    parser.addOption({ "state", "Result store with the known state; read at start, rewritten every cycle.", "file" });
+    parser.addOption({ "cycles", "Stop after this many cycles; 0 runs until killed.", "count", "0" });
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    QStringList targets;
+    QString error;
+    if (!TargetGenerator::expand(parser.value("targets"), targets, &error)) {
+        err << error << Qt::endl;
+        return 1;
+    }
+    PortSet ports;
+    if (!PortSet::parse(parser.value("ports"), ports, &error)) {
+        err << error << Qt::endl;
+        return 1;
+    }
+    ScanType scanType;
+    TimingTemplate timing;
+    if (!parseScanType(parser.value("scan-type"), scanType)) {
+        err << "Unknown scan type: " << parser.value("scan-type") << Qt::endl;
+        return 1;
+    }
+    if (!parseTiming(parser.value("timing"), timing)) {
+        err << "Unknown timing template: " << parser.value("timing") << Qt::endl;
+        return 1;
+    }
+
+    QSharedPointer<ProbeDispatcher> engine = QSharedPointer<ProbeDispatcher>::create();
+    HostPoliteness politeness;
+    politeness.maxInFlight = qMax(0, parser.value("host-probes").toInt());
+    politeness.minInterval = qMax(0, parser.value("host-delay").toInt());
+    engine->setHostPoliteness(politeness);
+
+    ScanMonitor monitor(engine);
+    monitor.setTargets(targets);
+    monitor.setPorts(ports);
+    monitor.setScanType(scanType);
+    monitor.setTiming(timing);
+    monitor.setInterval(parser.value("interval").toInt());
+    monitor.setSweepSize(parser.value("sweep").toInt());
+    monitor.setHostsAtOnce(parser.value("hosts-at-once").toInt());
+    monitor.setStateFile(parser.value("state"));
+
+    const int cycles = parser.value("cycles").toInt();
+    QObject::connect(&monitor, &ScanMonitor::portChanged, [&out](const ResultChange &change) {
+        static const char *const kinds[] = { "opened", "closed", "banner" };
+        out << QDateTime::currentDateTime().toString(Qt::ISODate) << ' ' << kinds[change.type] << ' '
+            << change.host << ' ' << change.port << '/' << (change.protocol == PortProtocol::UDP ? "udp" : "tcp") << ' '
+            << portStateName(change.oldState) << " -> " << portStateName(change.newState);
+        if (change.type == ResultChange::BannerChanged) {
+            out << " \"" << change.oldBanner << "\" -> \"" << change.newBanner << '"';
+        }
+        out << Qt::endl;
+    });
+    QObject::connect(&monitor, &ScanMonitor::cycleStarted, [&err](int cycle, int probes) {
+        err << "Cycle " << cycle << ": " << probes << " probes" << Qt::endl;
+    });
+    QObject::connect(&monitor, &ScanMonitor::cycleFinished, [&app, cycles](int cycle, const ResultDiffSummary &) {
+        if (cycles > 0 && cycle >= cycles) {
+            QMetaObject::invokeMethod(&app, "quit", Qt::QueuedConnection);
+        }
+    });
+    QObject::connect(&monitor, &ScanMonitor::logMessage, [&err](const QString &message, LogLevel level) {
+        if (level >= LogLevel::Info) {
+            err << message << Qt::endl;
+        }
+    });
+
+    if (!monitor.start(&error)) {
+        err << error << Qt::endl;
+        return 1;
+    }
+    err << "Monitoring " << targets.size() << " hosts, " << ports.size() << " ports each, every "
+        << parser.value("interval").toInt() << " s" << Qt::endl;
+    return app.exec();
+}
 
 int main(int argc, char *argv[])
 {
+    // Headless modes; see ScanCoordinator, ScanWorker, ScanImport and ScanMonitor.
+    if (hasOption(argc, argv, "--worker")) {
+        return runWorker(argc, argv);
+    }
+    if (hasOption(argc, argv, "--coordinate")) {
+        return runCoordinator(argc, argv);
+    }
+    if (hasOption(argc, argv, "--verify")) {
+        return runVerify(argc, argv);
+    }
+    if (hasOption(argc, argv, "--monitor")) {
+        return runMonitor(argc, argv);
+    }
+
     QApplication a(argc, argv);
 
     a.setApplicationName("CyberScanner");
@@ -1,408 +1,41 @@
 #include "mainwindow.h"
+#include "probetracer.h"
+#include "scanimport.h"
+#include "targetgenerator.h"
+#include "socketbudget.h"
 #include "./ui_mainwindow.h"
 #include <QThreadPool>
 #include <QRunnable>
 #include <QMutexLocker>
-#include <algorithm>
 #include <QDateTime>
 #include <QDesktopServices>
 #include <QUrl>
 #include <QFileDialog>
 #include <QMessageBox>
+#include <QScrollBar>
+#include <QHeaderView>
 
+// Rows sampled when sizing result columns, and how often that happens while
+// results stream in.
+static const int ResultSizingRows = 500;
+static const int ResultResizeIntervalMs = 1000;
 
-class PortScanTask : public QObject, public QRunnable
-{
-    Q_OBJECT
-
-public:
-    PortScanTask(const QString &host, int port, int timeout, ScanType scanType, PortScanner *scanner)
-        : host(host), port(port), timeout(timeout), scanType(scanType), scanner(scanner)
-    {
-        setAutoDelete(true);
-    }
-
-    void run() override
-    {
-        QElapsedTimer timer;
-        timer.start();
-
-        QString status;
-        QString banner;
-        QString service = getServiceName(port);
-        int responseTime = 0;
-
-        switch (scanType) {
-        case ScanType::TCP_CONNECT:
-            performTCPConnectScan(status, banner, responseTime, timer);
-            break;
-        case ScanType::UDP_SCAN:
-            performUDPScan(status, banner, responseTime, timer);
-            break;
-        case ScanType::TCP_SYN:
-            performTCPSynScan(status, banner, responseTime, timer);
-            break;
-        case ScanType::TCP_FIN:
-            performTCPFinScan(status, banner, responseTime, timer);
-            break;
-        case ScanType::TCP_XMAS:
-            performTCPXmasScan(status, banner, responseTime, timer);
-            break;
-        case ScanType::TCP_NULL:
-            performTCPNullScan(status, banner, responseTime, timer);
-            break;
-        case ScanType::TCP_ACK:
-            performTCPAckScan(status, banner, responseTime, timer);
-            break;
-        case ScanType::TCP_WINDOW:
-            performTCPWindowScan(status, banner, responseTime, timer);
-            break;
-        }
-
-        QMetaObject::invokeMethod(scanner, "portScanned", Qt::QueuedConnection,
-                                  Q_ARG(int, port),
-                                  Q_ARG(QString, status),
-                                  Q_ARG(QString, service),
-                                  Q_ARG(QString, banner),
-                                  Q_ARG(int, responseTime));
-    }
-
-private:
-    QString host;
-    int port;
-    int timeout;
-    ScanType scanType;
-    PortScanner *scanner;
-
-    void performTCPConnectScan(QString &status, QString &banner, int &responseTime, QElapsedTimer &timer)
-    {
-        QTcpSocket socket;
-        socket.connectToHost(host, port);
-
-        bool connected = socket.waitForConnected(timeout);
-        responseTime = timer.elapsed();
-
-        if (connected) {
-            status = "Open";
-            banner = grabBanner(&socket, port);
-            socket.disconnectFromHost();
-        } else {
-            QAbstractSocket::SocketError error = socket.error();
-            switch (error) {
-            case QAbstractSocket::ConnectionRefusedError:
-                status = "Closed";
-                break;
-            case QAbstractSocket::SocketTimeoutError:
-                status = "Filtered";
-                break;
-            case QAbstractSocket::NetworkError:
-            case QAbstractSocket::HostNotFoundError:
-                status = "Filtered";
-                break;
-            default:
-                status = responseTime < (timeout / 2) ? "Closed" : "Filtered";
-                break;
-            }
-        }
-    }
-
-    void performUDPScan(QString &status, QString &banner, int &responseTime, QElapsedTimer &timer)
-    {
-        QUdpSocket socket;
-
-        if (!socket.bind()) {
-            status = "Error";
-            responseTime = timer.elapsed();
-            return;
-        }
-
-        QByteArray probe = getUDPProbe(port);
-        qint64 sent = socket.writeDatagram(probe, QHostAddress(host), port);
-
-        if (sent == -1) {
-            status = "Error";
-            responseTime = timer.elapsed();
-            return;
-        }
-
-        bool hasResponse = socket.waitForReadyRead(timeout);
-        responseTime = timer.elapsed();
-
-        if (hasResponse) {
-            status = "Open";
-            QByteArray response;
-            QHostAddress sender;
-            quint16 senderPort;
-
-            while (socket.hasPendingDatagrams()) {
-                response.resize(socket.pendingDatagramSize());
-                socket.readDatagram(response.data(), response.size(), &sender, &senderPort);
-            }
-
-            banner = QString::fromUtf8(response).trimmed();
-            if (banner.length() > 100) {
-                banner = banner.left(100) + "...";
-            }
-        } else {
-
-            status = "Open|Filtered";
-        }
-    }
-
-    void performTCPSynScan(QString &status, QString &banner, int &responseTime, QElapsedTimer &timer)
-    {
-        QTcpSocket socket;
-        socket.connectToHost(host, port);
-
-        bool connected = socket.waitForConnected(timeout / 2);
-        responseTime = timer.elapsed();
-
-        if (connected) {
-            status = "Open";
-            socket.disconnectFromHost();
-            banner = "";
-        } else {
-            QAbstractSocket::SocketError error = socket.error();
-            switch (error) {
-            case QAbstractSocket::ConnectionRefusedError:
-                status = "Closed";
-                break;
-            case QAbstractSocket::SocketTimeoutError:
-                status = "Filtered";
-                break;
-            default:
-                status = "Filtered";
-                break;
-            }
-        }
-    }
-
-    void performTCPFinScan(QString &status, QString &banner, int &responseTime, QElapsedTimer &timer)
-    {
-        status = simulateStealthScan("FIN", responseTime, timer);
-        banner = "";
-    }
-
-    void performTCPXmasScan(QString &status, QString &banner, int &responseTime, QElapsedTimer &timer)
-    {
-        status = simulateStealthScan("XMAS", responseTime, timer);
-        banner = "";
-    }
-
-    void performTCPNullScan(QString &status, QString &banner, int &responseTime, QElapsedTimer &timer)
-    {
-        status = simulateStealthScan("NULL", responseTime, timer);
-        banner = "";
-    }
-
-    void performTCPAckScan(QString &status, QString &banner, int &responseTime, QElapsedTimer &timer)
-    {
-        status = simulateFirewallScan("ACK", responseTime, timer);
-        banner = "";
-    }
-
-    void performTCPWindowScan(QString &status, QString &banner, int &responseTime, QElapsedTimer &timer)
-    {
-        status = simulateStealthScan("Window", responseTime, timer);
-        banner = "";
-    }
-
-    QString simulateStealthScan(const QString &scanType, int &responseTime, QElapsedTimer &timer)
-    {
-
-        QTcpSocket socket;
-        socket.connectToHost(host, port);
-
-        bool result = socket.waitForConnected(timeout / 3);
-        responseTime = timer.elapsed();
-
-        if (result) {
-            socket.disconnectFromHost();
-
-            return "Open";
-        } else {
-            QAbstractSocket::SocketError error = socket.error();
-            if (error == QAbstractSocket::ConnectionRefusedError) {
-                return "Closed";
-            } else {
-                return "Filtered";
-            }
-        }
-    }
-
-    QString simulateFirewallScan(const QString &scanType, int &responseTime, QElapsedTimer &timer)
-    {
-        QTcpSocket socket;
-        socket.connectToHost(host, port);
-
-        bool result = socket.waitForConnected(timeout / 4);
-        responseTime = timer.elapsed();
-
-        if (result) {
-            socket.disconnectFromHost();
-            return "Unfiltered";
-        } else {
-            return "Filtered";
-        }
-    }
-
-    QByteArray getUDPProbe(int port)
-    {
-        switch (port) {
-        case 53:
-            return QByteArray::fromHex("1234010000010000000000000377777706676F6F676C6503636F6D0000010001");
-        case 67:
-            return QByteArray::fromHex("0101060000003d1d00000000000000000000000000000000");
-        case 69:
-            return QByteArray("\x00\x01test\x00octet\x00", 12);
-        case 123:
-            return QByteArray::fromHex("1B0000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000");
-        case 161:
-            return QByteArray::fromHex("302902010004067075626C6963A01C02020000020100020100308E");
-        case 514:
-            return QByteArray("<14>Test message");
-        default:
-            return QByteArray("UDP_PROBE_" + QByteArray::number(port));
-        }
-    }
-
-    QString getServiceName(int port)
-    {
-        static QHash<int, QString> services;
-        if (services.isEmpty()) {
-
-            services[21] = "FTP";
-            services[22] = "SSH";
-            services[23] = "Telnet";
-            services[25] = "SMTP";
-            services[53] = "DNS";
-            services[80] = "HTTP";
-            services[110] = "POP3";
-            services[143] = "IMAP";
-            services[443] = "HTTPS";
-            services[993] = "IMAPS";
-            services[995] = "POP3S";
-            services[3389] = "RDP";
-            services[8080] = "HTTP-Alt";
-            services[8443] = "HTTPS-Alt";
-            services[135] = "RPC";
-            services[139] = "NetBIOS";
-            services[445] = "SMB";
-            services[1433] = "MSSQL";
-            services[3306] = "MySQL";
-            services[5432] = "PostgreSQL";
-            services[6379] = "Redis";
-            services[27017] = "MongoDB";
-            services[1521] = "Oracle";
-            services[5060] = "SIP";
-            services[5061] = "SIP-TLS";
-
-            services[67] = "DHCP";
-            services[68] = "DHCP";
-            services[69] = "TFTP";
-            services[123] = "NTP";
-            services[161] = "SNMP";
-            services[162] = "SNMP-Trap";
-            services[514] = "Syslog";
-            services[520] = "RIP";
-            services[1900] = "UPnP";
-        }
-        return services.value(port, "Unknown");
-    }
-
-    QString grabBanner(QTcpSocket *socket, int port)
-    {
-        if (!socket || !socket->isOpen()) {
-            return "";
-        }
-
-        QString banner;
-
-        switch (port) {
-        case 21:
-            if (socket->waitForReadyRead(1000)) {
-                banner = QString::fromUtf8(socket->readAll()).trimmed();
-            }
-            break;
-
-        case 22:
-            if (socket->waitForReadyRead(1000)) {
-                banner = QString::fromUtf8(socket->readAll()).trimmed();
-            }
-            break;
-
-        case 25:
-            if (socket->waitForReadyRead(1000)) {
-                banner = QString::fromUtf8(socket->readAll()).trimmed();
-            }
-            break;
-
-        case 80:
-        case 8080:
-            socket->write("GET / HTTP/1.0\r\nHost: " + host.toUtf8() + "\r\n\r\n");
-            if (socket->waitForReadyRead(2000)) {
-                QByteArray data = socket->readAll();
-                banner = QString::fromUtf8(data).trimmed();
-
-                QRegularExpression serverRegex("Server: ([^\r\n]+)");
-                QRegularExpressionMatch match = serverRegex.match(banner);
-                if (match.hasMatch()) {
-                    banner = match.captured(1);
-                } else {
-
-                    QStringList lines = banner.split('\n');
-                    if (!lines.isEmpty()) {
-                        banner = lines.first().trimmed();
-                    }
-                }
-            }
-            break;
-
-        case 443:
-        case 8443:
-            banner = "HTTPS/SSL";
-            break;
-
-        case 110:
-            if (socket->waitForReadyRead(1000)) {
-                banner = QString::fromUtf8(socket->readAll()).trimmed();
-            }
-            break;
-
-        case 143:
-            if (socket->waitForReadyRead(1000)) {
-                banner = QString::fromUtf8(socket->readAll()).trimmed();
-            }
-            break;
-
-        case 3389:
-            banner = "RDP";
-            break;
-
-        default:
-
-            if (socket->waitForReadyRead(500)) {
-                banner = QString::fromUtf8(socket->readAll()).trimmed();
-            }
-            break;
-        }
-
-        banner = banner.remove(QRegularExpression("[\\x00-\\x1F\\x7F-\\xFF]"));
-        if (banner.length() > 100) {
-            banner = banner.left(100) + "...";
-        }
-
-        return banner;
-    }
-};
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
     , scanner(nullptr)
+    , jobQueue(nullptr)
     , totalPorts(0)
     , scannedPorts(0)
     , openPorts(0)
+    , forecasting(false)
+    , resultModel(nullptr)
+    , resultResizePending(false)
+    , metricsExporter(nullptr)
+    , logFlushTimer(nullptr)
+    , logViewSequence(0)
+    , logClearedSequence(0)
     , currentScanType(ScanType::TCP_CONNECT)
     , currentTiming(TimingTemplate::T3_NORMAL)
     , serviceDetectionEnabled(true)
@@ -411,29 +44,65 @@ MainWindow::MainWindow(QWidget *parent)
 {
     ui->setupUi(this);
 
-    scanner = new PortScanner(this);
+    // The main scan and queued jobs all run on one engine and share its
+    // probe slots by weight.
+    probeEngine = QSharedPointer<ProbeDispatcher>::create();
+    scanner = new PortScanner(probeEngine, this);
+    jobQueue = new ScanJobQueue(probeEngine, this);
+    tcpPriors = QSharedPointer<PortPriors>::create(PortProtocol::TCP);
+    udpPriors = QSharedPointer<PortPriors>::create(PortProtocol::UDP);
 
     connect(scanner, &PortScanner::scanStarted, this, &MainWindow::onScanStarted);
     connect(scanner, &PortScanner::scanFinished, this, &MainWindow::onScanFinished);
+    connect(scanner, &PortScanner::scanPaused, this, &MainWindow::onScanPaused);
     connect(scanner, &PortScanner::scanProgress, this, &MainWindow::onScanProgress);
-    connect(scanner, &PortScanner::portResult, this, &MainWindow::onPortResult);
+    connect(scanner, &PortScanner::scanForecast, this, &MainWindow::onScanForecast);
+    connect(scanner, &PortScanner::portResults, this, &MainWindow::onPortResults);
     connect(scanner, &PortScanner::scanError, this, &MainWindow::onScanError);
     connect(scanner, &PortScanner::logMessage, this, &MainWindow::onLogMessage);
     connect(scanner, &PortScanner::osDetectionResult, this, &MainWindow::onOSDetectionResult);
 
-    ui->tableWidget_results->setColumnCount(6);
-    QStringList headers;
-    headers << "Port" << "Protocol" << "Status" << "Service" << "Banner" << "Response Time";
-    ui->tableWidget_results->setHorizontalHeaderLabels(headers);
-    ui->tableWidget_results->resizeColumnsToContents();
+    connect(jobQueue, &ScanJobQueue::jobAdded, this, &MainWindow::onJobAdded);
+    connect(jobQueue, &ScanJobQueue::jobChanged, this, &MainWindow::onJobChanged);
+    connect(jobQueue, &ScanJobQueue::jobResults, this, &MainWindow::onJobResults);
+    connect(jobQueue, &ScanJobQueue::logMessage, this, &MainWindow::onLogMessage);
+
+    ui->tableWidget_jobs->setColumnCount(7);
+    ui->tableWidget_jobs->setHorizontalHeaderLabels(
+        QStringList() << "ID" << "Target" << "Ports" << "Weight" << "Progress" << "Open" << "State");
+
+    // Fixed row heights and sampled column sizing keep the view's cost
+    // independent of how many results it holds.
+    resultModel = new ResultTableModel(this);
+    ui->tableView_results->setModel(resultModel);
+    ui->tableView_results->horizontalHeader()->setSortIndicator(-1, Qt::AscendingOrder);
+    ui->tableView_results->horizontalHeader()->setResizeContentsPrecision(ResultSizingRows);
+    ui->tableView_results->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    ui->tableView_results->resizeColumnsToContents();
 
     updateTimer = new QTimer(this);
     connect(updateTimer, &QTimer::timeout, this, &MainWindow::updateUI);
 
+    metricsExporter = new MetricsExporter(this);
+    updateMetricsPanel();
+
+    // Messages go to the ring (and the file sink) immediately; the panel
+    // catches up in batches so bursts of per-port logging don't stall the UI.
+    logFlushTimer = new QTimer(this);
+    connect(logFlushTimer, &QTimer::timeout, this, &MainWindow::flushLogView);
+    logFlushTimer->start(100);
+
+    QString logDirectory = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/logs";
+    QString logError;
+    if (!scanLog.startFileSink(logDirectory, &logError)) {
+        addLogMessage(QString("Log file disabled: %1").arg(logError), LogLevel::Warning);
+    }
+
     ui->comboBox_timing->setCurrentIndex(3);
 
     addLogMessage("Enhanced Port Scanner initialized - Ready to scan");
     addLogMessage("Features: Multiple scan types, OS detection, Service detection");
+    addLogMessage(SocketBudget::instance()->describe());
 }
 
 MainWindow::~MainWindow()
@@ -450,9 +119,9 @@ void MainWindow::on_comboBox_scanType_currentTextChanged(const QString &text)
     addLogMessage(QString("Scan type changed to: %1").arg(text));
 
     if (currentScanType == ScanType::UDP_SCAN) {
-        ui->tableWidget_results->horizontalHeaderItem(1)->setText("Protocol (UDP)");
+        resultModel->setProtocolLabel("Protocol (UDP)");
     } else {
-        ui->tableWidget_results->horizontalHeaderItem(1)->setText("Protocol (TCP)");
+        resultModel->setProtocolLabel("Protocol (TCP)");
     }
 }
 
@@ -460,6 +129,9 @@ void MainWindow::on_comboBox_timing_currentTextChanged(const QString &text)
 {
     currentTiming = getTimingFromCombo();
     addLogMessage(QString("Timing template changed to: %1").arg(text));
+    if (scanner && scanner->isScanning()) {
+        scanner->setTiming(currentTiming);
+    }
 }
 
 void MainWindow::on_checkBox_osDetection_toggled(bool checked)
@@ -497,309 +169,323 @@ void MainWindow::on_checkBox_detectService_toggled(bool checked)
     }
 }
 
-void MainWindow::on_pushButton_start_clicked()
+void MainWindow::on_checkBox_nmapEngine_toggled(bool checked)
+{
+    if (checked) {
+        addLogMessage(QString("Next scans run through %1").arg(scanner->nmapProgram()));
+    } else {
+        addLogMessage("Next scans use the built-in engine");
+    }
+}
+
+bool MainWindow::readScanForm(QStringList &targets, PortSet &ports)
 {
-    QString target = ui->lineEdit_target->text().trimmed();
-    if (target.isEmpty()) {
+    const QString targetText = ui->lineEdit_target->text().trimmed();
+    if (targetText.isEmpty()) {
         QMessageBox::warning(this, "Error", "Please enter a target host or IP address.");
-        return;
+        return false;
     }
 
-    if (!isValidTarget(target)) {
-        QMessageBox::warning(this, "Error", "Invalid target format. Please enter a valid IP address or hostname.");
-        return;
+    QString targetError;
+    if (!TargetGenerator::expand(targetText, targets, &targetError)) {
+        QMessageBox::warning(this, "Error", targetError);
+        return false;
+    }
+    if (targets.isEmpty()) {
+        QMessageBox::warning(this, "Error", "The target list expands to no hosts.");
+        return false;
     }
 
-    QList<int> ports;
+    ports.clear();
     if (!ui->lineEdit_customPorts->text().trimmed().isEmpty()) {
-        ports = parsePortRange(ui->lineEdit_customPorts->text());
+        QString error;
+        if (!PortSet::parse(ui->lineEdit_customPorts->text(), ports, &error)) {
+            QMessageBox::warning(this, "Error", QString("Invalid custom ports: %1.").arg(error));
+            return false;
+        }
     } else {
         int fromPort = ui->spinBox_portFrom->value();
         int toPort = ui->spinBox_portTo->value();
         if (fromPort > toPort) {
             QMessageBox::warning(this, "Error", "Invalid port range. 'From' port must be less than or equal to 'To' port.");
-            return;
-        }
-        for (int i = fromPort; i <= toPort; i++) {
-            ports.append(i);
+            return false;
         }
+        ports.insertRange(fromPort, toPort);
     }
 
     if (ports.isEmpty()) {
         QMessageBox::warning(this, "Error", "No valid ports to scan.");
+        return false;
+    }
+    return true;
+}
+
+void MainWindow::on_pushButton_start_clicked()
+{
+    QStringList targets;
+    PortSet ports;
+    if (!readScanForm(targets, ports)) {
+        return;
+    }
+    // The main scan covers one host; ranges and hitlists become jobs.
+    if (targets.size() > 1) {
+        addLogMessage(QString("Target expands to %1 hosts; queueing a job for each").arg(targets.size()));
+        queueScanJobs(targets, ports);
         return;
     }
+    const QString target = targets.first();
 
     clearResults();
     totalPorts = ports.size();
+    currentTarget = target;
 
     addLogMessage(QString("=== Starting Enhanced Scan ==="));
     addLogMessage(QString("Target: %1").arg(target));
-    addLogMessage(QString("Ports: %1 total").arg(totalPorts));
+    addLogMessage(QString("Ports: %1 total (%2)").arg(totalPorts).arg(ports.toString()));
     addLogMessage(QString("Scan Type: %1").arg(ui->comboBox_scanType->currentText()));
     addLogMessage(QString("Timing: %1").arg(ui->comboBox_timing->currentText()));
     addLogMessage(QString("Service Detection: %1").arg(serviceDetectionEnabled ? "Enabled" : "Disabled"));
     addLogMessage(QString("OS Detection: %1").arg(osDetectionEnabled ? "Enabled" : "Disabled"));
     addLogMessage(QString("Aggressive Scan: %1").arg(aggressiveScanEnabled ? "Enabled" : "Disabled"));
 
+    scanner->setWeight(ui->spinBox_jobWeight->value());
+    scanner->setScanEngine(ui->checkBox_nmapEngine->isChecked() ? ScanEngine::Nmap : ScanEngine::Native);
+    scanner->setPortPriors(scanPriors());
     scanner->startScan(target, ports, currentScanType, currentTiming,
                        serviceDetectionEnabled, osDetectionEnabled, aggressiveScanEnabled);
 }
 
-ScanType MainWindow::getScanTypeFromCombo()
+void MainWindow::on_pushButton_queue_clicked()
 {
-    QString text = ui->comboBox_scanType->currentText();
-    if (text.contains("TCP Connect")) return ScanType::TCP_CONNECT;
-    if (text.contains("TCP SYN")) return ScanType::TCP_SYN;
-    if (text.contains("UDP")) return ScanType::UDP_SCAN;
-    if (text.contains("TCP FIN")) return ScanType::TCP_FIN;
-    if (text.contains("TCP XMAS")) return ScanType::TCP_XMAS;
-    if (text.contains("TCP NULL")) return ScanType::TCP_NULL;
-    if (text.contains("TCP ACK")) return ScanType::TCP_ACK;
-    if (text.contains("TCP Window")) return ScanType::TCP_WINDOW;
-    return ScanType::TCP_CONNECT;
+    QStringList targets;
+    PortSet ports;
+    if (!readScanForm(targets, ports)) {
+        return;
+    }
+    queueScanJobs(targets, ports);
 }
 
-TimingTemplate MainWindow::getTimingFromCombo()
+void MainWindow::queueScanJobs(const QStringList &targets, const PortSet &ports)
 {
-    QString text = ui->comboBox_timing->currentText();
-    if (text.contains("T0")) return TimingTemplate::T0_PARANOID;
-    if (text.contains("T1")) return TimingTemplate::T1_SNEAKY;
-    if (text.contains("T2")) return TimingTemplate::T2_POLITE;
-    if (text.contains("T3")) return TimingTemplate::T3_NORMAL;
-    if (text.contains("T4")) return TimingTemplate::T4_AGGRESSIVE;
-    if (text.contains("T5")) return TimingTemplate::T5_INSANE;
-    return TimingTemplate::T3_NORMAL;
+    ScanJobSpec spec;
+    spec.ports = ports;
+    spec.scanType = currentScanType;
+    spec.timing = currentTiming;
+    spec.weight = ui->spinBox_jobWeight->value();
+    spec.rateLimit = ui->spinBox_rateLimit->value();
+    spec.priors = scanPriors();
+    spec.earlyStopRate = ui->doubleSpinBox_earlyStop->value() / 100.0;
+
+    for (const QString &target : targets) {
+        spec.target = target;
+        jobQueue->addJob(spec);
+    }
+    ui->tabWidget->setCurrentWidget(ui->tab_jobs);
 }
 
-void MainWindow::onOSDetectionResult(const QString &osInfo)
+void MainWindow::on_actionVerifyImport_triggered()
 {
-    addLogMessage(QString("OS Detection Result: %1").arg(osInfo));
+    const QStringList fileNames = QFileDialog::getOpenFileNames(this, "Verify nmap/masscan Results", "",
+                                                                "Scan output (*.xml *.json *.ndjson *.txt *.lst);;All Files (*)");
+    if (fileNames.isEmpty()) {
+        return;
+    }
 
-    QMessageBox::information(this, "OS Detection",
-                             QString("Detected Operating System:\n%1").arg(osInfo));
+    ScanImport import(currentScanType == ScanType::UDP_SCAN ? PortProtocol::UDP : PortProtocol::TCP);
+    for (const QString &fileName : fileNames) {
+        QString error;
+        if (!import.read(fileName, &error)) {
+            QMessageBox::warning(this, "Error", QString("Could not import %1: %2").arg(fileName, error));
+            return;
+        }
+    }
+    if (import.portCount() == 0) {
+        QMessageBox::information(this, "Verify Results", "The imported results list no open ports of this scan's protocol.");
+        return;
+    }
+
+    addLogMessage(QString("Imported %1 open ports on %2 hosts (%3 records skipped); queueing verification")
+                      .arg(import.portCount()).arg(import.targetCount()).arg(import.skipped()));
+
+    for (ScanJobSpec spec : import.verificationJobs(currentTiming)) {
+        spec.weight = ui->spinBox_jobWeight->value();
+        spec.rateLimit = ui->spinBox_rateLimit->value();
+        jobQueue->addJob(spec);
+    }
+    ui->tabWidget->setCurrentWidget(ui->tab_jobs);
 }
 
-PortScanner::PortScanner(QObject *parent)
-    : QObject(parent)
-    , scanning(false)
-    , connectionTimeout(1000)
-    , completedScans(0)
-    , scanType(ScanType::TCP_CONNECT)
-    , timingTemplate(TimingTemplate::T3_NORMAL)
-    , enableServiceDetection(true)
-    , enableOSDetection(false)
-    , enableAggressiveScan(false)
-    , nmapProcess(nullptr)
+QSharedPointer<const PortPriors> MainWindow::scanPriors() const
 {
-    int optimalThreads = QThread::idealThreadCount() * 4;
-    QThreadPool::globalInstance()->setMaxThreadCount(optimalThreads);
+    if (!ui->checkBox_likelyFirst->isChecked()) {
+        return QSharedPointer<const PortPriors>();
+    }
+    return currentScanType == ScanType::UDP_SCAN ? udpPriors : tcpPriors;
 }
 
-PortScanner::~PortScanner()
+int MainWindow::selectedJobId() const
 {
-    stopScan();
+    int row = ui->tableWidget_jobs->currentRow();
+    QTableWidgetItem *item = row >= 0 ? ui->tableWidget_jobs->item(row, 0) : nullptr;
+    return item ? item->data(Qt::UserRole).toInt() : 0;
 }
 
-void PortScanner::startScan(const QString &target, const QList<int> &ports, ScanType scanType,
-                            TimingTemplate timing, bool serviceDetection, bool osDetection, bool aggressive)
+void MainWindow::on_pushButton_pauseJob_clicked()
 {
-    if (scanning) return;
+    int id = selectedJobId();
+    if (!id) return;
 
-    targetHost = target;
-    portList = ports;
-    this->scanType = scanType;
-    this->timingTemplate = timing;
-    this->enableServiceDetection = serviceDetection;
-    this->enableOSDetection = osDetection;
-    this->enableAggressiveScan = aggressive;
-
-    completedScans = 0;
-    scanning = true;
-
-    connectionTimeout = getTimeoutFromTiming(timing);
-
-    int threadCount = getOptimalThreadCount(timing, scanType);
-    QThreadPool::globalInstance()->setMaxThreadCount(threadCount);
-
-    emit scanStarted();
-    emit logMessage(QString("Starting %1 scan with %2 threads, timeout: %3ms")
-                        .arg(getScanTypeName(scanType))
-                        .arg(threadCount)
-                        .arg(connectionTimeout));
-
-    for (int port : ports) {
-        PortScanTask *task = new PortScanTask(target, port, connectionTimeout, scanType, this);
-        QThreadPool::globalInstance()->start(task);
+    if (jobQueue->job(id).state == ScanJobState::Paused) {
+        jobQueue->resumeJob(id);
+    } else {
+        jobQueue->pauseJob(id);
     }
 }
 
-int PortScanner::getOptimalThreadCount(TimingTemplate timing, ScanType scanType)
+void MainWindow::on_pushButton_cancelJob_clicked()
 {
-    int baseThreads = QThread::idealThreadCount();
-
-    switch (timing) {
-    case TimingTemplate::T0_PARANOID:
-        return 1;
-    case TimingTemplate::T1_SNEAKY:
-        return qMax(1, baseThreads / 4);
-    case TimingTemplate::T2_POLITE:
-        return qMax(1, baseThreads / 2);
-    case TimingTemplate::T3_NORMAL:
-        return baseThreads * 2;
-    case TimingTemplate::T4_AGGRESSIVE:
-        return baseThreads * 4;
-    case TimingTemplate::T5_INSANE:
-        return baseThreads * 8;
-    }
-
-    if (scanType == ScanType::UDP_SCAN) {
-        return qMax(1, baseThreads / 2);
+    int id = selectedJobId();
+    if (id) {
+        jobQueue->cancelJob(id);
     }
-
-    return baseThreads * 2;
 }
 
-QString PortScanner::getScanTypeName(ScanType scanType)
+void MainWindow::onJobAdded(int id)
 {
-    switch (scanType) {
-    case ScanType::TCP_CONNECT: return "TCP Connect";
-    case ScanType::TCP_SYN: return "TCP SYN";
-    case ScanType::UDP_SCAN: return "UDP";
-    case ScanType::TCP_FIN: return "TCP FIN";
-    case ScanType::TCP_XMAS: return "TCP XMAS";
-    case ScanType::TCP_NULL: return "TCP NULL";
-    case ScanType::TCP_ACK: return "TCP ACK";
-    case ScanType::TCP_WINDOW: return "TCP Window";
+    int row = ui->tableWidget_jobs->rowCount();
+    ui->tableWidget_jobs->insertRow(row);
+    for (int col = 0; col < ui->tableWidget_jobs->columnCount(); ++col) {
+        ui->tableWidget_jobs->setItem(row, col, new QTableWidgetItem);
     }
-    return "Unknown";
+    ui->tableWidget_jobs->item(row, 0)->setData(Qt::UserRole, id);
+    jobRows.insert(id, row);
+    onJobChanged(id);
 }
 
-void PortScanner::performOSDetection(const QString &target)
+void MainWindow::onJobChanged(int id)
 {
-    emit logMessage("Performing OS detection...");
-
-    if (tryNmapOSDetection(target)) {
-        return;
-    }
-
-    performSimpleOSDetection(target);
+    int row = jobRows.value(id, -1);
+    if (row < 0) return;
+
+    ScanJobInfo info = jobQueue->job(id);
+    int total = info.spec.ports.size();
+    ui->tableWidget_jobs->item(row, 0)->setText(QString::number(id));
+    ui->tableWidget_jobs->item(row, 1)->setText(info.spec.target);
+    ui->tableWidget_jobs->item(row, 2)->setText(QString::number(total));
+    ui->tableWidget_jobs->item(row, 3)->setText(QString::number(info.spec.weight));
+    ui->tableWidget_jobs->item(row, 4)->setText(QString("%1%").arg(total ? info.completed * 100 / total : 0));
+    ui->tableWidget_jobs->item(row, 5)->setText(QString::number(info.openPorts));
+    ui->tableWidget_jobs->item(row, 6)->setText(scanJobStateName(info.state));
 }
 
-bool PortScanner::tryNmapOSDetection(const QString &target)
+void MainWindow::onJobResults(int id, const QString &host, const QVector<ProbeResult> &results)
 {
-    if (!nmapProcess) {
-        nmapProcess = new QProcess(this);
-        connect(nmapProcess, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
-                this, &PortScanner::onNmapFinished);
-    }
-
-    QStringList args;
-    args << "-O" << "-v" << target;
+    PortProtocol protocol = jobQueue->job(id).spec.scanType == ScanType::UDP_SCAN ? PortProtocol::UDP : PortProtocol::TCP;
+    addResults(host, protocol, results);
+}
 
-    nmapProcess->start("nmap", args);
-    return nmapProcess->waitForStarted(1000);
+ScanType MainWindow::getScanTypeFromCombo()
+{
+    QString text = ui->comboBox_scanType->currentText();
+    if (text.contains("TCP Connect")) return ScanType::TCP_CONNECT;
+    if (text.contains("TCP SYN")) return ScanType::TCP_SYN;
+    if (text.contains("UDP")) return ScanType::UDP_SCAN;
+    if (text.contains("TCP FIN")) return ScanType::TCP_FIN;
+    if (text.contains("TCP XMAS")) return ScanType::TCP_XMAS;
+    if (text.contains("TCP NULL")) return ScanType::TCP_NULL;
+    if (text.contains("TCP ACK")) return ScanType::TCP_ACK;
+    if (text.contains("TCP Window")) return ScanType::TCP_WINDOW;
+    return ScanType::TCP_CONNECT;
 }
 
-void PortScanner::performSimpleOSDetection(const QString &target)
+TimingTemplate MainWindow::getTimingFromCombo()
 {
-    QString osInfo = "OS Detection: ";
+    QString text = ui->comboBox_timing->currentText();
+    if (text.contains("T0")) return TimingTemplate::T0_PARANOID;
+    if (text.contains("T1")) return TimingTemplate::T1_SNEAKY;
+    if (text.contains("T2")) return TimingTemplate::T2_POLITE;
+    if (text.contains("T3")) return TimingTemplate::T3_NORMAL;
+    if (text.contains("T4")) return TimingTemplate::T4_AGGRESSIVE;
+    if (text.contains("T5")) return TimingTemplate::T5_INSANE;
+    return TimingTemplate::T3_NORMAL;
+}
 
-    QTcpSocket socket;
-    socket.connectToHost(target, 80);
+void MainWindow::onOSDetectionResult(const QString &osInfo)
+{
+    addLogMessage(QString("OS Detection Result: %1").arg(osInfo));
 
-    if (socket.waitForConnected(2000)) {
+    QMessageBox::information(this, "OS Detection",
+                             QString("Detected Operating System:\n%1").arg(osInfo));
+}
 
-        osInfo += "Host appears to be running a TCP/IP stack (OS detection requires deeper analysis)";
-        socket.disconnectFromHost();
-    } else {
-        osInfo += "Unable to determine OS - no TCP services responding";
+void MainWindow::on_pushButton_stop_clicked()
+{
+    if (scanner && scanner->isScanning()) {
+        scanner->stopScan();
+        addLogMessage("Scan stopped by user", LogLevel::Warning);
     }
-
-    emit osDetectionResult(osInfo);
 }
 
-void PortScanner::stopScan()
+void MainWindow::on_pushButton_pause_clicked()
 {
-    if (!scanning) return;
-
-    scanning = false;
-    QThreadPool::globalInstance()->clear();
-    QThreadPool::globalInstance()->waitForDone(5000);
+    if (!scanner || !scanner->isScanning()) return;
 
-    if (nmapProcess && nmapProcess->state() != QProcess::NotRunning) {
-        nmapProcess->kill();
-        nmapProcess->waitForFinished(3000);
+    if (scanner->isPaused()) {
+        scanner->resumeScan();
+    } else {
+        scanner->pauseScan();
     }
-
-    emit scanFinished();
 }
 
-void PortScanner::portScanned(int port, const QString &status, const QString &service, const QString &banner, int responseTime)
+void MainWindow::on_spinBox_rateLimit_valueChanged(int value)
 {
-    if (!scanning) return;
-
-    completedScans++;
-    emit portResult(port, status, service, banner, responseTime);
-    emit scanProgress(completedScans, portList.size());
-
-    if (completedScans >= portList.size()) {
-
-        QList<int> openPorts;
-
-        if (enableOSDetection && !openPorts.isEmpty()) {
-            performOSDetection(targetHost);
-        }
-
-        if (enableServiceDetection && !openPorts.isEmpty()) {
-            performServiceDetection(targetHost, openPorts);
-        }
-
-        scanning = false;
-        emit scanFinished();
-    }
+    scanner->setRateLimit(value);
+    addLogMessage(value > 0 ? QString("Rate cap set to %1 probes/s").arg(value) : QString("Rate cap removed"));
 }
 
-int PortScanner::getTimeoutFromTiming(TimingTemplate timing)
+void MainWindow::on_spinBox_hostProbes_valueChanged(int value)
 {
-    switch (timing) {
-    case TimingTemplate::T0_PARANOID: return 5000;
-    case TimingTemplate::T1_SNEAKY:   return 3000;
-    case TimingTemplate::T2_POLITE:   return 2000;
-    case TimingTemplate::T3_NORMAL:   return 1000;
-    case TimingTemplate::T4_AGGRESSIVE: return 500;
-    case TimingTemplate::T5_INSANE:   return 250;
-    }
-    return 1000;
+    HostPoliteness politeness = probeEngine->hostPoliteness();
+    politeness.maxInFlight = value;
+    probeEngine->setHostPoliteness(politeness);
+    addLogMessage(value > 0 ? QString("At most %1 probes in flight per host").arg(value)
+                            : QString("Per-host probe cap removed"));
 }
 
+void MainWindow::on_spinBox_hostDelay_valueChanged(int value)
+{
+    HostPoliteness politeness = probeEngine->hostPoliteness();
+    politeness.minInterval = value;
+    probeEngine->setHostPoliteness(politeness);
+    addLogMessage(value > 0 ? QString("At least %1 ms between probes to a host").arg(value)
+                            : QString("Per-host probe delay removed"));
+}
 
-void PortScanner::performServiceDetection(const QString &target, const QList<int> &openPorts)
+void MainWindow::on_spinBox_hostsAtOnce_valueChanged(int value)
 {
-    emit logMessage("Performing enhanced service detection...");
+    jobQueue->setMaxRunningJobs(value);
+    addLogMessage(QString("Up to %1 queued scans run at once").arg(value));
 }
 
-void PortScanner::onNmapFinished(int exitCode, QProcess::ExitStatus exitStatus)
+void MainWindow::on_spinBox_engineSlots_valueChanged(int value)
 {
-    if (exitStatus == QProcess::NormalExit && exitCode == 0) {
-        QString output = nmapProcess->readAllStandardOutput();
-        emit osDetectionResult(output);
-    } else {
-        emit osDetectionResult("OS detection failed - nmap not available or insufficient privileges");
-    }
+    probeEngine->setSlots(value);
+    addLogMessage(QString("Engine runs up to %1 probes at once").arg(probeEngine->slotCount()));
 }
 
-bool PortScanner::isScanning() const
+void MainWindow::on_spinBox_deadline_valueChanged(int value)
 {
-    return scanning;
+    scanner->setDeadline(value * 60);
+    addLogMessage(value > 0 ? QString("Next scan is to finish within %1 min").arg(value)
+                            : QString("Deadline removed; scans run to the end"));
 }
 
-void MainWindow::on_pushButton_stop_clicked()
+void MainWindow::on_doubleSpinBox_earlyStop_valueChanged(double value)
 {
-    if (scanner && scanner->isScanning()) {
-        scanner->stopScan();
-        addLogMessage("Scan stopped by user");
-    }
+    scanner->setEarlyStop(value / 100.0);
+    addLogMessage(value > 0 ? QString("Scans stop early once under %1% of %2 probes in a row find an open port")
+                                  .arg(value).arg(PortScanner::DefaultEarlyStopWindow)
+                            : QString("Early stop off; scans cover every port"));
 }
 
 void MainWindow::on_pushButton_clear_clicked()
@@ -810,24 +496,36 @@ void MainWindow::on_pushButton_clear_clicked()
 
 void MainWindow::on_pushButton_clearLog_clicked()
 {
-    ui->textEdit_log->clear();
+    flushLogView();
+    ui->plainTextEdit_log->clear();
+    logClearedSequence = logViewSequence;
 }
 
 void MainWindow::on_pushButton_saveLog_clicked()
 {
     QString fileName = QFileDialog::getSaveFileName(this, "Save Log", "", "Text Files (*.txt)");
     if (!fileName.isEmpty()) {
-        QFile file(fileName);
-        if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-            QTextStream stream(&file);
-            stream << ui->textEdit_log->toPlainText();
+        QString error;
+        if (scanLog.saveTo(fileName, &error)) {
             addLogMessage(QString("Log saved to: %1").arg(fileName));
         } else {
-            QMessageBox::warning(this, "Error", "Could not save log file.");
+            QMessageBox::warning(this, "Error", QString("Could not save log file: %1").arg(error));
         }
     }
 }
 
+void MainWindow::on_comboBox_logLevel_currentIndexChanged(int index)
+{
+    Q_UNUSED(index)
+
+    // Rebuild from the ring; whatever the panel can't hold is still in the file.
+    QVector<LogEntry> entries;
+    quint64 dropped = 0;
+    logViewSequence = scanLog.drain(logClearedSequence, entries, &dropped);
+    ui->plainTextEdit_log->clear();
+    appendLogEntries(entries, dropped);
+}
+
 void MainWindow::on_lineEdit_filter_textChanged(const QString &text)
 {
     Q_UNUSED(text)
@@ -844,10 +542,15 @@ void MainWindow::onScanStarted()
 {
     ui->pushButton_start->setEnabled(false);
     ui->pushButton_stop->setEnabled(true);
+    ui->pushButton_pause->setEnabled(true);
+    ui->pushButton_pause->setText("PAUSE");
     ui->label_status->setText("Status: Scanning...");
     ui->progressBar->setValue(0);
+    ui->progressBar->setFormat("%p%");
+    forecasting = false;
     scannedPorts = 0;
     openPorts = 0;
+    scanStartMetrics = ScanMetrics::instance()->snapshot();
     scanTimer.start();
     updateTimer->start(250);
 }
@@ -856,9 +559,13 @@ void MainWindow::onScanFinished()
 {
     ui->pushButton_start->setEnabled(true);
     ui->pushButton_stop->setEnabled(false);
+    ui->pushButton_pause->setEnabled(false);
+    ui->pushButton_pause->setText("PAUSE");
     ui->label_status->setText("Status: Completed");
     ui->progressBar->setValue(100);
+    ui->progressBar->setFormat("%p%");
     updateTimer->stop();
+    updateMetricsPanel();
 
     qint64 elapsed = scanTimer.elapsed();
     QString timeStr = QString("%1:%2.%3").arg(elapsed / 60000, 2, 10, QChar('0'))
@@ -868,24 +575,48 @@ void MainWindow::onScanFinished()
     addLogMessage(QString("Scan rate: %1 ports/second").arg(totalPorts * 1000.0 / elapsed, 0, 'f', 1));
 }
 
+void MainWindow::onScanPaused(bool paused)
+{
+    ui->pushButton_pause->setText(paused ? "RESUME" : "PAUSE");
+    ui->label_status->setText(paused ? "Status: Paused" : "Status: Scanning...");
+}
+
 void MainWindow::onScanProgress(int current, int total)
 {
     scannedPorts = current;
-    if (total > 0) {
+    if (total > 0 && !forecasting) {
         int percentage = (current * 100) / total;
         ui->progressBar->setValue(percentage);
     }
 }
 
+static QString minutesSeconds(qint64 ms)
+{
+    return QString("%1:%2").arg(ms / 60000, 2, 10, QChar('0')).arg((ms % 60000) / 1000, 2, 10, QChar('0'));
+}
+
+void MainWindow::onScanForecast(const ScanForecast &forecast)
+{
+    // Against a deadline, how much of what is likely to be open has been
+    // covered says more than how many ports have been probed.
+    forecasting = true;
+    ui->progressBar->setValue(int(forecast.coverage * 100));
+    const QString eta = forecast.etaMs < 0 ? QString("--:--") : minutesSeconds(forecast.etaMs);
+    const qint64 left = qMax<qint64>(0, forecast.budgetMs - forecast.elapsedMs);
+    ui->progressBar->setFormat(QString("%p% of likely open ports, ETA %1 (%2 left), projected %3%")
+                                   .arg(eta, minutesSeconds(left))
+                                   .arg(int(forecast.projectedCoverage * 100)));
+}
+
 void MainWindow::onScanError(const QString &error)
 {
-    addLogMessage(QString("ERROR: %1").arg(error));
+    addLogMessage(error, LogLevel::Error);
     QMessageBox::critical(this, "Scan Error", error);
 }
 
-void MainWindow::onLogMessage(const QString &message)
+void MainWindow::onLogMessage(const QString &message, LogLevel level)
 {
-    addLogMessage(message);
+    addLogMessage(message, level);
 }
 
 void MainWindow::updateUI()
@@ -896,15 +627,105 @@ void MainWindow::updateUI()
                               .arg((elapsed % 60000) / 1000, 2, 10, QChar('0'));
         ui->label_stats->setText(QString("Scanned: %1 | Open: %2 | Time: %3")
                                      .arg(scannedPorts).arg(openPorts).arg(timeStr));
+        updateMetricsPanel();
+    }
+}
+
+void MainWindow::updateMetricsPanel()
+{
+    MetricsSnapshot metrics = ScanMetrics::instance()->snapshot() - scanStartMetrics;
+
+    auto latencyLine = [](const QString &label, const HistogramSnapshot &histogram) {
+        return QString("%1 p50 %2 | p90 %3 | p99 %4 | max %5 | mean %6 ms (%7 samples)")
+            .arg(label, -16)
+            .arg(histogram.percentile(0.50) / 1000.0, 0, 'f', 1)
+            .arg(histogram.percentile(0.90) / 1000.0, 0, 'f', 1)
+            .arg(histogram.percentile(0.99) / 1000.0, 0, 'f', 1)
+            .arg(histogram.maximum() / 1000.0, 0, 'f', 1)
+            .arg(histogram.mean() / 1000.0, 0, 'f', 1)
+            .arg(histogram.count);
+    };
+
+    QStringList lines;
+    lines << QString("Probes sent:     %1 | In flight: %2")
+                 .arg(metrics.counter(ScanCounter::ProbesSent))
+                 .arg(metrics.counter(ScanCounter::InFlight));
+    lines << QString("Responses:       Open %1 | Closed %2 | Filtered %3 | Open|Filtered %4 | Unfiltered %5 | Error %6")
+                 .arg(metrics.counter(ScanCounter::ResponsesOpen))
+                 .arg(metrics.counter(ScanCounter::ResponsesClosed))
+                 .arg(metrics.counter(ScanCounter::ResponsesFiltered))
+                 .arg(metrics.counter(ScanCounter::ResponsesOpenFiltered))
+                 .arg(metrics.counter(ScanCounter::ResponsesUnfiltered))
+                 .arg(metrics.counter(ScanCounter::ResponsesError));
+    lines << QString("Timeouts:        %1 | Retransmits: %2 | Out of sockets: %3")
+                 .arg(metrics.counter(ScanCounter::Timeouts))
+                 .arg(metrics.counter(ScanCounter::Retransmits))
+                 .arg(metrics.counter(ScanCounter::ResourceExhausted));
+    SocketBudget *sockets = SocketBudget::instance();
+    lines << QString("Socket budget:   %1 of %2 in use (window %3)")
+                 .arg(sockets->inFlight()).arg(sockets->budget()).arg(sockets->window());
+    lines << latencyLine("Connect RTT:", metrics.histogram(ScanHistogram::ConnectRtt));
+    lines << latencyLine("Banner time:", metrics.histogram(ScanHistogram::BannerTime));
+
+    if (!metricsExporter->textfile().isEmpty()) {
+        lines << QString("Textfile:        %1").arg(metricsExporter->textfile());
+    }
+    if (metricsExporter->isServingHttp()) {
+        lines << QString("HTTP endpoint:   http://127.0.0.1:%1/metrics").arg(ui->spinBox_metricsPort->value());
     }
+
+    ui->plainTextEdit_metrics->setPlainText(lines.join('\n'));
+}
+
+void MainWindow::on_pushButton_exportMetrics_clicked()
+{
+    QString fileName = QFileDialog::getSaveFileName(this, "Export Metrics", "cyberscanner.prom",
+                                                    "Prometheus Textfile (*.prom)");
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    QString error;
+    if (!metricsExporter->writeTextfile(fileName, &error)) {
+        QMessageBox::warning(this, "Error", QString("Could not export metrics: %1").arg(error));
+        return;
+    }
+
+    metricsExporter->setTextfile(fileName);
+    addLogMessage(QString("Exporting metrics to: %1").arg(fileName));
+    updateMetricsPanel();
+}
+
+void MainWindow::on_checkBox_metricsHttp_toggled(bool checked)
+{
+    if (!checked) {
+        metricsExporter->stopHttp();
+        ui->spinBox_metricsPort->setEnabled(true);
+        addLogMessage("Metrics endpoint stopped");
+        updateMetricsPanel();
+        return;
+    }
+
+    QString error;
+    if (!metricsExporter->startHttp(ui->spinBox_metricsPort->value(), &error)) {
+        QMessageBox::warning(this, "Error", QString("Could not serve metrics: %1").arg(error));
+        QSignalBlocker blocker(ui->checkBox_metricsHttp);
+        ui->checkBox_metricsHttp->setChecked(false);
+        return;
+    }
+
+    ui->spinBox_metricsPort->setEnabled(false);
+    addLogMessage(QString("Serving metrics at http://127.0.0.1:%1/metrics").arg(ui->spinBox_metricsPort->value()));
+    updateMetricsPanel();
 }
 
 void MainWindow::clearResults()
 {
-    ui->tableWidget_results->setRowCount(0);
+    resultModel->clear();
     ui->progressBar->setValue(0);
     ui->label_status->setText("Status: Ready");
     ui->label_stats->setText("Scanned: 0 | Open: 0 | Time: 00:00");
+    scanResults.clear();
     scannedPorts = 0;
     openPorts = 0;
     totalPorts = 0;
@@ -912,97 +733,68 @@ void MainWindow::clearResults()
 
 void MainWindow::applyFilters()
 {
-    QString filterText = ui->lineEdit_filter->text().toLower();
     QString filterType = ui->comboBox_filterType->currentText();
+    ResultStateFilter stateFilter = ResultStateFilter::All;
+    if (filterType == "Open Only") {
+        stateFilter = ResultStateFilter::OpenOnly;
+    } else if (filterType == "Closed Only") {
+        stateFilter = ResultStateFilter::ClosedOnly;
+    }
 
-    for (int row = 0; row < ui->tableWidget_results->rowCount(); ++row) {
-        bool showRow = true;
-
-        if (!filterText.isEmpty()) {
-            bool matchFound = false;
-            for (int col = 0; col < ui->tableWidget_results->columnCount(); ++col) {
-                QTableWidgetItem *item = ui->tableWidget_results->item(row, col);
-                if (item && item->text().toLower().contains(filterText)) {
-                    matchFound = true;
-                    break;
-                }
-            }
-            if (!matchFound) showRow = false;
-        }
-
-        if (showRow && filterType != "All") {
-            QTableWidgetItem *statusItem = ui->tableWidget_results->item(row, 2);
-            if (statusItem) {
-                QString status = statusItem->text();
-                if (filterType == "Open Only" && status != "Open") {
-                    showRow = false;
-                } else if (filterType == "Closed Only" && status != "Closed") {
-                    showRow = false;
-                }
-            }
-        }
-
-        ui->tableWidget_results->setRowHidden(row, !showRow);
+    // A query that doesn't parse leaves the previous filter in place, so the
+    // table doesn't flicker while a term is half typed.
+    ResultQuery query;
+    QString error;
+    if (!ResultQuery::parse(ui->lineEdit_filter->text(), query, &error)) {
+        ui->lineEdit_filter->setToolTip(error);
+        return;
     }
+    ui->lineEdit_filter->setToolTip(QString());
+    resultModel->setFilter(query, stateFilter);
 }
 
-void MainWindow::addLogMessage(const QString &message)
+void MainWindow::addLogMessage(const QString &message, LogLevel level)
 {
-    QString timestamp = QDateTime::currentDateTime().toString("hh:mm:ss");
-    QString logEntry = QString("[%1] %2").arg(timestamp, message);
-
-    ui->textEdit_log->append(logEntry);
-
-    if (ui->checkBox_autoScroll->isChecked()) {
-        QTextCursor cursor = ui->textEdit_log->textCursor();
-        cursor.movePosition(QTextCursor::End);
-        ui->textEdit_log->setTextCursor(cursor);
-    }
+    scanLog.append(level, message);
 }
 
-QList<int> MainWindow::parsePortRange(const QString &portString)
-{
-    QList<int> ports;
-    QStringList parts = portString.split(',', Qt::SkipEmptyParts);
-
-    for (const QString &part : parts) {
-        QString trimmed = part.trimmed();
-        if (trimmed.contains('-')) {
-            QStringList range = trimmed.split('-');
-            if (range.size() == 2) {
-                bool ok1, ok2;
-                int start = range[0].toInt(&ok1);
-                int end = range[1].toInt(&ok2);
-                if (ok1 && ok2 && start <= end && start >= 1 && end <= 65535) {
-                    for (int i = start; i <= end; i++) {
-                        if (!ports.contains(i)) {
-                            ports.append(i);
-                        }
-                    }
-                }
-            }
-        } else {
-            bool ok;
-            int port = trimmed.toInt(&ok);
-            if (ok && port >= 1 && port <= 65535 && !ports.contains(port)) {
-                ports.append(port);
-            }
-        }
+void MainWindow::flushLogView()
+{
+    QVector<LogEntry> entries;
+    quint64 dropped = 0;
+    logViewSequence = scanLog.drain(logViewSequence, entries, &dropped);
+    if (!entries.isEmpty() || dropped) {
+        appendLogEntries(entries, dropped);
     }
-
-    std::sort(ports.begin(), ports.end());
-    return ports;
 }
 
-bool MainWindow::isValidTarget(const QString &target)
+void MainWindow::appendLogEntries(const QVector<LogEntry> &entries, quint64 dropped)
 {
-    QHostAddress address(target);
-    if (!address.isNull()) {
-        return true;
+    LogLevel minimum = LogLevel(ui->comboBox_logLevel->currentIndex());
+    int limit = ui->plainTextEdit_log->maximumBlockCount();
+
+    // Only the last `limit` matching lines can survive in the panel anyway.
+    QStringList lines;
+    for (int i = entries.size() - 1; i >= 0 && lines.size() < limit; --i) {
+        if (entries[i].level >= minimum) {
+            lines.prepend(entries[i].format());
+        }
+    }
+    if (dropped) {
+        lines.prepend(QString("... %1 messages not shown, use Save Log for the full log").arg(dropped));
+    }
+    if (lines.isEmpty()) {
+        return;
     }
 
-    QRegularExpression hostnameRegex("^[a-zA-Z0-9]([a-zA-Z0-9\\-]{0,61}[a-zA-Z0-9])?(\\.[a-zA-Z0-9]([a-zA-Z0-9\\-]{0,61}[a-zA-Z0-9])?)*$");
-    return hostnameRegex.match(target).hasMatch();
+    QScrollBar *scrollBar = ui->plainTextEdit_log->verticalScrollBar();
+    int position = scrollBar->value();
+    ui->plainTextEdit_log->appendPlainText(lines.join('\n'));
+    if (ui->checkBox_autoScroll->isChecked()) {
+        scrollBar->setValue(scrollBar->maximum());
+    } else {
+        scrollBar->setValue(position);
+    }
 }
 
 void MainWindow::applyTargetPreset(const QString &preset)
@@ -1055,31 +847,185 @@ void MainWindow::on_actionGithub_triggered()
     openGithub();
 }
 
-void MainWindow::onPortResult(int port, const QString &status, const QString &service, const QString &banner, int responseTime)
+void MainWindow::onPortResults(const QVector<ProbeResult> &results)
+{
+    for (const ProbeResult &result : results) {
+        if (result.state == PortState::Open) {
+            openPorts++;
+        }
+    }
+    addResults(currentTarget, currentScanType == ScanType::UDP_SCAN ? PortProtocol::UDP : PortProtocol::TCP, results);
+}
+
+void MainWindow::addResults(const QString &host, PortProtocol protocol, const QVector<ProbeResult> &results)
+{
+    resultModel->appendResults(host, protocol, results);
+    scheduleResultColumnResize();
+
+    // A line per result costs the GUI thread a format and a locked log
+    // write each, and floods the ring; only when the log shows Debug.
+    const bool logEach = LogLevel(ui->comboBox_logLevel->currentIndex()) == LogLevel::Debug;
+    const QString protocolName = protocol == PortProtocol::UDP ? "udp" : "tcp";
+    for (const ProbeResult &result : results) {
+        if (logEach) {
+            addLogMessage(QString("%1:%2/%3 %4 (%5 ms)")
+                              .arg(host).arg(result.port).arg(protocolName).arg(portStateName(result.state))
+                              .arg(result.responseTime),
+                          LogLevel::Debug);
+        }
+        scanResults.addResult(host, result.port, protocol, result.state, result.banner, result.responseTime);
+    }
+}
+
+void MainWindow::scheduleResultColumnResize()
+{
+    // At most once a second, and only over a sample of rows.
+    if (resultResizePending) return;
+
+    resultResizePending = true;
+    QTimer::singleShot(ResultResizeIntervalMs, this, [this]() {
+        resultResizePending = false;
+        ui->tableView_results->resizeColumnsToContents();
+    });
+}
+
+void MainWindow::on_actionSaveResults_triggered()
+{
+    if (scanResults.count() == 0) {
+        QMessageBox::information(this, "Save Results", "There are no results to save.");
+        return;
+    }
+
+    QString fileName = QFileDialog::getSaveFileName(this, "Save Results", "", "CyberScanner Results (*.csr)");
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    QString error;
+    if (scanResults.write(fileName, &error)) {
+        addLogMessage(QString("Saved %1 results to: %2").arg(scanResults.count()).arg(fileName));
+    } else {
+        QMessageBox::warning(this, "Error", QString("Could not save results: %1").arg(error));
+    }
+}
+
+void MainWindow::on_actionCompareResults_triggered()
+{
+    if (scanResults.count() == 0) {
+        QMessageBox::information(this, "Compare Results", "Run a scan first to compare against saved results.");
+        return;
+    }
+
+    QString fileName = QFileDialog::getOpenFileName(this, "Compare With Saved Results", "", "CyberScanner Results (*.csr)");
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    ResultStore previous;
+    if (!previous.open(fileName)) {
+        QMessageBox::warning(this, "Error", QString("Could not open results: %1").arg(previous.errorString()));
+        return;
+    }
+
+    ResultStore current;
+    current.openBuffer(scanResults.toByteArray());
+
+    addLogMessage(QString("=== Comparing with %1 (%2) ===")
+                      .arg(fileName, QDateTime::fromMSecsSinceEpoch(previous.createdMs()).toString("yyyy-MM-dd hh:mm:ss")));
+
+    ResultDiffSummary summary = diffResultStores(previous, current, [this](const ResultChange &change) {
+        QString where = QString("%1:%2/%3").arg(change.host).arg(change.port)
+                            .arg(change.protocol == PortProtocol::UDP ? "udp" : "tcp");
+        switch (change.type) {
+        case ResultChange::Opened:
+            addLogMessage(QString("Newly open: %1").arg(where));
+            break;
+        case ResultChange::Closed:
+            addLogMessage(QString("Closed: %1 (now %2)").arg(where, portStateName(change.newState)));
+            break;
+        case ResultChange::BannerChanged:
+            addLogMessage(QString("Banner changed: %1 \"%2\" -> \"%3\"").arg(where, change.oldBanner, change.newBanner));
+            break;
+        }
+    });
+
+    addLogMessage(QString("Compared %1 ports: %2 newly open, %3 closed, %4 banner changes")
+                      .arg(summary.compared).arg(summary.opened).arg(summary.closed).arg(summary.bannerChanged));
+    QMessageBox::information(this, "Compare Results",
+                             QString("Newly open: %1\nClosed: %2\nBanner changed: %3")
+                                 .arg(summary.opened).arg(summary.closed).arg(summary.bannerChanged));
+}
+
+void MainWindow::on_actionLearnPortOrder_triggered()
 {
-    int row = ui->tableWidget_results->rowCount();
-    ui->tableWidget_results->insertRow(row);
+    const QStringList fileNames = QFileDialog::getOpenFileNames(this, "Learn Port Order From Saved Results", "",
+                                                                "CyberScanner Results (*.csr)");
+    if (fileNames.isEmpty()) {
+        return;
+    }
 
-    QString protocol = (currentScanType == ScanType::UDP_SCAN) ? "UDP" : "TCP";
+    // Scans already running keep the order they started with, so the
+    // priors they hold are left alone and new ones replace them.
+    QSharedPointer<PortPriors> tcp = QSharedPointer<PortPriors>::create(*tcpPriors);
+    QSharedPointer<PortPriors> udp = QSharedPointer<PortPriors>::create(*udpPriors);
+    for (const QString &fileName : fileNames) {
+        ResultStore store;
+        if (!store.open(fileName)) {
+            QMessageBox::warning(this, "Error", QString("Could not open %1: %2").arg(fileName, store.errorString()));
+            return;
+        }
+        tcp->learn(store);
+        udp->learn(store);
+    }
+    tcpPriors = tcp;
+    udpPriors = udp;
 
-    ui->tableWidget_results->setItem(row, 0, new QTableWidgetItem(QString::number(port)));
-    ui->tableWidget_results->setItem(row, 1, new QTableWidgetItem(protocol));
-    ui->tableWidget_results->setItem(row, 2, new QTableWidgetItem(status));
-    ui->tableWidget_results->setItem(row, 3, new QTableWidgetItem(service));
-    ui->tableWidget_results->setItem(row, 4, new QTableWidgetItem(banner));
-    ui->tableWidget_results->setItem(row, 5, new QTableWidgetItem(QString::number(responseTime) + " ms"));
+    addLogMessage(QString("Port order now learned from %1 host scans (%2 hosts) of TCP and %3 of UDP")
+                      .arg(tcpPriors->hostScans()).arg(tcpPriors->hostCount()).arg(udpPriors->hostScans()));
+    if (!ui->checkBox_likelyFirst->isChecked()) {
+        ui->checkBox_likelyFirst->setChecked(true);
+    }
+}
 
-    QTableWidgetItem *statusItem = ui->tableWidget_results->item(row, 2);
-    if (status == "Open") {
-        statusItem->setBackground(QBrush(QColor(144, 238, 144)));
-        openPorts++;
-    } else if (status == "Closed") {
-        statusItem->setBackground(QBrush(QColor(255, 182, 193)));
+void MainWindow::on_actionRecordTrace_toggled(bool checked)
+{
+    ProbeTracer *tracer = ProbeTracer::instance();
+    if (checked) {
+        tracer->clear();
+        tracer->setEnabled(true);
+        addLogMessage("Probe trace recording started");
     } else {
-        statusItem->setBackground(QBrush(QColor(255, 255, 224)));
+        tracer->setEnabled(false);
+        addLogMessage(QString("Probe trace recording stopped (%1 events)").arg(tracer->eventCount()));
+    }
+}
+
+void MainWindow::on_actionExportTrace_triggered()
+{
+    // Workers write their rings without locks, so stop recording before
+    // reading them back.
+    if (ui->actionRecordTrace->isChecked()) {
+        ui->actionRecordTrace->setChecked(false);
+    }
+
+    ProbeTracer *tracer = ProbeTracer::instance();
+    if (tracer->eventCount() == 0) {
+        QMessageBox::information(this, "Export Probe Trace",
+                                 "No trace events recorded. Enable File > Record Probe Trace and run a scan first.");
+        return;
     }
 
-    ui->tableWidget_results->resizeColumnsToContents();
+    QString fileName = QFileDialog::getSaveFileName(this, "Export Probe Trace", "", "Chrome Trace (*.json)");
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    QString error;
+    if (tracer->exportChromeTrace(fileName, &error)) {
+        addLogMessage(QString("Probe trace exported to: %1 (open in ui.perfetto.dev or chrome://tracing)").arg(fileName));
+    } else {
+        QMessageBox::warning(this, "Error", QString("Could not export trace: %1").arg(error));
+    }
 }
 
 void MainWindow::openGithub()
@@ -1104,88 +1050,6 @@ void MainWindow::showAbout()
                        "Copyright © 2024");
 }
 
-QString PortScanner::buildNmapCommand(const QString &target, const QList<int> &ports)
-{
-    QString command = "nmap";
-
-    switch (scanType) {
-    case ScanType::TCP_SYN:
-        command += " -sS";
-        break;
-    case ScanType::UDP_SCAN:
-        command += " -sU";
-        break;
-    case ScanType::TCP_FIN:
-        command += " -sF";
-        break;
-    case ScanType::TCP_XMAS:
-        command += " -sX";
-        break;
-    case ScanType::TCP_NULL:
-        command += " -sN";
-        break;
-    case ScanType::TCP_ACK:
-        command += " -sA";
-        break;
-    case ScanType::TCP_WINDOW:
-        command += " -sW";
-        break;
-    default:
-        command += " -sT";
-        break;
-    }
-
-    switch (timingTemplate) {
-    case TimingTemplate::T0_PARANOID:
-        command += " -T0";
-        break;
-    case TimingTemplate::T1_SNEAKY:
-        command += " -T1";
-        break;
-    case TimingTemplate::T2_POLITE:
-        command += " -T2";
-        break;
-    case TimingTemplate::T3_NORMAL:
-        command += " -T3";
-        break;
-    case TimingTemplate::T4_AGGRESSIVE:
-        command += " -T4";
-        break;
-    case TimingTemplate::T5_INSANE:
-        command += " -T5";
-        break;
-    }
-
-    if (enableServiceDetection) {
-        command += " -sV";
-    }
-
-    if (enableOSDetection) {
-        command += " -O";
-    }
-
-    if (enableAggressiveScan) {
-        command += " -A";
-    }
-
-    if (!ports.isEmpty()) {
-        command += " -p ";
-        QStringList portStrings;
-        for (int port : ports) {
-            portStrings << QString::number(port);
-        }
-        command += portStrings.join(",");
-    }
-
-    command += " " + target;
-
-    return command;
-}
-
 #include "mainwindow.h"
 #include <QBrush>
 #include <QColor>
-
-
-
-#include "mainwindow.moc"
@@ -25,6 +25,15 @@
 #include <QRunnable>
 #include <QMutexLocker>
 #include <QProcess>
+#include <QHash>
+#include "portpriors.h"
+#include "portscanner.h"
+#include "probedispatcher.h"
+#include "resultstore.h"
+#include "resulttablemodel.h"
+#include "scanjobqueue.h"
+#include "scanlog.h"
+#include "scanmetrics.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -32,29 +41,6 @@ class MainWindow;
 }
 QT_END_NAMESPACE
 
-enum class ScanType {
-    TCP_CONNECT,
-    TCP_SYN,
-    UDP_SCAN,
-    TCP_FIN,
-    TCP_XMAS,
-    TCP_NULL,
-    TCP_ACK,
-    TCP_WINDOW
-};
-
-enum class TimingTemplate {
-    T0_PARANOID,
-    T1_SNEAKY,
-    T2_POLITE,
-    T3_NORMAL,
-    T4_AGGRESSIVE,
-    T5_INSANE
-};
-
-class PortScanner;
-class PortScanTask;
-
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
@@ -66,6 +52,12 @@ private slots:
 
     void on_actionAbout_triggered();
     void on_actionGithub_triggered();
+    void on_actionSaveResults_triggered();
+    void on_actionCompareResults_triggered();
+    void on_actionLearnPortOrder_triggered();
+    void on_actionVerifyImport_triggered();
+    void on_actionRecordTrace_toggled(bool checked);
+    void on_actionExportTrace_triggered();
 
     void on_comboBox_presets_currentTextChanged(const QString &text);
     void on_comboBox_portPresets_currentTextChanged(const QString &text);
@@ -75,32 +67,71 @@ private slots:
     void on_checkBox_osDetection_toggled(bool checked);
     void on_checkBox_aggressiveScan_toggled(bool checked);
     void on_checkBox_detectService_toggled(bool checked);
+    void on_checkBox_nmapEngine_toggled(bool checked);
 
     void on_pushButton_start_clicked();
     void on_pushButton_stop_clicked();
+    void on_pushButton_pause_clicked();
+    void on_pushButton_queue_clicked();
+    void on_pushButton_pauseJob_clicked();
+    void on_pushButton_cancelJob_clicked();
+    void on_spinBox_rateLimit_valueChanged(int value);
+    void on_spinBox_hostProbes_valueChanged(int value);
+    void on_spinBox_hostDelay_valueChanged(int value);
+    void on_spinBox_hostsAtOnce_valueChanged(int value);
+    void on_spinBox_engineSlots_valueChanged(int value);
+    void on_doubleSpinBox_earlyStop_valueChanged(double value);
+    void on_spinBox_deadline_valueChanged(int value);
     void on_pushButton_clear_clicked();
     void on_pushButton_clearLog_clicked();
     void on_pushButton_saveLog_clicked();
+    void on_comboBox_logLevel_currentIndexChanged(int index);
+    void on_pushButton_exportMetrics_clicked();
+    void on_checkBox_metricsHttp_toggled(bool checked);
 
     void on_lineEdit_filter_textChanged(const QString &text);
     void on_comboBox_filterType_currentTextChanged(const QString &text);
 
     void onScanStarted();
     void onScanFinished();
+    void onScanPaused(bool paused);
     void onScanProgress(int current, int total);
-    void onPortResult(int port, const QString &status, const QString &service, const QString &banner, int responseTime);
+    void onScanForecast(const ScanForecast &forecast);
+    void onPortResults(const QVector<ProbeResult> &results);
     void onScanError(const QString &error);
-    void onLogMessage(const QString &message);
+    void onLogMessage(const QString &message, LogLevel level);
     void onOSDetectionResult(const QString &osInfo);
+    void onJobAdded(int id);
+    void onJobChanged(int id);
+    void onJobResults(int id, const QString &host, const QVector<ProbeResult> &results);
 
 private:
     Ui::MainWindow *ui;
+    QSharedPointer<ProbeDispatcher> probeEngine;
     PortScanner *scanner;
+    ScanJobQueue *jobQueue;
+    QHash<int, int> jobRows;
+    // Learned from saved results; empty ones still rank common ports first.
+    QSharedPointer<PortPriors> tcpPriors;
+    QSharedPointer<PortPriors> udpPriors;
     QTimer *updateTimer;
     QElapsedTimer scanTimer;
     int totalPorts;
     int scannedPorts;
     int openPorts;
+    // Set by the first forecast of a scan with a deadline, which then owns
+    // the progress bar.
+    bool forecasting;
+    QString currentTarget;
+    ResultStoreWriter scanResults;
+    ResultTableModel *resultModel;
+    bool resultResizePending;
+    MetricsExporter *metricsExporter;
+    MetricsSnapshot scanStartMetrics;
+    ScanLog scanLog;
+    QTimer *logFlushTimer;
+    quint64 logViewSequence;
+    quint64 logClearedSequence;
 
     ScanType currentScanType;
     TimingTemplate currentTiming;
@@ -112,76 +143,28 @@ private:
     void openGithub();
     void addSampleResults();
     void updateUI();
+    void updateMetricsPanel();
     void clearResults();
     void applyFilters();
+    void addResults(const QString &host, PortProtocol protocol, const QVector<ProbeResult> &results);
+    void scheduleResultColumnResize();
+    bool readScanForm(QStringList &targets, PortSet &ports);
+    void queueScanJobs(const QStringList &targets, const PortSet &ports);
+    QSharedPointer<const PortPriors> scanPriors() const;
+    int selectedJobId() const;
 
     void applyTargetPreset(const QString &preset);
     void applyPortPreset(const QString &preset);
 
-    QList<int> parsePortRange(const QString &portString);
-    bool isValidTarget(const QString &target);
-
     ScanType getScanTypeFromCombo();
     TimingTemplate getTimingFromCombo();
 
     // Logging
-    void addLogMessage(const QString &message);
+    void addLogMessage(const QString &message, LogLevel level = LogLevel::Info);
+    void flushLogView();
+    void appendLogEntries(const QVector<LogEntry> &entries, quint64 dropped);
 
 
 };
 
-class PortScanner : public QObject
-{
-    Q_OBJECT
-public:
-    explicit PortScanner(QObject *parent = nullptr);
-    ~PortScanner();
-
-    void startScan(const QString &target, const QList<int> &ports, ScanType scanType,
-                   TimingTemplate timing, bool serviceDetection, bool osDetection, bool aggressive);
-    void stopScan();
-    bool isScanning() const;
-
-public slots:
-    void portScanned(int port, const QString &status, const QString &service,
-                     const QString &banner, int responseTime);
-
-signals:
-    void scanStarted();
-    void scanFinished();
-    void scanProgress(int current, int total);
-    void portResult(int port, const QString &status, const QString &service, const QString &banner, int responseTime);
-    void scanError(const QString &error);
-    void logMessage(const QString &message);
-    void osDetectionResult(const QString &osInfo);
-
-private slots:
-    void onNmapFinished(int exitCode, QProcess::ExitStatus exitStatus);
-
-private:
-    QString targetHost;
-    QList<int> portList;
-    bool scanning;
-    int connectionTimeout;
-    int completedScans;
-
-    ScanType scanType;
-    TimingTemplate timingTemplate;
-    bool enableServiceDetection;
-    bool enableOSDetection;
-    bool enableAggressiveScan;
-
-    QProcess *nmapProcess;
-
-    void performOSDetection(const QString &target);
-    void performServiceDetection(const QString &target, const QList<int> &openPorts);
-    QString buildNmapCommand(const QString &target, const QList<int> &ports);
-    int getTimeoutFromTiming(TimingTemplate timing); // Added this declaration
-
-    int getOptimalThreadCount(TimingTemplate timing, ScanType scanType);
-    QString getScanTypeName(ScanType scanType);
-    bool tryNmapOSDetection(const QString &target);
-    void performSimpleOSDetection(const QString &target);
-};
-
 #endif
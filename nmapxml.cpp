@@ -0,0 +1,183 @@
+#include "nmapxml.h"
+
+// nmap's state names, including the ambiguous ones its stealth scans report.
+static PortState stateFromNmap(const QString &state)
+{
+    if (state == QLatin1String("open")) return PortState::Open;
+    if (state == QLatin1String("closed")) return PortState::Closed;
+    if (state == QLatin1String("filtered")) return PortState::Filtered;
+    if (state == QLatin1String("unfiltered")) return PortState::Unfiltered;
+    if (state == QLatin1String("open|filtered")) return PortState::OpenFiltered;
+    if (state == QLatin1String("closed|filtered")) return PortState::Filtered;
+    return PortState::Error;
+}
+
+NmapXmlParser::NmapXmlParser()
+{
+    clear();
+}
+
+void NmapXmlParser::clear()
+{
+    reader.clear();
+    hosts.clear();
+    host = NmapHostReport();
+    port = ProbeResult();
+    inHost = false;
+    inPort = false;
+    portWanted = false;
+    srttMs = 0;
+    currentTask.clear();
+    taskPercent = 0.0;
+    finished = false;
+    error.clear();
+}
+
+void NmapXmlParser::setProtocol(const QString &protocol)
+{
+    wantedProtocol = protocol;
+}
+
+void NmapXmlParser::addData(const QByteArray &data)
+{
+    if (hasError()) return;
+
+    reader.addData(data);
+    while (!reader.atEnd()) {
+        switch (reader.readNext()) {
+        case QXmlStreamReader::StartElement:
+            startElement();
+            break;
+        case QXmlStreamReader::EndElement:
+            endElement();
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Running out of input mid-element just means nmap hasn't written the rest.
+    if (reader.hasError() && reader.error() != QXmlStreamReader::PrematureEndOfDocumentError) {
+        error = QString("nmap XML, line %1: %2").arg(reader.lineNumber()).arg(reader.errorString());
+    }
+}
+
+void NmapXmlParser::startElement()
+{
+    const QString name = reader.name().toString();
+    const QXmlStreamAttributes attributes = reader.attributes();
+
+    if (name == QLatin1String("host")) {
+        host = NmapHostReport();
+        inHost = true;
+        srttMs = 0;
+    } else if (name == QLatin1String("taskbegin")) {
+        currentTask = attributes.value("task").toString();
+        taskPercent = 0.0;
+    } else if (name == QLatin1String("taskprogress")) {
+        currentTask = attributes.value("task").toString();
+        taskPercent = attributes.value("percent").toDouble();
+    } else if (name == QLatin1String("taskend")) {
+        taskPercent = 100.0;
+    } else if (name == QLatin1String("finished")) {
+        if (attributes.value("exit") == QLatin1String("error")) {
+            error = attributes.value("errormsg").toString();
+            if (error.isEmpty()) {
+                error = "nmap reported an error";
+            }
+        }
+    } else if (!inHost) {
+        return;
+    } else if (name == QLatin1String("address")) {
+        // Hosts on the local link carry a MAC address as well.
+        if (attributes.value("addrtype") != QLatin1String("mac") && host.address.isEmpty()) {
+            host.address = attributes.value("addr").toString();
+        }
+    } else if (name == QLatin1String("port")) {
+        port = ProbeResult();
+        port.port = attributes.value("portid").toInt();
+        portWanted = wantedProtocol.isEmpty() || attributes.value("protocol") == wantedProtocol;
+        inPort = true;
+    } else if (inPort && name == QLatin1String("state")) {
+        port.state = stateFromNmap(attributes.value("state").toString());
+        bool ok = false;
+        int ttl = attributes.value("reason_ttl").toInt(&ok);
+        if (ok && ttl > 0 && port.state == PortState::Open) {
+            port.fingerprint.ttl = qint16(ttl);
+        }
+    } else if (inPort && name == QLatin1String("service")) {
+        port.service = attributes.value("name").toString();
+        QStringList parts;
+        for (const char *field : {"product", "version", "extrainfo"}) {
+            const QString value = attributes.value(field).toString();
+            if (!value.isEmpty()) {
+                parts << value;
+            }
+        }
+        port.banner = parts.join(' ');
+    } else if (name == QLatin1String("extraports")) {
+        NmapHostReport::ExtraPorts extra;
+        extra.state = stateFromNmap(attributes.value("state").toString());
+        extra.count = attributes.value("count").toInt();
+        host.extraPorts.append(extra);
+    } else if (name == QLatin1String("osmatch")) {
+        host.osMatches << QString("%1 (%2%)").arg(attributes.value("name").toString(),
+                                                  attributes.value("accuracy").toString());
+    } else if (name == QLatin1String("times")) {
+        // Microseconds, smoothed over the host's probes.
+        srttMs = attributes.value("srtt").toInt() / 1000;
+    }
+}
+
+void NmapXmlParser::endElement()
+{
+    const QString name = reader.name().toString();
+
+    if (name == QLatin1String("nmaprun")) {
+        finished = true;
+    } else if (inPort && name == QLatin1String("port")) {
+        if (portWanted) {
+            host.ports.append(port);
+        }
+        inPort = false;
+    } else if (inHost && name == QLatin1String("host")) {
+        // <times> comes after <ports>, so the RTT is only known here.
+        for (ProbeResult &result : host.ports) {
+            result.responseTime = srttMs;
+        }
+        hosts.append(host);
+        inHost = false;
+    }
+}
+
+QVector<NmapHostReport> NmapXmlParser::takeHosts()
+{
+    QVector<NmapHostReport> taken;
+    taken.swap(hosts);
+    return taken;
+}
+
+QString NmapXmlParser::task() const
+{
+    return currentTask;
+}
+
+double NmapXmlParser::percent() const
+{
+    return taskPercent;
+}
+
+bool NmapXmlParser::isFinished() const
+{
+    return finished;
+}
+
+bool NmapXmlParser::hasError() const
+{
+    return !error.isEmpty();
+}
+
+QString NmapXmlParser::errorString() const
+{
+    return error;
+}
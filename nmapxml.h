@@ -0,0 +1,72 @@
+#ifndef NMAPXML_H
+#define NMAPXML_H
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QXmlStreamReader>
+#include "resultring.h"
+
+// One <host> element of nmap's XML output, complete with its ports.
+struct NmapHostReport
+{
+    QString address;
+    QVector<ProbeResult> ports;
+    // Ports nmap summarised in <extraports> instead of listing them.
+    struct ExtraPorts
+    {
+        PortState state = PortState::Filtered;
+        int count = 0;
+    };
+    QVector<ExtraPorts> extraPorts;
+    // "Linux 5.0 - 5.14 (98%)", best first.
+    QStringList osMatches;
+};
+
+// Reads nmap's -oX output as it arrives. Feed it whatever the process wrote;
+// a host is handed out as soon as its element closes, which nmap writes only
+// once it is done with that host, so results don't wait for the whole run.
+class NmapXmlParser
+{
+public:
+    NmapXmlParser();
+
+    void addData(const QByteArray &data);
+    void clear();
+
+    // Only ports of this protocol ("tcp", "udp") are reported; empty for all.
+    void setProtocol(const QString &protocol);
+
+    // Hosts completed since the last call.
+    QVector<NmapHostReport> takeHosts();
+
+    // From the latest <taskprogress>; each nmap phase starts again at 0.
+    QString task() const;
+    double percent() const;
+
+    // </nmaprun> was seen.
+    bool isFinished() const;
+    bool hasError() const;
+    QString errorString() const;
+
+private:
+    void startElement();
+    void endElement();
+
+    QXmlStreamReader reader;
+    QVector<NmapHostReport> hosts;
+    NmapHostReport host;
+    ProbeResult port;
+    bool inHost;
+    bool inPort;
+    bool portWanted;
+    QString wantedProtocol;
+    int srttMs;
+
+    QString currentTask;
+    double taskPercent;
+    bool finished;
+    QString error;
+};
+
+#endif
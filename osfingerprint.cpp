@@ -0,0 +1,252 @@
+#include "osfingerprint.h"
+#include <QHash>
+#include <algorithm>
+
+// Enough ports to outvote a middlebox answering for a few of them.
+static const int MaxFingerprints = 64;
+static const int MaxBanners = 32;
+
+static const int TtlWeight = 3;
+static const int WindowWeight = 2;
+static const int OptionsWeight = 2;
+static const int WindowScaleWeight = 3;
+static const int MssWeight = 1;
+static const int DontFragmentWeight = 1;
+static const int BannerWeight = 4;
+static const int PortsWeight = 2;
+static const int MinComparedWeight = 6;
+
+static const int TS = TcpFingerprint::Timestamps;
+static const int SACK = TcpFingerprint::Sack;
+static const int WS = TcpFingerprint::WindowScale;
+
+// SYN-ACK as each stack sends it by default; -1 is "varies". Windows leaves
+// timestamps off, Linux scales by 7, the BSDs and Apple by 6. Order breaks
+// ties, so the likelier of two lookalikes comes first.
+struct SignatureEntry
+{
+    const char *name;
+    const char *family;
+    int ttl;
+    int window;
+    int options;
+    int windowScale;
+    int mss;
+    int dontFragment;
+    const char *banner;
+    const char *ports;
+};
+
+static const char *const LinuxBanner = "Linux|Ubuntu|Debian|CentOS|Red Hat|RHEL|\\.el[6-9]|Fedora|Alpine|SUSE|Raspbian";
+static const char *const WindowsBanner = "Microsoft|Windows|IIS/|Win32|Win64|MSRPC";
+static const char *const WindowsPorts = "135,139,445,3389,5985";
+
+static const SignatureEntry Signatures[] = {
+    { "Linux 5.x-6.x", "Linux", 64, 65160, TS | SACK | WS, 7, 1460, 1, LinuxBanner, nullptr },
+    { "Linux 3.x-4.x", "Linux", 64, 28960, TS | SACK | WS, 7, 1460, 1, LinuxBanner, nullptr },
+    { "Windows 10/11, Server 2016+", "Windows", 128, 65535, SACK | WS, 8, 1460, 1, WindowsBanner, WindowsPorts },
+    { "Windows 7/8, Server 2008/2012", "Windows", 128, 8192, SACK | WS, 8, 1460, 1, WindowsBanner, WindowsPorts },
+    { "macOS", "macOS", 64, 65535, TS | SACK | WS, 6, 1460, 1, "Darwin|Mac ?OS|macOS", "88,548,3283" },
+    { "iOS/iPadOS", "iOS", 64, 65535, TS | SACK | WS, 6, 1460, 1, nullptr, "62078" },
+    { "FreeBSD", "BSD", 64, 65535, TS | SACK | WS, 6, 1460, 1, "FreeBSD", nullptr },
+    { "OpenBSD", "BSD", 64, 16384, TS | SACK | WS, -1, 1460, 1, "OpenBSD", nullptr },
+    { "Embedded Linux (router, NAS, camera)", "Linux", 64, 5840, TS | SACK | WS, -1, 1460, 1,
+      "dropbear|BusyBox|lighttpd|mini_httpd|uhttpd|GoAhead|Boa/|MikroTik|RouterOS|OpenWrt", nullptr },
+    { "Solaris/illumos", "Solaris", -1, -1, -1, -1, -1, 1, "SunOS|Solaris|illumos|SmartOS", nullptr },
+    { "Cisco IOS", "Cisco", 255, 4128, 0, -1, 536, -1, "Cisco", nullptr },
+};
+
+// TTLs start at 32, 64, 128 or 255 and only go down on the way.
+static int initialTtl(int ttl)
+{
+    if (ttl < 0) return -1;
+    if (ttl <= 32) return 32;
+    if (ttl <= 64) return 64;
+    if (ttl <= 128) return 128;
+    return 255;
+}
+
+static QString optionNames(int options)
+{
+    QStringList names;
+    if (options & TS) names << "timestamps";
+    if (options & SACK) names << "SACK";
+    if (options & WS) names << "window scaling";
+    return names.isEmpty() ? QString("no TCP options") : names.join(", ");
+}
+
+static int mostCommon(const QVector<int> &values)
+{
+    QHash<int, int> counts;
+    int best = -1;
+    int bestCount = 0;
+    for (int value : values) {
+        if (value < 0) continue;
+        int count = ++counts[value];
+        if (count > bestCount) {
+            best = value;
+            bestCount = count;
+        }
+    }
+    return best;
+}
+
+QString OsGuess::toString() const
+{
+    QString text = QString("%1 (%2%)").arg(name).arg(score);
+    if (!reasons.isEmpty()) {
+        text += ": " + reasons.join(", ");
+    }
+    return text;
+}
+
+void OsEvidence::add(const ProbeResult &result)
+{
+    if (result.state != PortState::Open) return;
+
+    open.insert(result.port);
+    if (result.fingerprint.isValid() && fingerprints.size() < MaxFingerprints) {
+        fingerprints.append(result.fingerprint);
+    }
+    if (!result.banner.isEmpty() && bannerList.size() < MaxBanners) {
+        bannerList.append(result.banner);
+    }
+}
+
+void OsEvidence::clear()
+{
+    open.clear();
+    fingerprints.clear();
+    bannerList.clear();
+}
+
+bool OsEvidence::isEmpty() const
+{
+    return open.isEmpty();
+}
+
+PortSet OsEvidence::openPorts() const
+{
+    return open;
+}
+
+QStringList OsEvidence::banners() const
+{
+    return bannerList;
+}
+
+TcpFingerprint OsEvidence::consensus() const
+{
+    QVector<int> ttls, windows, mss, options, scales, dontFragment;
+    for (const TcpFingerprint &fingerprint : fingerprints) {
+        ttls.append(initialTtl(fingerprint.ttl));
+        windows.append(fingerprint.window);
+        mss.append(fingerprint.mss);
+        options.append(fingerprint.options);
+        scales.append(fingerprint.windowScale);
+        dontFragment.append(fingerprint.dontFragment);
+    }
+
+    TcpFingerprint result;
+    result.ttl = qint16(mostCommon(ttls));
+    result.window = mostCommon(windows);
+    result.mss = mostCommon(mss);
+    result.options = qint8(mostCommon(options));
+    result.windowScale = qint8(mostCommon(scales));
+    result.dontFragment = qint8(mostCommon(dontFragment));
+    return result;
+}
+
+const OsFingerprintDatabase &OsFingerprintDatabase::builtin()
+{
+    static const OsFingerprintDatabase database;
+    return database;
+}
+
+OsFingerprintDatabase::OsFingerprintDatabase()
+{
+    for (const SignatureEntry &entry : Signatures) {
+        Signature signature;
+        signature.name = entry.name;
+        signature.family = entry.family;
+        signature.fingerprint.ttl = qint16(entry.ttl);
+        signature.fingerprint.window = entry.window;
+        signature.fingerprint.options = qint8(entry.options);
+        signature.fingerprint.windowScale = qint8(entry.windowScale);
+        signature.fingerprint.mss = entry.mss;
+        signature.fingerprint.dontFragment = qint8(entry.dontFragment);
+        if (entry.banner) {
+            signature.banner = QRegularExpression(entry.banner, QRegularExpression::CaseInsensitiveOption);
+            signature.banner.optimize();
+        }
+        if (entry.ports) {
+            PortSet::parse(entry.ports, signature.ports);
+        }
+        signatures.append(signature);
+    }
+}
+
+QVector<OsGuess> OsFingerprintDatabase::match(const OsEvidence &evidence, int count) const
+{
+    const TcpFingerprint seen = evidence.consensus();
+    const PortSet open = evidence.openPorts();
+    const QStringList banners = evidence.banners();
+
+    QVector<OsGuess> guesses;
+    for (const Signature &signature : signatures) {
+        const TcpFingerprint &expected = signature.fingerprint;
+        int matched = 0;
+        int compared = 0;
+        QStringList reasons;
+        auto compare = [&](int observed, int wanted, int weight, const QString &reason) {
+            if (observed < 0 || wanted < 0) return;
+            compared += weight;
+            if (observed == wanted) {
+                matched += weight;
+                reasons << reason;
+            }
+        };
+
+        compare(seen.ttl, expected.ttl, TtlWeight, QString("TTL %1").arg(expected.ttl));
+        compare(seen.window, expected.window, WindowWeight, QString("window %1").arg(expected.window));
+        compare(seen.options, expected.options, OptionsWeight, optionNames(expected.options));
+        compare(seen.windowScale, expected.windowScale, WindowScaleWeight,
+                QString("window scale %1").arg(expected.windowScale));
+        compare(seen.mss, expected.mss, MssWeight, QString("MSS %1").arg(expected.mss));
+        compare(seen.dontFragment, expected.dontFragment, DontFragmentWeight, "DF set");
+
+        if (signature.banner.isValid() && !signature.banner.pattern().isEmpty()) {
+            for (const QString &banner : banners) {
+                if (signature.banner.match(banner).hasMatch()) {
+                    matched += BannerWeight;
+                    compared += BannerWeight;
+                    reasons << QString("banner \"%1\"").arg(banner.left(40));
+                    break;
+                }
+            }
+        }
+        const PortSet hits = open & signature.ports;
+        if (!hits.isEmpty()) {
+            matched += PortsWeight;
+            compared += PortsWeight;
+            reasons << QString("ports %1").arg(hits.toString());
+        }
+
+        if (matched == 0) continue;
+
+        OsGuess guess;
+        guess.name = signature.name;
+        guess.family = signature.family;
+        guess.score = 100 * matched / qMax(compared, MinComparedWeight);
+        guess.reasons = reasons;
+        guesses.append(guess);
+    }
+
+    std::stable_sort(guesses.begin(), guesses.end(), [](const OsGuess &a, const OsGuess &b) {
+        return a.score > b.score;
+    });
+    if (guesses.size() > count) {
+        guesses.resize(count);
+    }
+    return guesses;
+}
@@ -0,0 +1,67 @@
+#ifndef OSFINGERPRINT_H
+#define OSFINGERPRINT_H
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QRegularExpression>
+#include "portset.h"
+#include "resultring.h"
+
+struct OsGuess
+{
+    QString name;
+    QString family;
+    // 0-100, relative to how much evidence there was to compare.
+    int score = 0;
+    QStringList reasons;
+
+    QString toString() const;
+};
+
+// What one scan learned about its host from results it already had: the TCP
+// fingerprints of connected ports, the open ports and their banners.
+class OsEvidence
+{
+public:
+    void add(const ProbeResult &result);
+    void clear();
+
+    bool isEmpty() const;
+    PortSet openPorts() const;
+    QStringList banners() const;
+    // The most common value of each fingerprint field across ports.
+    TcpFingerprint consensus() const;
+
+private:
+    PortSet open;
+    QVector<TcpFingerprint> fingerprints;
+    QStringList bannerList;
+};
+
+// Signatures compiled into the binary. Each field that both the signature
+// and the evidence have is compared with a weight; banner and port hints
+// only ever add. The score is the matched weight over the compared weight,
+// with a floor on the latter so one lucky field doesn't make a sure guess.
+class OsFingerprintDatabase
+{
+public:
+    static const OsFingerprintDatabase &builtin();
+
+    QVector<OsGuess> match(const OsEvidence &evidence, int count = 3) const;
+
+private:
+    struct Signature
+    {
+        QString name;
+        QString family;
+        TcpFingerprint fingerprint;
+        QRegularExpression banner;
+        PortSet ports;
+    };
+
+    OsFingerprintDatabase();
+
+    QVector<Signature> signatures;
+};
+
+#endif
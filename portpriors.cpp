@@ -0,0 +1,181 @@
+#include "portpriors.h"
+#include <QHostAddress>
+#include <algorithm>
+
+// How many observations each level's estimate of the level above is worth.
+static const double PriorWeight = 2.0;
+
+// Cold-start rates: ports in nmap's open-frequency order get a prior that
+// falls with their rank, everything else a small flat one.
+static const double TopPortPrior = 0.2;
+static const double OtherPortPrior = 0.001;
+
+static const int TopTcpPorts[] = {
+    80, 23, 443, 21, 22, 25, 3389, 110, 445, 139, 143, 53, 135, 3306, 8080, 1723, 111, 995, 993, 5900,
+    1025, 587, 8888, 199, 1720, 465, 548, 113, 81, 6001, 10000, 514, 5060, 179, 1026, 2000, 8443, 8000,
+    32768, 554, 26, 1433, 49152, 2001, 515, 8008, 49154, 1027, 5666, 646,
+};
+
+static const int TopUdpPorts[] = {
+    631, 161, 137, 123, 138, 1434, 445, 135, 67, 53, 139, 500, 68, 520, 1900, 4500, 514, 49152, 162, 69,
+};
+
+static const QHash<int, double> &coldStart(PortProtocol protocol)
+{
+    static const QHash<int, double> tcp = [] {
+        QHash<int, double> priors;
+        int rank = 0;
+        for (int port : TopTcpPorts) {
+            priors.insert(port, TopPortPrior / (1.0 + 0.25 * rank++));
+        }
+        return priors;
+    }();
+    static const QHash<int, double> udp = [] {
+        QHash<int, double> priors;
+        int rank = 0;
+        for (int port : TopUdpPorts) {
+            priors.insert(port, TopPortPrior / (1.0 + 0.25 * rank++));
+        }
+        return priors;
+    }();
+    return protocol == PortProtocol::UDP ? udp : tcp;
+}
+
+PortPriors::PortPriors(PortProtocol protocol)
+    : wanted(protocol)
+{
+}
+
+void PortPriors::learn(const ResultStore &store)
+{
+    // Records of a host need not be adjacent; collect each host's scan first.
+    QHash<quint32, QPair<PortSet, PortSet>> scans;
+    for (quint64 i = 0; i < store.recordCount(); ++i) {
+        const ResultRecord &record = store.record(i);
+        if (PortProtocol(record.protocol) != wanted) continue;
+        // A local failure says nothing about the port.
+        if (PortState(record.state) == PortState::Error || PortState(record.state) == PortState::Exhausted) continue;
+
+        QPair<PortSet, PortSet> &scan = scans[record.host];
+        scan.first.insert(record.port);
+        if (PortState(record.state) == PortState::Open) {
+            scan.second.insert(record.port);
+        }
+    }
+
+    for (auto it = scans.cbegin(); it != scans.cend(); ++it) {
+        addHostScan(store.hostName(it.key()), it->first, it->second);
+    }
+}
+
+bool PortPriors::learn(const QString &fileName, QString *errorString)
+{
+    ResultStore store;
+    if (!store.open(fileName)) {
+        if (errorString) *errorString = store.errorString();
+        return false;
+    }
+    learn(store);
+    return true;
+}
+
+void PortPriors::addHostScan(const QString &host, const PortSet &scanned, const PortSet &open)
+{
+    Level &subnet = subnets[subnetOf(host)];
+    HostHistory &history = hosts[host];
+    ++everyone.scans;
+    ++subnet.scans;
+    ++history.scans;
+    history.scanned |= scanned;
+    for (int port : open) {
+        ++everyone.open[port];
+        ++subnet.open[port];
+        ++history.open[port];
+    }
+}
+
+PortProtocol PortPriors::protocol() const
+{
+    return wanted;
+}
+
+bool PortPriors::isEmpty() const
+{
+    return hosts.isEmpty();
+}
+
+int PortPriors::hostCount() const
+{
+    return hosts.size();
+}
+
+int PortPriors::hostScans() const
+{
+    return everyone.scans;
+}
+
+double PortPriors::estimate(const HostHistory *host, const Level *subnet, int port) const
+{
+    double rate = (everyone.open.value(port) + PriorWeight * coldStart(wanted).value(port, OtherPortPrior))
+                  / (everyone.scans + PriorWeight);
+    if (subnet) {
+        rate = (subnet->open.value(port) + PriorWeight * rate) / (subnet->scans + PriorWeight);
+    }
+    if (host && host->scanned.contains(port)) {
+        rate = (host->open.value(port) + PriorWeight * rate) / (host->scans + PriorWeight);
+    }
+    return rate;
+}
+
+double PortPriors::likelihood(const QString &host, int port) const
+{
+    auto subnet = subnets.constFind(subnetOf(host));
+    auto history = hosts.constFind(host);
+    return estimate(history != hosts.constEnd() ? &history.value() : nullptr,
+                    subnet != subnets.constEnd() ? &subnet.value() : nullptr, port);
+}
+
+QVector<quint16> PortPriors::rank(const QString &host, const PortSet &ports, QVector<double> *likelihoods) const
+{
+    auto subnet = subnets.constFind(subnetOf(host));
+    auto history = hosts.constFind(host);
+    const HostHistory *hostLevel = history != hosts.constEnd() ? &history.value() : nullptr;
+    const Level *subnetLevel = subnet != subnets.constEnd() ? &subnet.value() : nullptr;
+
+    QVector<QPair<double, quint16>> scored;
+    scored.reserve(ports.size());
+    for (int port : ports) {
+        scored.append(qMakePair(estimate(hostLevel, subnetLevel, port), quint16(port)));
+    }
+    std::stable_sort(scored.begin(), scored.end(), [](const QPair<double, quint16> &a, const QPair<double, quint16> &b) {
+        return a.first > b.first;
+    });
+
+    QVector<quint16> order;
+    order.reserve(scored.size());
+    if (likelihoods) {
+        likelihoods->clear();
+        likelihoods->reserve(scored.size());
+    }
+    for (const auto &entry : qAsConst(scored)) {
+        order.append(entry.second);
+        if (likelihoods) likelihoods->append(entry.first);
+    }
+    return order;
+}
+
+QString PortPriors::subnetOf(const QString &host)
+{
+    QHostAddress address(host);
+    if (address.protocol() == QAbstractSocket::IPv4Protocol) {
+        return QString("%1/24").arg(QHostAddress(address.toIPv4Address() & 0xFFFFFF00u).toString());
+    }
+    if (address.protocol() == QAbstractSocket::IPv6Protocol) {
+        Q_IPV6ADDR bytes = address.toIPv6Address();
+        for (int i = 8; i < 16; ++i) {
+            bytes[i] = 0;
+        }
+        return QString("%1/64").arg(QHostAddress(bytes).toString());
+    }
+    return host;
+}
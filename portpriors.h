@@ -0,0 +1,63 @@
+#ifndef PORTPRIORS_H
+#define PORTPRIORS_H
+#include <QString>
+#include <QHash>
+#include <QVector>
+#include "portset.h"
+#include "resultstore.h"
+
+// How likely each port is to be open, learned from earlier scans of one
+// protocol. Evidence is kept at three levels: the host itself, its subnet
+// (the /24 of an IPv4 address, the /64 of an IPv6 one; names are their own
+// subnet) and every host seen. Each level is smoothed towards the one above
+// it, and the top level towards a built-in list of commonly open ports, so
+// a host seen once doesn't override its neighbours and an empty history
+// still gives a useful order.
+//
+// A level's rate counts every scanned host as having been asked about the
+// port; stores only keep what they were given, so closed ports that weren't
+// recorded look the same as ports that weren't scanned.
+class PortPriors
+{
+public:
+    explicit PortPriors(PortProtocol protocol = PortProtocol::TCP);
+
+    void learn(const ResultStore &store);
+    bool learn(const QString &fileName, QString *errorString = nullptr);
+    void addHostScan(const QString &host, const PortSet &scanned, const PortSet &open);
+
+    PortProtocol protocol() const;
+    bool isEmpty() const;
+    int hostCount() const;
+    int hostScans() const;
+
+    double likelihood(const QString &host, int port) const;
+    // The ports in probing order: most likely first, ties in port order.
+    // With likelihoods, also each ranked port's likelihood.
+    QVector<quint16> rank(const QString &host, const PortSet &ports, QVector<double> *likelihoods = nullptr) const;
+
+    static QString subnetOf(const QString &host);
+
+private:
+    struct Level
+    {
+        int scans = 0;
+        QHash<int, int> open;
+    };
+
+    struct HostHistory
+    {
+        int scans = 0;
+        PortSet scanned;
+        QHash<int, int> open;
+    };
+
+    double estimate(const HostHistory *host, const Level *subnet, int port) const;
+
+    PortProtocol wanted;
+    Level everyone;
+    QHash<QString, Level> subnets;
+    QHash<QString, HostHistory> hosts;
+};
+
+#endif
@@ -0,0 +1,1145 @@
+#include "portscanner.h"
+#include "portpriors.h"
+#include "probedispatcher.h"
+#include "probetracer.h"
+#include "probetransport.h"
+#include "resultstore.h"
+#include "scanmetrics.h"
+#include "scanplan.h"
+#include <QMutexLocker>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QRegularExpression>
+#include <QHash>
+#include <QThread>
+#include <QTimer>
+#include <cmath>
+
+// How often the GUI thread collects results, and how many it takes at most
+// per pass so a burst can't stall it.
+static const int DrainIntervalMs = 50;
+static const int MaxDrainBatch = 16384;
+static const int MaxRingCapacity = 65536;
+
+// Probe threads only back off when the GUI has fallen a whole ring behind.
+static const int RingFullBackoffMs = 1;
+
+// Deadline scans re-measure their pace this often, once enough probes have
+// returned to go by, and plan for that much more than the pace says.
+static const qint64 DeadlinePaceIntervalMs = 1000;
+static const int MinPaceSamples = 16;
+static const double DeadlineHeadroom = 1.2;
+
+// nmap prints a <taskprogress> line this often while a phase runs.
+static const char *const NmapStatsInterval = "1s";
+static const int NmapKillWaitMs = 1000;
+
+static ScanCounter responseCounter(PortState state)
+{
+    switch (state) {
+    case PortState::Open: return ScanCounter::ResponsesOpen;
+    case PortState::Closed: return ScanCounter::ResponsesClosed;
+    case PortState::Filtered: return ScanCounter::ResponsesFiltered;
+    case PortState::OpenFiltered: return ScanCounter::ResponsesOpenFiltered;
+    case PortState::Unfiltered: return ScanCounter::ResponsesUnfiltered;
+    case PortState::Error:
+    case PortState::Exhausted:
+        break;
+    }
+    return ScanCounter::ResponsesError;
+}
+
+// One probe, carried out from its plan descriptor on a dispatcher thread.
+// Lives on the worker's stack and only borrows from the plan and the scan,
+// which outlive it, so running a probe copies and allocates nothing the
+// result itself doesn't need.
+class PortScanTask
+{
+public:
+    PortScanTask(const ScanPlan &plan, const ProbeDescriptor &probe, int timeout, ProbeTransport &transport,
+                 const CancellationToken &cancel, ProbeResultRing &results, quint64 probeId, qint64 queuedAt)
+        : plan(plan), probe(probe), timeout(timeout), transport(transport), cancel(cancel)
+        , results(results), probeId(probeId), queuedAt(queuedAt)
+    {
+    }
+
+    void run()
+    {
+        if (cancel.isCancelled()) {
+            return;
+        }
+
+        const int port = probe.port;
+        ProbeResult result;
+        result.probeId = probeId;
+        result.port = port;
+        result.service = plan.serviceName(probe.service);
+
+        // Nothing exists of a probe until a worker takes it, so its start is
+        // stamped after the fact with the time the scan queued it.
+        ProbeTracer::traceAt(queuedAt, probeId, TracePhase::Probe, TraceEventKind::Begin, port);
+        ProbeTracer::traceAt(queuedAt, probeId, TracePhase::Queued, TraceEventKind::Begin, port);
+        ProbeTracer::trace(probeId, TracePhase::Queued, TraceEventKind::End, port);
+
+        ScanMetrics *metrics = ScanMetrics::instance();
+        metrics->add(ScanCounter::ProbesSent);
+        metrics->add(ScanCounter::InFlight);
+
+        switch (probe.kind) {
+        case ProbeKind::ConnectBanner:
+            performTCPConnectScan(result.state, result.banner, result.responseTime);
+            break;
+        case ProbeKind::ConnectOnly:
+            performConnectOnlyScan(result.state, result.responseTime);
+            break;
+        case ProbeKind::ConnectFirewall:
+            performFirewallScan(result.state, result.responseTime);
+            break;
+        case ProbeKind::Udp:
+            performUDPScan(result.state, result.banner, result.responseTime);
+            break;
+        }
+
+        metrics->add(ScanCounter::InFlight, -1);
+        if (cancel.isCancelled()) {
+            return;
+        }
+        result.fingerprint = fingerprint;
+        // The socket budget counts exhausted probes as ResourceExhausted.
+        if (result.state != PortState::Exhausted) {
+            metrics->add(responseCounter(result.state));
+        }
+
+        // The ring belongs to this scan alone, so nothing from a stopped scan
+        // reaches the next one. A stopped scan stops draining, which is why a
+        // full ring is only waited on while the token is live.
+        ProbeTracer::trace(probeId, TracePhase::Delivery, TraceEventKind::Begin, port);
+        while (!results.tryPush(result)) {
+            if (cancel.isCancelled()) {
+                return;
+            }
+            QThread::msleep(RingFullBackoffMs);
+        }
+    }
+
+private:
+    const ScanPlan &plan;
+    const ProbeDescriptor &probe;
+    int timeout;
+    ProbeTransport &transport;
+    const CancellationToken &cancel;
+    ProbeResultRing &results;
+    quint64 probeId;
+    qint64 queuedAt;
+    TcpFingerprint fingerprint;
+
+    TcpProbeReply connectProbe()
+    {
+        TcpProbeRequest request;
+        request.host = plan.host();
+        request.address = plan.address();
+        request.port = probe.port;
+        request.timeout = timeout / probe.timeoutDivisor;
+        request.bannerMode = probe.bannerMode;
+        request.bannerWait = probe.bannerWait;
+        request.cancel = &cancel;
+
+        bool tracing = ProbeTracer::isEnabled();
+        qint64 traceStart = tracing ? ProbeTracer::now() : 0;
+        TcpProbeReply reply = transport.probeTcp(request);
+        if (tracing) {
+            traceTcpPhases(traceStart, reply);
+        }
+
+        ScanMetrics *metrics = ScanMetrics::instance();
+        if (reply.outcome == ConnectOutcome::TimedOut) {
+            metrics->add(ScanCounter::Timeouts);
+        } else if (reply.outcome == ConnectOutcome::Connected || reply.outcome == ConnectOutcome::Refused) {
+            metrics->record(ScanHistogram::ConnectRtt, reply.connectMicros);
+        }
+        if (reply.outcome == ConnectOutcome::Connected && probe.bannerMode != BannerMode::None) {
+            metrics->record(ScanHistogram::BannerTime, reply.bannerMicros);
+        }
+        if (reply.outcome == ConnectOutcome::Connected) {
+            fingerprint = reply.fingerprint;
+        }
+        return reply;
+    }
+
+    void traceTcpPhases(qint64 start, const TcpProbeReply &reply)
+    {
+        // The transport does connect and banner in one call, so split the
+        // wall-clock span at the connect time it reports. Simulated transports
+        // report virtual time; clamping keeps their phases inside the real span.
+        const int port = probe.port;
+        qint64 end = ProbeTracer::now();
+        qint64 split = qMin(end, start + reply.connectMicros * 1000);
+        ProbeTracer::traceAt(start, probeId, TracePhase::Connect, TraceEventKind::Begin, port);
+        if (reply.outcome == ConnectOutcome::Connected && probe.bannerMode != BannerMode::None) {
+            ProbeTracer::traceAt(split, probeId, TracePhase::Connect, TraceEventKind::End, port);
+            ProbeTracer::traceAt(split, probeId, TracePhase::Banner, TraceEventKind::Begin, port);
+            ProbeTracer::traceAt(end, probeId, TracePhase::Banner, TraceEventKind::End, port);
+        } else {
+            ProbeTracer::traceAt(end, probeId, TracePhase::Connect, TraceEventKind::End, port);
+        }
+    }
+
+    void performTCPConnectScan(PortState &state, QString &banner, int &responseTime)
+    {
+        TcpProbeReply reply = connectProbe();
+        responseTime = reply.connectTime;
+
+        switch (reply.outcome) {
+        case ConnectOutcome::Connected:
+            state = PortState::Open;
+            banner = formatBanner(probe.port, reply.banner);
+            break;
+        case ConnectOutcome::Refused:
+            state = PortState::Closed;
+            break;
+        case ConnectOutcome::TimedOut:
+        case ConnectOutcome::Unreachable:
+        case ConnectOutcome::Cancelled:
+            state = PortState::Filtered;
+            break;
+        case ConnectOutcome::Error:
+            state = responseTime < (timeout / 2) ? PortState::Closed : PortState::Filtered;
+            break;
+        case ConnectOutcome::ResourceExhausted:
+            state = PortState::Exhausted;
+            break;
+        }
+    }
+
+    void performUDPScan(PortState &state, QString &banner, int &responseTime)
+    {
+        UdpProbeRequest request;
+        request.host = plan.host();
+        request.address = plan.address();
+        request.port = probe.port;
+        request.timeout = timeout;
+        request.payload = *probe.payload;
+        request.cancel = &cancel;
+
+        ProbeTracer::trace(probeId, TracePhase::UdpExchange, TraceEventKind::Begin, probe.port);
+        UdpProbeReply reply = transport.probeUdp(request);
+        ProbeTracer::trace(probeId, TracePhase::UdpExchange, TraceEventKind::End, probe.port);
+        responseTime = reply.responseTime;
+        if (reply.sent && !reply.answered && !reply.cancelled) {
+            ScanMetrics::instance()->add(ScanCounter::Timeouts);
+        }
+
+        if (!reply.sent) {
+            state = reply.exhausted ? PortState::Exhausted : PortState::Error;
+            return;
+        }
+
+        if (reply.answered) {
+            state = PortState::Open;
+            banner = QString::fromUtf8(reply.response).trimmed();
+            if (banner.length() > 100) {
+                banner = banner.left(100) + "...";
+            }
+        } else {
+
+            state = PortState::OpenFiltered;
+        }
+    }
+
+    // SYN and the stealth types: connect() is all an unprivileged scan has.
+    void performConnectOnlyScan(PortState &state, int &responseTime)
+    {
+        TcpProbeReply reply = connectProbe();
+        responseTime = reply.connectTime;
+
+        if (reply.outcome == ConnectOutcome::Connected) {
+            state = PortState::Open;
+        } else if (reply.outcome == ConnectOutcome::ResourceExhausted) {
+            state = PortState::Exhausted;
+        } else if (reply.outcome == ConnectOutcome::Refused) {
+            state = PortState::Closed;
+        } else {
+            state = PortState::Filtered;
+        }
+    }
+
+    void performFirewallScan(PortState &state, int &responseTime)
+    {
+        TcpProbeReply reply = connectProbe();
+        responseTime = reply.connectTime;
+
+        if (reply.outcome == ConnectOutcome::Connected) {
+            state = PortState::Unfiltered;
+        } else if (reply.outcome == ConnectOutcome::ResourceExhausted) {
+            state = PortState::Exhausted;
+        } else {
+            state = PortState::Filtered;
+        }
+    }
+
+    QString formatBanner(int port, const QByteArray &data)
+    {
+        static const QRegularExpression serverRegex("Server: ([^\r\n]+)");
+        static const QRegularExpression controlRegex("[\\x00-\\x1F\\x7F-\\xFF]");
+
+        QString banner;
+
+        switch (port) {
+        case 80:
+        case 8080:
+            if (!data.isEmpty()) {
+                banner = QString::fromUtf8(data).trimmed();
+
+                QRegularExpressionMatch match = serverRegex.match(banner);
+                if (match.hasMatch()) {
+                    banner = match.captured(1);
+                } else {
+
+                    QStringList lines = banner.split('\n');
+                    if (!lines.isEmpty()) {
+                        banner = lines.first().trimmed();
+                    }
+                }
+            }
+            break;
+
+        case 443:
+        case 8443:
+            banner = "HTTPS/SSL";
+            break;
+
+        case 3389:
+            banner = "RDP";
+            break;
+
+        default:
+            banner = QString::fromUtf8(data).trimmed();
+            break;
+        }
+
+        banner = banner.remove(controlRegex);
+        if (banner.length() > 100) {
+            banner = banner.left(100) + "...";
+        }
+
+        return banner;
+    }
+};
+
+PortScanner::PortScanner(QObject *parent)
+    : PortScanner(QSharedPointer<ProbeDispatcher>::create(), parent)
+{
+}
+
+PortScanner::PortScanner(const QSharedPointer<ProbeDispatcher> &engine, QObject *parent)
+    : QObject(parent)
+    , scanning(false)
+    , connectionTimeout(1000)
+    , completedScans(0)
+    , scanType(ScanType::TCP_CONNECT)
+    , timingTemplate(TimingTemplate::T3_NORMAL)
+    , enableServiceDetection(true)
+    , enableOSDetection(false)
+    , enableAggressiveScan(false)
+    , probeTransport(new SocketTransport)
+    , engine(engine)
+    , engineJob(0)
+    , drainTimer(new QTimer(this))
+    , probeRateLimit(0.0)
+    , jobWeight(1)
+    , probeConcurrency(0)
+    , grabBanners(true)
+    , earlyStopMinRate(0.0)
+    , earlyStopWindow(DefaultEarlyStopWindow)
+    , windowResults(0)
+    , windowOpen(0)
+    , deadlineSeconds(0)
+    , budgetMs(0)
+    , plannedProbes(0)
+    , droppedProbes(0)
+    , deadlineConcurrency(0)
+    , slotRate(0.0)
+    , paceSince(0)
+    , paceDone(0)
+    , engineKind(ScanEngine::Native)
+    , nmapBinary(qEnvironmentVariable("CYBERSCANNER_NMAP", "nmap"))
+    , nmapProcess(new QProcess(this))
+{
+    drainTimer->setInterval(DrainIntervalMs);
+    connect(drainTimer, &QTimer::timeout, this, &PortScanner::drainResults);
+
+    connect(nmapProcess, &QProcess::readyReadStandardOutput, this, &PortScanner::readNmapOutput);
+    connect(nmapProcess, &QProcess::readyReadStandardError, this, &PortScanner::readNmapErrors);
+    connect(nmapProcess, &QProcess::errorOccurred, this, &PortScanner::onNmapError);
+    connect(nmapProcess, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+            this, &PortScanner::onNmapFinished);
+}
+
+PortScanner::~PortScanner()
+{
+    stopScan();
+
+    // Don't leave probes of this scanner running past it. Cancelled probes
+    // let go within a wait slice.
+    for (quint64 job : engineJobs) {
+        engine->waitForJob(job);
+    }
+}
+
+void PortScanner::startScan(const QString &target, const PortSet &ports, ScanType scanType,
+                            TimingTemplate timing, bool serviceDetection, bool osDetection, bool aggressive)
+{
+    if (scanning) return;
+
+    targetHost = target;
+    portList = ports;
+    osEvidence.clear();
+    nmapOsMatches.clear();
+    this->scanType = scanType;
+    this->timingTemplate = timing;
+    this->enableServiceDetection = serviceDetection;
+    this->enableOSDetection = osDetection;
+    this->enableAggressiveScan = aggressive;
+
+    completedScans = 0;
+    windowResults = 0;
+    windowOpen = 0;
+    plannedProbes = ports.size();
+    budgetMs = 0;
+    scanning = true;
+
+    if (engineKind == ScanEngine::Nmap) {
+        startNmapScan();
+        return;
+    }
+
+    connectionTimeout = getTimeoutFromTiming(timing);
+
+    int threadCount = getOptimalThreadCount(timing, scanType);
+    scanToken = QSharedPointer<CancellationToken>::create();
+    resultRing = QSharedPointer<ProbeResultRing>::create(qMin(MaxRingCapacity, qMax(1, ports.size())));
+
+    emit scanStarted();
+    emit logMessage(QString("Starting %1 scan with %2 threads, timeout: %3ms")
+                        .arg(scanType == ScanType::TCP_CONNECT && !grabBanners ? QString("TCP Connect (no banners)")
+                                                                               : getScanTypeName(scanType))
+                        .arg(threadCount)
+                        .arg(connectionTimeout));
+
+    // Everything per port is settled here, once, rather than by each probe.
+    // The engine hands out probes in plan order. A deadline needs an order
+    // to drop from, so it ranks ports even without priors.
+    const PortProtocol protocol = scanType == ScanType::UDP_SCAN ? PortProtocol::UDP : PortProtocol::TCP;
+    QSharedPointer<const PortPriors> ranking;
+    if (priors && priors->protocol() == protocol) {
+        ranking = priors;
+    } else if (deadlineSeconds > 0) {
+        ranking = QSharedPointer<PortPriors>::create(protocol);
+    }
+    QSharedPointer<const ScanPlan> plan;
+    QVector<double> likelihoods;
+    if (ranking) {
+        plan = ScanPlan::compile(target, ranking->rank(target, ports, deadlineSeconds > 0 ? &likelihoods : nullptr),
+                                 scanType, grabBanners);
+    } else {
+        plan = ScanPlan::compile(target, ports, scanType, grabBanners);
+    }
+    if (deadlineSeconds > 0) {
+        threadCount = startDeadline(likelihoods, threadCount);
+    }
+
+    // Probe i of the plan is probe id firstProbeId + i. The engine only
+    // counts through the indices, so nothing here grows with the port count.
+    const quint64 firstProbeId = ProbeTracer::reserveProbeIds(plan->size());
+    const qint64 queuedAt = ProbeTracer::now();
+
+    // Jobs of earlier scans that have since drained need no waiting for.
+    for (int i = engineJobs.size() - 1; i >= 0; --i) {
+        if (!engine->hasJob(engineJobs[i])) {
+            engineJobs.removeAt(i);
+        }
+    }
+
+    ProbeJobLimits limits;
+    limits.concurrency = threadCount;
+    limits.timeout = connectionTimeout;
+    limits.rateLimit = probeRateLimit;
+    limits.weight = jobWeight;
+    limits.host = target;
+
+    QSharedPointer<ProbeTransport> transport = probeTransport;
+    QSharedPointer<CancellationToken> token = scanToken;
+    QSharedPointer<ProbeResultRing> ring = resultRing;
+    engineJob = engine->addJob(plan->size(), [plan, transport, token, ring, firstProbeId, queuedAt](const ProbeWork &work, int timeout) {
+        PortScanTask task(*plan, plan->probe(work.index), timeout, *transport, *token, *ring,
+                          firstProbeId + quint64(work.index), queuedAt);
+        task.run();
+    }, scanToken, limits);
+    engineJobs.append(engineJob);
+    drainTimer->start();
+}
+
+void PortScanner::pauseScan()
+{
+    if (engineKind == ScanEngine::Nmap) {
+        if (scanning) emit logMessage("Scans run through nmap can't be paused", LogLevel::Warning);
+        return;
+    }
+    if (!scanning || engine->isJobPaused(engineJob)) return;
+
+    engine->pauseJob(engineJob);
+    emit logMessage(QString("Scan paused, %1 probes waiting").arg(engine->pending(engineJob)));
+    emit scanPaused(true);
+}
+
+void PortScanner::resumeScan()
+{
+    if (engineKind == ScanEngine::Nmap || !scanning || !engine->isJobPaused(engineJob)) return;
+
+    engine->resumeJob(engineJob);
+    emit logMessage("Scan resumed");
+    emit scanPaused(false);
+}
+
+bool PortScanner::isPaused() const
+{
+    return scanning && engineKind == ScanEngine::Native && engine->isJobPaused(engineJob);
+}
+
+void PortScanner::setTiming(TimingTemplate timing)
+{
+    timingTemplate = timing;
+    if (!scanning) return;
+    if (engineKind == ScanEngine::Nmap) {
+        emit logMessage("nmap keeps the timing it was started with", LogLevel::Warning);
+        return;
+    }
+
+    // Probes already in flight keep the timeout they started with.
+    connectionTimeout = getTimeoutFromTiming(timing);
+    int threadCount = getOptimalThreadCount(timing, scanType);
+    if (budgetMs > 0) {
+        // The deadline sets the pace; the timing can only raise its floor.
+        deadlineConcurrency = qMax(deadlineConcurrency, threadCount);
+        threadCount = deadlineConcurrency;
+    }
+    engine->setJobTimeout(engineJob, connectionTimeout);
+    engine->setJobConcurrency(engineJob, threadCount);
+    emit logMessage(QString("Timing changed: %1 threads, timeout: %2ms").arg(threadCount).arg(connectionTimeout));
+}
+
+void PortScanner::setRateLimit(double probesPerSecond)
+{
+    probeRateLimit = probesPerSecond;
+    if (scanning && engineKind == ScanEngine::Native) {
+        engine->setJobRateLimit(engineJob, probesPerSecond);
+    }
+}
+
+double PortScanner::rateLimit() const
+{
+    return probeRateLimit;
+}
+
+void PortScanner::setWeight(int weight)
+{
+    jobWeight = qMax(1, weight);
+    if (scanning && engineKind == ScanEngine::Native) {
+        engine->setJobWeight(engineJob, jobWeight);
+    }
+}
+
+int PortScanner::weight() const
+{
+    return jobWeight;
+}
+
+void PortScanner::setConcurrency(int probes)
+{
+    probeConcurrency = qMax(0, probes);
+    if (scanning && engineKind == ScanEngine::Native) {
+        int threadCount = getOptimalThreadCount(timingTemplate, scanType);
+        if (budgetMs > 0) {
+            deadlineConcurrency = qMax(deadlineConcurrency, threadCount);
+            threadCount = deadlineConcurrency;
+        }
+        engine->setJobConcurrency(engineJob, threadCount);
+    }
+}
+
+int PortScanner::concurrency() const
+{
+    return probeConcurrency;
+}
+
+QString PortScanner::target() const
+{
+    return targetHost;
+}
+
+ScanType PortScanner::currentScanType() const
+{
+    return scanType;
+}
+
+void PortScanner::setPortPriors(const QSharedPointer<const PortPriors> &priors)
+{
+    this->priors = priors;
+}
+
+QSharedPointer<const PortPriors> PortScanner::portPriors() const
+{
+    return priors;
+}
+
+void PortScanner::setEarlyStop(double minRate, int window)
+{
+    earlyStopMinRate = qBound(0.0, minRate, 1.0);
+    earlyStopWindow = qMax(1, window);
+    windowResults = 0;
+    windowOpen = 0;
+}
+
+double PortScanner::earlyStopRate() const
+{
+    return earlyStopMinRate;
+}
+
+void PortScanner::setBannerGrab(bool enabled)
+{
+    grabBanners = enabled;
+}
+
+bool PortScanner::bannerGrab() const
+{
+    return grabBanners;
+}
+
+void PortScanner::setDeadline(int seconds)
+{
+    deadlineSeconds = qMax(0, seconds);
+}
+
+int PortScanner::deadline() const
+{
+    return deadlineSeconds;
+}
+
+int PortScanner::getOptimalThreadCount(TimingTemplate timing, ScanType scanType)
+{
+    if (probeConcurrency > 0) {
+        return probeConcurrency;
+    }
+
+    int baseThreads = QThread::idealThreadCount();
+
+    switch (timing) {
+    case TimingTemplate::T0_PARANOID:
+        return 1;
+    case TimingTemplate::T1_SNEAKY:
+        return qMax(1, baseThreads / 4);
+    case TimingTemplate::T2_POLITE:
+        return qMax(1, baseThreads / 2);
+    case TimingTemplate::T3_NORMAL:
+        return baseThreads * 2;
+    case TimingTemplate::T4_AGGRESSIVE:
+        return baseThreads * 4;
+    case TimingTemplate::T5_INSANE:
+        return baseThreads * 8;
+    }
+
+    if (scanType == ScanType::UDP_SCAN) {
+        return qMax(1, baseThreads / 2);
+    }
+
+    return baseThreads * 2;
+}
+
+QString PortScanner::getScanTypeName(ScanType scanType)
+{
+    switch (scanType) {
+    case ScanType::TCP_CONNECT: return "TCP Connect";
+    case ScanType::TCP_SYN: return "TCP SYN";
+    case ScanType::UDP_SCAN: return "UDP";
+    case ScanType::TCP_FIN: return "TCP FIN";
+    case ScanType::TCP_XMAS: return "TCP XMAS";
+    case ScanType::TCP_NULL: return "TCP NULL";
+    case ScanType::TCP_ACK: return "TCP ACK";
+    case ScanType::TCP_WINDOW: return "TCP Window";
+    }
+    return "Unknown";
+}
+
+void PortScanner::performOSDetection(const QString &target, const QVector<OsGuess> &guesses)
+{
+    if (guesses.isEmpty()) {
+        emit osDetectionResult(QString("%1: no open TCP ports to fingerprint").arg(target));
+        return;
+    }
+
+    QStringList lines;
+    for (const OsGuess &guess : guesses) {
+        lines << guess.toString();
+    }
+    emit osDetectionResult(QString("%1\n%2").arg(target, lines.join("\n")));
+}
+
+void PortScanner::stopScan()
+{
+    if (!scanning) return;
+
+    scanning = false;
+    if (engineKind == ScanEngine::Nmap) {
+        nmapProcess->kill();
+        nmapProcess->waitForFinished(NmapKillWaitMs);
+    } else {
+        drainTimer->stop();
+        scanToken->cancel();
+        engine->cancelJob(engineJob);
+    }
+
+    emit scanFinished();
+}
+
+void PortScanner::drainResults()
+{
+    if (!scanning) return;
+
+    QVector<ProbeResult> batch;
+    resultRing->drain(batch, MaxDrainBatch);
+    if (batch.isEmpty()) {
+        if (budgetMs > 0 && scanClock.elapsed() >= budgetMs) {
+            stopEarly(QString("Deadline reached: %1 of %2 ports scanned, the rest left out")
+                          .arg(completedScans).arg(portList.size()));
+        }
+        return;
+    }
+
+    const bool tracing = ProbeTracer::isEnabled();
+    const qint64 delivered = tracing ? ProbeTracer::now() : 0;
+
+    deliverResults(batch);
+    if (scanning && budgetMs > 0) {
+        paceToDeadline();
+    }
+
+    if (tracing) {
+        // One GUI span per batch, shared by every probe in it.
+        const qint64 handled = ProbeTracer::now();
+        for (const ProbeResult &result : qAsConst(batch)) {
+            ProbeTracer::traceAt(delivered, result.probeId, TracePhase::Delivery, TraceEventKind::End, result.port);
+            ProbeTracer::traceAt(delivered, result.probeId, TracePhase::Gui, TraceEventKind::Begin, result.port);
+            ProbeTracer::traceAt(handled, result.probeId, TracePhase::Gui, TraceEventKind::End, result.port);
+            ProbeTracer::traceAt(handled, result.probeId, TracePhase::Probe, TraceEventKind::End, result.port);
+        }
+    }
+
+    // A slot may have stopped the scan.
+    if (scanning && completedScans >= plannedProbes) {
+        finishScan();
+    } else if (scanning && discoveryStalled(batch)) {
+        stopEarly(QString("Stopping early: under %1% of the last %2 probes found an open port; %3 ports left unscanned")
+                      .arg(earlyStopMinRate * 100.0).arg(earlyStopWindow).arg(portList.size() - completedScans));
+    } else if (scanning && budgetMs > 0 && scanClock.elapsed() >= budgetMs) {
+        stopEarly(QString("Deadline reached: %1 of %2 ports scanned, the rest left out")
+                      .arg(completedScans).arg(portList.size()));
+    }
+}
+
+void PortScanner::stopEarly(const QString &reason)
+{
+    // Ends as finished: what was found still gets OS and service detection.
+    emit logMessage(reason, LogLevel::Warning);
+    scanToken->cancel();
+    engine->cancelJob(engineJob);
+    finishScan();
+}
+
+int PortScanner::startDeadline(const QVector<double> &likelihoods, int threadCount)
+{
+    budgetMs = qint64(deadlineSeconds) * 1000;
+    expectedOpen.resize(likelihoods.size() + 1);
+    expectedOpen[0] = 0.0;
+    for (int i = 0; i < likelihoods.size(); ++i) {
+        expectedOpen[i + 1] = expectedOpen[i] + likelihoods[i];
+    }
+    droppedProbes = 0;
+    paceSince = 0;
+    paceDone = 0;
+
+    // Until a pace has been measured, assume every probe waits out its
+    // timeout, as a filtered port does.
+    slotRate = 1000.0 / connectionTimeout;
+    const int needed = int(std::ceil(plannedProbes / (slotRate * deadlineSeconds)));
+    deadlineConcurrency = qBound(threadCount, needed, ProbeDispatcher::maxSlots());
+    if (needed > engine->slotCount()) {
+        emit logMessage(QString("Deadline of %1 s may need %2 probes in flight, but the engine allows %3")
+                            .arg(deadlineSeconds).arg(needed).arg(engine->slotCount()), LogLevel::Warning);
+    }
+    emit logMessage(QString("Deadline %1 s: starting with %2 probes in flight, likely ports first")
+                        .arg(deadlineSeconds).arg(deadlineConcurrency));
+    scanClock.start();
+    return deadlineConcurrency;
+}
+
+void PortScanner::paceToDeadline()
+{
+    const qint64 now = scanClock.elapsed();
+    const double secondsLeft = qMax<qint64>(1, budgetMs - now) / 1000.0;
+    const int reachableSlots = qMin(ProbeDispatcher::maxSlots(), engine->slotCount());
+
+    if (now - paceSince >= DeadlinePaceIntervalMs && completedScans - paceDone >= MinPaceSamples) {
+        const int slotsUsed = qMax(1, qMin(deadlineConcurrency, engine->slotCount()));
+        slotRate = (completedScans - paceDone) / ((now - paceSince) / 1000.0) / slotsUsed;
+        paceSince = now;
+        paceDone = completedScans;
+
+        const int remaining = plannedProbes - completedScans;
+        const double needed = std::ceil(remaining / (slotRate * secondsLeft) * DeadlineHeadroom);
+        const int concurrency = qBound(getOptimalThreadCount(timingTemplate, scanType),
+                                       int(qMin<double>(needed, ProbeDispatcher::maxSlots())), ProbeDispatcher::maxSlots());
+        if (concurrency != deadlineConcurrency) {
+            deadlineConcurrency = concurrency;
+            engine->setJobConcurrency(engineJob, concurrency);
+        }
+
+        // Even with every slot the engine has, the tail of the plan won't be
+        // reached; those are its least likely ports.
+        const double reachable = slotRate * reachableSlots * secondsLeft;
+        if (reachable < remaining) {
+            const int kept = engine->truncateJob(engineJob, completedScans + int(reachable));
+            if (kept >= 0 && kept < plannedProbes) {
+                emit logMessage(QString("Deadline: dropping the %1 least likely ports, which won't fit")
+                                    .arg(plannedProbes - kept), LogLevel::Warning);
+                droppedProbes += plannedProbes - kept;
+                plannedProbes = kept;
+            }
+        }
+    }
+
+    const double rate = slotRate * qMin(deadlineConcurrency, engine->slotCount());
+    const double total = expectedOpen.last();
+    const int done = qMin(completedScans, expectedOpen.size() - 1);
+    const int reachableEnd = int(qMin<double>(plannedProbes, completedScans + rate * secondsLeft));
+
+    ScanForecast forecast;
+    forecast.elapsedMs = now;
+    forecast.budgetMs = budgetMs;
+    forecast.etaMs = rate > 0 ? qint64((plannedProbes - completedScans) / rate * 1000) : -1;
+    forecast.coverage = total > 0 ? expectedOpen[done] / total : 0.0;
+    forecast.projectedCoverage = total > 0 ? expectedOpen[qMax(done, reachableEnd)] / total : 0.0;
+    forecast.planned = plannedProbes;
+    forecast.dropped = droppedProbes;
+    forecast.concurrency = deadlineConcurrency;
+    emit scanForecast(forecast);
+}
+
+bool PortScanner::discoveryStalled(const QVector<ProbeResult> &batch)
+{
+    if (earlyStopMinRate <= 0.0) return false;
+
+    bool stalled = false;
+    for (const ProbeResult &result : batch) {
+        ++windowResults;
+        if (result.state == PortState::Open) {
+            ++windowOpen;
+        }
+        if (windowResults == earlyStopWindow) {
+            stalled = stalled || windowOpen < earlyStopMinRate * earlyStopWindow;
+            windowResults = 0;
+            windowOpen = 0;
+        }
+    }
+    return stalled;
+}
+
+void PortScanner::deliverResults(const QVector<ProbeResult> &batch)
+{
+    completedScans += batch.size();
+    for (const ProbeResult &result : batch) {
+        osEvidence.add(result);
+    }
+    emit portResults(batch);
+    emit scanProgress(completedScans, plannedProbes);
+}
+
+void PortScanner::finishScan()
+{
+    const PortSet openPorts = osEvidence.openPorts();
+
+    // Fingerprinting costs no probes, so every scan gets a guess; the
+    // OS detection option only decides whether it is shown up front.
+    QVector<OsGuess> guesses;
+    if (!osEvidence.isEmpty()) {
+        guesses = OsFingerprintDatabase::builtin().match(osEvidence);
+        if (!guesses.isEmpty()) {
+            emit logMessage(QString("OS guess for %1: %2").arg(targetHost, guesses.first().toString()));
+        }
+        emit osGuesses(targetHost, guesses);
+    }
+    if (enableOSDetection) {
+        // nmap's own -O matches, when it ran, beat guessing from its results.
+        if (!nmapOsMatches.isEmpty()) {
+            emit osDetectionResult(QString("%1\n%2").arg(targetHost, nmapOsMatches.join("\n")));
+        } else {
+            performOSDetection(targetHost, guesses);
+        }
+    }
+
+    if (enableServiceDetection && !openPorts.isEmpty()) {
+        performServiceDetection(targetHost, openPorts);
+    }
+
+    scanning = false;
+    drainTimer->stop();
+    emit scanFinished();
+}
+
+int PortScanner::getTimeoutFromTiming(TimingTemplate timing)
+{
+    switch (timing) {
+    case TimingTemplate::T0_PARANOID: return 5000;
+    case TimingTemplate::T1_SNEAKY:   return 3000;
+    case TimingTemplate::T2_POLITE:   return 2000;
+    case TimingTemplate::T3_NORMAL:   return 1000;
+    case TimingTemplate::T4_AGGRESSIVE: return 500;
+    case TimingTemplate::T5_INSANE:   return 250;
+    }
+    return 1000;
+}
+
+
+void PortScanner::performServiceDetection(const QString &target, const PortSet &openPorts)
+{
+    emit logMessage("Performing enhanced service detection...");
+}
+
+bool PortScanner::isScanning() const
+{
+    return scanning;
+}
+
+void PortScanner::setTransport(const QSharedPointer<ProbeTransport> &transport)
+{
+    if (scanning || !transport) return;
+    probeTransport = transport;
+}
+
+QSharedPointer<ProbeTransport> PortScanner::transport() const
+{
+    return probeTransport;
+}
+
+void PortScanner::setScanEngine(ScanEngine engine)
+{
+    if (scanning) return;
+    engineKind = engine;
+}
+
+ScanEngine PortScanner::scanEngine() const
+{
+    return engineKind;
+}
+
+void PortScanner::setNmapProgram(const QString &program)
+{
+    if (program.isEmpty()) return;
+    nmapBinary = program;
+}
+
+QString PortScanner::nmapProgram() const
+{
+    return nmapBinary;
+}
+
+void PortScanner::startNmapScan()
+{
+    nmapParser.clear();
+    nmapParser.setProtocol(scanType == ScanType::UDP_SCAN ? "udp" : "tcp");
+
+    const QStringList arguments = buildNmapArguments(targetHost, portList);
+    emit scanStarted();
+    emit logMessage(QString("Starting %1 scan through nmap: %2 %3")
+                        .arg(getScanTypeName(scanType), nmapBinary, arguments.join(' ')));
+
+    // Failing to start is reported through onNmapError.
+    nmapProcess->start(nmapBinary, arguments);
+}
+
+void PortScanner::readNmapOutput()
+{
+    nmapParser.addData(nmapProcess->readAllStandardOutput());
+    if (!scanning) return;
+
+    const int total = portList.size();
+    const QVector<NmapHostReport> hosts = nmapParser.takeHosts();
+    for (const NmapHostReport &host : hosts) {
+        QVector<ProbeResult> batch;
+        PortSet listed;
+        for (const ProbeResult &result : host.ports) {
+            if (!portList.contains(result.port) || listed.contains(result.port)) continue;
+            listed.insert(result.port);
+            batch.append(result);
+        }
+
+        // nmap folds the dull majority into <extraports>. With one state
+        // there it covers every port not listed; with several we can't tell
+        // which port had which, so those go unreported.
+        const PortSet unlisted = portList - listed;
+        if (host.extraPorts.size() == 1) {
+            for (int port : unlisted) {
+                ProbeResult result;
+                result.port = port;
+                result.state = host.extraPorts.first().state;
+                batch.append(result);
+            }
+        } else if (!unlisted.isEmpty() && host.extraPorts.isEmpty()) {
+            emit logMessage(QString("nmap did not report %1 ports of %2; they are left out")
+                                .arg(unlisted.size()).arg(host.address), LogLevel::Warning);
+        } else if (!unlisted.isEmpty()) {
+            emit logMessage(QString("nmap summarised %1 ports of %2 in several states; they are left out")
+                                .arg(unlisted.size()).arg(host.address), LogLevel::Warning);
+        }
+
+        nmapOsMatches += host.osMatches;
+        deliverResults(batch);
+        // This scanner covers one host; whatever nmap left out is done too.
+        completedScans = total;
+        // A slot may have stopped the scan.
+        if (!scanning) return;
+    }
+
+    // Port scan phases are named "Connect Scan", "SYN Stealth Scan" and so
+    // on; ping, DNS and service phases would make the bar jump back and forth.
+    const QString task = nmapParser.task();
+    if (completedScans < total && task.endsWith(" Scan") && task != "Ping Scan") {
+        emit scanProgress(int(total * nmapParser.percent() / 100.0), total);
+    }
+}
+
+void PortScanner::readNmapErrors()
+{
+    const QStringList lines = QString::fromLocal8Bit(nmapProcess->readAllStandardError()).split('\n', Qt::SkipEmptyParts);
+    for (const QString &line : lines) {
+        emit logMessage("nmap: " + line.trimmed(), LogLevel::Warning);
+    }
+}
+
+void PortScanner::onNmapError(QProcess::ProcessError error)
+{
+    // Everything else ends in finished(), which onNmapFinished handles.
+    if (error != QProcess::FailedToStart || !scanning) return;
+
+    emit scanError(QString("Could not run %1: %2").arg(nmapBinary, nmapProcess->errorString()));
+    finishScan();
+}
+
+void PortScanner::onNmapFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    // Output may still be buffered when the process is reaped.
+    readNmapOutput();
+    readNmapErrors();
+    if (!scanning) return;
+
+    if (exitStatus == QProcess::CrashExit) {
+        emit scanError(QString("%1 crashed").arg(nmapBinary));
+    } else if (nmapParser.hasError()) {
+        emit scanError(nmapParser.errorString());
+    } else if (exitCode != 0) {
+        emit scanError(QString("%1 exited with code %2").arg(nmapBinary).arg(exitCode));
+    } else if (!nmapParser.isFinished()) {
+        emit scanError(QString("%1 stopped before its XML output was complete").arg(nmapBinary));
+    } else if (completedScans == 0) {
+        emit logMessage(QString("nmap reported nothing for %1; the host looks down (or blocks ping probes)")
+                            .arg(targetHost), LogLevel::Warning);
+    }
+
+    if (scanning) {
+        finishScan();
+    }
+}
+
+QStringList PortScanner::buildNmapArguments(const QString &target, const PortSet &ports)
+{
+    QStringList arguments;
+
+    switch (scanType) {
+    case ScanType::TCP_SYN:
+        arguments << "-sS";
+        break;
+    case ScanType::UDP_SCAN:
+        arguments << "-sU";
+        break;
+    case ScanType::TCP_FIN:
+        arguments << "-sF";
+        break;
+    case ScanType::TCP_XMAS:
+        arguments << "-sX";
+        break;
+    case ScanType::TCP_NULL:
+        arguments << "-sN";
+        break;
+    case ScanType::TCP_ACK:
+        arguments << "-sA";
+        break;
+    case ScanType::TCP_WINDOW:
+        arguments << "-sW";
+        break;
+    default:
+        arguments << "-sT";
+        break;
+    }
+
+    switch (timingTemplate) {
+    case TimingTemplate::T0_PARANOID:
+        arguments << "-T0";
+        break;
+    case TimingTemplate::T1_SNEAKY:
+        arguments << "-T1";
+        break;
+    case TimingTemplate::T2_POLITE:
+        arguments << "-T2";
+        break;
+    case TimingTemplate::T3_NORMAL:
+        arguments << "-T3";
+        break;
+    case TimingTemplate::T4_AGGRESSIVE:
+        arguments << "-T4";
+        break;
+    case TimingTemplate::T5_INSANE:
+        arguments << "-T5";
+        break;
+    }
+
+    if (enableServiceDetection) {
+        arguments << "-sV";
+    }
+
+    if (enableOSDetection) {
+        arguments << "-O";
+    }
+
+    if (enableAggressiveScan) {
+        arguments << "-A";
+    }
+
+    if (probeRateLimit > 0) {
+        arguments << "--max-rate" << QString::number(probeRateLimit);
+    }
+
+    if (!ports.isEmpty()) {
+        arguments << "-p" << ports.toString();
+    }
+
+    if (QHostAddress(target).protocol() == QAbstractSocket::IPv6Protocol) {
+        arguments << "-6";
+    }
+
+    // XML on stdout, which also silences the normal output there.
+    arguments << "-oX" << "-" << "--stats-every" << NmapStatsInterval;
+
+    arguments << target;
+
+    return arguments;
+}
+
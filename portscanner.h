@@ -0,0 +1,240 @@
+#ifndef PORTSCANNER_H
+#define PORTSCANNER_H
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QProcess>
+#include <QSharedPointer>
+#include <QVector>
+#include <QElapsedTimer>
+#include "nmapxml.h"
+#include "osfingerprint.h"
+#include "portset.h"
+#include "resultring.h"
+#include "scanlog.h"
+
+enum class ScanType {
+    TCP_CONNECT,
+    TCP_SYN,
+    UDP_SCAN,
+    TCP_FIN,
+    TCP_XMAS,
+    TCP_NULL,
+    TCP_ACK,
+    TCP_WINDOW
+};
+
+enum class TimingTemplate {
+    T0_PARANOID,
+    T1_SNEAKY,
+    T2_POLITE,
+    T3_NORMAL,
+    T4_AGGRESSIVE,
+    T5_INSANE
+};
+
+// Native probes through the ProbeTransport, or an nmap child process whose
+// XML output is read as it streams.
+enum class ScanEngine {
+    Native,
+    Nmap
+};
+
+// How a scan with a deadline stands against it; see setDeadline().
+struct ScanForecast
+{
+    qint64 elapsedMs = 0;
+    qint64 budgetMs = 0;
+    // Until the last planned probe is done at the current pace; -1 before
+    // there is a pace.
+    qint64 etaMs = -1;
+    // Open ports the priors expect among the probes done so far, and among
+    // those that fit the budget, as a share (0-1) of the expected open
+    // ports of every port asked for.
+    double coverage = 0.0;
+    double projectedCoverage = 0.0;
+    int planned = 0;
+    int dropped = 0;
+    int concurrency = 0;
+};
+
+class PortPriors;
+class PortScanTask;
+class ProbeTransport;
+class CancellationToken;
+class ProbeDispatcher;
+class QTimer;
+
+class PortScanner : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PortScanner(QObject *parent = nullptr);
+    // Scanners built on the same engine share its probe slots fairly, in
+    // proportion to their weights.
+    PortScanner(const QSharedPointer<ProbeDispatcher> &engine, QObject *parent = nullptr);
+    ~PortScanner();
+
+    void startScan(const QString &target, const PortSet &ports, ScanType scanType,
+                   TimingTemplate timing, bool serviceDetection, bool osDetection, bool aggressive);
+    void stopScan();
+    bool isScanning() const;
+
+    // Pausing lets probes in flight finish but starts no new ones. Timing and
+    // rate changes apply to the running scan from its next probe on.
+    void pauseScan();
+    void resumeScan();
+    bool isPaused() const;
+    void setTiming(TimingTemplate timing);
+    void setRateLimit(double probesPerSecond);
+    double rateLimit() const;
+    void setWeight(int weight);
+    int weight() const;
+    // Probes in flight at once; 0 takes it from the timing template. During
+    // a scan with a deadline, this and the timing are only a lower bound.
+    void setConcurrency(int probes);
+    int concurrency() const;
+
+    QString target() const;
+    ScanType currentScanType() const;
+
+    // Probes ports most likely open first, going by earlier scans; changes
+    // the order only, never which ports are scanned. Priors of the other
+    // protocol are ignored, and nmap keeps its own order. Takes effect from
+    // the next scan.
+    void setPortPriors(const QSharedPointer<const PortPriors> &priors);
+    QSharedPointer<const PortPriors> portPriors() const;
+    // Ends a native scan as finished once a window of results in a row has
+    // found open ports at less than minRate (0-1). With likely ports probed
+    // first, the rest seldom make up for the probes. 0 turns it off.
+    void setEarlyStop(double minRate, int window = DefaultEarlyStopWindow);
+    double earlyStopRate() const;
+
+    // Scans to a time budget: ports go most likely first (by the priors, or
+    // common services without any), probes in flight rise as far as it
+    // takes to fit the budget, the least likely ports are dropped once even
+    // the engine's every slot can't reach them, and what is left when the
+    // budget runs out goes unscanned. Native engine only; 0 turns it off.
+    // Takes effect from the next scan.
+    void setDeadline(int seconds);
+    int deadline() const;
+
+    static const int DefaultEarlyStopWindow = 256;
+
+    // TCP connect scans read each open port's banner; without, they stop at
+    // the handshake. Takes effect from the next scan.
+    void setBannerGrab(bool enabled);
+    bool bannerGrab() const;
+
+    void setTransport(const QSharedPointer<ProbeTransport> &transport);
+    QSharedPointer<ProbeTransport> transport() const;
+
+    // Takes effect from the next scan. The nmap engine ignores the
+    // transport, and can't be paused or retimed once running.
+    void setScanEngine(ScanEngine engine);
+    ScanEngine scanEngine() const;
+    // Defaults to $CYBERSCANNER_NMAP, else nmap from the PATH. Anything that
+    // writes nmap's -oX format to stdout will do, e.g. a script replaying a
+    // recorded run.
+    void setNmapProgram(const QString &program);
+    QString nmapProgram() const;
+
+signals:
+    void scanStarted();
+    void scanFinished();
+    void scanPaused(bool paused);
+    // Results arrive in batches, one per drain of the scan's result ring,
+    // followed by a single progress update.
+    void scanProgress(int current, int total);
+    void portResults(const QVector<ProbeResult> &results);
+    // Scans with a deadline, after every progress update.
+    void scanForecast(const ScanForecast &forecast);
+    void scanError(const QString &error);
+    void logMessage(const QString &message, LogLevel level = LogLevel::Info);
+    void osDetectionResult(const QString &osInfo);
+    // Best matches for the scanned host, from the results the scan already
+    // had; emitted at the end of every scan that found an open port.
+    void osGuesses(const QString &host, const QVector<OsGuess> &guesses);
+
+private slots:
+    void drainResults();
+    void readNmapOutput();
+    void readNmapErrors();
+    void onNmapError(QProcess::ProcessError error);
+    void onNmapFinished(int exitCode, QProcess::ExitStatus exitStatus);
+
+private:
+    QString targetHost;
+    PortSet portList;
+    OsEvidence osEvidence;
+    bool scanning;
+    int connectionTimeout;
+    int completedScans;
+
+    ScanType scanType;
+    TimingTemplate timingTemplate;
+    bool enableServiceDetection;
+    bool enableOSDetection;
+    bool enableAggressiveScan;
+
+    QSharedPointer<ProbeTransport> probeTransport;
+
+    // Each scan is one job on the engine with its own cancellation token.
+    // Jobs of stopped scans linger until their last probe returns.
+    QSharedPointer<ProbeDispatcher> engine;
+    QSharedPointer<CancellationToken> scanToken;
+    quint64 engineJob;
+    QList<quint64> engineJobs;
+    // Probe threads push into the ring; the GUI thread drains it on a timer.
+    QSharedPointer<ProbeResultRing> resultRing;
+    QTimer *drainTimer;
+    double probeRateLimit;
+    int jobWeight;
+    int probeConcurrency;
+    bool grabBanners;
+
+    QSharedPointer<const PortPriors> priors;
+    double earlyStopMinRate;
+    int earlyStopWindow;
+    int windowResults;
+    int windowOpen;
+
+    int deadlineSeconds;
+    // The running scan's budget, 0 for none, and what its plan expects:
+    // expectedOpen[i] sums the likelihoods of the plan's first i probes.
+    qint64 budgetMs;
+    QElapsedTimer scanClock;
+    QVector<double> expectedOpen;
+    int plannedProbes;
+    int droppedProbes;
+    int deadlineConcurrency;
+    // Probes per second per slot, measured over the last pace window.
+    double slotRate;
+    qint64 paceSince;
+    int paceDone;
+
+    ScanEngine engineKind;
+    QString nmapBinary;
+    QProcess *nmapProcess;
+    NmapXmlParser nmapParser;
+    QStringList nmapOsMatches;
+
+    void startNmapScan();
+    void deliverResults(const QVector<ProbeResult> &batch);
+    bool discoveryStalled(const QVector<ProbeResult> &batch);
+    int startDeadline(const QVector<double> &likelihoods, int threadCount);
+    void paceToDeadline();
+    void stopEarly(const QString &reason);
+    void finishScan();
+
+    void performOSDetection(const QString &target, const QVector<OsGuess> &guesses);
+    void performServiceDetection(const QString &target, const PortSet &openPorts);
+    QStringList buildNmapArguments(const QString &target, const PortSet &ports);
+    int getTimeoutFromTiming(TimingTemplate timing); // Added this declaration
+
+    int getOptimalThreadCount(TimingTemplate timing, ScanType scanType);
+    QString getScanTypeName(ScanType scanType);
+};
+
+#endif
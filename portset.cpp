@@ -0,0 +1,309 @@
+#include "portset.h"
+#include <QStringList>
+#include <QtAlgorithms>
+
+static quint64 maskFrom(int bit)
+{
+    return ~quint64(0) << bit;
+}
+
+PortSet PortSet::range(int first, int last)
+{
+    PortSet ports;
+    ports.insertRange(first, last);
+    return ports;
+}
+
+bool PortSet::isEmpty() const
+{
+    return count == 0;
+}
+
+int PortSet::size() const
+{
+    return count;
+}
+
+bool PortSet::contains(int port) const
+{
+    int i = (port >> 6) - baseWord;
+    return port >= 0 && i >= 0 && i < words.size() && (words.at(i) >> (port & 63)) & 1;
+}
+
+int PortSet::next(int from) const
+{
+    if (from > MaxPort) return -1;
+    from = qMax(0, from);
+
+    int i = (from >> 6) - baseWord;
+    quint64 mask = maskFrom(from & 63);
+    if (i < 0) {
+        i = 0;
+        mask = ~quint64(0);
+    }
+    for (; i < words.size(); ++i) {
+        quint64 word = words.at(i) & mask;
+        if (word) {
+            return (baseWord + i) * 64 + qCountTrailingZeroBits(word);
+        }
+        mask = ~quint64(0);
+    }
+    return -1;
+}
+
+void PortSet::insert(int port)
+{
+    insertRange(port, port);
+}
+
+void PortSet::insertRange(int first, int last)
+{
+    first = qMax(0, first);
+    last = qMin(int(MaxPort), last);
+    if (first > last) return;
+
+    cover(first >> 6, last >> 6);
+    for (int word = first >> 6; word <= (last >> 6); ++word) {
+        quint64 mask = ~quint64(0);
+        if (word == (first >> 6)) {
+            mask &= maskFrom(first & 63);
+        }
+        if (word == (last >> 6) && (last & 63) != 63) {
+            mask &= ~maskFrom((last & 63) + 1);
+        }
+        quint64 &bits = words[word - baseWord];
+        count += qPopulationCount(mask & ~bits);
+        bits |= mask;
+    }
+}
+
+void PortSet::remove(int port)
+{
+    if (!contains(port)) return;
+
+    words[(port >> 6) - baseWord] &= ~(quint64(1) << (port & 63));
+    if (--count == 0) {
+        clear();
+    }
+}
+
+void PortSet::clear()
+{
+    words.clear();
+    baseWord = 0;
+    count = 0;
+}
+
+PortSet &PortSet::unite(const PortSet &other)
+{
+    if (other.isEmpty()) return *this;
+    if (isEmpty()) return *this = other;
+
+    cover(other.baseWord, other.baseWord + other.words.size() - 1);
+    const int offset = other.baseWord - baseWord;
+    for (int i = 0; i < other.words.size(); ++i) {
+        words[offset + i] |= other.words.at(i);
+    }
+    recount();
+    return *this;
+}
+
+PortSet &PortSet::subtract(const PortSet &other)
+{
+    if (isEmpty() || other.isEmpty()) return *this;
+
+    const int offset = baseWord - other.baseWord;
+    for (int i = 0; i < words.size(); ++i) {
+        if (offset + i >= 0 && offset + i < other.words.size()) {
+            words[i] &= ~other.words.at(offset + i);
+        }
+    }
+    recount();
+    trim();
+    return *this;
+}
+
+PortSet &PortSet::intersect(const PortSet &other)
+{
+    if (isEmpty()) return *this;
+
+    const int offset = baseWord - other.baseWord;
+    for (int i = 0; i < words.size(); ++i) {
+        bool inside = offset + i >= 0 && offset + i < other.words.size();
+        words[i] &= inside ? other.words.at(offset + i) : 0;
+    }
+    recount();
+    trim();
+    return *this;
+}
+
+bool PortSet::operator==(const PortSet &other) const
+{
+    return count == other.count && ranges() == other.ranges();
+}
+
+QVector<QPair<int, int>> PortSet::ranges() const
+{
+    QVector<QPair<int, int>> runs;
+    int first = next(0);
+    while (first >= 0) {
+        // Find the first clear bit after first, a word at a time.
+        int i = (first >> 6) - baseWord;
+        quint64 mask = maskFrom(first & 63);
+        int last = (baseWord + words.size()) * 64 - 1;
+        for (; i < words.size(); ++i) {
+            quint64 clear = ~words.at(i) & mask;
+            if (clear) {
+                last = (baseWord + i) * 64 + qCountTrailingZeroBits(clear) - 1;
+                break;
+            }
+            mask = ~quint64(0);
+        }
+        runs.append(qMakePair(first, last));
+        first = next(last + 1);
+    }
+    return runs;
+}
+
+QVector<PortSet> PortSet::split(int sliceSize) const
+{
+    sliceSize = qMax(1, sliceSize);
+    QVector<PortSet> slices;
+    PortSet slice;
+    for (const QPair<int, int> &run : ranges()) {
+        int first = run.first;
+        while (first <= run.second) {
+            int take = qMin(run.second - first + 1, sliceSize - slice.size());
+            slice.insertRange(first, first + take - 1);
+            first += take;
+            if (slice.size() == sliceSize) {
+                slices.append(slice);
+                slice.clear();
+            }
+        }
+    }
+    if (!slice.isEmpty()) {
+        slices.append(slice);
+    }
+    return slices;
+}
+
+QString PortSet::toString() const
+{
+    QStringList parts;
+    for (const QPair<int, int> &run : ranges()) {
+        parts.append(run.first == run.second ? QString::number(run.first)
+                                             : QString("%1-%2").arg(run.first).arg(run.second));
+    }
+    return parts.join(',');
+}
+
+bool PortSet::parse(const QString &text, PortSet &ports, QString *errorString)
+{
+    PortSet parsed;
+    for (const QString &rawPart : text.split(',', Qt::SkipEmptyParts)) {
+        const QString part = rawPart.trimmed();
+        if (part.isEmpty()) continue;
+
+        int dash = part.indexOf('-');
+        bool ok1 = true;
+        bool ok2 = true;
+        int first = 0;
+        int last = 0;
+        if (dash < 0) {
+            first = last = part.toInt(&ok1);
+        } else {
+            const QString low = part.left(dash).trimmed();
+            const QString high = part.mid(dash + 1).trimmed();
+            first = low.isEmpty() ? 1 : low.toInt(&ok1);
+            last = high.isEmpty() ? MaxPort : high.toInt(&ok2);
+        }
+        if (!ok1 || !ok2 || first < 1 || last > MaxPort || first > last) {
+            if (errorString) {
+                *errorString = QString("Invalid port or range \"%1\"").arg(part);
+            }
+            return false;
+        }
+        parsed.insertRange(first, last);
+    }
+    ports = parsed;
+    return true;
+}
+
+void PortSet::cover(int firstWord, int lastWord)
+{
+    if (words.isEmpty()) {
+        baseWord = firstWord;
+        words.resize(lastWord - firstWord + 1);
+        return;
+    }
+    if (firstWord < baseWord) {
+        QVector<quint64> grown(baseWord - firstWord);
+        grown += words;
+        words = grown;
+        baseWord = firstWord;
+    }
+    if (lastWord >= baseWord + words.size()) {
+        words.resize(lastWord - baseWord + 1);
+    }
+}
+
+void PortSet::trim()
+{
+    if (count == 0) {
+        clear();
+        return;
+    }
+    int head = 0;
+    while (words.at(head) == 0) {
+        ++head;
+    }
+    int tail = words.size();
+    while (words.at(tail - 1) == 0) {
+        --tail;
+    }
+    if (head > 0 || tail < words.size()) {
+        words = words.mid(head, tail - head);
+        baseWord += head;
+    }
+}
+
+void PortSet::recount()
+{
+    count = 0;
+    for (quint64 word : qAsConst(words)) {
+        count += qPopulationCount(word);
+    }
+}
+
+QDataStream &operator<<(QDataStream &out, const PortSet &ports)
+{
+    const QVector<QPair<int, int>> runs = ports.ranges();
+    out << quint32(runs.size());
+    for (const QPair<int, int> &run : runs) {
+        out << quint16(run.first) << quint16(run.second);
+    }
+    return out;
+}
+
+QDataStream &operator>>(QDataStream &in, PortSet &ports)
+{
+    // Disjoint runs of a 65536-port space can't number more than half of it.
+    quint32 runs = 0;
+    in >> runs;
+    PortSet parsed;
+    if (runs > 32768) {
+        in.setStatus(QDataStream::ReadCorruptData);
+    }
+    for (quint32 i = 0; i < runs && in.status() == QDataStream::Ok; ++i) {
+        quint16 first = 0;
+        quint16 last = 0;
+        in >> first >> last;
+        if (first > last) {
+            in.setStatus(QDataStream::ReadCorruptData);
+        }
+        parsed.insertRange(first, last);
+    }
+    ports = in.status() == QDataStream::Ok ? parsed : PortSet();
+    return in;
+}
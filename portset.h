@@ -0,0 +1,93 @@
+#ifndef PORTSET_H
+#define PORTSET_H
+#include <QString>
+#include <QVector>
+#include <QPair>
+#include <QDataStream>
+
+// A set of ports (0-65535), held as a bitset over the words between its
+// lowest and highest port, so a full 1-65535 sweep is 8 KB and a 256-port
+// slice of it is 32 bytes. Copies share the bits until one of them changes.
+// Iteration is in ascending port order.
+//
+// Port expressions use the nmap -p syntax: "22,80,443", "1-1024", "8000-"
+// (to 65535), "-1024" (from 1) and "-" (1-65535). toString() writes the
+// same syntax back with runs collapsed into ranges.
+class PortSet
+{
+public:
+    class const_iterator
+    {
+    public:
+        int operator*() const { return port; }
+        const_iterator &operator++()
+        {
+            port = set->next(port + 1);
+            return *this;
+        }
+        bool operator==(const const_iterator &other) const { return port == other.port; }
+        bool operator!=(const const_iterator &other) const { return port != other.port; }
+
+    private:
+        friend class PortSet;
+        const_iterator(const PortSet *set, int port) : set(set), port(port) {}
+
+        const PortSet *set;
+        int port;
+    };
+
+    static const int MaxPort = 65535;
+
+    PortSet() = default;
+    static PortSet range(int first, int last);
+
+    bool isEmpty() const;
+    int size() const;
+    bool contains(int port) const;
+    // Lowest port at or above from, or -1.
+    int next(int from) const;
+
+    void insert(int port);
+    void insertRange(int first, int last);
+    void remove(int port);
+    void clear();
+
+    PortSet &unite(const PortSet &other);
+    PortSet &subtract(const PortSet &other);
+    PortSet &intersect(const PortSet &other);
+    PortSet &operator|=(const PortSet &other) { return unite(other); }
+    PortSet &operator-=(const PortSet &other) { return subtract(other); }
+    PortSet &operator&=(const PortSet &other) { return intersect(other); }
+    PortSet operator|(const PortSet &other) const { return PortSet(*this).unite(other); }
+    PortSet operator-(const PortSet &other) const { return PortSet(*this).subtract(other); }
+    PortSet operator&(const PortSet &other) const { return PortSet(*this).intersect(other); }
+    bool operator==(const PortSet &other) const;
+    bool operator!=(const PortSet &other) const { return !(*this == other); }
+
+    // Inclusive runs of consecutive ports, ascending.
+    QVector<QPair<int, int>> ranges() const;
+    // Consecutive slices of at most count ports each.
+    QVector<PortSet> split(int count) const;
+
+    const_iterator begin() const { return const_iterator(this, next(0)); }
+    const_iterator end() const { return const_iterator(this, -1); }
+
+    QString toString() const;
+    static bool parse(const QString &text, PortSet &ports, QString *errorString = nullptr);
+
+private:
+    void cover(int firstWord, int lastWord);
+    void trim();
+    void recount();
+
+    // words[i] holds ports (baseWord + i) * 64 .. + 63.
+    QVector<quint64> words;
+    int baseWord = 0;
+    int count = 0;
+};
+
+// Written as its ranges, so a sweep costs a few bytes on the wire.
+QDataStream &operator<<(QDataStream &out, const PortSet &ports);
+QDataStream &operator>>(QDataStream &in, PortSet &ports);
+
+#endif
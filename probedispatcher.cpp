@@ -0,0 +1,410 @@
+#include "probedispatcher.h"
+#include "probetransport.h"
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+#include <cmath>
+
+// Upper bound on probes in flight; T5 on a 64-thread machine stays below it.
+static const int MaxConcurrency = 1024;
+
+// A weight-1 job advances its pass by this much per probe.
+static const quint64 StrideScale = 1 << 20;
+
+class DispatchWorker : public QRunnable
+{
+public:
+    explicit DispatchWorker(const std::function<void()> &loop)
+        : loop(loop)
+    {
+        setAutoDelete(true);
+    }
+
+    void run() override
+    {
+        loop();
+    }
+
+private:
+    std::function<void()> loop;
+};
+
+ProbeDispatcher::ProbeDispatcher(int slotCount)
+    : nextJobId(1)
+    , virtualTime(0)
+    , slotLimit(1)
+    , workers(0)
+    , stopping(false)
+{
+    // The engine decides how many workers exist; the pool only has to have
+    // room for all of them.
+    pool.setMaxThreadCount(MaxConcurrency);
+    rateClock.start();
+    setSlots(slotCount);
+}
+
+ProbeDispatcher::~ProbeDispatcher()
+{
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+        for (const QSharedPointer<Job> &job : jobs) {
+            job->drop();
+        }
+        changed.wakeAll();
+    }
+    pool.waitForDone();
+}
+
+void ProbeDispatcher::setSlots(int count)
+{
+    QMutexLocker locker(&mutex);
+    slotLimit = qBound(1, count > 0 ? count : QThread::idealThreadCount() * 8, MaxConcurrency);
+    spawnWorkers();
+    changed.wakeAll();
+}
+
+int ProbeDispatcher::slotCount() const
+{
+    QMutexLocker locker(&mutex);
+    return slotLimit;
+}
+
+int ProbeDispatcher::maxSlots()
+{
+    return MaxConcurrency;
+}
+
+void ProbeDispatcher::setHostPoliteness(const HostPoliteness &politeness)
+{
+    QMutexLocker locker(&mutex);
+    defaultPoliteness = politeness;
+    for (const QSharedPointer<HostState> &host : hosts) {
+        host->limits = politenessFor(host->name);
+    }
+    changed.wakeAll();
+}
+
+HostPoliteness ProbeDispatcher::hostPoliteness() const
+{
+    QMutexLocker locker(&mutex);
+    return defaultPoliteness;
+}
+
+void ProbeDispatcher::setHostPoliteness(const QString &host, const HostPoliteness &politeness)
+{
+    QMutexLocker locker(&mutex);
+    politenessOverrides.insert(host, politeness);
+    if (QSharedPointer<HostState> state = hosts.value(host)) {
+        state->limits = politeness;
+    }
+    changed.wakeAll();
+}
+
+void ProbeDispatcher::clearHostPoliteness(const QString &host)
+{
+    QMutexLocker locker(&mutex);
+    politenessOverrides.remove(host);
+    if (QSharedPointer<HostState> state = hosts.value(host)) {
+        state->limits = defaultPoliteness;
+    }
+    changed.wakeAll();
+}
+
+HostPoliteness ProbeDispatcher::politenessFor(const QString &host) const
+{
+    return politenessOverrides.value(host, defaultPoliteness);
+}
+
+quint64 ProbeDispatcher::addJob(int count, const Executor &executor,
+                                const QSharedPointer<CancellationToken> &cancel, const ProbeJobLimits &limits)
+{
+    QSharedPointer<Job> job = QSharedPointer<Job>::create();
+    job->end = qMax(0, count);
+    job->executor = executor;
+    job->token = cancel;
+    job->limits = limits;
+    job->limits.concurrency = qBound(1, limits.concurrency, MaxConcurrency);
+    job->limits.weight = qMax(1, limits.weight);
+
+    QMutexLocker locker(&mutex);
+    job->id = nextJobId++;
+    job->lastRefill = rateClock.elapsed();
+    // Start at the current virtual time, so a new job gets its fair share
+    // from now on rather than a catch-up burst.
+    job->pass = virtualTime;
+    if (job->remaining() > 0) {
+        if (!limits.host.isEmpty()) {
+            QSharedPointer<HostState> &host = hosts[limits.host];
+            if (!host) {
+                host = QSharedPointer<HostState>::create();
+                host->name = limits.host;
+                host->limits = politenessFor(limits.host);
+            }
+            host->jobs++;
+            job->host = host;
+        }
+        jobs.insert(job->id, job);
+        spawnWorkers();
+    }
+    return job->id;
+}
+
+void ProbeDispatcher::setJobConcurrency(quint64 id, int concurrency)
+{
+    QMutexLocker locker(&mutex);
+    if (QSharedPointer<Job> job = jobs.value(id)) {
+        job->limits.concurrency = qBound(1, concurrency, MaxConcurrency);
+        spawnWorkers();
+        changed.wakeAll();
+    }
+}
+
+void ProbeDispatcher::setJobTimeout(quint64 id, int timeout)
+{
+    QMutexLocker locker(&mutex);
+    if (QSharedPointer<Job> job = jobs.value(id)) {
+        job->limits.timeout = timeout;
+    }
+}
+
+void ProbeDispatcher::setJobRateLimit(quint64 id, double probesPerSecond)
+{
+    QMutexLocker locker(&mutex);
+    if (QSharedPointer<Job> job = jobs.value(id)) {
+        job->limits.rateLimit = probesPerSecond;
+        job->rateTokens = qMin(job->rateTokens, 1.0);
+        changed.wakeAll();
+    }
+}
+
+void ProbeDispatcher::setJobWeight(quint64 id, int weight)
+{
+    QMutexLocker locker(&mutex);
+    if (QSharedPointer<Job> job = jobs.value(id)) {
+        job->limits.weight = qMax(1, weight);
+    }
+}
+
+void ProbeDispatcher::pauseJob(quint64 id)
+{
+    QMutexLocker locker(&mutex);
+    if (QSharedPointer<Job> job = jobs.value(id)) {
+        job->paused = true;
+    }
+}
+
+void ProbeDispatcher::resumeJob(quint64 id)
+{
+    QMutexLocker locker(&mutex);
+    if (QSharedPointer<Job> job = jobs.value(id)) {
+        job->paused = false;
+        job->lastRefill = rateClock.elapsed();
+        // A paused job fell behind in pass; don't let it make up for it.
+        job->pass = qMax(job->pass, virtualTime);
+        spawnWorkers();
+        changed.wakeAll();
+    }
+}
+
+bool ProbeDispatcher::isJobPaused(quint64 id) const
+{
+    QMutexLocker locker(&mutex);
+    QSharedPointer<Job> job = jobs.value(id);
+    return job && job->paused;
+}
+
+void ProbeDispatcher::cancelJob(quint64 id)
+{
+    QMutexLocker locker(&mutex);
+    if (QSharedPointer<Job> job = jobs.value(id)) {
+        job->drop();
+        removeIfDone(job);
+        changed.wakeAll();
+    }
+}
+
+int ProbeDispatcher::truncateJob(quint64 id, int count)
+{
+    QMutexLocker locker(&mutex);
+    QSharedPointer<Job> job = jobs.value(id);
+    if (!job) return -1;
+
+    job->end = qBound(job->next, count, job->end);
+    const int total = job->end;
+    removeIfDone(job);
+    changed.wakeAll();
+    return total;
+}
+
+int ProbeDispatcher::pending(quint64 id) const
+{
+    QMutexLocker locker(&mutex);
+    QSharedPointer<Job> job = jobs.value(id);
+    return job ? job->remaining() : 0;
+}
+
+bool ProbeDispatcher::hasJob(quint64 id) const
+{
+    QMutexLocker locker(&mutex);
+    return jobs.contains(id);
+}
+
+void ProbeDispatcher::waitForJob(quint64 id)
+{
+    QMutexLocker locker(&mutex);
+    while (jobs.contains(id)) {
+        jobDone.wait(&mutex);
+    }
+}
+
+void ProbeDispatcher::removeIfDone(const QSharedPointer<Job> &job)
+{
+    if (job->remaining() == 0 && job->inFlight == 0) {
+        detachHost(job);
+        jobs.remove(job->id);
+        jobDone.wakeAll();
+    }
+}
+
+void ProbeDispatcher::detachHost(const QSharedPointer<Job> &job)
+{
+    // Host state goes with the last job of the host; a later scan of it
+    // starts without a delay to sit out.
+    if (job->host && --job->host->jobs == 0) {
+        hosts.remove(job->host->name);
+    }
+    job->host.reset();
+}
+
+void ProbeDispatcher::spawnWorkers()
+{
+    int pendingTotal = 0;
+    for (const QSharedPointer<Job> &job : jobs) {
+        pendingTotal += job->remaining();
+    }
+    int wanted = qMin(slotLimit, pendingTotal);
+    while (workers < wanted) {
+        ++workers;
+        pool.start(new DispatchWorker([this]() { workerLoop(); }));
+    }
+}
+
+bool ProbeDispatcher::take(QSharedPointer<Job> &chosen, ProbeWork &work, int &timeout)
+{
+    QMutexLocker locker(&mutex);
+    forever {
+        qint64 now = rateClock.elapsed();
+        qint64 wakeIn = -1;
+        int pendingTotal = 0;
+        chosen.reset();
+
+        // Linear in the number of jobs, which stays small.
+        for (auto it = jobs.begin(); it != jobs.end();) {
+            const QSharedPointer<Job> &job = it.value();
+            if (job->token->isCancelled()) {
+                job->drop();
+            }
+            if (job->remaining() == 0) {
+                if (job->inFlight == 0) {
+                    detachHost(job);
+                    it = jobs.erase(it);
+                    jobDone.wakeAll();
+                } else {
+                    ++it;
+                }
+                continue;
+            }
+            pendingTotal += job->remaining();
+
+            if (job->paused || job->inFlight >= job->limits.concurrency) {
+                ++it;
+                continue;
+            }
+            if (const HostState *host = job->host.data()) {
+                if (host->limits.maxInFlight > 0 && host->inFlight >= host->limits.maxInFlight) {
+                    ++it;
+                    continue;
+                }
+                if (host->limits.minInterval > 0 && host->lastStart >= 0) {
+                    qint64 wait = host->lastStart + host->limits.minInterval - now;
+                    if (wait > 0) {
+                        wakeIn = wakeIn < 0 ? wait : qMin(wakeIn, wait);
+                        ++it;
+                        continue;
+                    }
+                }
+            }
+            double rate = job->limits.rateLimit;
+            if (rate > 0.0) {
+                // Token bucket with at most 100 ms worth of burst.
+                double burst = qMax(1.0, rate / 10.0);
+                job->rateTokens = qMin(burst, job->rateTokens + (now - job->lastRefill) * rate / 1000.0);
+                job->lastRefill = now;
+                if (job->rateTokens < 1.0) {
+                    qint64 wait = qMax<qint64>(1, qint64(std::ceil((1.0 - job->rateTokens) * 1000.0 / rate)));
+                    wakeIn = wakeIn < 0 ? wait : qMin(wakeIn, wait);
+                    ++it;
+                    continue;
+                }
+            }
+            if (!chosen || job->pass < chosen->pass) {
+                chosen = job;
+            }
+            ++it;
+        }
+
+        if (stopping || pendingTotal == 0 || workers > slotLimit) {
+            chosen.reset();
+            --workers;
+            return false;
+        }
+
+        if (chosen) {
+            if (chosen->limits.rateLimit > 0.0) {
+                chosen->rateTokens -= 1.0;
+            }
+            virtualTime = chosen->pass;
+            chosen->pass += StrideScale / quint64(chosen->limits.weight);
+            chosen->inFlight++;
+            if (chosen->host) {
+                chosen->host->inFlight++;
+                chosen->host->lastStart = now;
+            }
+            work.index = chosen->next++;
+            timeout = chosen->limits.timeout;
+            return true;
+        }
+
+        // Everything with work is paused, at its concurrency or host cap, or
+        // waiting for rate tokens or a host's interval.
+        if (wakeIn >= 0) {
+            changed.wait(&mutex, quint64(wakeIn));
+        } else {
+            changed.wait(&mutex);
+        }
+    }
+}
+
+void ProbeDispatcher::finish(const QSharedPointer<Job> &job)
+{
+    QMutexLocker locker(&mutex);
+    job->inFlight--;
+    if (job->host) {
+        job->host->inFlight--;
+    }
+    removeIfDone(job);
+    // A concurrency slot of this job just opened up.
+    changed.wakeAll();
+}
+
+void ProbeDispatcher::workerLoop()
+{
+    QSharedPointer<Job> job;
+    ProbeWork work;
+    int timeout = 0;
+    while (take(job, work, timeout)) {
+        job->executor(work, timeout);
+        finish(job);
+    }
+}
@@ -0,0 +1,160 @@
+#ifndef PROBEDISPATCHER_H
+#define PROBEDISPATCHER_H
+#include <QString>
+#include <QList>
+#include <QMap>
+#include <QHash>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QSharedPointer>
+#include <functional>
+
+class CancellationToken;
+
+// A job's probes are the indices 0..count-1 into a table its executor
+// keeps (a scan's plan). The engine only hands out the next index, so
+// queueing a job costs the same for one port as for 65535.
+struct ProbeWork
+{
+    int index = 0;
+};
+
+struct ProbeJobLimits
+{
+    int concurrency = 1;
+    int timeout = 1000;
+    // Probes per second; zero or less means unlimited.
+    double rateLimit = 0.0;
+    int weight = 1;
+    // Jobs naming the same host share its politeness limits. Empty for none.
+    QString host;
+};
+
+// What one host gets to see, however many jobs are probing it: fragile
+// devices can be held to a trickle while the rest of a multi-host scan
+// runs at full speed around them.
+struct HostPoliteness
+{
+    // Probes in flight at the host at once; 0 means no limit.
+    int maxInFlight = 0;
+    // Milliseconds from one probe's start to the next one's.
+    int minInterval = 0;
+
+    bool isLimited() const { return maxInFlight > 0 || minInterval > 0; }
+};
+
+// Pull-based probe engine shared by any number of scans ("jobs"). Worker
+// loops take one probe at a time, so per-job concurrency, timeout, rate cap
+// and pause all take effect at the next probe. When several jobs have work,
+// probe slots are handed out by stride scheduling: each job advances its pass
+// by 1/weight per probe and the lowest pass goes next, so jobs share the
+// engine in proportion to their weights however much work they queued.
+// Nothing is assigned to a worker ahead of time, so a slow host only ever
+// holds its own job's slots and never strands a backlog behind it.
+class ProbeDispatcher
+{
+public:
+    using Executor = std::function<void(const ProbeWork &work, int timeout)>;
+
+    explicit ProbeDispatcher(int slotCount = 0);
+    ~ProbeDispatcher();
+
+    // Total probes in flight across all jobs; 0 picks a default from the
+    // number of cores.
+    void setSlots(int count);
+    int slotCount() const;
+    // The most slots, or probes of one job, the engine will run at once.
+    static int maxSlots();
+
+    // Applies to every host without limits of its own, including the hosts
+    // of running jobs.
+    void setHostPoliteness(const HostPoliteness &politeness);
+    HostPoliteness hostPoliteness() const;
+    // Limits for one host, e.g. a PLC, in place of the default.
+    void setHostPoliteness(const QString &host, const HostPoliteness &politeness);
+    void clearHostPoliteness(const QString &host);
+
+    quint64 addJob(int count, const Executor &executor,
+                   const QSharedPointer<CancellationToken> &cancel, const ProbeJobLimits &limits);
+
+    void setJobConcurrency(quint64 job, int concurrency);
+    void setJobTimeout(quint64 job, int timeout);
+    void setJobRateLimit(quint64 job, double probesPerSecond);
+    void setJobWeight(quint64 job, int weight);
+
+    void pauseJob(quint64 job);
+    void resumeJob(quint64 job);
+    bool isJobPaused(quint64 job) const;
+
+    // Drops the job's queued probes. It goes away once its in-flight probes
+    // have returned.
+    void cancelJob(quint64 job);
+    // Drops the job's queued probes from index count on; ones already handed
+    // out stay. Returns how many probes the job now has in all, or -1 if it
+    // is already gone.
+    int truncateJob(quint64 job, int count);
+
+    int pending(quint64 job) const;
+    // A job exists until all its probes are handed out and none is in flight.
+    bool hasJob(quint64 job) const;
+    void waitForJob(quint64 job);
+
+private:
+    // Shared by the jobs of one host while any of them exists.
+    struct HostState
+    {
+        QString name;
+        HostPoliteness limits;
+        int inFlight = 0;
+        qint64 lastStart = -1;
+        int jobs = 0;
+    };
+
+    struct Job
+    {
+        quint64 id = 0;
+        // Probes next..end-1 have yet to be handed out.
+        int next = 0;
+        int end = 0;
+        Executor executor;
+        QSharedPointer<CancellationToken> token;
+        ProbeJobLimits limits;
+        QSharedPointer<HostState> host;
+        double rateTokens = 1.0;
+        qint64 lastRefill = 0;
+        quint64 pass = 0;
+        int inFlight = 0;
+        bool paused = false;
+
+        int remaining() const { return end - next; }
+        void drop() { next = end; }
+    };
+
+    bool take(QSharedPointer<Job> &job, ProbeWork &work, int &timeout);
+    void finish(const QSharedPointer<Job> &job);
+    void removeIfDone(const QSharedPointer<Job> &job);
+    void detachHost(const QSharedPointer<Job> &job);
+    void spawnWorkers();
+    void workerLoop();
+    HostPoliteness politenessFor(const QString &host) const;
+
+    QThreadPool pool;
+
+    mutable QMutex mutex;
+    QWaitCondition changed;
+    QWaitCondition jobDone;
+    QMap<quint64, QSharedPointer<Job>> jobs;
+    QHash<QString, QSharedPointer<HostState>> hosts;
+    HostPoliteness defaultPoliteness;
+    QHash<QString, HostPoliteness> politenessOverrides;
+    quint64 nextJobId;
+    quint64 virtualTime;
+    int slotLimit;
+    int workers;
+    bool stopping;
+    QElapsedTimer rateClock;
+};
+
+#endif
@@ -0,0 +1,230 @@
+#include "probetracer.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QThread>
+
+std::atomic<bool> ProbeTracer::enabled(false);
+
+static std::atomic<quint64> probeIdCounter(0);
+
+static const char *phaseName(TracePhase phase)
+{
+    switch (phase) {
+    case TracePhase::Probe: return "probe";
+    case TracePhase::Queued: return "queued";
+    case TracePhase::Connect: return "connect";
+    case TracePhase::Banner: return "banner";
+    case TracePhase::UdpExchange: return "udp exchange";
+    case TracePhase::Delivery: return "delivery";
+    case TracePhase::Gui: return "gui";
+    }
+    return "unknown";
+}
+
+static QByteArray jsonString(const QString &text)
+{
+    QByteArray out = "\"";
+    for (char c : text.toUtf8()) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (uchar(c) < 0x20) {
+            out += "\\u00" + QByteArray::number(uchar(c), 16).rightJustified(2, '0');
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+    return out;
+}
+
+ProbeTracer::ProbeTracer()
+    : ringCapacity(16384)
+{
+}
+
+ProbeTracer *ProbeTracer::instance()
+{
+    static ProbeTracer tracer;
+    return &tracer;
+}
+
+qint64 ProbeTracer::now()
+{
+    static const QElapsedTimer epoch = []() {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return epoch.nsecsElapsed();
+}
+
+quint64 ProbeTracer::nextProbeId()
+{
+    return probeIdCounter.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+quint64 ProbeTracer::reserveProbeIds(int count)
+{
+    return probeIdCounter.fetch_add(quint64(qMax(1, count)), std::memory_order_relaxed) + 1;
+}
+
+void ProbeTracer::setEnabled(bool on)
+{
+    now();
+    enabled.store(on, std::memory_order_relaxed);
+}
+
+void ProbeTracer::setRingCapacity(int events)
+{
+    QMutexLocker locker(&ringMutex);
+    ringCapacity = qMax(1024, events);
+}
+
+void ProbeTracer::clear()
+{
+    // Only meant to be called while recording is off; a worker still inside
+    // record() could otherwise land one stale event in a fresh ring.
+    QMutexLocker locker(&ringMutex);
+    for (Ring *ring : rings) {
+        if (ring->events.size() != ringCapacity) {
+            ring->events = QVector<TraceEvent>(ringCapacity);
+        }
+        ring->head.store(0, std::memory_order_release);
+    }
+}
+
+ProbeTracer::Ring *ProbeTracer::localRing()
+{
+    // Like the metric shards, rings outlive their threads so that a trace
+    // still shows the work of pool threads that have since expired, and go
+    // to the next new thread once theirs has exited, so pool threads coming
+    // and going don't add a ring each. They are only allocated once tracing
+    // has been switched on.
+    struct Lease
+    {
+        Ring *ring = nullptr;
+        ~Lease()
+        {
+            if (ring) ProbeTracer::instance()->releaseRing(ring);
+        }
+    };
+    thread_local Lease lease;
+    if (!lease.ring) {
+        lease.ring = acquireRing();
+    }
+    return lease.ring;
+}
+
+ProbeTracer::Ring *ProbeTracer::acquireRing()
+{
+    QThread *thread = QThread::currentThread();
+    QCoreApplication *app = QCoreApplication::instance();
+    QMutexLocker locker(&ringMutex);
+
+    // A reused ring keeps its track and the events already in it; the new
+    // thread's overwrite them oldest first.
+    Ring *ring = nullptr;
+    if (!freeRings.isEmpty()) {
+        ring = freeRings.takeLast();
+    } else {
+        ring = new Ring;
+        ring->head.store(0, std::memory_order_relaxed);
+        ring->events = QVector<TraceEvent>(ringCapacity);
+        ring->threadId = rings.size() + 1;
+        rings.append(ring);
+    }
+    if (!thread->objectName().isEmpty()) {
+        ring->threadName = thread->objectName();
+    } else if (app && thread == app->thread()) {
+        ring->threadName = "GUI thread";
+    } else {
+        ring->threadName = QString("worker %1").arg(ring->threadId);
+    }
+    return ring;
+}
+
+void ProbeTracer::releaseRing(Ring *ring)
+{
+    QMutexLocker locker(&ringMutex);
+    freeRings.append(ring);
+}
+
+void ProbeTracer::record(quint64 probeId, TracePhase phase, TraceEventKind kind, int port, qint64 timestampNs)
+{
+    Ring *ring = localRing();
+    quint64 head = ring->head.load(std::memory_order_relaxed);
+    TraceEvent &event = ring->events[int(head % quint64(ring->events.size()))];
+    event.timestampNs = timestampNs;
+    event.probeId = probeId;
+    event.port = quint16(port);
+    event.phase = phase;
+    event.kind = kind;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+int ProbeTracer::eventCount() const
+{
+    QMutexLocker locker(&ringMutex);
+    quint64 total = 0;
+    for (const Ring *ring : rings) {
+        total += qMin<quint64>(ring->head.load(std::memory_order_acquire), quint64(ring->events.size()));
+    }
+    return int(total);
+}
+
+QByteArray ProbeTracer::toChromeTraceJson() const
+{
+    // Async begin/end pairs keyed by probe id put each probe on its own track
+    // no matter which threads touched it; nested phases share the id.
+    QByteArray json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    auto separator = [&]() {
+        if (!first) {
+            json += ",\n";
+        }
+        first = false;
+    };
+
+    QMutexLocker locker(&ringMutex);
+    for (const Ring *ring : rings) {
+        separator();
+        json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + QByteArray::number(ring->threadId)
+                + ",\"args\":{\"name\":" + jsonString(ring->threadName) + "}}";
+
+        quint64 head = ring->head.load(std::memory_order_acquire);
+        quint64 capacity = quint64(ring->events.size());
+        quint64 begin = head > capacity ? head - capacity : 0;
+        for (quint64 i = begin; i < head; ++i) {
+            const TraceEvent &event = ring->events[int(i % capacity)];
+            separator();
+            json += "{\"name\":\"";
+            json += phaseName(event.phase);
+            json += "\",\"cat\":\"probe\",\"ph\":\"";
+            json += event.kind == TraceEventKind::Begin ? "b" : "e";
+            json += "\",\"id\":" + QByteArray::number(event.probeId);
+            json += ",\"ts\":" + QByteArray::number(event.timestampNs / 1000.0, 'f', 3);
+            json += ",\"pid\":1,\"tid\":" + QByteArray::number(ring->threadId);
+            json += ",\"args\":{\"port\":" + QByteArray::number(event.port) + "}}";
+        }
+    }
+    json += "\n]}\n";
+    return json;
+}
+
+bool ProbeTracer::exportChromeTrace(const QString &fileName, QString *errorString) const
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+    file.write(toChromeTraceJson());
+    if (!file.commit()) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+    return true;
+}
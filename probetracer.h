@@ -0,0 +1,100 @@
+#ifndef PROBETRACER_H
+#define PROBETRACER_H
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QMutex>
+#include <QList>
+#include <atomic>
+
+enum class TracePhase : quint8 {
+    Probe,
+    Queued,
+    Connect,
+    Banner,
+    UdpExchange,
+    Delivery,
+    Gui
+};
+
+enum class TraceEventKind : quint8 {
+    Begin,
+    End
+};
+
+struct TraceEvent
+{
+    qint64 timestampNs;
+    quint64 probeId;
+    quint16 port;
+    TracePhase phase;
+    TraceEventKind kind;
+};
+
+// Opt-in recorder of per-probe lifecycles. Each thread appends to its own
+// fixed-size ring (oldest events are overwritten), and the whole thing exports
+// as Chrome/Perfetto trace JSON where every probe is one async track:
+// queued -> connect -> banner -> delivery -> gui. While disabled, trace()
+// costs a single relaxed load.
+class ProbeTracer
+{
+public:
+    static ProbeTracer *instance();
+
+    static bool isEnabled()
+    {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    static void trace(quint64 probeId, TracePhase phase, TraceEventKind kind, int port)
+    {
+        if (isEnabled()) {
+            instance()->record(probeId, phase, kind, port, now());
+        }
+    }
+
+    static void traceAt(qint64 timestampNs, quint64 probeId, TracePhase phase, TraceEventKind kind, int port)
+    {
+        if (isEnabled()) {
+            instance()->record(probeId, phase, kind, port, timestampNs);
+        }
+    }
+
+    static qint64 now();
+    static quint64 nextProbeId();
+    // The first of count consecutive ids, for work that numbers its probes.
+    static quint64 reserveProbeIds(int count);
+
+    void setEnabled(bool on);
+    void setRingCapacity(int events);
+    void clear();
+
+    int eventCount() const;
+    QByteArray toChromeTraceJson() const;
+    bool exportChromeTrace(const QString &fileName, QString *errorString = nullptr) const;
+
+private:
+    struct Ring
+    {
+        QVector<TraceEvent> events;
+        std::atomic<quint64> head;
+        int threadId;
+        QString threadName;
+    };
+
+    ProbeTracer();
+    Ring *localRing();
+    Ring *acquireRing();
+    void releaseRing(Ring *ring);
+    void record(quint64 probeId, TracePhase phase, TraceEventKind kind, int port, qint64 timestampNs);
+
+    static std::atomic<bool> enabled;
+
+    mutable QMutex ringMutex;
+    QList<Ring *> rings;
+    // Rings of exited threads, handed to the next thread that records.
+    QList<Ring *> freeRings;
+    int ringCapacity;
+};
+
+#endif
@@ -0,0 +1,616 @@
+#include "probetransport.h"
+#include "scanmetrics.h"
+#include "socketbudget.h"
+#include <QTcpSocket>
+#include <QUdpSocket>
+#include <QHostAddress>
+#include <QHostInfo>
+#include <QNetworkInterface>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTimer>
+
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+#ifdef Q_OS_LINUX
+#include <netinet/tcp.h>
+#endif
+
+// How often a blocked probe looks at its cancellation token.
+static const int CancelSliceMs = 20;
+
+// Attempts after the first when a probe runs out of sockets or ports. Each
+// one backs off first and then waits for the shrunken budget, so they don't
+// pile on.
+static const int MaxExhaustedRetries = 3;
+
+// Enough for any banner the scan shows; longer answers are cut.
+static const int MaxUdpResponse = 2048;
+
+static bool isCancelled(const CancellationToken *cancel)
+{
+    return cancel && cancel->isCancelled();
+}
+
+#ifndef Q_OS_UNIX
+static bool waitForConnected(QTcpSocket &socket, int timeout, const CancellationToken *cancel)
+{
+    if (!cancel) {
+        return socket.waitForConnected(timeout);
+    }
+
+    // waitForConnected() gives up on the connection when it times out, so it
+    // can't be called in slices. Wait on the socket's own events instead and
+    // poll the token from a timer.
+    QEventLoop loop;
+    QObject::connect(&socket, &QAbstractSocket::stateChanged, &loop, [&loop](QAbstractSocket::SocketState state) {
+        if (state == QAbstractSocket::ConnectedState || state == QAbstractSocket::UnconnectedState) {
+            loop.quit();
+        }
+    });
+
+    QTimer deadline;
+    deadline.setSingleShot(true);
+    QObject::connect(&deadline, &QTimer::timeout, &loop, &QEventLoop::quit);
+
+    QTimer slice;
+    QObject::connect(&slice, &QTimer::timeout, &loop, [&loop, cancel]() {
+        if (cancel->isCancelled()) {
+            loop.quit();
+        }
+    });
+
+    if (socket.state() != QAbstractSocket::ConnectedState && socket.state() != QAbstractSocket::UnconnectedState) {
+        deadline.start(timeout);
+        slice.start(CancelSliceMs);
+        loop.exec();
+    }
+    return socket.state() == QAbstractSocket::ConnectedState;
+}
+#endif
+
+static bool waitForReadyRead(QAbstractSocket &socket, int timeout, const CancellationToken *cancel)
+{
+    if (!cancel) {
+        return socket.waitForReadyRead(timeout);
+    }
+
+    // Unlike connecting, a timed out read leaves the socket usable, so plain
+    // slices are enough here.
+    QElapsedTimer timer;
+    timer.start();
+    forever {
+        int remaining = timeout - int(timer.elapsed());
+        if (remaining <= 0 || cancel->isCancelled()) {
+            return false;
+        }
+        if (socket.waitForReadyRead(qMin(remaining, CancelSliceMs))) {
+            return true;
+        }
+        if (socket.state() == QAbstractSocket::UnconnectedState) {
+            return false;
+        }
+    }
+}
+
+static QHostAddress resolveHost(const QString &host)
+{
+    // Every probe of a scan resolves the same name; only look it up once.
+    // Failures aren't cached, so a name that comes up later still works.
+    // The cache comes first: parsing the name as an address allocates.
+    static QMutex cacheMutex;
+    static QHash<QString, QHostAddress> cache;
+    {
+        QMutexLocker locker(&cacheMutex);
+        auto it = cache.constFind(host);
+        if (it != cache.constEnd()) {
+            return it.value();
+        }
+    }
+
+    QHostAddress address(host);
+    if (!address.isNull()) {
+        return address;
+    }
+
+    const QList<QHostAddress> addresses = QHostInfo::fromName(host).addresses();
+    if (addresses.isEmpty()) {
+        return QHostAddress();
+    }
+    QMutexLocker locker(&cacheMutex);
+    cache.insert(host, addresses.first());
+    return addresses.first();
+}
+
+// IPv6 literals go in brackets, without their zone (RFC 7230, 6874).
+static QByteArray hostHeader(const QString &host)
+{
+    const QHostAddress address(host);
+    if (address.protocol() != QAbstractSocket::IPv6Protocol) {
+        return host.toUtf8();
+    }
+    QHostAddress bare = address;
+    bare.setScopeId(QString());
+    return "[" + bare.toString().toUtf8() + "]";
+}
+
+static void readBanner(QTcpSocket &socket, const TcpProbeRequest &request, TcpProbeReply &reply)
+{
+    switch (request.bannerMode) {
+    case BannerMode::None:
+        break;
+    case BannerMode::HttpGet:
+        socket.write("GET / HTTP/1.0\r\nHost: " + hostHeader(request.host) + "\r\n\r\n");
+        if (waitForReadyRead(socket, request.bannerWait, request.cancel)) {
+            reply.banner = socket.readAll();
+        }
+        break;
+    case BannerMode::Read:
+        if (waitForReadyRead(socket, request.bannerWait, request.cancel)) {
+            reply.banner = socket.readAll();
+        }
+        break;
+    }
+}
+
+#ifdef Q_OS_UNIX
+static ConnectOutcome outcomeForErrno(int error)
+{
+    switch (error) {
+    case ECONNREFUSED:
+        return ConnectOutcome::Refused;
+    case ETIMEDOUT:
+        return ConnectOutcome::TimedOut;
+    case EHOSTUNREACH:
+    case ENETUNREACH:
+    case ENETDOWN:
+    case EHOSTDOWN:
+        return ConnectOutcome::Unreachable;
+    case EADDRNOTAVAIL:
+    case EADDRINUSE:
+    case EAGAIN:
+    case EMFILE:
+    case ENFILE:
+    case ENOBUFS:
+    case ENOMEM:
+        return ConnectOutcome::ResourceExhausted;
+    default:
+        return ConnectOutcome::Error;
+    }
+}
+
+static socklen_t socketAddress(const QHostAddress &address, int port, sockaddr_storage &storage)
+{
+    std::memset(&storage, 0, sizeof(storage));
+    if (address.protocol() == QAbstractSocket::IPv6Protocol) {
+        sockaddr_in6 *in6 = reinterpret_cast<sockaddr_in6 *>(&storage);
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(quint16(port));
+        Q_IPV6ADDR bytes = address.toIPv6Address();
+        std::memcpy(&in6->sin6_addr, &bytes, sizeof(bytes));
+        // Link-local addresses mean nothing without their interface.
+        const QString scope = address.scopeId();
+        if (!scope.isEmpty()) {
+            bool numeric = false;
+            int index = scope.toInt(&numeric);
+            in6->sin6_scope_id = quint32(numeric ? index : QNetworkInterface::interfaceIndexFromName(scope));
+        }
+        return sizeof(sockaddr_in6);
+    }
+    sockaddr_in *in4 = reinterpret_cast<sockaddr_in *>(&storage);
+    in4->sin_family = AF_INET;
+    in4->sin_port = htons(quint16(port));
+    in4->sin_addr.s_addr = htonl(address.toIPv4Address());
+    return sizeof(sockaddr_in);
+}
+
+static int openNonBlocking(int family, int type)
+{
+    int fd = ::socket(family, type, 0);
+    if (fd >= 0) {
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+    return fd;
+}
+
+// Connects without QAbstractSocket, which folds EADDRNOTAVAIL and friends
+// into NetworkError; that read as unreachable and turned into false
+// "filtered" results once a fast scan ran out of local ports.
+static ConnectOutcome connectNative(const QHostAddress &address, int port, int timeout,
+                                    const CancellationToken *cancel, int &fd)
+{
+    sockaddr_storage storage;
+    socklen_t length = socketAddress(address, port, storage);
+
+    fd = openNonBlocking(storage.ss_family, SOCK_STREAM);
+    if (fd < 0) {
+        return outcomeForErrno(errno);
+    }
+
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&storage), length) == 0) {
+        return ConnectOutcome::Connected;
+    }
+    if (errno != EINPROGRESS) {
+        return outcomeForErrno(errno);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    forever {
+        if (isCancelled(cancel)) {
+            return ConnectOutcome::Cancelled;
+        }
+        int remaining = timeout - int(timer.elapsed());
+        if (remaining <= 0) {
+            return ConnectOutcome::TimedOut;
+        }
+        pollfd waiting;
+        waiting.fd = fd;
+        waiting.events = POLLOUT;
+        waiting.revents = 0;
+        int ready = ::poll(&waiting, 1, cancel ? qMin(remaining, CancelSliceMs) : remaining);
+        if (ready < 0 && errno != EINTR) {
+            return outcomeForErrno(errno);
+        }
+        if (ready > 0) {
+            int error = 0;
+            socklen_t size = sizeof(error);
+            ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &size);
+            return error == 0 ? ConnectOutcome::Connected : outcomeForErrno(error);
+        }
+    }
+}
+
+#ifdef Q_OS_LINUX
+// TCP_INFO has the options the handshake settled on and the peer's window
+// scale; the send MSS is what the peer advertised, less the timestamp option.
+static TcpFingerprint fingerprintOf(int fd)
+{
+    TcpFingerprint fingerprint;
+    tcp_info info;
+    socklen_t size = sizeof(info);
+    if (::getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &size) != 0) {
+        return fingerprint;
+    }
+    fingerprint.options = 0;
+    if (info.tcpi_options & TCPI_OPT_TIMESTAMPS) {
+        fingerprint.options |= TcpFingerprint::Timestamps;
+    }
+    if (info.tcpi_options & TCPI_OPT_SACK) {
+        fingerprint.options |= TcpFingerprint::Sack;
+    }
+    if (info.tcpi_options & TCPI_OPT_WSCALE) {
+        fingerprint.options |= TcpFingerprint::WindowScale;
+        fingerprint.windowScale = qint8(info.tcpi_snd_wscale);
+    }
+    fingerprint.mss = int(info.tcpi_snd_mss) + (fingerprint.options & TcpFingerprint::Timestamps ? 12 : 0);
+    return fingerprint;
+}
+#endif
+
+// SO_LINGER with a zero timeout makes close() send a reset: the port is free
+// at once instead of sitting in TIME_WAIT for a minute.
+static void closeAbortively(QTcpSocket &socket)
+{
+    linger reset;
+    reset.l_onoff = 1;
+    reset.l_linger = 0;
+    ::setsockopt(int(socket.socketDescriptor()), SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+    socket.abort();
+}
+
+static TcpProbeReply probeTcpOnce(const TcpProbeRequest &request, const QHostAddress &address)
+{
+    TcpProbeReply reply;
+    SocketLease lease(request.cancel);
+    if (!lease.isValid()) {
+        reply.outcome = ConnectOutcome::Cancelled;
+        return reply;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    int fd = -1;
+    reply.outcome = connectNative(address, request.port, request.timeout, request.cancel, fd);
+    reply.connectMicros = timer.nsecsElapsed() / 1000;
+    reply.connectTime = int(reply.connectMicros / 1000);
+
+    // Unconnected sockets never reach TIME_WAIT, so a plain close is enough.
+    if (reply.outcome != ConnectOutcome::Connected) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return reply;
+    }
+#ifdef Q_OS_LINUX
+    reply.fingerprint = fingerprintOf(fd);
+#endif
+
+    QTcpSocket socket;
+    if (!socket.setSocketDescriptor(fd)) {
+        ::close(fd);
+        reply.outcome = ConnectOutcome::Error;
+        return reply;
+    }
+
+    readBanner(socket, request, reply);
+    reply.bannerMicros = timer.nsecsElapsed() / 1000 - reply.connectMicros;
+    if (isCancelled(request.cancel)) {
+        reply.outcome = ConnectOutcome::Cancelled;
+    }
+    closeAbortively(socket);
+    return reply;
+}
+#else
+static TcpProbeReply probeTcpOnce(const TcpProbeRequest &request, const QHostAddress &address)
+{
+    TcpProbeReply reply;
+    SocketLease lease(request.cancel);
+    if (!lease.isValid()) {
+        reply.outcome = ConnectOutcome::Cancelled;
+        return reply;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QTcpSocket socket;
+    socket.connectToHost(address, quint16(request.port));
+
+    bool connected = waitForConnected(socket, request.timeout, request.cancel);
+    reply.connectMicros = timer.nsecsElapsed() / 1000;
+    reply.connectTime = int(reply.connectMicros / 1000);
+
+    if (!connected) {
+        if (isCancelled(request.cancel)) {
+            reply.outcome = ConnectOutcome::Cancelled;
+            socket.abort();
+            return reply;
+        }
+        if (socket.state() != QAbstractSocket::UnconnectedState) {
+            reply.outcome = ConnectOutcome::TimedOut;
+            socket.abort();
+            return reply;
+        }
+        switch (socket.error()) {
+        case QAbstractSocket::ConnectionRefusedError:
+            reply.outcome = ConnectOutcome::Refused;
+            break;
+        case QAbstractSocket::SocketTimeoutError:
+            reply.outcome = ConnectOutcome::TimedOut;
+            break;
+        case QAbstractSocket::SocketResourceError:
+        case QAbstractSocket::AddressInUseError:
+            reply.outcome = ConnectOutcome::ResourceExhausted;
+            break;
+        case QAbstractSocket::NetworkError:
+        case QAbstractSocket::HostNotFoundError:
+            reply.outcome = ConnectOutcome::Unreachable;
+            break;
+        default:
+            reply.outcome = ConnectOutcome::Error;
+            break;
+        }
+        return reply;
+    }
+
+    reply.outcome = ConnectOutcome::Connected;
+    readBanner(socket, request, reply);
+    reply.bannerMicros = timer.nsecsElapsed() / 1000 - reply.connectMicros;
+
+    if (isCancelled(request.cancel)) {
+        reply.outcome = ConnectOutcome::Cancelled;
+        socket.abort();
+        return reply;
+    }
+
+    // Without SO_LINGER control the close is graceful; the budget keeps the
+    // port out of its count until TIME_WAIT is over.
+    socket.disconnectFromHost();
+    lease.setTimeWait(true);
+    return reply;
+}
+#endif
+
+static TcpProbeReply probeTcpAt(const TcpProbeRequest &request, const QHostAddress &address)
+{
+    TcpProbeReply reply;
+    if (address.isNull()) {
+        reply.outcome = ConnectOutcome::Unreachable;
+        return reply;
+    }
+
+    reply = probeTcpOnce(request, address);
+    for (int retry = 1; reply.outcome == ConnectOutcome::ResourceExhausted; ++retry) {
+        SocketBudget::instance()->reportExhausted();
+        if (retry > MaxExhaustedRetries || !SocketBudget::instance()->backOff(retry, request.cancel)) {
+            return reply;
+        }
+        // Only the retry path copies the request.
+        TcpProbeRequest again = request;
+        again.attempt = request.attempt + retry;
+        ScanMetrics::instance()->add(ScanCounter::Retransmits);
+        reply = probeTcpOnce(again, address);
+    }
+    return reply;
+}
+
+TcpProbeReply SocketTransport::probeTcp(const TcpProbeRequest &request)
+{
+    if (isCancelled(request.cancel)) {
+        TcpProbeReply reply;
+        reply.outcome = ConnectOutcome::Cancelled;
+        return reply;
+    }
+    // A scan plan hands over its literal address, so probes don't each
+    // build one from the string.
+    if (request.address) {
+        return probeTcpAt(request, *request.address);
+    }
+    return probeTcpAt(request, resolveHost(request.host));
+}
+
+#ifdef Q_OS_UNIX
+// A plain datagram socket: a QUdpSocket per probe costs a QObject, its
+// private data and a notifier. Like the Qt version it takes any datagram
+// that arrives on the socket as the answer.
+static UdpProbeReply probeUdpOnce(const UdpProbeRequest &request, const QHostAddress &address)
+{
+    UdpProbeReply reply;
+    SocketLease lease(request.cancel);
+    if (!lease.isValid()) {
+        reply.cancelled = true;
+        return reply;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    sockaddr_storage target;
+    socklen_t length = socketAddress(address, request.port, target);
+    int fd = openNonBlocking(target.ss_family, SOCK_DGRAM);
+    if (fd < 0) {
+        reply.exhausted = outcomeForErrno(errno) == ConnectOutcome::ResourceExhausted;
+        reply.responseTime = int(timer.elapsed());
+        return reply;
+    }
+
+    if (::sendto(fd, request.payload.constData(), size_t(request.payload.size()), 0,
+                 reinterpret_cast<sockaddr *>(&target), length) < 0) {
+        reply.exhausted = outcomeForErrno(errno) == ConnectOutcome::ResourceExhausted;
+        reply.responseTime = int(timer.elapsed());
+        ::close(fd);
+        return reply;
+    }
+    reply.sent = true;
+
+    char buffer[MaxUdpResponse];
+    forever {
+        if (isCancelled(request.cancel)) {
+            reply.cancelled = true;
+            break;
+        }
+        int remaining = request.timeout - int(timer.elapsed());
+        if (remaining <= 0) {
+            break;
+        }
+        pollfd waiting;
+        waiting.fd = fd;
+        waiting.events = POLLIN;
+        waiting.revents = 0;
+        int ready = ::poll(&waiting, 1, request.cancel ? qMin(remaining, CancelSliceMs) : remaining);
+        if (ready < 0 && errno != EINTR) {
+            break;
+        }
+        if (ready > 0) {
+            ssize_t received = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (received >= 0) {
+                reply.answered = true;
+                reply.response = QByteArray(buffer, int(received));
+                break;
+            }
+            if (errno != EAGAIN && errno != EINTR) {
+                break;
+            }
+        }
+    }
+    reply.responseMicros = timer.nsecsElapsed() / 1000;
+    reply.responseTime = int(reply.responseMicros / 1000);
+    ::close(fd);
+    return reply;
+}
+#else
+static UdpProbeReply probeUdpOnce(const UdpProbeRequest &request, const QHostAddress &address)
+{
+    UdpProbeReply reply;
+    SocketLease lease(request.cancel);
+    if (!lease.isValid()) {
+        reply.cancelled = true;
+        return reply;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Bind the target's family explicitly; the dual-stack default fails
+    // where IPv6 is disabled and is IPv6-only where IPV6_V6ONLY is set.
+    QUdpSocket socket;
+    const bool v6 = address.protocol() == QAbstractSocket::IPv6Protocol;
+    if (!socket.bind(v6 ? QHostAddress(QHostAddress::AnyIPv6) : QHostAddress(QHostAddress::AnyIPv4), 0)) {
+        reply.exhausted = socket.error() == QAbstractSocket::SocketResourceError
+            || socket.error() == QAbstractSocket::AddressInUseError;
+        reply.responseTime = timer.elapsed();
+        return reply;
+    }
+
+    if (socket.writeDatagram(request.payload, address, quint16(request.port)) == -1) {
+        reply.exhausted = socket.error() == QAbstractSocket::SocketResourceError;
+        reply.responseTime = timer.elapsed();
+        return reply;
+    }
+    reply.sent = true;
+
+    reply.answered = waitForReadyRead(socket, request.timeout, request.cancel);
+    reply.cancelled = !reply.answered && isCancelled(request.cancel);
+    reply.responseMicros = timer.nsecsElapsed() / 1000;
+    reply.responseTime = int(reply.responseMicros / 1000);
+
+    if (reply.answered) {
+        QHostAddress sender;
+        quint16 senderPort;
+        while (socket.hasPendingDatagrams()) {
+            reply.response.resize(socket.pendingDatagramSize());
+            socket.readDatagram(reply.response.data(), reply.response.size(), &sender, &senderPort);
+        }
+    }
+    return reply;
+}
+#endif
+
+static UdpProbeReply probeUdpAt(const UdpProbeRequest &request, const QHostAddress &address)
+{
+    UdpProbeReply reply;
+    if (address.isNull()) {
+        return reply;
+    }
+
+    reply = probeUdpOnce(request, address);
+    for (int retry = 1; reply.exhausted; ++retry) {
+        SocketBudget::instance()->reportExhausted();
+        if (retry > MaxExhaustedRetries || !SocketBudget::instance()->backOff(retry, request.cancel)) {
+            return reply;
+        }
+        UdpProbeRequest again = request;
+        again.attempt = request.attempt + retry;
+        ScanMetrics::instance()->add(ScanCounter::Retransmits);
+        reply = probeUdpOnce(again, address);
+    }
+    return reply;
+}
+
+UdpProbeReply SocketTransport::probeUdp(const UdpProbeRequest &request)
+{
+    if (isCancelled(request.cancel)) {
+        UdpProbeReply reply;
+        reply.cancelled = true;
+        return reply;
+    }
+    if (request.address) {
+        return probeUdpAt(request, *request.address);
+    }
+    return probeUdpAt(request, resolveHost(request.host));
+}
@@ -0,0 +1,131 @@
+#ifndef PROBETRANSPORT_H
+#define PROBETRANSPORT_H
+#include <QString>
+#include <QByteArray>
+#include <atomic>
+
+class QHostAddress;
+
+enum class ConnectOutcome {
+    Connected,
+    Refused,
+    TimedOut,
+    Unreachable,
+    Error,
+    Cancelled,
+    // Out of descriptors or local ports. Says nothing about the target.
+    ResourceExhausted
+};
+
+enum class BannerMode {
+    None,
+    Read,
+    HttpGet
+};
+
+// Shared by a scan and all of its probes. Transports check it between short
+// wait slices, so cancel() frees their sockets within a few milliseconds.
+class CancellationToken
+{
+public:
+    void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+    bool isCancelled() const { return cancelled.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<bool> cancelled{false};
+};
+
+// What a connected probe saw of the target's TCP stack, for OS guessing.
+// Anything the platform doesn't expose stays at -1: plain sockets never see
+// the SYN-ACK's TTL, window or DF bit, only what the kernel negotiated.
+struct TcpFingerprint
+{
+    enum Option : qint8 {
+        Timestamps = 1,
+        Sack = 2,
+        WindowScale = 4
+    };
+
+    qint16 ttl = -1;
+    qint32 window = -1;
+    qint32 mss = -1;
+    // Options the peer agreed to, or -1 when unknown.
+    qint8 options = -1;
+    // Only set when WindowScale is among the options.
+    qint8 windowScale = -1;
+    qint8 dontFragment = -1;
+
+    bool isValid() const { return options >= 0 || ttl >= 0 || window >= 0; }
+};
+
+struct TcpProbeRequest
+{
+    QString host;
+    // The host's address when the caller already has it; otherwise the
+    // transport resolves host. Must outlive the call.
+    const QHostAddress *address = nullptr;
+    int port = 0;
+    int timeout = 1000;
+    BannerMode bannerMode = BannerMode::None;
+    int bannerWait = 0;
+    // Tries before this one; the transport counts its own retries on.
+    int attempt = 0;
+    const CancellationToken *cancel = nullptr;
+};
+
+struct TcpProbeReply
+{
+    ConnectOutcome outcome = ConnectOutcome::Error;
+    int connectTime = 0;
+    qint64 connectMicros = 0;
+    qint64 bannerMicros = 0;
+    QByteArray banner;
+    TcpFingerprint fingerprint;
+};
+
+struct UdpProbeRequest
+{
+    QString host;
+    const QHostAddress *address = nullptr;
+    int port = 0;
+    int timeout = 1000;
+    QByteArray payload;
+    int attempt = 0;
+    const CancellationToken *cancel = nullptr;
+};
+
+struct UdpProbeReply
+{
+    bool sent = false;
+    bool answered = false;
+    bool cancelled = false;
+    bool exhausted = false;
+    int responseTime = 0;
+    qint64 responseMicros = 0;
+    QByteArray response;
+};
+
+// Everything a probe does on the wire goes through a transport, so the scan
+// logic can run against real sockets or an in-process simulated network.
+// Implementations must be safe to call from many worker threads at once.
+class ProbeTransport
+{
+public:
+    virtual ~ProbeTransport() = default;
+
+    virtual TcpProbeReply probeTcp(const TcpProbeRequest &request) = 0;
+    virtual UdpProbeReply probeUdp(const UdpProbeRequest &request) = 0;
+};
+
+// Real sockets, within the process-wide SocketBudget. A probe that runs
+// into EMFILE or EADDRNOTAVAIL shrinks the budget and tries again before it
+// gives up with ResourceExhausted. Connected TCP probes are closed with a
+// reset, so they leave no TIME_WAIT port behind.
+class SocketTransport : public ProbeTransport
+{
+public:
+    TcpProbeReply probeTcp(const TcpProbeRequest &request) override;
+    UdpProbeReply probeUdp(const UdpProbeRequest &request) override;
+};
+
+#endif
@@ -0,0 +1,310 @@
+#include "resultindex.h"
+#include <QRegularExpression>
+#include <QtAlgorithms>
+#include <algorithm>
+#include <climits>
+#include <iterator>
+
+RecordBitmap::RecordBitmap(int size, bool set)
+{
+    resize(size);
+    if (set) {
+        words.fill(~quint64(0));
+        // Keep the bits past the end clear, so count() and andWith() stay exact.
+        if (bits % 64) {
+            words.last() &= (quint64(1) << (bits % 64)) - 1;
+        }
+    }
+}
+
+int RecordBitmap::size() const
+{
+    return bits;
+}
+
+void RecordBitmap::resize(int size)
+{
+    bits = size;
+    words.resize((size + 63) / 64);
+}
+
+void RecordBitmap::set(int record)
+{
+    if (record >= bits) {
+        resize(record + 1);
+    }
+    words[record / 64] |= quint64(1) << (record % 64);
+}
+
+bool RecordBitmap::test(int record) const
+{
+    return record < bits && (words.at(record / 64) >> (record % 64)) & 1;
+}
+
+void RecordBitmap::andWith(const RecordBitmap &other)
+{
+    for (int i = 0; i < words.size(); ++i) {
+        words[i] &= i < other.words.size() ? other.words.at(i) : 0;
+    }
+}
+
+void RecordBitmap::orWith(const RecordBitmap &other)
+{
+    if (other.bits > bits) {
+        resize(other.bits);
+    }
+    for (int i = 0; i < other.words.size(); ++i) {
+        words[i] |= other.words.at(i);
+    }
+}
+
+int RecordBitmap::count() const
+{
+    int total = 0;
+    for (quint64 word : words) {
+        total += qPopulationCount(word);
+    }
+    return total;
+}
+
+void RecordBitmap::forEach(const std::function<void(int record)> &visit) const
+{
+    for (int i = 0; i < words.size(); ++i) {
+        quint64 word = words.at(i);
+        while (word) {
+            int bit = qCountTrailingZeroBits(word);
+            visit(i * 64 + bit);
+            word &= word - 1;
+        }
+    }
+}
+
+quint64 TrigramIndex::key(const QChar *text)
+{
+    return (quint64(text[0].unicode()) << 32) | (quint64(text[1].unicode()) << 16) | quint64(text[2].unicode());
+}
+
+void TrigramIndex::add(quint32 id, const QString &text)
+{
+    const QString lower = text.toLower();
+    for (int i = 0; i + 3 <= lower.size(); ++i) {
+        QVector<quint32> &list = postings[key(lower.constData() + i)];
+        // Ids only grow, so a repeated trigram is always the last entry.
+        if (list.isEmpty() || list.last() != id) {
+            list.append(id);
+        }
+    }
+}
+
+void TrigramIndex::clear()
+{
+    postings.clear();
+}
+
+bool TrigramIndex::candidates(const QString &needle, QVector<quint32> &ids) const
+{
+    const QString lower = needle.toLower();
+    if (lower.size() < 3) {
+        return false;
+    }
+
+    QVector<const QVector<quint32> *> lists;
+    for (int i = 0; i + 3 <= lower.size(); ++i) {
+        auto it = postings.constFind(key(lower.constData() + i));
+        if (it == postings.constEnd()) {
+            ids.clear();
+            return true;
+        }
+        lists.append(&it.value());
+    }
+
+    // Intersect starting from the rarest trigram.
+    std::sort(lists.begin(), lists.end(), [](const QVector<quint32> *a, const QVector<quint32> *b) {
+        return a->size() < b->size();
+    });
+    ids = *lists.first();
+    for (int i = 1; i < lists.size() && !ids.isEmpty(); ++i) {
+        QVector<quint32> narrowed;
+        std::set_intersection(ids.constBegin(), ids.constEnd(), lists.at(i)->constBegin(), lists.at(i)->constEnd(),
+                              std::back_inserter(narrowed));
+        ids = narrowed;
+    }
+    return true;
+}
+
+bool ResultQuery::isEmpty() const
+{
+    return terms.isEmpty();
+}
+
+static QStringList tokenize(const QString &query, bool &unterminated)
+{
+    QStringList tokens;
+    QString token;
+    bool quoted = false;
+    bool hasToken = false;
+    for (QChar c : query) {
+        if (c == '"') {
+            quoted = !quoted;
+            hasToken = true;
+        } else if (c.isSpace() && !quoted) {
+            if (hasToken) {
+                tokens.append(token);
+            }
+            token.clear();
+            hasToken = false;
+        } else {
+            token.append(c);
+            hasToken = true;
+        }
+    }
+    if (hasToken) {
+        tokens.append(token);
+    }
+    unterminated = quoted;
+    return tokens;
+}
+
+static bool parseRanges(const QString &value, int minimum, int maximum, QVector<QPair<int, int>> &ranges)
+{
+    for (const QString &part : value.split(',', Qt::SkipEmptyParts)) {
+        QStringList bounds = part.split('-');
+        bool ok1 = false;
+        bool ok2 = false;
+        int low = bounds.value(0).toInt(&ok1);
+        int high = bounds.size() == 2 ? bounds.value(1).toInt(&ok2) : low;
+        if (bounds.size() == 1) {
+            ok2 = ok1;
+        }
+        if (!ok1 || !ok2 || bounds.size() > 2 || low < minimum || high > maximum || low > high) {
+            return false;
+        }
+        ranges.append(qMakePair(low, high));
+    }
+    return !ranges.isEmpty();
+}
+
+static bool parseResponseTime(const QString &value, QVector<QPair<int, int>> &ranges)
+{
+    bool ok = false;
+    if (value.startsWith("<=") || value.startsWith(">=")) {
+        int limit = value.mid(2).toInt(&ok);
+        ranges.append(value.startsWith('<') ? qMakePair(0, limit) : qMakePair(limit, INT_MAX));
+    } else if (value.startsWith('<') || value.startsWith('>')) {
+        int limit = value.mid(1).toInt(&ok);
+        ranges.append(value.startsWith('<') ? qMakePair(0, limit - 1) : qMakePair(limit + 1, INT_MAX));
+    } else {
+        return parseRanges(value, 0, INT_MAX, ranges);
+    }
+    return ok;
+}
+
+static bool parseStates(const QString &value, quint32 &states)
+{
+    static const QHash<QString, PortState> names = {
+        { "open", PortState::Open },
+        { "closed", PortState::Closed },
+        { "filtered", PortState::Filtered },
+        { "open|filtered", PortState::OpenFiltered },
+        { "open-filtered", PortState::OpenFiltered },
+        { "unfiltered", PortState::Unfiltered },
+        { "error", PortState::Error },
+        { "exhausted", PortState::Exhausted },
+    };
+    for (const QString &name : value.toLower().split(',', Qt::SkipEmptyParts)) {
+        auto it = names.constFind(name);
+        if (it == names.constEnd()) {
+            return false;
+        }
+        states |= 1u << quint32(it.value());
+    }
+    return states != 0;
+}
+
+bool ResultQuery::parse(const QString &query, ResultQuery &result, QString *errorString)
+{
+    static const QHash<QString, ResultQueryTerm::Field> fields = {
+        { "host", ResultQueryTerm::Host },
+        { "port", ResultQueryTerm::Port },
+        { "proto", ResultQueryTerm::Protocol },
+        { "protocol", ResultQueryTerm::Protocol },
+        { "state", ResultQueryTerm::State },
+        { "status", ResultQueryTerm::State },
+        { "service", ResultQueryTerm::Service },
+        { "banner", ResultQueryTerm::Banner },
+        { "rtt", ResultQueryTerm::ResponseTime },
+    };
+    static const QRegularExpression fieldName("^[A-Za-z]+$");
+
+    auto fail = [errorString](const QString &message) {
+        if (errorString) {
+            *errorString = message;
+        }
+        return false;
+    };
+
+    result.terms.clear();
+    bool unterminated = false;
+    const QStringList tokens = tokenize(query, unterminated);
+    if (unterminated) {
+        return fail("Unterminated quote");
+    }
+
+    for (const QString &token : tokens) {
+        ResultQueryTerm term;
+        int colon = token.indexOf(':');
+        QString name = colon > 0 ? token.left(colon).toLower() : QString();
+        auto field = fields.constFind(name);
+
+        if (field == fields.constEnd()) {
+            // "10.0.0.1:80" and IPv6 addresses are free text, "foo:bar" is a typo.
+            if (!name.isEmpty() && fieldName.match(name).hasMatch()) {
+                return fail(QString("Unknown filter field \"%1\"").arg(name));
+            }
+            term.text = token.toLower();
+            result.terms.append(term);
+            continue;
+        }
+
+        term.field = field.value();
+        const QString value = token.mid(colon + 1);
+        if (value.isEmpty()) {
+            return fail(QString("Missing value for %1:").arg(name));
+        }
+
+        switch (term.field) {
+        case ResultQueryTerm::Port:
+            if (!parseRanges(value, 0, 65535, term.ranges)) {
+                return fail(QString("Invalid port list \"%1\"").arg(value));
+            }
+            break;
+        case ResultQueryTerm::ResponseTime:
+            if (!parseResponseTime(value, term.ranges)) {
+                return fail(QString("Invalid response time \"%1\"").arg(value));
+            }
+            break;
+        case ResultQueryTerm::State:
+            if (!parseStates(value, term.states)) {
+                return fail(QString("Invalid state \"%1\"").arg(value));
+            }
+            break;
+        case ResultQueryTerm::Protocol:
+            if (value.compare("tcp", Qt::CaseInsensitive) == 0) {
+                term.protocol = PortProtocol::TCP;
+            } else if (value.compare("udp", Qt::CaseInsensitive) == 0) {
+                term.protocol = PortProtocol::UDP;
+            } else {
+                return fail(QString("Invalid protocol \"%1\"").arg(value));
+            }
+            break;
+        case ResultQueryTerm::Text:
+        case ResultQueryTerm::Host:
+        case ResultQueryTerm::Service:
+        case ResultQueryTerm::Banner:
+            term.text = value.toLower();
+            break;
+        }
+        result.terms.append(term);
+    }
+    return true;
+}
@@ -0,0 +1,93 @@
+#ifndef RESULTINDEX_H
+#define RESULTINDEX_H
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QPair>
+#include <functional>
+#include "resultstore.h"
+
+// One bit per result record.
+class RecordBitmap
+{
+public:
+    RecordBitmap() = default;
+    explicit RecordBitmap(int size, bool set = false);
+
+    int size() const;
+    void resize(int size);
+    void set(int record);
+    bool test(int record) const;
+
+    void andWith(const RecordBitmap &other);
+    void orWith(const RecordBitmap &other);
+    int count() const;
+    // Calls visit for every set bit, in record order.
+    void forEach(const std::function<void(int record)> &visit) const;
+
+private:
+    QVector<quint64> words;
+    int bits = 0;
+};
+
+// Trigram index over a growing table of strings, keyed by the caller's string
+// ids, which must be added in increasing order. candidates() narrows a
+// substring search to the strings that contain every trigram of the needle;
+// the caller still checks those for the actual substring.
+class TrigramIndex
+{
+public:
+    void add(quint32 id, const QString &text);
+    void clear();
+
+    // False when the needle is too short to use the index; scan everything then.
+    bool candidates(const QString &needle, QVector<quint32> &ids) const;
+
+private:
+    static quint64 key(const QChar *text);
+
+    QHash<quint64, QVector<quint32>> postings;
+};
+
+// Filter query for the results view. Terms are separated by spaces and all
+// have to match:
+//
+//   port:22  port:1-1024  port:22,80,443
+//   state:open  state:closed,filtered  (open, closed, filtered, open|filtered, unfiltered, error, exhausted)
+//   proto:tcp  proto:udp
+//   host:10.0.  service:http  banner:nginx  (case-insensitive substring)
+//   rtt:<100  rtt:>500  rtt:100-200  (milliseconds)
+//   anything else  substring of host, port, protocol, state, service or banner
+//
+// Values may be quoted: banner:"Apache httpd".
+struct ResultQueryTerm
+{
+    enum Field {
+        Text,
+        Host,
+        Port,
+        Protocol,
+        State,
+        Service,
+        Banner,
+        ResponseTime
+    };
+
+    Field field = Text;
+    QString text;
+    // Inclusive ranges for Port and ResponseTime.
+    QVector<QPair<int, int>> ranges;
+    quint32 states = 0;
+    PortProtocol protocol = PortProtocol::TCP;
+};
+
+struct ResultQuery
+{
+    QVector<ResultQueryTerm> terms;
+
+    bool isEmpty() const;
+    static bool parse(const QString &query, ResultQuery &result, QString *errorString = nullptr);
+};
+
+#endif
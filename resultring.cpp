@@ -0,0 +1,75 @@
+#include "resultring.h"
+
+static quint64 roundUpToPowerOfTwo(int value)
+{
+    quint64 size = 2;
+    while (size < quint64(qMax(2, value))) {
+        size <<= 1;
+    }
+    return size;
+}
+
+ProbeResultRing::ProbeResultRing(int capacity)
+    : cells(nullptr)
+    , mask(roundUpToPowerOfTwo(capacity) - 1)
+    , head(0)
+    , tail(0)
+{
+    cells = new Cell[mask + 1];
+    for (quint64 i = 0; i <= mask; ++i) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+ProbeResultRing::~ProbeResultRing()
+{
+    delete[] cells;
+}
+
+bool ProbeResultRing::tryPush(ProbeResult &result)
+{
+    quint64 position = head.load(std::memory_order_relaxed);
+    Cell *cell;
+    forever {
+        cell = &cells[position & mask];
+        quint64 sequence = cell->sequence.load(std::memory_order_acquire);
+        qint64 difference = qint64(sequence) - qint64(position);
+        if (difference == 0) {
+            if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            // The consumer hasn't freed this cell since the last lap: full.
+            return false;
+        } else {
+            position = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->value = std::move(result);
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+int ProbeResultRing::drain(QVector<ProbeResult> &out, int maxResults)
+{
+    int taken = 0;
+    while (taken < maxResults) {
+        Cell &cell = cells[tail & mask];
+        if (cell.sequence.load(std::memory_order_acquire) != tail + 1) {
+            break;
+        }
+        out.append(std::move(cell.value));
+        cell.value = ProbeResult();
+        // Hand the cell back to producers for the next lap.
+        cell.sequence.store(tail + mask + 1, std::memory_order_release);
+        ++tail;
+        ++taken;
+    }
+    return taken;
+}
+
+int ProbeResultRing::capacity() const
+{
+    return int(mask + 1);
+}
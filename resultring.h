@@ -0,0 +1,62 @@
+#ifndef RESULTRING_H
+#define RESULTRING_H
+#include <QString>
+#include <QVector>
+#include <QMetaType>
+#include <atomic>
+#include "probetransport.h"
+#include "resultstore.h"
+
+// One probe's outcome as it travels from a probe thread to the GUI thread.
+// The strings are implicitly shared, and empty for most ports.
+struct ProbeResult
+{
+    quint64 probeId = 0;
+    int port = 0;
+    PortState state = PortState::Error;
+    int responseTime = 0;
+    QString service;
+    QString banner;
+    // Only for ports a TCP probe connected to.
+    TcpFingerprint fingerprint;
+};
+
+Q_DECLARE_METATYPE(ProbeResult)
+
+// Bounded multi-producer, single-consumer ring. Probe threads push without
+// taking a lock: each claims a cell by bumping the head with a CAS, then
+// publishes it through the cell's sequence number (Vyukov's bounded queue).
+// The consumer drains whatever is published, in batches, on its own thread.
+class ProbeResultRing
+{
+public:
+    // Capacity is rounded up to a power of two.
+    explicit ProbeResultRing(int capacity = 65536);
+    ~ProbeResultRing();
+
+    // Any thread. Moves result into the ring, or leaves it untouched and
+    // returns false when the ring is full.
+    bool tryPush(ProbeResult &result);
+
+    // Consumer thread only. Appends up to maxResults results to out and
+    // returns how many it took.
+    int drain(QVector<ProbeResult> &out, int maxResults);
+
+    int capacity() const;
+
+private:
+    Q_DISABLE_COPY(ProbeResultRing)
+
+    struct Cell
+    {
+        std::atomic<quint64> sequence;
+        ProbeResult value;
+    };
+
+    Cell *cells;
+    const quint64 mask;
+    alignas(64) std::atomic<quint64> head;
+    alignas(64) quint64 tail;
+};
+
+#endif
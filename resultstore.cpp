@@ -0,0 +1,523 @@
+#include "resultstore.h"
+#include <QDateTime>
+#include <QSaveFile>
+#include <algorithm>
+#include <cstring>
+
+static const char ResultStoreMagic[4] = { 'C', 'S', 'R', 'S' };
+static const quint32 ResultStoreVersion = 1;
+
+static quint32 bannerHash(const QByteArray &data)
+{
+    // FNV-1a: stable across processes, unlike qHash() which is seeded per run.
+    quint32 hash = 2166136261u;
+    for (char c : data) {
+        hash ^= static_cast<quint8>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int compareBytes(const char *a, quint32 aLength, const char *b, quint32 bLength)
+{
+    int result = std::memcmp(a, b, qMin(aLength, bLength));
+    if (result != 0) {
+        return result;
+    }
+    return aLength < bLength ? -1 : (aLength > bLength ? 1 : 0);
+}
+
+PortState portStateFromString(const QString &status)
+{
+    if (status == "Open") return PortState::Open;
+    if (status == "Closed") return PortState::Closed;
+    if (status == "Filtered") return PortState::Filtered;
+    if (status == "Open|Filtered") return PortState::OpenFiltered;
+    if (status == "Unfiltered") return PortState::Unfiltered;
+    if (status == "Exhausted") return PortState::Exhausted;
+    return PortState::Error;
+}
+
+QString portStateName(PortState state)
+{
+    switch (state) {
+    case PortState::Open: return "Open";
+    case PortState::Closed: return "Closed";
+    case PortState::Filtered: return "Filtered";
+    case PortState::OpenFiltered: return "Open|Filtered";
+    case PortState::Unfiltered: return "Unfiltered";
+    case PortState::Error: return "Error";
+    case PortState::Exhausted: return "Exhausted";
+    }
+    return "Error";
+}
+
+ResultStoreWriter::ResultStoreWriter()
+{
+}
+
+void ResultStoreWriter::addResult(const QString &host, int port, PortProtocol protocol, PortState state,
+                                  const QString &banner, int responseTime)
+{
+    quint32 hostId;
+    auto hostIt = hostIds.constFind(host);
+    if (hostIt != hostIds.constEnd()) {
+        hostId = hostIt.value();
+    } else {
+        hostId = hostNames.size();
+        hostIds.insert(host, hostId);
+        hostNames.append(host.toUtf8());
+    }
+
+    ResultRecord record;
+    record.host = hostId;
+    record.port = static_cast<quint16>(port);
+    record.protocol = static_cast<quint8>(protocol);
+    record.state = static_cast<quint8>(state);
+    record.responseTime = static_cast<quint32>(qMax(0, responseTime));
+    record.bannerHash = 0;
+    record.bannerOffset = 0;
+    record.bannerLength = 0;
+
+    if (!banner.isEmpty()) {
+        QByteArray bytes = banner.toUtf8();
+        auto bannerIt = bannerOffsets.constFind(bytes);
+        if (bannerIt != bannerOffsets.constEnd()) {
+            record.bannerOffset = bannerIt.value();
+        } else {
+            record.bannerOffset = bannerPool.size();
+            bannerOffsets.insert(bytes, record.bannerOffset);
+            bannerPool.append(bytes);
+        }
+        record.bannerLength = bytes.size();
+        record.bannerHash = bannerHash(bytes);
+    }
+
+    records.append(record);
+}
+
+void ResultStoreWriter::clear()
+{
+    records.clear();
+    hostNames.clear();
+    hostIds.clear();
+    bannerPool.clear();
+    bannerOffsets.clear();
+}
+
+int ResultStoreWriter::count() const
+{
+    return records.size();
+}
+
+QByteArray ResultStoreWriter::toByteArray() const
+{
+    // Host ids are handed out in arrival order; the file wants them sorted by
+    // name so two stores can be merged without a lookup table.
+    QVector<quint32> order(hostNames.size());
+    for (int i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [this](quint32 a, quint32 b) {
+        return hostNames.at(a) < hostNames.at(b);
+    });
+
+    QVector<quint32> rank(hostNames.size());
+    for (int i = 0; i < order.size(); ++i) {
+        rank[order.at(i)] = i;
+    }
+
+    QVector<ResultRecord> sorted;
+    sorted.reserve(records.size());
+    for (const ResultRecord &record : records) {
+        ResultRecord copy = record;
+        copy.host = rank.at(record.host);
+        sorted.append(copy);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const ResultRecord &a, const ResultRecord &b) {
+        if (a.host != b.host) return a.host < b.host;
+        if (a.protocol != b.protocol) return a.protocol < b.protocol;
+        return a.port < b.port;
+    });
+
+    // A rescanned port keeps only its most recent result.
+    QVector<ResultRecord> unique;
+    unique.reserve(sorted.size());
+    for (const ResultRecord &record : sorted) {
+        if (!unique.isEmpty()) {
+            ResultRecord &last = unique.last();
+            if (last.host == record.host && last.protocol == record.protocol && last.port == record.port) {
+                last = record;
+                continue;
+            }
+        }
+        unique.append(record);
+    }
+
+    QByteArray pool = bannerPool;
+    QVector<quint32> hostTable;
+    hostTable.reserve(hostNames.size() * 2);
+    for (quint32 id : order) {
+        hostTable.append(pool.size());
+        hostTable.append(hostNames.at(id).size());
+        pool.append(hostNames.at(id));
+    }
+
+    ResultStoreHeader header;
+    std::memcpy(header.magic, ResultStoreMagic, sizeof(header.magic));
+    header.version = ResultStoreVersion;
+    header.hostCount = hostNames.size();
+    header.reserved = 0;
+    header.recordCount = unique.size();
+    header.poolSize = pool.size();
+    header.createdMs = QDateTime::currentMSecsSinceEpoch();
+
+    QByteArray data;
+    data.reserve(sizeof(header) + hostTable.size() * sizeof(quint32)
+                 + unique.size() * sizeof(ResultRecord) + pool.size());
+    data.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    data.append(reinterpret_cast<const char *>(hostTable.constData()), hostTable.size() * sizeof(quint32));
+    data.append(reinterpret_cast<const char *>(unique.constData()), unique.size() * sizeof(ResultRecord));
+    data.append(pool);
+    return data;
+}
+
+bool ResultStoreWriter::write(const QString &fileName, QString *errorString) const
+{
+    if (static_cast<quint64>(bannerPool.size()) > 0xFFFFFFFFull) {
+        if (errorString) *errorString = "Banner pool exceeds 4 GiB";
+        return false;
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+
+    QByteArray data = toByteArray();
+    if (file.write(data) != data.size() || !file.commit()) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+ResultStore::ResultStore()
+    : mapped(nullptr)
+    , header(nullptr)
+    , hostTable(nullptr)
+    , records(nullptr)
+    , pool(nullptr)
+{
+}
+
+ResultStore::~ResultStore()
+{
+    close();
+}
+
+bool ResultStore::open(const QString &fileName)
+{
+    close();
+
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+
+    mapped = file.map(0, file.size());
+    if (!mapped) {
+        error = file.errorString();
+        file.close();
+        return false;
+    }
+
+    if (!attach(mapped, file.size())) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool ResultStore::openBuffer(const QByteArray &data)
+{
+    close();
+
+    buffer = data;
+    if (!attach(reinterpret_cast<const uchar *>(buffer.constData()), buffer.size())) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void ResultStore::close()
+{
+    if (mapped) {
+        file.unmap(mapped);
+        mapped = nullptr;
+    }
+    if (file.isOpen()) {
+        file.close();
+    }
+    buffer.clear();
+    header = nullptr;
+    hostTable = nullptr;
+    records = nullptr;
+    pool = nullptr;
+}
+
+bool ResultStore::attach(const uchar *base, quint64 size)
+{
+    if (size < sizeof(ResultStoreHeader)) {
+        error = "File is too small to be a result store";
+        return false;
+    }
+
+    const ResultStoreHeader *candidate = reinterpret_cast<const ResultStoreHeader *>(base);
+    if (std::memcmp(candidate->magic, ResultStoreMagic, sizeof(ResultStoreMagic)) != 0) {
+        error = "Not a CyberScanner result store";
+        return false;
+    }
+    if (candidate->version != ResultStoreVersion) {
+        error = QString("Unsupported result store version %1").arg(candidate->version);
+        return false;
+    }
+
+    // Every part is checked against the file size before they are added up,
+    // so a crafted header can't wrap the sum.
+    quint64 hostBytes = quint64(candidate->hostCount) * 2 * sizeof(quint32);
+    if (hostBytes > size || candidate->recordCount > size / sizeof(ResultRecord) || candidate->poolSize > size) {
+        error = "Result store is truncated or corrupt";
+        return false;
+    }
+    quint64 recordBytes = candidate->recordCount * sizeof(ResultRecord);
+    quint64 expected = sizeof(ResultStoreHeader) + hostBytes + recordBytes + candidate->poolSize;
+    if (expected != size) {
+        error = "Result store is truncated or corrupt";
+        return false;
+    }
+
+    const quint32 *candidateHosts = reinterpret_cast<const quint32 *>(base + sizeof(ResultStoreHeader));
+    const ResultRecord *candidateRecords = reinterpret_cast<const ResultRecord *>(base + sizeof(ResultStoreHeader) + hostBytes);
+    const char *candidatePool = reinterpret_cast<const char *>(base + sizeof(ResultStoreHeader) + hostBytes + recordBytes);
+
+    // The diff merges two host tables by name, so names must be in strictly
+    // ascending byte order.
+    for (quint32 i = 0; i < candidate->hostCount; ++i) {
+        if (quint64(candidateHosts[i * 2]) + candidateHosts[i * 2 + 1] > candidate->poolSize) {
+            error = "Result store host table is corrupt";
+            return false;
+        }
+        if (i > 0 && compareBytes(candidatePool + candidateHosts[i * 2 - 2], candidateHosts[i * 2 - 1],
+                                  candidatePool + candidateHosts[i * 2], candidateHosts[i * 2 + 1]) >= 0) {
+            error = "Result store host table is not sorted";
+            return false;
+        }
+    }
+
+    // The diff merges stores linearly and indexes host tables by record, so
+    // both the order and the host ids have to hold.
+    for (quint64 i = 0; i < candidate->recordCount; ++i) {
+        const ResultRecord &record = candidateRecords[i];
+        if (record.host >= candidate->hostCount) {
+            error = "Result store record names an unknown host";
+            return false;
+        }
+        if (i > 0) {
+            const ResultRecord &previous = candidateRecords[i - 1];
+            const bool ordered = previous.host != record.host ? previous.host < record.host
+                                 : previous.protocol != record.protocol ? previous.protocol < record.protocol
+                                 : previous.port < record.port;
+            if (!ordered) {
+                error = "Result store records are not sorted";
+                return false;
+            }
+        }
+    }
+
+    header = candidate;
+    hostTable = candidateHosts;
+    records = candidateRecords;
+    pool = candidatePool;
+    return true;
+}
+
+bool ResultStore::isOpen() const
+{
+    return header != nullptr;
+}
+
+QString ResultStore::errorString() const
+{
+    return error;
+}
+
+qint64 ResultStore::createdMs() const
+{
+    return header ? header->createdMs : 0;
+}
+
+quint64 ResultStore::recordCount() const
+{
+    return header ? header->recordCount : 0;
+}
+
+quint32 ResultStore::hostCount() const
+{
+    return header ? header->hostCount : 0;
+}
+
+const ResultRecord &ResultStore::record(quint64 index) const
+{
+    return records[index];
+}
+
+QByteArray ResultStore::hostNameBytes(quint32 host) const
+{
+    if (!header || host >= header->hostCount) {
+        return QByteArray();
+    }
+    return QByteArray::fromRawData(pool + hostTable[host * 2], hostTable[host * 2 + 1]);
+}
+
+QString ResultStore::hostName(quint32 host) const
+{
+    return QString::fromUtf8(hostNameBytes(host));
+}
+
+QByteArray ResultStore::bannerBytes(const ResultRecord &record) const
+{
+    if (!header || record.bannerLength == 0
+        || quint64(record.bannerOffset) + record.bannerLength > header->poolSize) {
+        return QByteArray();
+    }
+    return QByteArray::fromRawData(pool + record.bannerOffset, record.bannerLength);
+}
+
+QString ResultStore::banner(const ResultRecord &record) const
+{
+    return QString::fromUtf8(bannerBytes(record));
+}
+
+static QVector<quint32> unifiedHostRanks(const ResultStore &a, const ResultStore &b, QVector<quint32> &bRanks)
+{
+    // Both host tables are sorted, so one merge assigns every host a rank that
+    // is comparable across the two stores.
+    QVector<quint32> aRanks(a.hostCount());
+    bRanks.resize(b.hostCount());
+
+    quint32 i = 0;
+    quint32 j = 0;
+    quint32 rank = 0;
+    while (i < a.hostCount() || j < b.hostCount()) {
+        if (i == a.hostCount()) {
+            bRanks[j++] = rank++;
+            continue;
+        }
+        if (j == b.hostCount()) {
+            aRanks[i++] = rank++;
+            continue;
+        }
+
+        QByteArray left = a.hostNameBytes(i);
+        QByteArray right = b.hostNameBytes(j);
+        int cmp = compareBytes(left.constData(), left.size(), right.constData(), right.size());
+        if (cmp < 0) {
+            aRanks[i++] = rank++;
+        } else if (cmp > 0) {
+            bRanks[j++] = rank++;
+        } else {
+            aRanks[i++] = rank;
+            bRanks[j++] = rank++;
+        }
+    }
+    return aRanks;
+}
+
+ResultDiffSummary diffResultStores(const ResultStore &before, const ResultStore &after,
+                                   const std::function<void(const ResultChange &)> &visitor)
+{
+    ResultDiffSummary summary;
+    if (!before.isOpen() || !after.isOpen()) {
+        return summary;
+    }
+
+    QVector<quint32> afterRanks;
+    QVector<quint32> beforeRanks = unifiedHostRanks(before, after, afterRanks);
+
+    auto key = [](quint32 rank, const ResultRecord &record) {
+        return (quint64(rank) << 24) | (quint64(record.protocol) << 16) | record.port;
+    };
+
+    auto report = [&](ResultChange::Type type, const ResultRecord *old, const ResultRecord *current) {
+        if (!visitor) return;
+        ResultChange change;
+        change.type = type;
+        change.host = current ? after.hostName(current->host) : before.hostName(old->host);
+        change.port = current ? current->port : old->port;
+        change.protocol = static_cast<PortProtocol>(current ? current->protocol : old->protocol);
+        change.oldState = old ? static_cast<PortState>(old->state) : PortState::Closed;
+        change.newState = current ? static_cast<PortState>(current->state) : PortState::Closed;
+        change.oldBanner = old ? before.banner(*old) : QString();
+        change.newBanner = current ? after.banner(*current) : QString();
+        visitor(change);
+    };
+
+    const quint64 beforeCount = before.recordCount();
+    const quint64 afterCount = after.recordCount();
+    quint64 i = 0;
+    quint64 j = 0;
+
+    while (i < beforeCount || j < afterCount) {
+        const ResultRecord *old = i < beforeCount ? &before.record(i) : nullptr;
+        const ResultRecord *current = j < afterCount ? &after.record(j) : nullptr;
+
+        quint64 oldKey = old ? key(beforeRanks.at(old->host), *old) : ~0ull;
+        quint64 newKey = current ? key(afterRanks.at(current->host), *current) : ~0ull;
+
+        if (oldKey < newKey) {
+            ++i;
+            continue;
+        }
+
+        if (newKey < oldKey) {
+            if (current->state == quint8(PortState::Open)) {
+                summary.opened++;
+                report(ResultChange::Opened, nullptr, current);
+            }
+            ++j;
+            continue;
+        }
+
+        // A port the newer scan had no socket for wasn't rescanned.
+        if (current->state == quint8(PortState::Exhausted)) {
+            ++i;
+            ++j;
+            continue;
+        }
+
+        summary.compared++;
+        bool wasOpen = old->state == quint8(PortState::Open);
+        bool isOpen = current->state == quint8(PortState::Open);
+
+        if (!wasOpen && isOpen) {
+            summary.opened++;
+            report(ResultChange::Opened, old, current);
+        } else if (wasOpen && !isOpen) {
+            summary.closed++;
+            report(ResultChange::Closed, old, current);
+        } else if (wasOpen && isOpen
+                   && (old->bannerHash != current->bannerHash
+                       || before.bannerBytes(*old) != after.bannerBytes(*current))) {
+            summary.bannerChanged++;
+            report(ResultChange::BannerChanged, old, current);
+        }
+        ++i;
+        ++j;
+    }
+
+    return summary;
+}
@@ -0,0 +1,160 @@
+#ifndef RESULTSTORE_H
+#define RESULTSTORE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QHash>
+#include <QFile>
+#include <functional>
+
+enum class PortState : quint8 {
+    Open,
+    Closed,
+    Filtered,
+    OpenFiltered,
+    Unfiltered,
+    Error,
+    // No probe went out: the scanner ran out of local sockets or ports.
+    // Says nothing about the port, unlike Error, which a send can fail with.
+    Exhausted
+};
+
+enum class PortProtocol : quint8 {
+    TCP,
+    UDP
+};
+
+PortState portStateFromString(const QString &status);
+QString portStateName(PortState state);
+
+// Binary result store layout (little endian, 8-byte aligned sections):
+//
+//   ResultStoreHeader
+//   host table    hostCount   x { quint32 offset, quint32 length } into the pool, sorted by name
+//   record array  recordCount x ResultRecord, sorted by (host, protocol, port)
+//   string pool   host names and deduplicated banners
+//
+// Readers map the file and index straight into it, so opening a store costs
+// nothing regardless of how many results it holds.
+
+struct ResultStoreHeader
+{
+    char magic[4];
+    quint32 version;
+    quint32 hostCount;
+    quint32 reserved;
+    quint64 recordCount;
+    quint64 poolSize;
+    qint64 createdMs;
+};
+
+struct ResultRecord
+{
+    quint32 host;
+    quint16 port;
+    quint8 protocol;
+    quint8 state;
+    quint32 responseTime;
+    quint32 bannerHash;
+    quint32 bannerOffset;
+    quint32 bannerLength;
+};
+
+static_assert(sizeof(ResultStoreHeader) == 40, "ResultStoreHeader layout changed");
+static_assert(sizeof(ResultRecord) == 24, "ResultRecord layout changed");
+
+class ResultStoreWriter
+{
+public:
+    ResultStoreWriter();
+
+    void addResult(const QString &host, int port, PortProtocol protocol, PortState state,
+                   const QString &banner, int responseTime);
+    void clear();
+    int count() const;
+
+    QByteArray toByteArray() const;
+    bool write(const QString &fileName, QString *errorString = nullptr) const;
+
+private:
+    QVector<ResultRecord> records;
+    QVector<QByteArray> hostNames;
+    QHash<QString, quint32> hostIds;
+    QByteArray bannerPool;
+    QHash<QByteArray, quint32> bannerOffsets;
+};
+
+class ResultStore
+{
+public:
+    ResultStore();
+    ~ResultStore();
+
+    bool open(const QString &fileName);
+    bool openBuffer(const QByteArray &buffer);
+    void close();
+
+    bool isOpen() const;
+    QString errorString() const;
+
+    qint64 createdMs() const;
+    quint64 recordCount() const;
+    quint32 hostCount() const;
+
+    const ResultRecord &record(quint64 index) const;
+    QByteArray hostNameBytes(quint32 host) const;
+    QString hostName(quint32 host) const;
+    QByteArray bannerBytes(const ResultRecord &record) const;
+    QString banner(const ResultRecord &record) const;
+
+private:
+    Q_DISABLE_COPY(ResultStore)
+
+    bool attach(const uchar *base, quint64 size);
+
+    QFile file;
+    QByteArray buffer;
+    uchar *mapped;
+    QString error;
+
+    const ResultStoreHeader *header;
+    const quint32 *hostTable;
+    const ResultRecord *records;
+    const char *pool;
+};
+
+struct ResultChange
+{
+    enum Type {
+        Opened,
+        Closed,
+        BannerChanged
+    };
+
+    Type type;
+    QString host;
+    int port;
+    PortProtocol protocol;
+    PortState oldState;
+    PortState newState;
+    QString oldBanner;
+    QString newBanner;
+};
+
+struct ResultDiffSummary
+{
+    quint64 opened = 0;
+    quint64 closed = 0;
+    quint64 bannerChanged = 0;
+    quint64 compared = 0;
+};
+
+// Merges two stores in a single linear pass. A port only counts as closed when
+// the newer store actually probed it; one missing from the newer store is
+// taken as not rescanned. A port only the newer store has counts as opened
+// if it is open there, since the older scan never saw it open.
+ResultDiffSummary diffResultStores(const ResultStore &before, const ResultStore &after,
+                                   const std::function<void(const ResultChange &)> &visitor);
+
+#endif
@@ -0,0 +1,526 @@
+#include "resulttablemodel.h"
+#include <QBrush>
+#include <QColor>
+#include <algorithm>
+#include <iterator>
+
+ResultTableModel::ResultTableModel(QObject *parent)
+    : QAbstractTableModel(parent)
+    , sortColumn(-1)
+    , sortOrder(Qt::AscendingOrder)
+    , stateFilter(ResultStateFilter::All)
+    , protocolLabel("Protocol")
+{
+    clear();
+}
+
+void ResultTableModel::appendResults(const QString &host, PortProtocol protocol, const QVector<ProbeResult> &results)
+{
+    if (results.isEmpty()) return;
+
+    quint32 hostId = hostIds.value(host, quint32(hostNames.size()));
+    if (hostId == quint32(hostNames.size())) {
+        hostNames.append(host);
+        hostIds.insert(host, hostId);
+        hostRecords.append(QVector<quint32>());
+    }
+
+    const quint32 first = quint32(ports.size());
+    const int total = ports.size() + results.size();
+    hosts.reserve(total);
+    ports.reserve(total);
+    protocols.reserve(total);
+    states.reserve(total);
+    responseTimes.reserve(total);
+    services.reserve(total);
+    banners.reserve(total);
+
+    quint32 record = first;
+    for (const ProbeResult &result : results) {
+        quint32 service = intern(result.service);
+        quint32 banner = intern(result.banner);
+        hosts.append(hostId);
+        ports.append(quint16(result.port));
+        protocols.append(quint8(protocol));
+        states.append(quint8(result.state));
+        responseTimes.append(result.responseTime);
+        services.append(service);
+        banners.append(banner);
+
+        stateBits[int(result.state)].set(int(record));
+        protocolBits[int(protocol)].set(int(record));
+        hostRecords[int(hostId)].append(record);
+        serviceRecords[int(service)].append(record);
+        if (banner != 0) {
+            bannerRecords[int(banner)].append(record);
+        }
+        ++record;
+    }
+
+    QVector<quint32> added;
+    added.reserve(results.size());
+    for (record = first; record < quint32(total); ++record) {
+        if (accepts(record)) {
+            added.append(record);
+        }
+    }
+    if (added.isEmpty()) return;
+
+    if (sortColumn < 0) {
+        beginInsertRows(QModelIndex(), rows.size(), rows.size() + added.size() - 1);
+        rows += added;
+        endInsertRows();
+        return;
+    }
+
+    // Sorting only the batch and merging keeps a sorted live scan linear per
+    // batch instead of re-sorting everything.
+    sortRows(added);
+    QVector<quint32> merged;
+    merged.reserve(rows.size() + added.size());
+    std::merge(rows.constBegin(), rows.constEnd(), added.constBegin(), added.constEnd(), std::back_inserter(merged),
+               [this](quint32 a, quint32 b) { return lessThan(a, b); });
+    relayout(merged);
+}
+
+void ResultTableModel::clear()
+{
+    beginResetModel();
+    hosts.clear();
+    ports.clear();
+    protocols.clear();
+    states.clear();
+    responseTimes.clear();
+    services.clear();
+    banners.clear();
+    hostNames.clear();
+    hostIds.clear();
+    strings.clear();
+    strings.append(QString());
+    stringIds.clear();
+    stringIds.insert(QString(), 0);
+
+    stateBits = QVector<RecordBitmap>(int(PortState::Exhausted) + 1);
+    protocolBits = QVector<RecordBitmap>(int(PortProtocol::UDP) + 1);
+    hostRecords.clear();
+    serviceRecords = QVector<QVector<quint32>>(1);
+    bannerRecords = QVector<QVector<quint32>>(1);
+    stringIndex.clear();
+
+    rows.clear();
+    endResetModel();
+}
+
+void ResultTableModel::setProtocolLabel(const QString &label)
+{
+    protocolLabel = label;
+    emit headerDataChanged(Qt::Horizontal, ProtocolColumn, ProtocolColumn);
+}
+
+void ResultTableModel::setFilter(const ResultQuery &filter, ResultStateFilter filterState)
+{
+    query = filter;
+    stateFilter = filterState;
+
+    const int total = ports.size();
+    RecordBitmap matched(total, true);
+    if (stateFilter == ResultStateFilter::OpenOnly) {
+        matched.andWith(stateBits.at(int(PortState::Open)));
+    } else if (stateFilter == ResultStateFilter::ClosedOnly) {
+        matched.andWith(stateBits.at(int(PortState::Closed)));
+    }
+
+    // Indexed terms first, so the column scans only visit what is left.
+    for (const ResultQueryTerm &term : qAsConst(query.terms)) {
+        if (isIndexed(term)) {
+            matched.andWith(indexedMatches(term));
+        }
+    }
+    for (const ResultQueryTerm &term : qAsConst(query.terms)) {
+        if (!isIndexed(term)) {
+            RecordBitmap narrowed(total);
+            matched.forEach([&](int record) {
+                if (matches(quint32(record), term)) {
+                    narrowed.set(record);
+                }
+            });
+            matched = narrowed;
+        }
+    }
+
+    beginResetModel();
+    rows.clear();
+    rows.reserve(matched.count());
+    matched.forEach([this](int record) { rows.append(quint32(record)); });
+    sortRows(rows);
+    endResetModel();
+}
+
+int ResultTableModel::recordCount() const
+{
+    return ports.size();
+}
+
+QString ResultTableModel::host(int record) const
+{
+    return hostNames.at(int(hosts.at(record)));
+}
+
+int ResultTableModel::port(int record) const
+{
+    return ports.at(record);
+}
+
+PortProtocol ResultTableModel::protocol(int record) const
+{
+    return PortProtocol(protocols.at(record));
+}
+
+PortState ResultTableModel::state(int record) const
+{
+    return PortState(states.at(record));
+}
+
+int ResultTableModel::responseTime(int record) const
+{
+    return responseTimes.at(record);
+}
+
+QString ResultTableModel::service(int record) const
+{
+    return strings.at(int(services.at(record)));
+}
+
+QString ResultTableModel::banner(int record) const
+{
+    return strings.at(int(banners.at(record)));
+}
+
+int ResultTableModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : rows.size();
+}
+
+int ResultTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant ResultTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= rows.size()) {
+        return QVariant();
+    }
+
+    quint32 record = rows.at(index.row());
+    switch (role) {
+    case Qt::DisplayRole:
+        return displayText(record, index.column());
+    case Qt::BackgroundRole:
+        if (index.column() == StatusColumn) {
+            switch (PortState(states.at(int(record)))) {
+            case PortState::Open: return QBrush(QColor(144, 238, 144));
+            case PortState::Closed: return QBrush(QColor(255, 182, 193));
+            default: return QBrush(QColor(255, 255, 224));
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    return QVariant();
+}
+
+QVariant ResultTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+
+    switch (section) {
+    case HostColumn: return "Host";
+    case PortColumn: return "Port";
+    case ProtocolColumn: return protocolLabel;
+    case StatusColumn: return "Status";
+    case ServiceColumn: return "Service";
+    case BannerColumn: return "Banner";
+    case ResponseTimeColumn: return "Response Time";
+    }
+    return QVariant();
+}
+
+void ResultTableModel::sort(int column, Qt::SortOrder order)
+{
+    sortColumn = column < ColumnCount ? column : -1;
+    sortOrder = order;
+
+    QVector<quint32> sorted = rows;
+    sortRows(sorted);
+    relayout(sorted);
+}
+
+quint32 ResultTableModel::intern(const QString &text)
+{
+    if (text.isEmpty()) return 0;
+
+    auto it = stringIds.constFind(text);
+    if (it != stringIds.constEnd()) {
+        return it.value();
+    }
+    quint32 id = quint32(strings.size());
+    strings.append(text);
+    stringIds.insert(text, id);
+    serviceRecords.append(QVector<quint32>());
+    bannerRecords.append(QVector<quint32>());
+    stringIndex.add(id, text);
+    return id;
+}
+
+bool ResultTableModel::accepts(quint32 record) const
+{
+    PortState recordState = PortState(states.at(int(record)));
+    if (stateFilter == ResultStateFilter::OpenOnly && recordState != PortState::Open) {
+        return false;
+    }
+    if (stateFilter == ResultStateFilter::ClosedOnly && recordState != PortState::Closed) {
+        return false;
+    }
+    for (const ResultQueryTerm &term : query.terms) {
+        if (!matches(record, term)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ResultTableModel::matches(quint32 record, const ResultQueryTerm &term) const
+{
+    const int i = int(record);
+    auto inRanges = [&term](int value) {
+        for (const QPair<int, int> &range : term.ranges) {
+            if (value >= range.first && value <= range.second) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    switch (term.field) {
+    case ResultQueryTerm::Text:
+        return matchesText(record, term.text);
+    case ResultQueryTerm::Host:
+        return hostNames.at(int(hosts.at(i))).contains(term.text, Qt::CaseInsensitive);
+    case ResultQueryTerm::Port:
+        return inRanges(ports.at(i));
+    case ResultQueryTerm::Protocol:
+        return PortProtocol(protocols.at(i)) == term.protocol;
+    case ResultQueryTerm::State:
+        return term.states & (1u << states.at(i));
+    case ResultQueryTerm::Service:
+        return strings.at(int(services.at(i))).contains(term.text, Qt::CaseInsensitive);
+    case ResultQueryTerm::Banner:
+        return strings.at(int(banners.at(i))).contains(term.text, Qt::CaseInsensitive);
+    case ResultQueryTerm::ResponseTime:
+        return inRanges(responseTimes.at(i));
+    }
+    return false;
+}
+
+bool ResultTableModel::matchesText(quint32 record, const QString &text) const
+{
+    for (int column = HostColumn; column <= BannerColumn; ++column) {
+        if (displayText(record, column).contains(text, Qt::CaseInsensitive)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ResultTableModel::isIndexed(const ResultQueryTerm &term)
+{
+    return term.field != ResultQueryTerm::Port && term.field != ResultQueryTerm::ResponseTime;
+}
+
+RecordBitmap ResultTableModel::indexedMatches(const ResultQueryTerm &term) const
+{
+    RecordBitmap out(ports.size());
+    auto addHosts = [&]() {
+        for (int host = 0; host < hostNames.size(); ++host) {
+            if (hostNames.at(host).contains(term.text, Qt::CaseInsensitive)) {
+                for (quint32 record : hostRecords.at(host)) {
+                    out.set(int(record));
+                }
+            }
+        }
+    };
+
+    switch (term.field) {
+    case ResultQueryTerm::Host:
+        addHosts();
+        break;
+    case ResultQueryTerm::Service:
+        addMatchingStrings(term.text, serviceRecords, out);
+        break;
+    case ResultQueryTerm::Banner:
+        addMatchingStrings(term.text, bannerRecords, out);
+        break;
+    case ResultQueryTerm::Protocol:
+        out.orWith(protocolBits.at(int(term.protocol)));
+        break;
+    case ResultQueryTerm::State:
+        for (int state = 0; state < stateBits.size(); ++state) {
+            if (term.states & (1u << state)) {
+                out.orWith(stateBits.at(state));
+            }
+        }
+        break;
+    case ResultQueryTerm::Text: {
+        addHosts();
+        addMatchingStrings(term.text, serviceRecords, out);
+        addMatchingStrings(term.text, bannerRecords, out);
+        for (int state = 0; state < stateBits.size(); ++state) {
+            if (portStateName(PortState(state)).contains(term.text, Qt::CaseInsensitive)) {
+                out.orWith(stateBits.at(state));
+            }
+        }
+        if (QString("tcp").contains(term.text)) {
+            out.orWith(protocolBits.at(int(PortProtocol::TCP)));
+        }
+        if (QString("udp").contains(term.text)) {
+            out.orWith(protocolBits.at(int(PortProtocol::UDP)));
+        }
+        // Port numbers: decide per port once, then look each record up.
+        bool digits = !term.text.isEmpty() && term.text.size() <= 5;
+        for (QChar c : term.text) {
+            digits = digits && c.isDigit();
+        }
+        if (digits) {
+            QVector<bool> portMatches(65536);
+            for (int port = 0; port < 65536; ++port) {
+                portMatches[port] = QString::number(port).contains(term.text);
+            }
+            for (int record = 0; record < ports.size(); ++record) {
+                if (portMatches.at(ports.at(record))) {
+                    out.set(record);
+                }
+            }
+        }
+        break;
+    }
+    case ResultQueryTerm::Port:
+    case ResultQueryTerm::ResponseTime:
+        break;
+    }
+    return out;
+}
+
+void ResultTableModel::addMatchingStrings(const QString &text, const QVector<QVector<quint32>> &records,
+                                          RecordBitmap &out) const
+{
+    QVector<quint32> candidates;
+    if (!stringIndex.candidates(text, candidates)) {
+        // Too short for trigrams; there are far fewer strings than records.
+        for (quint32 id = 1; id < quint32(strings.size()); ++id) {
+            candidates.append(id);
+        }
+    }
+    for (quint32 id : qAsConst(candidates)) {
+        if (strings.at(int(id)).contains(text, Qt::CaseInsensitive)) {
+            for (quint32 record : records.at(int(id))) {
+                out.set(int(record));
+            }
+        }
+    }
+}
+
+bool ResultTableModel::lessThan(quint32 a, quint32 b) const
+{
+    int order = compare(a, b);
+    if (order == 0) {
+        // Ties keep arrival order either way round.
+        return a < b;
+    }
+    return sortOrder == Qt::AscendingOrder ? order < 0 : order > 0;
+}
+
+int ResultTableModel::compare(quint32 a, quint32 b) const
+{
+    auto byPort = [this](quint32 x, quint32 y) {
+        return int(ports.at(int(x))) - int(ports.at(int(y)));
+    };
+
+    switch (sortColumn) {
+    case HostColumn:
+        if (hosts.at(int(a)) != hosts.at(int(b))) {
+            return hostNames.at(int(hosts.at(int(a)))).compare(hostNames.at(int(hosts.at(int(b)))));
+        }
+        return byPort(a, b);
+    case PortColumn:
+        return byPort(a, b);
+    case ProtocolColumn:
+        if (protocols.at(int(a)) != protocols.at(int(b))) {
+            return int(protocols.at(int(a))) - int(protocols.at(int(b)));
+        }
+        return byPort(a, b);
+    case StatusColumn:
+        if (states.at(int(a)) != states.at(int(b))) {
+            return int(states.at(int(a))) - int(states.at(int(b)));
+        }
+        return byPort(a, b);
+    case ServiceColumn:
+        return strings.at(int(services.at(int(a)))).compare(strings.at(int(services.at(int(b)))), Qt::CaseInsensitive);
+    case BannerColumn:
+        return strings.at(int(banners.at(int(a)))).compare(strings.at(int(banners.at(int(b)))), Qt::CaseInsensitive);
+    case ResponseTimeColumn:
+        return responseTimes.at(int(a)) - responseTimes.at(int(b));
+    }
+    return 0;
+}
+
+QString ResultTableModel::displayText(quint32 record, int column) const
+{
+    const int i = int(record);
+    switch (column) {
+    case HostColumn: return hostNames.at(int(hosts.at(i)));
+    case PortColumn: return QString::number(ports.at(i));
+    case ProtocolColumn: return PortProtocol(protocols.at(i)) == PortProtocol::UDP ? "UDP" : "TCP";
+    case StatusColumn: return portStateName(PortState(states.at(i)));
+    case ServiceColumn: return strings.at(int(services.at(i)));
+    case BannerColumn: return strings.at(int(banners.at(i)));
+    case ResponseTimeColumn: return QString::number(responseTimes.at(i)) + " ms";
+    }
+    return QString();
+}
+
+void ResultTableModel::sortRows(QVector<quint32> &list) const
+{
+    if (sortColumn < 0) {
+        std::sort(list.begin(), list.end());
+    } else {
+        std::sort(list.begin(), list.end(), [this](quint32 a, quint32 b) { return lessThan(a, b); });
+    }
+}
+
+void ResultTableModel::relayout(const QVector<quint32> &newRows)
+{
+    emit layoutAboutToBeChanged();
+
+    // Keep selection and current index on the same records.
+    const QModelIndexList persistent = persistentIndexList();
+    if (!persistent.isEmpty()) {
+        QVector<int> rowOf(ports.size(), -1);
+        for (int row = 0; row < newRows.size(); ++row) {
+            rowOf[int(newRows.at(row))] = row;
+        }
+        QModelIndexList moved;
+        moved.reserve(persistent.size());
+        for (const QModelIndex &index : persistent) {
+            int row = index.row() < rows.size() ? rowOf.at(int(rows.at(index.row()))) : -1;
+            moved.append(row < 0 ? QModelIndex() : createIndex(row, index.column()));
+        }
+        changePersistentIndexList(persistent, moved);
+    }
+
+    rows = newRows;
+    emit layoutChanged();
+}
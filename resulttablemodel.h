@@ -0,0 +1,118 @@
+#ifndef RESULTTABLEMODEL_H
+#define RESULTTABLEMODEL_H
+#include <QAbstractTableModel>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include "resultindex.h"
+#include "resultring.h"
+#include "resultstore.h"
+
+enum class ResultStateFilter {
+    All,
+    OpenOnly,
+    ClosedOnly
+};
+
+// Scan results for the results view, stored column by column: one vector per
+// field, with hosts, services and banners interned into string tables. A row
+// costs about twenty bytes however long its banner is, and nothing is
+// allocated per cell until the view asks for it.
+//
+// The view sees "rows", the records that pass the filter in the current sort
+// order. New results arrive in batches: unsorted, a batch is one
+// rowsInserted; sorted, it is merged in with a single layout change.
+//
+// Filtering doesn't walk the table. Per-state and per-protocol bitmaps,
+// per-host/service/banner record lists and a trigram index over the interned
+// strings are kept up to date as results arrive, so a new filter is a few
+// bitmap operations; only port and response time ranges scan a column, and
+// only over the records the other terms left.
+class ResultTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+public:
+    enum Column {
+        HostColumn,
+        PortColumn,
+        ProtocolColumn,
+        StatusColumn,
+        ServiceColumn,
+        BannerColumn,
+        ResponseTimeColumn,
+        ColumnCount
+    };
+
+    explicit ResultTableModel(QObject *parent = nullptr);
+
+    void appendResults(const QString &host, PortProtocol protocol, const QVector<ProbeResult> &results);
+    void clear();
+
+    void setProtocolLabel(const QString &label);
+    void setFilter(const ResultQuery &query, ResultStateFilter stateFilter);
+
+    int recordCount() const;
+    QString host(int record) const;
+    int port(int record) const;
+    PortProtocol protocol(int record) const;
+    PortState state(int record) const;
+    int responseTime(int record) const;
+    QString service(int record) const;
+    QString banner(int record) const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    // A negative column restores arrival order.
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+private:
+    quint32 intern(const QString &text);
+    bool accepts(quint32 record) const;
+    bool matches(quint32 record, const ResultQueryTerm &term) const;
+    bool matchesText(quint32 record, const QString &text) const;
+    RecordBitmap indexedMatches(const ResultQueryTerm &term) const;
+    void addMatchingStrings(const QString &text, const QVector<QVector<quint32>> &records, RecordBitmap &out) const;
+    static bool isIndexed(const ResultQueryTerm &term);
+    bool lessThan(quint32 a, quint32 b) const;
+    int compare(quint32 a, quint32 b) const;
+    QString displayText(quint32 record, int column) const;
+    void sortRows(QVector<quint32> &list) const;
+    void relayout(const QVector<quint32> &newRows);
+
+    // One entry per record, in arrival order.
+    QVector<quint32> hosts;
+    QVector<quint16> ports;
+    QVector<quint8> protocols;
+    QVector<quint8> states;
+    QVector<qint32> responseTimes;
+    QVector<quint32> services;
+    QVector<quint32> banners;
+
+    QStringList hostNames;
+    QHash<QString, quint32> hostIds;
+    // Entry 0 is the empty string.
+    QVector<QString> strings;
+    QHash<QString, quint32> stringIds;
+
+    // Filter indexes, all keyed by record number.
+    QVector<RecordBitmap> stateBits;
+    QVector<RecordBitmap> protocolBits;
+    QVector<QVector<quint32>> hostRecords;
+    QVector<QVector<quint32>> serviceRecords;
+    QVector<QVector<quint32>> bannerRecords;
+    TrigramIndex stringIndex;
+
+    // Record numbers of the visible rows, in view order.
+    QVector<quint32> rows;
+
+    int sortColumn;
+    Qt::SortOrder sortOrder;
+    ResultQuery query;
+    ResultStateFilter stateFilter;
+    QString protocolLabel;
+};
+
+#endif
@@ -0,0 +1,224 @@
+#include "scanimport.h"
+#include "nmapxml.h"
+#include "probedispatcher.h"
+#include "socketbudget.h"
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+
+static const qint64 XmlChunkSize = 64 * 1024;
+// masscan banner records are the longest lines; anything past this is split
+// and the pieces counted as unreadable.
+static const qint64 MaxLineLength = 1024 * 1024;
+static const qint64 SniffLength = 4096;
+
+static QString protocolName(PortProtocol protocol)
+{
+    return protocol == PortProtocol::UDP ? "udp" : "tcp";
+}
+
+ScanImport::ScanImport(PortProtocol protocol)
+    : wanted(protocol)
+    , openCount(0)
+    , skippedCount(0)
+{
+}
+
+bool ScanImport::read(const QString &fileName, QString *errorString)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+    return read(&file, Format::Auto, errorString);
+}
+
+bool ScanImport::read(QIODevice *device, Format format, QString *errorString)
+{
+    if (format == Format::Auto) {
+        const QByteArray head = device->peek(SniffLength).trimmed();
+        if (head.isEmpty()) {
+            if (errorString) *errorString = "File is empty";
+            return false;
+        }
+        switch (head.at(0)) {
+        case '<': format = Format::Xml; break;
+        case '[':
+        case '{': format = Format::Json; break;
+        default: format = Format::List; break;
+        }
+    }
+
+    switch (format) {
+    case Format::Xml: return readXml(device, errorString);
+    case Format::Json: return readJson(device, errorString);
+    default: return readList(device, errorString);
+    }
+}
+
+bool ScanImport::readXml(QIODevice *device, QString *errorString)
+{
+    // masscan's -oX borrows nmap's layout, so one reader does for both.
+    NmapXmlParser parser;
+    parser.setProtocol(protocolName(wanted));
+
+    auto takeHosts = [this, &parser]() {
+        const QVector<NmapHostReport> hosts = parser.takeHosts();
+        for (const NmapHostReport &host : hosts) {
+            for (const ProbeResult &result : host.ports) {
+                if (result.state == PortState::Open && !host.address.isEmpty()) {
+                    addOpen(host.address, result.port);
+                } else {
+                    ++skippedCount;
+                }
+            }
+        }
+    };
+
+    while (!device->atEnd()) {
+        const QByteArray chunk = device->read(XmlChunkSize);
+        if (chunk.isEmpty()) break;
+        parser.addData(chunk);
+        takeHosts();
+        if (parser.hasError()) {
+            if (errorString) *errorString = parser.errorString();
+            return false;
+        }
+    }
+    // An interrupted run leaves the document unclosed; its hosts still count.
+    return true;
+}
+
+bool ScanImport::readJson(QIODevice *device, QString *errorString)
+{
+    Q_UNUSED(errorString);
+    const QString wantedName = protocolName(wanted);
+
+    // masscan writes one record per line, -oJ wrapped in an array with the
+    // commas on either end of the line, -oD (ndjson) bare.
+    while (!device->atEnd()) {
+        QByteArray line = device->readLine(MaxLineLength).trimmed();
+        while (line.startsWith(',')) line.remove(0, 1);
+        while (line.endsWith(',')) line.chop(1);
+        line = line.trimmed();
+        if (line.isEmpty() || line == "[" || line == "]") continue;
+
+        const QJsonDocument document = QJsonDocument::fromJson(line);
+        if (!document.isObject()) {
+            ++skippedCount;
+            continue;
+        }
+        const QJsonObject record = document.object();
+        const QString ip = record.value("ip").toString();
+        const QJsonArray ports = record.value("ports").toArray();
+        if (ip.isEmpty() || ports.isEmpty()) {
+            ++skippedCount;
+            continue;
+        }
+        for (const QJsonValue &value : ports) {
+            const QJsonObject port = value.toObject();
+            const QString status = port.value("status").toString();
+            // Banner records carry no status, but only open ports have banners.
+            const bool isOpen = status == "open" || (status.isEmpty() && port.contains("service"));
+            if (!isOpen || port.value("proto").toString(wantedName) != wantedName) {
+                ++skippedCount;
+                continue;
+            }
+            addOpen(ip, port.value("port").toInt());
+        }
+    }
+    return true;
+}
+
+bool ScanImport::readList(QIODevice *device, QString *errorString)
+{
+    Q_UNUSED(errorString);
+    const QString wantedName = protocolName(wanted);
+
+    // "open tcp 80 10.0.0.1 1390000000", with # comments around the records.
+    while (!device->atEnd()) {
+        const QString line = QString::fromLatin1(device->readLine(MaxLineLength)).trimmed();
+        if (line.isEmpty() || line.startsWith('#')) continue;
+
+        const QStringList fields = line.split(' ', Qt::SkipEmptyParts);
+        if (fields.size() < 4 || fields.at(0) != "open" || fields.at(1) != wantedName) {
+            ++skippedCount;
+            continue;
+        }
+        addOpen(fields.at(3), fields.at(2).toInt());
+    }
+    return true;
+}
+
+void ScanImport::addOpen(const QString &target, int port)
+{
+    if (port < 1 || port > 65535 || target.isEmpty()) {
+        ++skippedCount;
+        return;
+    }
+    PortSet &ports = open[target];
+    if (!ports.contains(port)) {
+        ports.insert(port);
+        ++openCount;
+    }
+}
+
+PortProtocol ScanImport::protocol() const
+{
+    return wanted;
+}
+
+QStringList ScanImport::targets() const
+{
+    QStringList names = open.keys();
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+PortSet ScanImport::ports(const QString &target) const
+{
+    return open.value(target);
+}
+
+int ScanImport::targetCount() const
+{
+    return open.size();
+}
+
+qint64 ScanImport::portCount() const
+{
+    return openCount;
+}
+
+qint64 ScanImport::skipped() const
+{
+    return skippedCount;
+}
+
+QList<ScanJobSpec> ScanImport::verificationJobs(TimingTemplate timing) const
+{
+    const int concurrency = verificationConcurrency();
+
+    QList<ScanJobSpec> jobs;
+    for (const QString &target : targets()) {
+        ScanJobSpec spec;
+        spec.target = target;
+        spec.ports = open.value(target);
+        // Confirming a port only needs the handshake; waiting for a banner
+        // would hold each socket for the whole read timeout.
+        spec.scanType = wanted == PortProtocol::UDP ? ScanType::UDP_SCAN : ScanType::TCP_CONNECT;
+        spec.banners = false;
+        spec.timing = timing;
+        spec.concurrency = concurrency;
+        jobs.append(spec);
+    }
+    return jobs;
+}
+
+int ScanImport::verificationConcurrency()
+{
+    return qMin(ProbeDispatcher::maxSlots(), SocketBudget::instance()->budget());
+}
@@ -0,0 +1,62 @@
+#ifndef SCANIMPORT_H
+#define SCANIMPORT_H
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include "portset.h"
+#include "resultstore.h"
+#include "scanjobqueue.h"
+
+class QIODevice;
+
+// Reads the open ports of earlier nmap (-oX) and masscan (-oX, -oJ, -oD,
+// -oL) runs into a target -> ports work list. Files are read a chunk or a
+// line at a time and only open ports of one protocol are kept, so memory
+// follows the size of the estate rather than the size of the file. Several
+// files can be read into one import; their ports are merged per target.
+class ScanImport
+{
+public:
+    enum class Format {
+        Auto,
+        Xml,
+        Json,
+        List
+    };
+
+    explicit ScanImport(PortProtocol protocol = PortProtocol::TCP);
+
+    bool read(const QString &fileName, QString *errorString = nullptr);
+    // Auto looks at the first non-blank byte: '<' XML, '[' or '{' JSON,
+    // anything else masscan's list format.
+    bool read(QIODevice *device, Format format = Format::Auto, QString *errorString = nullptr);
+
+    PortProtocol protocol() const;
+    // Sorted, so a verification walks the estate in a stable order.
+    QStringList targets() const;
+    PortSet ports(const QString &target) const;
+    int targetCount() const;
+    qint64 portCount() const;
+    // Lines or ports that were unreadable, of another protocol or not open.
+    qint64 skipped() const;
+
+    // One job per target over only its imported ports, each allowed as many
+    // probes in flight as the engine and the socket budget permit: a known
+    // estate is confirmed in one pass instead of rescanned. TCP ports get a
+    // connect-only probe.
+    QList<ScanJobSpec> verificationJobs(TimingTemplate timing) const;
+    static int verificationConcurrency();
+
+private:
+    bool readXml(QIODevice *device, QString *errorString);
+    bool readJson(QIODevice *device, QString *errorString);
+    bool readList(QIODevice *device, QString *errorString);
+    void addOpen(const QString &target, int port);
+
+    PortProtocol wanted;
+    QHash<QString, PortSet> open;
+    qint64 openCount;
+    qint64 skippedCount;
+};
+
+#endif
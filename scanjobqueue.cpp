@@ -0,0 +1,207 @@
+#include "scanjobqueue.h"
+#include "probedispatcher.h"
+
+QString scanJobStateName(ScanJobState state)
+{
+    switch (state) {
+    case ScanJobState::Queued: return "Queued";
+    case ScanJobState::Running: return "Running";
+    case ScanJobState::Paused: return "Paused";
+    case ScanJobState::Finished: return "Finished";
+    case ScanJobState::Cancelled: return "Cancelled";
+    }
+    return "Unknown";
+}
+
+ScanJobQueue::ScanJobQueue(const QSharedPointer<ProbeDispatcher> &engine, QObject *parent)
+    : QObject(parent)
+    , engine(engine)
+    , nextId(1)
+    , runningLimit(4)
+    , running(0)
+{
+}
+
+ScanJobQueue::~ScanJobQueue()
+{
+    for (Job &job : jobs) {
+        if (job.scanner) {
+            job.info.state = ScanJobState::Cancelled;
+            job.scanner->disconnect(this);
+            job.scanner->stopScan();
+        }
+    }
+}
+
+int ScanJobQueue::addJob(const ScanJobSpec &spec)
+{
+    Job job;
+    job.info.id = nextId++;
+    job.info.spec = spec;
+    jobs.insert(job.info.id, job);
+    waiting.enqueue(job.info.id);
+
+    emit jobAdded(job.info.id);
+    emit logMessage(QString("Job %1 queued: %2, %3 ports, weight %4")
+                        .arg(job.info.id).arg(spec.target).arg(spec.ports.size()).arg(spec.weight));
+    startQueuedJobs();
+    return job.info.id;
+}
+
+void ScanJobQueue::cancelJob(int id)
+{
+    auto it = jobs.find(id);
+    if (it == jobs.end()) return;
+
+    Job &job = it.value();
+    switch (job.info.state) {
+    case ScanJobState::Queued:
+        job.info.state = ScanJobState::Cancelled;
+        emit jobChanged(id);
+        break;
+    case ScanJobState::Running:
+    case ScanJobState::Paused:
+        // stopScan() emits scanFinished, which lands in onJobFinished().
+        job.info.state = ScanJobState::Cancelled;
+        job.scanner->stopScan();
+        break;
+    case ScanJobState::Finished:
+    case ScanJobState::Cancelled:
+        break;
+    }
+}
+
+void ScanJobQueue::pauseJob(int id)
+{
+    auto it = jobs.find(id);
+    if (it == jobs.end() || it->info.state != ScanJobState::Running) return;
+
+    it->scanner->pauseScan();
+    it->info.state = ScanJobState::Paused;
+    emit jobChanged(id);
+}
+
+void ScanJobQueue::resumeJob(int id)
+{
+    auto it = jobs.find(id);
+    if (it == jobs.end() || it->info.state != ScanJobState::Paused) return;
+
+    it->scanner->resumeScan();
+    it->info.state = ScanJobState::Running;
+    emit jobChanged(id);
+}
+
+void ScanJobQueue::setJobWeight(int id, int weight)
+{
+    auto it = jobs.find(id);
+    if (it == jobs.end()) return;
+
+    it->info.spec.weight = qMax(1, weight);
+    if (it->scanner) {
+        it->scanner->setWeight(it->info.spec.weight);
+    }
+    emit jobChanged(id);
+}
+
+void ScanJobQueue::removeJob(int id)
+{
+    auto it = jobs.find(id);
+    if (it == jobs.end() || it->scanner) return;
+    if (it->info.state == ScanJobState::Finished || it->info.state == ScanJobState::Cancelled) {
+        jobs.erase(it);
+    }
+}
+
+void ScanJobQueue::setMaxRunningJobs(int count)
+{
+    runningLimit = qMax(1, count);
+    startQueuedJobs();
+}
+
+int ScanJobQueue::maxRunningJobs() const
+{
+    return runningLimit;
+}
+
+QList<int> ScanJobQueue::jobIds() const
+{
+    return jobs.keys();
+}
+
+ScanJobInfo ScanJobQueue::job(int id) const
+{
+    return jobs.value(id).info;
+}
+
+int ScanJobQueue::activeJobCount() const
+{
+    return running;
+}
+
+void ScanJobQueue::startQueuedJobs()
+{
+    // Imports queue a job per host, so this must not walk the whole map.
+    while (running < runningLimit && !waiting.isEmpty()) {
+        auto it = jobs.find(waiting.dequeue());
+        if (it != jobs.end() && it->info.state == ScanJobState::Queued) {
+            startJob(it.value());
+        }
+    }
+}
+
+void ScanJobQueue::startJob(Job &job)
+{
+    const int id = job.info.id;
+    const ScanJobSpec &spec = job.info.spec;
+
+    PortScanner *scanner = new PortScanner(engine, this);
+    scanner->setWeight(spec.weight);
+    scanner->setRateLimit(spec.rateLimit);
+    scanner->setConcurrency(spec.concurrency);
+    scanner->setPortPriors(spec.priors);
+    scanner->setEarlyStop(spec.earlyStopRate);
+    scanner->setBannerGrab(spec.banners);
+
+    connect(scanner, &PortScanner::portResults, this, [this, id](const QVector<ProbeResult> &results) {
+        auto it = jobs.find(id);
+        if (it == jobs.end()) return;
+        it->info.completed += results.size();
+        for (const ProbeResult &result : results) {
+            if (result.state == PortState::Open) {
+                it->info.openPorts++;
+            }
+        }
+        emit jobResults(id, it->info.spec.target, results);
+        emit jobChanged(id);
+    });
+    connect(scanner, &PortScanner::scanFinished, this, [this, id]() { onJobFinished(id); });
+    connect(scanner, &PortScanner::logMessage, this, [this, id](const QString &message, LogLevel level) {
+        emit logMessage(QString("[job %1] %2").arg(id).arg(message), level);
+    });
+
+    job.scanner = scanner;
+    job.info.state = ScanJobState::Running;
+    ++running;
+    emit jobChanged(id);
+
+    scanner->startScan(spec.target, spec.ports, spec.scanType, spec.timing, false, false, false);
+}
+
+void ScanJobQueue::onJobFinished(int id)
+{
+    auto it = jobs.find(id);
+    if (it == jobs.end() || !it->scanner) return;
+
+    if (it->info.state != ScanJobState::Cancelled) {
+        it->info.state = ScanJobState::Finished;
+    }
+    it->scanner->deleteLater();
+    it->scanner = nullptr;
+    --running;
+
+    emit logMessage(QString("Job %1 %2: %3 of %4 ports scanned, %5 open")
+                        .arg(id).arg(scanJobStateName(it->info.state).toLower())
+                        .arg(it->info.completed).arg(it->info.spec.ports.size()).arg(it->info.openPorts));
+    emit jobChanged(id);
+    startQueuedJobs();
+}
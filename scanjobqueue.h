@@ -0,0 +1,102 @@
+#ifndef SCANJOBQUEUE_H
+#define SCANJOBQUEUE_H
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QMap>
+#include <QQueue>
+#include <QSharedPointer>
+#include "portscanner.h"
+
+class ProbeDispatcher;
+
+enum class ScanJobState {
+    Queued,
+    Running,
+    Paused,
+    Finished,
+    Cancelled
+};
+
+QString scanJobStateName(ScanJobState state);
+
+struct ScanJobSpec
+{
+    QString target;
+    PortSet ports;
+    ScanType scanType = ScanType::TCP_CONNECT;
+    TimingTemplate timing = TimingTemplate::T3_NORMAL;
+    int weight = 1;
+    double rateLimit = 0.0;
+    // Probes in flight; 0 takes it from the timing template.
+    int concurrency = 0;
+    // Probe order and early stop, see PortScanner.
+    QSharedPointer<const PortPriors> priors;
+    double earlyStopRate = 0.0;
+    // Off for connect-only TCP probes, e.g. to confirm ports already known.
+    bool banners = true;
+};
+
+struct ScanJobInfo
+{
+    int id = 0;
+    ScanJobSpec spec;
+    ScanJobState state = ScanJobState::Queued;
+    int completed = 0;
+    int openPorts = 0;
+};
+
+// Runs several scans at once on one shared probe engine. Each running job is
+// a PortScanner on that engine, so jobs get probe slots in proportion to
+// their weights and a short job finishes quickly next to a long sweep.
+// Beyond maxRunningJobs, jobs wait in FIFO order.
+class ScanJobQueue : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ScanJobQueue(const QSharedPointer<ProbeDispatcher> &engine, QObject *parent = nullptr);
+    ~ScanJobQueue();
+
+    int addJob(const ScanJobSpec &spec);
+    void cancelJob(int id);
+    void pauseJob(int id);
+    void resumeJob(int id);
+    void setJobWeight(int id, int weight);
+    // Forgets a finished or cancelled job, so a queue that runs for days
+    // doesn't keep every job it ever ran.
+    void removeJob(int id);
+
+    void setMaxRunningJobs(int count);
+    int maxRunningJobs() const;
+
+    QList<int> jobIds() const;
+    ScanJobInfo job(int id) const;
+    int activeJobCount() const;
+
+signals:
+    void jobAdded(int id);
+    void jobChanged(int id);
+    void jobResults(int id, const QString &host, const QVector<ProbeResult> &results);
+    void logMessage(const QString &message, LogLevel level = LogLevel::Info);
+
+private:
+    struct Job
+    {
+        ScanJobInfo info;
+        PortScanner *scanner = nullptr;
+    };
+
+    void startQueuedJobs();
+    void startJob(Job &job);
+    void onJobFinished(int id);
+
+    QSharedPointer<ProbeDispatcher> engine;
+    QMap<int, Job> jobs;
+    // Ids in submission order; cancelled ones are skipped when they come up.
+    QQueue<int> waiting;
+    int nextId;
+    int runningLimit;
+    int running;
+};
+
+#endif
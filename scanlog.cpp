@@ -0,0 +1,299 @@
+#include "scanlog.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+
+QString logLevelName(LogLevel level)
+{
+    switch (level) {
+    case LogLevel::Debug: return "DEBUG";
+    case LogLevel::Info: return "INFO";
+    case LogLevel::Warning: return "WARN";
+    case LogLevel::Error: return "ERROR";
+    }
+    return "INFO";
+}
+
+QString LogEntry::format(bool withDate) const
+{
+    QString timestamp = QDateTime::fromMSecsSinceEpoch(timestampMs)
+                            .toString(withDate ? "yyyy-MM-dd hh:mm:ss.zzz" : "hh:mm:ss");
+    return QString("[%1] %2 %3").arg(timestamp, logLevelName(level).leftJustified(5), message);
+}
+
+LogFileSink::LogFileSink(const QString &directory, const QString &baseName, qint64 maxFileBytes, int maxFiles)
+    : directory(directory)
+    , baseName(baseName)
+    , maxFileBytes(maxFileBytes)
+    , maxFiles(qMax(1, maxFiles))
+    , rotations(0)
+    , bytesQueued(0)
+    , bytesWritten(0)
+    , stopping(false)
+{
+}
+
+LogFileSink::~LogFileSink()
+{
+    close();
+}
+
+QString LogFileSink::filePath(int index) const
+{
+    if (index == 0) {
+        return QDir(directory).filePath(baseName + ".log");
+    }
+    return QDir(directory).filePath(QString("%1.%2.log").arg(baseName).arg(index));
+}
+
+void LogFileSink::shiftFiles()
+{
+    QFile::remove(filePath(maxFiles - 1));
+    for (int i = maxFiles - 2; i >= 0; --i) {
+        if (QFile::exists(filePath(i))) {
+            QFile::rename(filePath(i), filePath(i + 1));
+        }
+    }
+}
+
+bool LogFileSink::open(QString *errorString)
+{
+    if (!QDir().mkpath(directory)) {
+        if (errorString) *errorString = QString("Could not create %1").arg(directory);
+        return false;
+    }
+
+    // A previous session's log moves aside instead of being appended to, so
+    // sessionFiles() never mixes runs.
+    if (QFileInfo(filePath(0)).size() > 0) {
+        shiftFiles();
+    }
+
+    file.setFileName(filePath(0));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+
+    stopping = false;
+    rotations = 0;
+    start(QThread::LowPriority);
+    return true;
+}
+
+void LogFileSink::close()
+{
+    if (isRunning()) {
+        {
+            QMutexLocker locker(&mutex);
+            stopping = true;
+            pendingReady.wakeOne();
+        }
+        wait();
+    }
+    file.close();
+}
+
+void LogFileSink::write(const QByteArray &data)
+{
+    QMutexLocker locker(&mutex);
+    bool wasEmpty = pending.isEmpty();
+    pending += data;
+    bytesQueued += data.size();
+    if (wasEmpty) {
+        pendingReady.wakeOne();
+    }
+}
+
+void LogFileSink::flush()
+{
+    QMutexLocker locker(&mutex);
+    quint64 target = bytesQueued;
+    while (bytesWritten < target && isRunning()) {
+        pendingWritten.wait(&mutex, 100);
+    }
+}
+
+QStringList LogFileSink::sessionFiles() const
+{
+    QMutexLocker locker(&mutex);
+    QStringList files;
+    for (int i = qMin(rotations, maxFiles - 1); i >= 0; --i) {
+        if (QFile::exists(filePath(i))) {
+            files << filePath(i);
+        }
+    }
+    return files;
+}
+
+void LogFileSink::rotate()
+{
+    file.close();
+    shiftFiles();
+    file.setFileName(filePath(0));
+    file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+}
+
+void LogFileSink::run()
+{
+    QMutexLocker locker(&mutex);
+    forever {
+        while (pending.isEmpty() && !stopping) {
+            pendingReady.wait(&mutex);
+        }
+        if (pending.isEmpty()) {
+            break;
+        }
+
+        QByteArray chunk;
+        chunk.swap(pending);
+        locker.unlock();
+
+        file.write(chunk);
+        file.flush();
+        bool rotated = false;
+        if (file.size() >= maxFileBytes) {
+            rotate();
+            rotated = true;
+        }
+
+        locker.relock();
+        if (rotated) {
+            ++rotations;
+        }
+        bytesWritten += chunk.size();
+        pendingWritten.wakeAll();
+    }
+}
+
+ScanLog::ScanLog(int capacity)
+    : ring(qMax(1, capacity))
+    , nextSequence(1)
+    , sink(nullptr)
+{
+}
+
+ScanLog::~ScanLog()
+{
+    stopFileSink();
+}
+
+void ScanLog::append(LogLevel level, const QString &message)
+{
+    LogEntry entry;
+    entry.timestampMs = QDateTime::currentMSecsSinceEpoch();
+    entry.level = level;
+    entry.message = message;
+
+    QMutexLocker locker(&mutex);
+    entry.sequence = nextSequence++;
+    if (sink) {
+        sink->write((entry.format(true) + '\n').toUtf8());
+    }
+    ring[int(entry.sequence % quint64(ring.size()))] = std::move(entry);
+}
+
+quint64 ScanLog::drain(quint64 after, QVector<LogEntry> &out, quint64 *dropped) const
+{
+    QMutexLocker locker(&mutex);
+    quint64 capacity = quint64(ring.size());
+    quint64 oldest = nextSequence > capacity ? nextSequence - capacity : 1;
+    quint64 first = qMax(after + 1, oldest);
+
+    if (dropped) {
+        *dropped = first - (after + 1);
+    }
+    out.reserve(out.size() + int(nextSequence - first));
+    for (quint64 sequence = first; sequence < nextSequence; ++sequence) {
+        out.append(ring[int(sequence % capacity)]);
+    }
+    return nextSequence - 1;
+}
+
+quint64 ScanLog::lastSequence() const
+{
+    QMutexLocker locker(&mutex);
+    return nextSequence - 1;
+}
+
+bool ScanLog::startFileSink(const QString &directory, QString *errorString)
+{
+    stopFileSink();
+
+    LogFileSink *newSink = new LogFileSink(directory, "cyberscanner");
+    if (!newSink->open(errorString)) {
+        delete newSink;
+        return false;
+    }
+
+    // Entries logged before the sink existed are still in the ring.
+    QMutexLocker locker(&mutex);
+    quint64 capacity = quint64(ring.size());
+    quint64 oldest = nextSequence > capacity ? nextSequence - capacity : 1;
+    QByteArray backlog;
+    for (quint64 sequence = oldest; sequence < nextSequence; ++sequence) {
+        backlog += (ring[int(sequence % capacity)].format(true) + '\n').toUtf8();
+    }
+    newSink->write(backlog);
+    sink = newSink;
+    return true;
+}
+
+void ScanLog::stopFileSink()
+{
+    LogFileSink *oldSink;
+    {
+        QMutexLocker locker(&mutex);
+        oldSink = sink;
+        sink = nullptr;
+    }
+    delete oldSink;
+}
+
+bool ScanLog::hasFileSink() const
+{
+    QMutexLocker locker(&mutex);
+    return sink != nullptr;
+}
+
+bool ScanLog::saveTo(const QString &fileName, QString *errorString) const
+{
+    QSaveFile out(fileName);
+    if (!out.open(QIODevice::WriteOnly)) {
+        if (errorString) *errorString = out.errorString();
+        return false;
+    }
+
+    QMutexLocker locker(&mutex);
+    if (sink) {
+        // Copy the sink's files in chunks rather than building the session
+        // in memory; flush first so the copy is complete up to now.
+        LogFileSink *fileSink = sink;
+        locker.unlock();
+        fileSink->flush();
+        for (const QString &path : fileSink->sessionFiles()) {
+            QFile in(path);
+            if (!in.open(QIODevice::ReadOnly)) {
+                continue;
+            }
+            while (!in.atEnd()) {
+                out.write(in.read(1024 * 1024));
+            }
+        }
+    } else {
+        quint64 capacity = quint64(ring.size());
+        quint64 oldest = nextSequence > capacity ? nextSequence - capacity : 1;
+        for (quint64 sequence = oldest; sequence < nextSequence; ++sequence) {
+            out.write((ring[int(sequence % capacity)].format(true) + '\n').toUtf8());
+        }
+        locker.unlock();
+    }
+
+    if (!out.commit()) {
+        if (errorString) *errorString = out.errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,110 @@
+#ifndef SCANLOG_H
+#define SCANLOG_H
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QVector>
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+#include <QMetaType>
+
+enum class LogLevel {
+    Debug,
+    Info,
+    Warning,
+    Error
+};
+
+Q_DECLARE_METATYPE(LogLevel)
+
+QString logLevelName(LogLevel level);
+
+struct LogEntry
+{
+    quint64 sequence = 0;
+    qint64 timestampMs = 0;
+    LogLevel level = LogLevel::Info;
+    QString message;
+
+    QString format(bool withDate = false) const;
+};
+
+// Appends log lines to <directory>/<baseName>.log on its own thread and
+// rotates to <baseName>.1.log, .2.log, ... once a file passes maxFileBytes.
+// Callers only ever copy bytes into a pending buffer under a mutex.
+class LogFileSink : public QThread
+{
+public:
+    LogFileSink(const QString &directory, const QString &baseName, qint64 maxFileBytes = 16 * 1024 * 1024,
+                int maxFiles = 8);
+    ~LogFileSink();
+
+    bool open(QString *errorString = nullptr);
+    void close();
+
+    void write(const QByteArray &data);
+    void flush();
+
+    // Files holding this session's output, oldest first.
+    QStringList sessionFiles() const;
+
+protected:
+    void run() override;
+
+private:
+    QString filePath(int index) const;
+    void shiftFiles();
+    void rotate();
+
+    QString directory;
+    QString baseName;
+    qint64 maxFileBytes;
+    int maxFiles;
+
+    QFile file;
+    int rotations;
+
+    mutable QMutex mutex;
+    QWaitCondition pendingReady;
+    QWaitCondition pendingWritten;
+    QByteArray pending;
+    quint64 bytesQueued;
+    quint64 bytesWritten;
+    bool stopping;
+};
+
+// Thread-safe log with a bounded in-memory ring of the most recent entries
+// and an optional file sink that keeps everything. Views poll drain() with
+// their last seen sequence number instead of being called per message.
+class ScanLog
+{
+public:
+    explicit ScanLog(int capacity = 100000);
+    ~ScanLog();
+
+    void append(LogLevel level, const QString &message);
+
+    // Copies entries with a sequence number above `after` into `out` and
+    // returns the newest sequence number. Entries that already fell out of
+    // the ring are counted in `dropped`.
+    quint64 drain(quint64 after, QVector<LogEntry> &out, quint64 *dropped = nullptr) const;
+    quint64 lastSequence() const;
+
+    bool startFileSink(const QString &directory, QString *errorString = nullptr);
+    void stopFileSink();
+    bool hasFileSink() const;
+
+    // Writes the whole session to a file: the sink's files when there is a
+    // sink, the ring otherwise.
+    bool saveTo(const QString &fileName, QString *errorString = nullptr) const;
+
+private:
+    mutable QMutex mutex;
+    QVector<LogEntry> ring;
+    quint64 nextSequence;
+    LogFileSink *sink;
+};
+
+#endif
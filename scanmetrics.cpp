@@ -0,0 +1,369 @@
+#include "scanmetrics.h"
+#include <QMutexLocker>
+#include <QHostAddress>
+#include <QSaveFile>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QtAlgorithms>
+
+int HistogramSnapshot::bucketIndex(quint64 micros)
+{
+    if (micros < SubBucketCount) {
+        return int(micros);
+    }
+    int exponent = 63 - int(qCountLeadingZeroBits(micros));
+    int shift = exponent - SubBucketBits;
+    int index = SubBucketCount * (shift + 1) + int((micros >> shift) - SubBucketCount);
+    return qMin(index, BucketCount - 1);
+}
+
+quint64 HistogramSnapshot::bucketLowerBound(int index)
+{
+    if (index < SubBucketCount) {
+        return quint64(index);
+    }
+    int shift = index / SubBucketCount - 1;
+    return quint64(SubBucketCount + index % SubBucketCount) << shift;
+}
+
+quint64 HistogramSnapshot::bucketUpperBound(int index)
+{
+    if (index + 1 >= BucketCount) {
+        return ~quint64(0);
+    }
+    return bucketLowerBound(index + 1) - 1;
+}
+
+quint64 HistogramSnapshot::percentile(double fraction) const
+{
+    if (count == 0) {
+        return 0;
+    }
+    quint64 target = qMax<quint64>(1, quint64(fraction * count + 0.5));
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += buckets[i];
+        if (seen >= target) {
+            return bucketUpperBound(i);
+        }
+    }
+    return maximum();
+}
+
+quint64 HistogramSnapshot::maximum() const
+{
+    for (int i = BucketCount - 1; i >= 0; --i) {
+        if (buckets[i]) {
+            return bucketUpperBound(i);
+        }
+    }
+    return 0;
+}
+
+double HistogramSnapshot::mean() const
+{
+    return count ? double(sumMicros) / count : 0.0;
+}
+
+quint64 HistogramSnapshot::countAtOrBelow(quint64 micros) const
+{
+    quint64 total = 0;
+    for (int i = 0; i < BucketCount && bucketUpperBound(i) <= micros; ++i) {
+        total += buckets[i];
+    }
+    return total;
+}
+
+HistogramSnapshot HistogramSnapshot::operator-(const HistogramSnapshot &other) const
+{
+    HistogramSnapshot result;
+    for (int i = 0; i < BucketCount; ++i) {
+        result.buckets[i] = buckets[i] - other.buckets[i];
+    }
+    result.count = count - other.count;
+    result.sumMicros = sumMicros - other.sumMicros;
+    return result;
+}
+
+MetricsSnapshot MetricsSnapshot::operator-(const MetricsSnapshot &other) const
+{
+    MetricsSnapshot result;
+    for (int i = 0; i < int(ScanCounter::Count); ++i) {
+        result.counters[i] = counters[i] - other.counters[i];
+    }
+    // In-flight is a gauge, not a counter.
+    result.counters[int(ScanCounter::InFlight)] = counters[int(ScanCounter::InFlight)];
+    for (int i = 0; i < int(ScanHistogram::Count); ++i) {
+        result.histograms[i] = histograms[i] - other.histograms[i];
+    }
+    return result;
+}
+
+static void appendHistogram(QString &text, const QString &name, const QString &help, const HistogramSnapshot &histogram)
+{
+    static const double bounds[] = { 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05,
+                                     0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0 };
+
+    text += QString("# HELP %1 %2\n# TYPE %1 histogram\n").arg(name, help);
+    for (double bound : bounds) {
+        text += QString("%1_bucket{le=\"%2\"} %3\n")
+                    .arg(name).arg(bound).arg(histogram.countAtOrBelow(quint64(bound * 1e6)));
+    }
+    text += QString("%1_bucket{le=\"+Inf\"} %2\n").arg(name).arg(histogram.count);
+    text += QString("%1_sum %2\n").arg(name).arg(histogram.sumMicros / 1e6, 0, 'f', 6);
+    text += QString("%1_count %2\n").arg(name).arg(histogram.count);
+}
+
+QString MetricsSnapshot::toPrometheusText() const
+{
+    QString text;
+
+    text += "# HELP cyberscanner_probes_sent_total Probes sent.\n"
+            "# TYPE cyberscanner_probes_sent_total counter\n";
+    text += QString("cyberscanner_probes_sent_total %1\n").arg(counter(ScanCounter::ProbesSent));
+
+    text += "# HELP cyberscanner_responses_total Probe results by port state.\n"
+            "# TYPE cyberscanner_responses_total counter\n";
+    const struct { const char *state; ScanCounter counter; } states[] = {
+        { "open", ScanCounter::ResponsesOpen },
+        { "closed", ScanCounter::ResponsesClosed },
+        { "filtered", ScanCounter::ResponsesFiltered },
+        { "open_filtered", ScanCounter::ResponsesOpenFiltered },
+        { "unfiltered", ScanCounter::ResponsesUnfiltered },
+        { "error", ScanCounter::ResponsesError },
+    };
+    for (const auto &state : states) {
+        text += QString("cyberscanner_responses_total{state=\"%1\"} %2\n").arg(state.state).arg(counter(state.counter));
+    }
+
+    text += "# HELP cyberscanner_timeouts_total Probes that got no answer before their timeout.\n"
+            "# TYPE cyberscanner_timeouts_total counter\n";
+    text += QString("cyberscanner_timeouts_total %1\n").arg(counter(ScanCounter::Timeouts));
+
+    text += "# HELP cyberscanner_retransmits_total Probes tried again after running out of sockets or local ports.\n"
+            "# TYPE cyberscanner_retransmits_total counter\n";
+    text += QString("cyberscanner_retransmits_total %1\n").arg(counter(ScanCounter::Retransmits));
+
+    text += "# HELP cyberscanner_resource_exhausted_total Probes that ran out of descriptors or local ports.\n"
+            "# TYPE cyberscanner_resource_exhausted_total counter\n";
+    text += QString("cyberscanner_resource_exhausted_total %1\n").arg(counter(ScanCounter::ResourceExhausted));
+
+    text += "# HELP cyberscanner_probes_in_flight Probes currently waiting on the network.\n"
+            "# TYPE cyberscanner_probes_in_flight gauge\n";
+    text += QString("cyberscanner_probes_in_flight %1\n").arg(counter(ScanCounter::InFlight));
+
+    appendHistogram(text, "cyberscanner_connect_rtt_seconds", "Time to connect or to get a refusal.",
+                    histogram(ScanHistogram::ConnectRtt));
+    appendHistogram(text, "cyberscanner_banner_seconds", "Time spent waiting for service banners.",
+                    histogram(ScanHistogram::BannerTime));
+    return text;
+}
+
+ScanMetrics::Shard::Shard()
+{
+    for (auto &value : counters) {
+        value.store(0, std::memory_order_relaxed);
+    }
+    for (auto &histogram : buckets) {
+        for (auto &value : histogram) {
+            value.store(0, std::memory_order_relaxed);
+        }
+    }
+    for (auto &value : sums) {
+        value.store(0, std::memory_order_relaxed);
+    }
+}
+
+ScanMetrics::ScanMetrics()
+{
+}
+
+ScanMetrics *ScanMetrics::instance()
+{
+    static ScanMetrics metrics;
+    return &metrics;
+}
+
+ScanMetrics::Shard *ScanMetrics::localShard()
+{
+    // A thread gives its shard back when it exits. Counts only ever add up,
+    // so the next thread carries on in the same shard, and long-running
+    // modes whose pools keep expiring threads hold only as many shards as
+    // they ever had threads at once.
+    struct Lease
+    {
+        Shard *shard = nullptr;
+        ~Lease()
+        {
+            if (shard) ScanMetrics::instance()->releaseShard(shard);
+        }
+    };
+    thread_local Lease lease;
+    if (!lease.shard) {
+        lease.shard = acquireShard();
+    }
+    return lease.shard;
+}
+
+ScanMetrics::Shard *ScanMetrics::acquireShard()
+{
+    QMutexLocker locker(&shardMutex);
+    if (!freeShards.isEmpty()) {
+        return freeShards.takeLast();
+    }
+    Shard *shard = new Shard;
+    shards.append(shard);
+    return shard;
+}
+
+void ScanMetrics::releaseShard(Shard *shard)
+{
+    QMutexLocker locker(&shardMutex);
+    freeShards.append(shard);
+}
+
+void ScanMetrics::add(ScanCounter which, qint64 delta)
+{
+    localShard()->counters[int(which)].fetch_add(delta, std::memory_order_relaxed);
+}
+
+void ScanMetrics::record(ScanHistogram which, quint64 micros)
+{
+    Shard *shard = localShard();
+    shard->buckets[int(which)][HistogramSnapshot::bucketIndex(micros)].fetch_add(1, std::memory_order_relaxed);
+    shard->sums[int(which)].fetch_add(micros, std::memory_order_relaxed);
+}
+
+MetricsSnapshot ScanMetrics::snapshot() const
+{
+    MetricsSnapshot result;
+
+    QMutexLocker locker(&shardMutex);
+    for (const Shard *shard : shards) {
+        for (int i = 0; i < int(ScanCounter::Count); ++i) {
+            result.counters[i] += shard->counters[i].load(std::memory_order_relaxed);
+        }
+        for (int h = 0; h < int(ScanHistogram::Count); ++h) {
+            HistogramSnapshot &histogram = result.histograms[h];
+            for (int i = 0; i < HistogramSnapshot::BucketCount; ++i) {
+                quint64 value = shard->buckets[h][i].load(std::memory_order_relaxed);
+                histogram.buckets[i] += value;
+                histogram.count += value;
+            }
+            histogram.sumMicros += shard->sums[h].load(std::memory_order_relaxed);
+        }
+    }
+    return result;
+}
+
+MetricsExporter::MetricsExporter(QObject *parent)
+    : QObject(parent)
+    , textfileTimer(new QTimer(this))
+    , httpServer(nullptr)
+{
+    connect(textfileTimer, &QTimer::timeout, this, &MetricsExporter::onTextfileTimer);
+}
+
+MetricsExporter::~MetricsExporter()
+{
+    stopHttp();
+}
+
+bool MetricsExporter::writeTextfile(const QString &fileName, QString *errorString)
+{
+    // The node_exporter textfile collector reads whole files, so write to a
+    // temporary and rename to never expose a half-written scrape.
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+    file.write(ScanMetrics::instance()->snapshot().toPrometheusText().toUtf8());
+    if (!file.commit()) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+void MetricsExporter::setTextfile(const QString &fileName, int intervalMs)
+{
+    textfileName = fileName;
+    if (fileName.isEmpty()) {
+        textfileTimer->stop();
+    } else {
+        writeTextfile(fileName);
+        textfileTimer->start(intervalMs);
+    }
+}
+
+QString MetricsExporter::textfile() const
+{
+    return textfileName;
+}
+
+void MetricsExporter::onTextfileTimer()
+{
+    writeTextfile(textfileName);
+}
+
+bool MetricsExporter::startHttp(quint16 port, QString *errorString)
+{
+    stopHttp();
+
+    httpServer = new QTcpServer(this);
+    connect(httpServer, &QTcpServer::newConnection, this, &MetricsExporter::onHttpConnection);
+    if (!httpServer->listen(QHostAddress::LocalHost, port)) {
+        if (errorString) *errorString = httpServer->errorString();
+        delete httpServer;
+        httpServer = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void MetricsExporter::stopHttp()
+{
+    if (httpServer) {
+        httpServer->close();
+        delete httpServer;
+        httpServer = nullptr;
+    }
+}
+
+bool MetricsExporter::isServingHttp() const
+{
+    return httpServer && httpServer->isListening();
+}
+
+void MetricsExporter::onHttpConnection()
+{
+    while (QTcpSocket *socket = httpServer->nextPendingConnection()) {
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        connect(socket, &QTcpSocket::readyRead, socket, [socket]() {
+            QByteArray request = socket->peek(4096);
+            if (!request.contains("\r\n\r\n") && !request.contains("\n\n")) {
+                return;
+            }
+            socket->readAll();
+
+            QByteArray body;
+            QByteArray status;
+            if (request.startsWith("GET /metrics ") || request.startsWith("GET / ")) {
+                status = "200 OK";
+                body = ScanMetrics::instance()->snapshot().toPrometheusText().toUtf8();
+            } else {
+                status = "404 Not Found";
+                body = "Not found\n";
+            }
+
+            socket->write("HTTP/1.0 " + status + "\r\n"
+                          "Content-Type: text/plain; version=0.0.4\r\n"
+                          "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                          "Connection: close\r\n\r\n");
+            socket->write(body);
+            socket->disconnectFromHost();
+        });
+    }
+}
@@ -0,0 +1,131 @@
+#ifndef SCANMETRICS_H
+#define SCANMETRICS_H
+#include <QObject>
+#include <QString>
+#include <QMutex>
+#include <QList>
+#include <atomic>
+
+class QTimer;
+class QTcpServer;
+
+enum class ScanCounter {
+    ProbesSent,
+    ResponsesOpen,
+    ResponsesClosed,
+    ResponsesFiltered,
+    ResponsesOpenFiltered,
+    ResponsesUnfiltered,
+    ResponsesError,
+    Timeouts,
+    Retransmits,
+    ResourceExhausted,
+    InFlight,
+    Count
+};
+
+enum class ScanHistogram {
+    ConnectRtt,
+    BannerTime,
+    Count
+};
+
+// Log-linear buckets in microseconds, HDR histogram style: 16 linear
+// sub-buckets per power of two, so any recorded value is within ~6% of its
+// bucket bounds from 1 us up to about 12 days.
+struct HistogramSnapshot
+{
+    static const int SubBucketBits = 4;
+    static const int SubBucketCount = 1 << SubBucketBits;
+    static const int BucketCount = SubBucketCount * 37;
+
+    quint64 buckets[BucketCount] = {};
+    quint64 count = 0;
+    quint64 sumMicros = 0;
+
+    static int bucketIndex(quint64 micros);
+    static quint64 bucketLowerBound(int index);
+    static quint64 bucketUpperBound(int index);
+
+    quint64 percentile(double fraction) const;
+    quint64 maximum() const;
+    double mean() const;
+    quint64 countAtOrBelow(quint64 micros) const;
+
+    HistogramSnapshot operator-(const HistogramSnapshot &other) const;
+};
+
+struct MetricsSnapshot
+{
+    qint64 counters[int(ScanCounter::Count)] = {};
+    HistogramSnapshot histograms[int(ScanHistogram::Count)];
+
+    qint64 counter(ScanCounter which) const { return counters[int(which)]; }
+    const HistogramSnapshot &histogram(ScanHistogram which) const { return histograms[int(which)]; }
+
+    MetricsSnapshot operator-(const MetricsSnapshot &other) const;
+    QString toPrometheusText() const;
+};
+
+// Process-wide scan telemetry. Every thread records into its own shard with
+// relaxed atomics, so the probe hot path never contends on a lock; readers
+// sum the shards when they take a snapshot. Counters only ever grow, which is
+// what Prometheus expects; callers wanting per-scan numbers subtract a
+// snapshot taken at scan start.
+class ScanMetrics
+{
+public:
+    static ScanMetrics *instance();
+
+    void add(ScanCounter which, qint64 delta = 1);
+    void record(ScanHistogram which, quint64 micros);
+
+    MetricsSnapshot snapshot() const;
+
+private:
+    struct Shard
+    {
+        std::atomic<qint64> counters[int(ScanCounter::Count)];
+        std::atomic<quint64> buckets[int(ScanHistogram::Count)][HistogramSnapshot::BucketCount];
+        std::atomic<quint64> sums[int(ScanHistogram::Count)];
+
+        Shard();
+    };
+
+    ScanMetrics();
+    Shard *localShard();
+    Shard *acquireShard();
+    void releaseShard(Shard *shard);
+
+    mutable QMutex shardMutex;
+    QList<Shard *> shards;
+    // Shards of threads that have exited, ready for the next new thread.
+    QList<Shard *> freeShards;
+};
+
+class MetricsExporter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MetricsExporter(QObject *parent = nullptr);
+    ~MetricsExporter();
+
+    bool writeTextfile(const QString &fileName, QString *errorString = nullptr);
+    void setTextfile(const QString &fileName, int intervalMs = 5000);
+    QString textfile() const;
+
+    bool startHttp(quint16 port, QString *errorString = nullptr);
+    void stopHttp();
+    bool isServingHttp() const;
+
+private slots:
+    void onTextfileTimer();
+    void onHttpConnection();
+
+private:
+    QString textfileName;
+    QTimer *textfileTimer;
+    QTcpServer *httpServer;
+};
+
+#endif
@@ -0,0 +1,327 @@
+#include "scanmonitor.h"
+#include "probedispatcher.h"
+#include "scanjobqueue.h"
+#include <QFile>
+#include <QTimer>
+
+// QTimer takes an int; a longer interval is waited out in steps of this.
+static const qint64 MaxTimerMs = 24LL * 3600 * 1000;
+
+ScanMonitor::ScanMonitor(const QSharedPointer<ProbeDispatcher> &engine, QObject *parent)
+    : QObject(parent)
+    , queue(new ScanJobQueue(engine, this))
+    , cycleTimer(new QTimer(this))
+    , type(ScanType::TCP_CONNECT)
+    , timingTemplate(TimingTemplate::T3_NORMAL)
+    , intervalSeconds(3600)
+    , sweepSize(DefaultSweepSize)
+    , cycleNumber(0)
+    , running(false)
+{
+    cycleTimer->setSingleShot(true);
+    connect(cycleTimer, &QTimer::timeout, this, [this]() {
+        const qint64 left = qint64(intervalSeconds) * 1000 - cycleClock.elapsed();
+        if (cycleNumber > 0 && left > 0) {
+            cycleTimer->start(int(qMin(left, MaxTimerMs)));
+            return;
+        }
+        startCycle();
+    });
+
+    connect(queue, &ScanJobQueue::jobResults, this, [this](int, const QString &host, const QVector<ProbeResult> &results) {
+        applyResults(host, results);
+    });
+    connect(queue, &ScanJobQueue::jobChanged, this, &ScanMonitor::onJobChanged);
+    // Every cycle queues a job per host; only trouble is worth passing on.
+    connect(queue, &ScanJobQueue::logMessage, this, [this](const QString &message, LogLevel level) {
+        if (level >= LogLevel::Warning) {
+            emit logMessage(message, level);
+        }
+    });
+}
+
+ScanMonitor::~ScanMonitor()
+{
+    stop();
+}
+
+void ScanMonitor::setTargets(const QStringList &targets)
+{
+    targetList = targets;
+}
+
+void ScanMonitor::setPorts(const PortSet &ports)
+{
+    portRange = ports;
+}
+
+void ScanMonitor::setScanType(ScanType scanType)
+{
+    type = scanType;
+}
+
+void ScanMonitor::setTiming(TimingTemplate timing)
+{
+    timingTemplate = timing;
+}
+
+void ScanMonitor::setInterval(int seconds)
+{
+    intervalSeconds = qMax(0, seconds);
+}
+
+void ScanMonitor::setSweepSize(int ports)
+{
+    sweepSize = qMax(1, ports);
+}
+
+void ScanMonitor::setHostsAtOnce(int count)
+{
+    queue->setMaxRunningJobs(count);
+}
+
+void ScanMonitor::setStateFile(const QString &fileName)
+{
+    stateFile = fileName;
+}
+
+bool ScanMonitor::start(QString *errorString)
+{
+    if (running) return true;
+    if (targetList.isEmpty() || portRange.isEmpty()) {
+        if (errorString) *errorString = "Nothing to monitor: no targets or no ports";
+        return false;
+    }
+    if (!stateFile.isEmpty() && QFile::exists(stateFile) && !loadState(errorString)) {
+        return false;
+    }
+
+    running = true;
+    cycleNumber = 0;
+    cycleTimer->start(0);
+    return true;
+}
+
+void ScanMonitor::stop()
+{
+    if (!running) return;
+    running = false;
+    cycleTimer->stop();
+
+    // Cancelling lands in onJobChanged(), which must not see a live cycle.
+    const QList<int> ids = cycleJobs.keys();
+    for (int id : ids) {
+        queue->cancelJob(id);
+    }
+    cycleJobs.clear();
+}
+
+bool ScanMonitor::isRunning() const
+{
+    return running;
+}
+
+int ScanMonitor::cycle() const
+{
+    return cycleNumber;
+}
+
+PortProtocol ScanMonitor::protocol() const
+{
+    return type == ScanType::UDP_SCAN ? PortProtocol::UDP : PortProtocol::TCP;
+}
+
+void ScanMonitor::startCycle()
+{
+    if (!running) return;
+
+    ++cycleNumber;
+    summary = ResultDiffSummary();
+    cycleClock.start();
+    for (int id : qAsConst(finishedJobs)) {
+        queue->removeJob(id);
+    }
+    finishedJobs.clear();
+
+    QList<ScanJobSpec> jobs;
+    int probes = 0;
+    for (const QString &target : qAsConst(targetList)) {
+        ScanJobSpec spec;
+        spec.target = target;
+        spec.ports = cyclePorts(hosts[target]);
+        spec.scanType = type;
+        spec.timing = timingTemplate;
+        if (!spec.ports.isEmpty()) {
+            probes += spec.ports.size();
+            jobs.append(spec);
+        }
+    }
+
+    emit cycleStarted(cycleNumber, probes);
+    for (const ScanJobSpec &spec : qAsConst(jobs)) {
+        cycleJobs.insert(queue->addJob(spec), spec.target);
+    }
+    if (cycleJobs.isEmpty()) {
+        finishCycle();
+    }
+}
+
+PortSet ScanMonitor::cyclePorts(HostState &host)
+{
+    if (!host.baseline) {
+        return portRange;
+    }
+
+    PortSet ports;
+    for (auto it = host.ports.cbegin(); it != host.ports.cend(); ++it) {
+        if (portRange.contains(it.key())) {
+            ports.insert(it.key());
+        }
+    }
+
+    // The next slice of the sweep, wrapping around the end of the range.
+    const int slice = qMin(sweepSize, portRange.size());
+    int port = portRange.next(host.sweepNext);
+    for (int i = 0; i < slice; ++i) {
+        if (port < 0) {
+            port = portRange.next(0);
+        }
+        ports.insert(port);
+        port = portRange.next(port + 1);
+    }
+    host.sweepNext = qMax(0, port);
+    return ports;
+}
+
+void ScanMonitor::onJobChanged(int id)
+{
+    auto it = cycleJobs.find(id);
+    if (it == cycleJobs.end()) return;
+
+    const ScanJobState state = queue->job(id).state;
+    if (state == ScanJobState::Finished) {
+        // From here on the host's ports are known, and news about them is a
+        // change.
+        hosts[it.value()].baseline = true;
+    } else if (state != ScanJobState::Cancelled) {
+        return;
+    }
+    cycleJobs.erase(it);
+    finishedJobs.append(id);
+    if (cycleJobs.isEmpty() && running) {
+        finishCycle();
+    }
+}
+
+void ScanMonitor::finishCycle()
+{
+    QString error;
+    if (!stateFile.isEmpty() && !saveState(&error)) {
+        emit logMessage(QString("Could not save monitor state to %1: %2").arg(stateFile, error), LogLevel::Warning);
+    }
+
+    const qint64 wait = qMax<qint64>(0, qint64(intervalSeconds) * 1000 - cycleClock.elapsed());
+    emit logMessage(QString("Cycle %1 done in %2 s: %3 probes, %4 opened, %5 closed, %6 banners changed; next in %7 s")
+                        .arg(cycleNumber).arg(cycleClock.elapsed() / 1000.0, 0, 'f', 1).arg(summary.compared)
+                        .arg(summary.opened).arg(summary.closed).arg(summary.bannerChanged).arg(wait / 1000));
+    emit cycleFinished(cycleNumber, summary);
+    if (running) {
+        cycleTimer->start(int(qMin(wait, MaxTimerMs)));
+    }
+}
+
+void ScanMonitor::applyResults(const QString &target, const QVector<ProbeResult> &results)
+{
+    HostState &host = hosts[target];
+    for (const ProbeResult &result : results) {
+        ++summary.compared;
+        // Says nothing about the port.
+        if (result.state == PortState::Error || result.state == PortState::Exhausted) continue;
+
+        const bool isOpen = result.state == PortState::Open;
+        auto it = host.ports.find(result.port);
+        if (it == host.ports.end()) {
+            if (!isOpen) continue;
+            KnownPort before;
+            if (host.baseline) {
+                report(ResultChange::Opened, target, result.port, before, result);
+            }
+            KnownPort &known = host.ports[result.port];
+            known.state = result.state;
+            known.banner = result.banner;
+            continue;
+        }
+
+        KnownPort &known = it.value();
+        const bool wasOpen = known.state == PortState::Open;
+        if (isOpen != wasOpen) {
+            report(isOpen ? ResultChange::Opened : ResultChange::Closed, target, result.port, known, result);
+        } else if (isOpen && !result.banner.isEmpty() && result.banner != known.banner) {
+            // A banner that didn't arrive in time isn't a new banner.
+            report(ResultChange::BannerChanged, target, result.port, known, result);
+        }
+        known.state = result.state;
+        if (!result.banner.isEmpty()) {
+            known.banner = result.banner;
+        }
+    }
+}
+
+void ScanMonitor::report(ResultChange::Type type, const QString &target, int port, const KnownPort &before,
+                         const ProbeResult &after)
+{
+    switch (type) {
+    case ResultChange::Opened: ++summary.opened; break;
+    case ResultChange::Closed: ++summary.closed; break;
+    case ResultChange::BannerChanged: ++summary.bannerChanged; break;
+    }
+
+    ResultChange change;
+    change.type = type;
+    change.host = target;
+    change.port = port;
+    change.protocol = protocol();
+    change.oldState = before.state;
+    change.newState = after.state;
+    change.oldBanner = before.banner;
+    change.newBanner = after.banner;
+    emit portChanged(change);
+}
+
+bool ScanMonitor::loadState(QString *errorString)
+{
+    ResultStore store;
+    if (!store.open(stateFile)) {
+        if (errorString) *errorString = QString("Could not read %1: %2").arg(stateFile, store.errorString());
+        return false;
+    }
+
+    const PortProtocol wanted = protocol();
+    for (quint64 i = 0; i < store.recordCount(); ++i) {
+        const ResultRecord &record = store.record(i);
+        if (PortProtocol(record.protocol) != wanted) continue;
+
+        HostState &host = hosts[store.hostName(record.host)];
+        host.baseline = true;
+        KnownPort &known = host.ports[record.port];
+        known.state = PortState(record.state);
+        known.banner = store.banner(record);
+    }
+    emit logMessage(QString("Loaded state of %1 hosts from %2").arg(hosts.size()).arg(stateFile));
+    return true;
+}
+
+bool ScanMonitor::saveState(QString *errorString) const
+{
+    // Only ports that have been open are kept, so a host that never had one
+    // gets a fresh baseline after a restart.
+    ResultStoreWriter store;
+    const PortProtocol wanted = protocol();
+    for (auto host = hosts.cbegin(); host != hosts.cend(); ++host) {
+        if (!host->baseline) continue;
+        for (auto port = host->ports.cbegin(); port != host->ports.cend(); ++port) {
+            store.addResult(host.key(), port.key(), wanted, port->state, port->banner, 0);
+        }
+    }
+    return store.write(stateFile, errorString);
+}
@@ -0,0 +1,106 @@
+#ifndef SCANMONITOR_H
+#define SCANMONITOR_H
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QSharedPointer>
+#include <QElapsedTimer>
+#include "portscanner.h"
+#include "portset.h"
+#include "resultstore.h"
+#include "scanlog.h"
+
+class ProbeDispatcher;
+class ScanJobQueue;
+class QTimer;
+
+// Rescans a set of targets on a schedule and reports only what changed.
+// Each cycle a host gets every port that has ever been open on it (which
+// includes every port that ever changed) and the next slice of the rest of
+// the range, so each port is still looked at every range/sweep cycles while
+// most probes go where changes happen. A host without known state is
+// scanned in full once, as its baseline; that scan reports no changes.
+//
+// With a state file, what is known survives restarts: it is read by start()
+// and rewritten, as a result store, after every cycle.
+class ScanMonitor : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ScanMonitor(const QSharedPointer<ProbeDispatcher> &engine, QObject *parent = nullptr);
+    ~ScanMonitor();
+
+    void setTargets(const QStringList &targets);
+    void setPorts(const PortSet &ports);
+    void setScanType(ScanType type);
+    void setTiming(TimingTemplate timing);
+    // From the start of one cycle to the start of the next. A cycle that
+    // runs longer is followed at once.
+    void setInterval(int seconds);
+    // Ports of the sweep each host gets per cycle.
+    void setSweepSize(int ports);
+    void setHostsAtOnce(int hosts);
+    void setStateFile(const QString &fileName);
+
+    bool start(QString *errorString = nullptr);
+    void stop();
+    bool isRunning() const;
+    int cycle() const;
+
+    static const int DefaultSweepSize = 4096;
+
+signals:
+    void cycleStarted(int cycle, int probes);
+    void cycleFinished(int cycle, const ResultDiffSummary &summary);
+    void portChanged(const ResultChange &change);
+    void logMessage(const QString &message, LogLevel level = LogLevel::Info);
+
+private:
+    struct KnownPort
+    {
+        PortState state = PortState::Closed;
+        QString banner;
+    };
+
+    struct HostState
+    {
+        // Every port that has been open at some point, with its last state.
+        QHash<int, KnownPort> ports;
+        bool baseline = false;
+        // Where the next sweep slice starts.
+        int sweepNext = 0;
+    };
+
+    void startCycle();
+    void finishCycle();
+    PortSet cyclePorts(HostState &host);
+    void onJobChanged(int id);
+    void applyResults(const QString &target, const QVector<ProbeResult> &results);
+    void report(ResultChange::Type type, const QString &target, int port, const KnownPort &before,
+                const ProbeResult &after);
+    bool loadState(QString *errorString);
+    bool saveState(QString *errorString) const;
+    PortProtocol protocol() const;
+
+    ScanJobQueue *queue;
+    QTimer *cycleTimer;
+    QStringList targetList;
+    PortSet portRange;
+    ScanType type;
+    TimingTemplate timingTemplate;
+    int intervalSeconds;
+    int sweepSize;
+    QString stateFile;
+
+    QHash<QString, HostState> hosts;
+    // Jobs of the running cycle, by id, and the host each one scans.
+    QHash<int, QString> cycleJobs;
+    QList<int> finishedJobs;
+    ResultDiffSummary summary;
+    QElapsedTimer cycleClock;
+    int cycleNumber;
+    bool running;
+};
+
+#endif
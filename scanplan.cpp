@@ -0,0 +1,178 @@
+#include "scanplan.h"
+#include <QHash>
+
+static const char *const UnknownService = "Unknown";
+
+static const QHash<int, QString> &serviceTable()
+{
+    static const QHash<int, QString> services = {
+        {21, "FTP"},
+        {22, "SSH"},
+        {23, "Telnet"},
+        {25, "SMTP"},
+        {53, "DNS"},
+        {80, "HTTP"},
+        {110, "POP3"},
+        {143, "IMAP"},
+        {443, "HTTPS"},
+        {993, "IMAPS"},
+        {995, "POP3S"},
+        {3389, "RDP"},
+        {8080, "HTTP-Alt"},
+        {8443, "HTTPS-Alt"},
+        {135, "RPC"},
+        {139, "NetBIOS"},
+        {445, "SMB"},
+        {1433, "MSSQL"},
+        {3306, "MySQL"},
+        {5432, "PostgreSQL"},
+        {6379, "Redis"},
+        {27017, "MongoDB"},
+        {1521, "Oracle"},
+        {5060, "SIP"},
+        {5061, "SIP-TLS"},
+
+        {67, "DHCP"},
+        {68, "DHCP"},
+        {69, "TFTP"},
+        {123, "NTP"},
+        {161, "SNMP"},
+        {162, "SNMP-Trap"},
+        {514, "Syslog"},
+        {520, "RIP"},
+        {1900, "UPnP"},
+    };
+    return services;
+}
+
+static QByteArray udpPayload(int port)
+{
+    switch (port) {
+    case 53:
+        return QByteArray::fromHex("1234010000010000000000000377777706676F6F676C6503636F6D0000010001");
+    case 67:
+        return QByteArray::fromHex("0101060000003d1d00000000000000000000000000000000");
+    case 69:
+        return QByteArray("\x00\x01test\x00octet\x00", 12);
+    case 123:
+        return QByteArray::fromHex("1B0000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000");
+    case 161:
+        return QByteArray::fromHex("302902010004067075626C6963A01C02020000020100020100308E");
+    case 514:
+        return QByteArray("<14>Test message");
+    default:
+        return QByteArray("UDP_PROBE_" + QByteArray::number(port));
+    }
+}
+
+static void bannerStrategy(int port, BannerMode &mode, int &wait)
+{
+    switch (port) {
+    case 21:
+    case 22:
+    case 25:
+    case 110:
+    case 143:
+        mode = BannerMode::Read;
+        wait = 1000;
+        break;
+    case 80:
+    case 8080:
+        mode = BannerMode::HttpGet;
+        wait = 2000;
+        break;
+    case 443:
+    case 8443:
+    case 3389:
+        mode = BannerMode::None;
+        wait = 0;
+        break;
+    default:
+        mode = BannerMode::Read;
+        wait = 500;
+        break;
+    }
+}
+
+QSharedPointer<const ScanPlan> ScanPlan::compile(const QString &host, const PortSet &ports, ScanType scanType,
+                                                 bool banners)
+{
+    QVector<quint16> order;
+    order.reserve(ports.size());
+    for (int port : ports) {
+        order.append(quint16(port));
+    }
+    return compile(host, order, scanType, banners);
+}
+
+QSharedPointer<const ScanPlan> ScanPlan::compile(const QString &host, const QVector<quint16> &order, ScanType scanType,
+                                                 bool banners)
+{
+    ScanPlan *plan = new ScanPlan;
+    plan->targetHost = host;
+    plan->targetAddress = QHostAddress(host);
+    plan->literal = !plan->targetAddress.isNull();
+    plan->type = scanType;
+
+    // Without raw sockets every TCP type is a connect; they differ in how
+    // long they wait and in what an answer means.
+    ProbeKind kind = ProbeKind::ConnectOnly;
+    quint8 divisor = 1;
+    switch (scanType) {
+    case ScanType::TCP_CONNECT:
+        kind = banners ? ProbeKind::ConnectBanner : ProbeKind::ConnectOnly;
+        break;
+    case ScanType::UDP_SCAN:
+        kind = ProbeKind::Udp;
+        break;
+    case ScanType::TCP_SYN:
+        divisor = 2;
+        break;
+    case ScanType::TCP_FIN:
+    case ScanType::TCP_XMAS:
+    case ScanType::TCP_NULL:
+    case ScanType::TCP_WINDOW:
+        divisor = 3;
+        break;
+    case ScanType::TCP_ACK:
+        kind = ProbeKind::ConnectFirewall;
+        divisor = 4;
+        break;
+    }
+
+    QHash<QString, quint16> serviceIds;
+    plan->services.append(UnknownService);
+    serviceIds.insert(UnknownService, 0);
+
+    plan->probes.reserve(order.size());
+    if (kind == ProbeKind::Udp) {
+        plan->payloads.reserve(order.size());
+    }
+    for (int port : order) {
+        ProbeDescriptor probe;
+        probe.port = quint16(port);
+        probe.kind = kind;
+        probe.timeoutDivisor = divisor;
+
+        const QString name = serviceTable().value(port, UnknownService);
+        auto it = serviceIds.constFind(name);
+        if (it == serviceIds.constEnd()) {
+            it = serviceIds.insert(name, quint16(plan->services.size()));
+            plan->services.append(name);
+        }
+        probe.service = it.value();
+
+        if (kind == ProbeKind::ConnectBanner) {
+            bannerStrategy(port, probe.bannerMode, probe.bannerWait);
+        } else if (kind == ProbeKind::Udp) {
+            plan->payloads.append(udpPayload(port));
+        }
+        plan->probes.append(probe);
+    }
+
+    // Only point into the payloads once they have stopped moving.
+    for (int i = 0; i < plan->payloads.size(); ++i) {
+        plan->probes[i].payload = &plan->payloads.at(i);
+    }
+    return QSharedPointer<const ScanPlan>(plan);
+}
@@ -0,0 +1,76 @@
+#ifndef SCANPLAN_H
+#define SCANPLAN_H
+#include <QString>
+#include <QByteArray>
+#include <QHostAddress>
+#include <QSharedPointer>
+#include <QVector>
+#include "portscanner.h"
+#include "portset.h"
+#include "probetransport.h"
+
+// What a probe does on the wire and how its outcome reads as a port state.
+enum class ProbeKind : quint8 {
+    // Connect, then read a banner the way the port's service wants it.
+    ConnectBanner,
+    // Connect only: SYN, the stealth scan types and bannerless connect scans.
+    ConnectOnly,
+    // Connect only, and an answer of any kind means unfiltered: ACK.
+    ConnectFirewall,
+    Udp
+};
+
+// One port's probe, worked out before the scan starts.
+struct ProbeDescriptor
+{
+    quint16 port = 0;
+    // Index into the plan's service names.
+    quint16 service = 0;
+    ProbeKind kind = ProbeKind::ConnectBanner;
+    BannerMode bannerMode = BannerMode::None;
+    // Kept as a divisor rather than a timeout so retiming a running scan
+    // still reaches its probes.
+    quint8 timeoutDivisor = 1;
+    int bannerWait = 0;
+    // UDP only; points into the plan, which outlives every probe.
+    const QByteArray *payload = nullptr;
+};
+
+// Everything about a scan's probes that can't change while it runs: the
+// target and its address, and one descriptor per port in probe order. It is
+// compiled once by startScan() and only read from then on, so every probe
+// thread indexes the same copy without locks, lookups or allocations.
+class ScanPlan
+{
+public:
+    // Without banners, a connect scan only connects, with the full timeout.
+    static QSharedPointer<const ScanPlan> compile(const QString &host, const PortSet &ports, ScanType scanType,
+                                                  bool banners = true);
+    // Probes the ports in the order given, e.g. most likely open first.
+    static QSharedPointer<const ScanPlan> compile(const QString &host, const QVector<quint16> &order, ScanType scanType,
+                                                  bool banners = true);
+
+    const QString &host() const { return targetHost; }
+    // Null when the target is a name; those are resolved by the transport,
+    // on the probe threads, so compiling never blocks on DNS.
+    const QHostAddress *address() const { return literal ? &targetAddress : nullptr; }
+    ScanType scanType() const { return type; }
+
+    int size() const { return probes.size(); }
+    const ProbeDescriptor &probe(int index) const { return probes.at(index); }
+    const QString &serviceName(quint16 service) const { return services.at(service); }
+
+private:
+    ScanPlan() = default;
+    Q_DISABLE_COPY(ScanPlan)
+
+    QString targetHost;
+    QHostAddress targetAddress;
+    bool literal = false;
+    ScanType type = ScanType::TCP_CONNECT;
+    QVector<ProbeDescriptor> probes;
+    QVector<QString> services;
+    QVector<QByteArray> payloads;
+};
+
+#endif
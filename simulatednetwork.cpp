@@ -0,0 +1,321 @@
+#include "simulatednetwork.h"
+#include <QMutexLocker>
+#include <cmath>
+
+static const double Pi = 3.14159265358979323846;
+
+static quint64 splitMix64(quint64 x)
+{
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+static quint64 hostHash(const QString &address)
+{
+    quint64 hash = 1469598103934665603ull;
+    for (QChar c : address) {
+        hash ^= c.unicode();
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+VirtualClock::VirtualClock()
+    : time(0)
+    , participants(0)
+    , sleeping(0)
+{
+}
+
+qint64 VirtualClock::now() const
+{
+    QMutexLocker locker(&mutex);
+    return time;
+}
+
+void VirtualClock::reset()
+{
+    QMutexLocker locker(&mutex);
+    time = 0;
+    wakeups.clear();
+    sleeping = 0;
+}
+
+void VirtualClock::enter()
+{
+    QMutexLocker locker(&mutex);
+    participants++;
+}
+
+void VirtualClock::leave()
+{
+    QMutexLocker locker(&mutex);
+    participants--;
+    advanceIfIdle();
+}
+
+void VirtualClock::sleepUntil(qint64 wakeup)
+{
+    QMutexLocker locker(&mutex);
+    if (wakeup <= time) {
+        return;
+    }
+
+    wakeups.emplace(wakeup, 0);
+    sleeping++;
+    advanceIfIdle();
+
+    while (time < wakeup) {
+        wakeupChanged.wait(&mutex);
+    }
+}
+
+void VirtualClock::advanceIfIdle()
+{
+    // Only jump once nobody is still computing, otherwise a probe that has not
+    // reached its sleep yet would observe time moving underneath it. Woken
+    // sleepers are retired here rather than by themselves, so the count stays
+    // right even before they get the mutex back.
+    if (sleeping == 0 || sleeping < participants || wakeups.empty()) {
+        return;
+    }
+
+    time = qMax(time, wakeups.begin()->first);
+    while (!wakeups.empty() && wakeups.begin()->first <= time) {
+        wakeups.erase(wakeups.begin());
+        sleeping--;
+    }
+    wakeupChanged.wakeAll();
+}
+
+SimulatedNetwork::SimulatedNetwork(quint64 seed)
+    : seed(seed)
+    , tcpProbes(0)
+    , udpProbes(0)
+    , lost(0)
+    , rateLimited(0)
+{
+}
+
+void SimulatedNetwork::setDefaultHost(const SimulatedHost &host)
+{
+    defaultHost = host;
+}
+
+void SimulatedNetwork::setHost(const QString &address, const SimulatedHost &host)
+{
+    hosts.insert(address, host);
+}
+
+VirtualClock &SimulatedNetwork::clock()
+{
+    return virtualClock;
+}
+
+SimulatedNetworkStats SimulatedNetwork::stats() const
+{
+    SimulatedNetworkStats result;
+    result.tcpProbes = tcpProbes.loadRelaxed();
+    result.udpProbes = udpProbes.loadRelaxed();
+    result.lost = lost.loadRelaxed();
+    result.rateLimited = rateLimited.loadRelaxed();
+    return result;
+}
+
+const SimulatedHost &SimulatedNetwork::profile(const QString &address) const
+{
+    auto it = hosts.constFind(address);
+    return it != hosts.constEnd() ? it.value() : defaultHost;
+}
+
+double SimulatedNetwork::uniform(quint64 host, int port, int attempt, int stream) const
+{
+    quint64 x = splitMix64(seed ^ host ^ (quint64(port) << 32) ^ (quint64(attempt) << 48) ^ (quint64(stream) << 56));
+    return (x >> 11) * (1.0 / 9007199254740992.0);
+}
+
+SimulatedPortState SimulatedNetwork::portState(const SimulatedHost &host, quint64 hash, int port) const
+{
+    auto it = host.ports.constFind(port);
+    if (it != host.ports.constEnd()) {
+        return it.value();
+    }
+    if (host.openDensity > 0 && uniform(hash, port, 0, 1) < host.openDensity) {
+        return SimulatedPortState::Open;
+    }
+    return host.defaultState;
+}
+
+int SimulatedNetwork::sampleRtt(const SimulatedHost &host, quint64 hash, int port, int attempt) const
+{
+    const double u1 = qMax(uniform(hash, port, attempt, 2), 1e-12);
+    const double u2 = uniform(hash, port, attempt, 3);
+    const double z = std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * Pi * u2);
+
+    double rtt = host.rttMean;
+    switch (host.distribution) {
+    case RttDistribution::Fixed:
+        break;
+    case RttDistribution::Uniform:
+        rtt = host.rttMean + (2.0 * u2 - 1.0) * host.rttJitter;
+        break;
+    case RttDistribution::Normal:
+        rtt = host.rttMean + host.rttJitter * z;
+        break;
+    case RttDistribution::LogNormal:
+        if (host.rttMean > 0) {
+            rtt = host.rttMean * std::exp((host.rttJitter / host.rttMean) * z);
+        }
+        break;
+    }
+    return qMax(1, int(std::lround(rtt)));
+}
+
+bool SimulatedNetwork::admitResponse(const QString &address, const SimulatedHost &host, qint64 at)
+{
+    if (host.rateLimit <= 0) {
+        return true;
+    }
+
+    QMutexLocker locker(&bucketMutex);
+    Bucket &bucket = buckets[address];
+    const double capacity = qMax(1.0, host.rateLimit);
+    if (bucket.updated < 0) {
+        bucket.tokens = capacity;
+    } else if (at > bucket.updated) {
+        bucket.tokens = qMin(capacity, bucket.tokens + (at - bucket.updated) * host.rateLimit / 1000.0);
+    }
+    bucket.updated = qMax(bucket.updated, at);
+
+    if (bucket.tokens < 1.0) {
+        return false;
+    }
+    bucket.tokens -= 1.0;
+    return true;
+}
+
+TcpProbeReply SimulatedNetwork::probeTcp(const TcpProbeRequest &request)
+{
+    // Virtual waits finish as soon as every prober is asleep, so checking the
+    // token on the way in is as prompt as real sockets get.
+    if (request.cancel && request.cancel->isCancelled()) {
+        TcpProbeReply reply;
+        reply.outcome = ConnectOutcome::Cancelled;
+        return reply;
+    }
+
+    tcpProbes.fetchAndAddRelaxed(1);
+
+    const SimulatedHost &host = profile(request.host);
+    const quint64 hash = hostHash(request.host);
+    const SimulatedPortState state = portState(host, hash, request.port);
+    const int rtt = sampleRtt(host, hash, request.port, request.attempt);
+    const bool dropped = uniform(hash, request.port, request.attempt, 0) < host.loss;
+
+    virtualClock.enter();
+    const qint64 sent = virtualClock.now();
+
+    TcpProbeReply reply;
+    bool answered = state != SimulatedPortState::Filtered && !dropped && rtt < request.timeout;
+    if (dropped) {
+        lost.fetchAndAddRelaxed(1);
+    }
+    if (answered && !admitResponse(request.host, host, sent + rtt / 2)) {
+        rateLimited.fetchAndAddRelaxed(1);
+        answered = false;
+    }
+
+    if (!answered) {
+        virtualClock.sleepUntil(sent + request.timeout);
+        reply.outcome = ConnectOutcome::TimedOut;
+        reply.connectTime = request.timeout;
+        reply.connectMicros = qint64(request.timeout) * 1000;
+        virtualClock.leave();
+        return reply;
+    }
+
+    virtualClock.sleepUntil(sent + rtt);
+    reply.connectTime = rtt;
+    reply.connectMicros = qint64(rtt) * 1000;
+
+    if (state == SimulatedPortState::Closed) {
+        reply.outcome = ConnectOutcome::Refused;
+        virtualClock.leave();
+        return reply;
+    }
+
+    reply.outcome = ConnectOutcome::Connected;
+    switch (request.bannerMode) {
+    case BannerMode::None:
+        break;
+    case BannerMode::Read:
+        if (!host.banner.isEmpty() && rtt / 2 < request.bannerWait) {
+            virtualClock.sleepUntil(sent + rtt + rtt / 2);
+            reply.banner = host.banner;
+        } else {
+            virtualClock.sleepUntil(sent + rtt + request.bannerWait);
+        }
+        break;
+    case BannerMode::HttpGet:
+        if (!host.banner.isEmpty() && rtt < request.bannerWait) {
+            virtualClock.sleepUntil(sent + 2 * rtt);
+            reply.banner = "HTTP/1.0 200 OK\r\nServer: " + host.banner + "\r\n\r\n";
+        } else {
+            virtualClock.sleepUntil(sent + rtt + request.bannerWait);
+        }
+        break;
+    }
+    reply.bannerMicros = (virtualClock.now() - sent - rtt) * 1000;
+
+    virtualClock.leave();
+    return reply;
+}
+
+UdpProbeReply SimulatedNetwork::probeUdp(const UdpProbeRequest &request)
+{
+    if (request.cancel && request.cancel->isCancelled()) {
+        UdpProbeReply reply;
+        reply.cancelled = true;
+        return reply;
+    }
+
+    udpProbes.fetchAndAddRelaxed(1);
+
+    const SimulatedHost &host = profile(request.host);
+    const quint64 hash = hostHash(request.host);
+    const SimulatedPortState state = portState(host, hash, request.port);
+    const int rtt = sampleRtt(host, hash, request.port, request.attempt);
+    const bool dropped = uniform(hash, request.port, request.attempt, 0) < host.loss;
+
+    virtualClock.enter();
+    const qint64 sent = virtualClock.now();
+
+    UdpProbeReply reply;
+    reply.sent = true;
+
+    bool answered = state == SimulatedPortState::Open && !dropped && rtt < request.timeout;
+    if (dropped) {
+        lost.fetchAndAddRelaxed(1);
+    }
+    if (answered && !admitResponse(request.host, host, sent + rtt / 2)) {
+        rateLimited.fetchAndAddRelaxed(1);
+        answered = false;
+    }
+
+    if (answered) {
+        virtualClock.sleepUntil(sent + rtt);
+        reply.answered = true;
+        reply.responseTime = rtt;
+        reply.responseMicros = qint64(rtt) * 1000;
+        reply.response = host.banner;
+    } else {
+        virtualClock.sleepUntil(sent + request.timeout);
+        reply.responseTime = request.timeout;
+        reply.responseMicros = qint64(request.timeout) * 1000;
+    }
+
+    virtualClock.leave();
+    return reply;
+}
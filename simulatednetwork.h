@@ -0,0 +1,121 @@
+#ifndef SIMULATEDNETWORK_H
+#define SIMULATEDNETWORK_H
+#include "probetransport.h"
+#include <QHash>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInteger>
+#include <map>
+
+enum class SimulatedPortState {
+    Open,
+    Closed,
+    Filtered
+};
+
+enum class RttDistribution {
+    Fixed,
+    Uniform,
+    Normal,
+    LogNormal
+};
+
+struct SimulatedHost
+{
+    double rttMean = 20.0;
+    double rttJitter = 5.0;
+    RttDistribution distribution = RttDistribution::Normal;
+    double loss = 0.0;
+    double rateLimit = 0.0;
+    double openDensity = 0.0;
+    SimulatedPortState defaultState = SimulatedPortState::Closed;
+    QHash<int, SimulatedPortState> ports;
+    QByteArray banner = "SSH-2.0-Simulated";
+};
+
+// Virtual time for the simulated network. Probes sleep in virtual time, and
+// the clock jumps straight to the next wakeup once every in-flight probe is
+// asleep, so a scan that would take hours on the wire finishes as fast as the
+// CPU can run it.
+class VirtualClock
+{
+public:
+    VirtualClock();
+
+    qint64 now() const;
+    void reset();
+
+    void enter();
+    void leave();
+    void sleepUntil(qint64 wakeup);
+
+private:
+    void advanceIfIdle();
+
+    mutable QMutex mutex;
+    QWaitCondition wakeupChanged;
+    qint64 time;
+    int participants;
+    int sleeping;
+    std::multimap<qint64, int> wakeups;
+};
+
+struct SimulatedNetworkStats
+{
+    quint64 tcpProbes = 0;
+    quint64 udpProbes = 0;
+    quint64 lost = 0;
+    quint64 rateLimited = 0;
+};
+
+// In-process network for deterministic scale testing. Port states, loss and
+// RTT draws are pure functions of (seed, host, port, attempt), so repeated
+// runs see the same network no matter how the worker threads interleave. Rate
+// limiting is a per-host token bucket refilled in virtual time.
+//
+// Only the network side runs on the virtual clock. ProbeDispatcher paces
+// scans (job rate caps, per-host minimum intervals) by the wall clock, so a
+// simulated scan with those set is neither sped up nor deterministic; leave
+// them off when benchmarking on virtual time.
+class SimulatedNetwork : public ProbeTransport
+{
+public:
+    explicit SimulatedNetwork(quint64 seed = 1);
+
+    void setDefaultHost(const SimulatedHost &host);
+    void setHost(const QString &address, const SimulatedHost &host);
+
+    VirtualClock &clock();
+    SimulatedNetworkStats stats() const;
+
+    TcpProbeReply probeTcp(const TcpProbeRequest &request) override;
+    UdpProbeReply probeUdp(const UdpProbeRequest &request) override;
+
+private:
+    struct Bucket
+    {
+        double tokens = 0;
+        qint64 updated = -1;
+    };
+
+    const SimulatedHost &profile(const QString &address) const;
+    SimulatedPortState portState(const SimulatedHost &host, quint64 hostHash, int port) const;
+    double uniform(quint64 hostHash, int port, int attempt, int stream) const;
+    int sampleRtt(const SimulatedHost &host, quint64 hostHash, int port, int attempt) const;
+    bool admitResponse(const QString &address, const SimulatedHost &host, qint64 at);
+
+    quint64 seed;
+    SimulatedHost defaultHost;
+    QHash<QString, SimulatedHost> hosts;
+    VirtualClock virtualClock;
+
+    QMutex bucketMutex;
+    QHash<QString, Bucket> buckets;
+
+    QAtomicInteger<quint64> tcpProbes;
+    QAtomicInteger<quint64> udpProbes;
+    QAtomicInteger<quint64> lost;
+    QAtomicInteger<quint64> rateLimited;
+};
+
+#endif
@@ -0,0 +1,199 @@
+#include "socketbudget.h"
+#include "probetransport.h"
+#include "scanmetrics.h"
+#include <QFile>
+#include <QMutexLocker>
+#include <QStringList>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+// Descriptors kept back for the GUI, log files, metrics sockets and the like.
+static const int ReservedDescriptors = 64;
+// Never raise the soft limit past this; select()-free code doesn't need more.
+static const int MaxDescriptors = 65536;
+// Without rlimits (Windows) sockets are bounded by memory, not a table.
+static const int DefaultDescriptors = 16384;
+
+// Linux holds closed ports for 60 s, Windows for up to 120 s by default.
+static const qint64 TimeWaitMs = 60000;
+
+static const int MinWindow = 8;
+// A burst of failing probes is one exhaustion event, not dozens of halvings.
+static const qint64 ExhaustionHoldMs = 100;
+static const qint64 ExhaustionCooldownMs = 1000;
+static const int CancelSliceMs = 20;
+static const qint64 FirstBackoffMs = 50;
+
+SocketBudget *SocketBudget::instance()
+{
+    static SocketBudget budget;
+    return &budget;
+}
+
+SocketBudget::SocketBudget()
+    : descriptors(DefaultDescriptors)
+    , ephemeralFirst(49152)
+    , ephemeralLast(65535)
+    , limit(MinWindow)
+    , windowSize(MinWindow)
+    , active(0)
+    , lastExhausted(-ExhaustionCooldownMs)
+{
+    clock.start();
+    discover();
+}
+
+void SocketBudget::discover()
+{
+#ifdef Q_OS_UNIX
+    // Raise the soft limit towards the hard one, as nmap does; macOS refuses
+    // values above OPEN_MAX, so read back whatever actually took.
+    struct rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0) {
+        rlim_t wanted = files.rlim_max == RLIM_INFINITY ? rlim_t(MaxDescriptors)
+                                                        : qMin(files.rlim_max, rlim_t(MaxDescriptors));
+        if (files.rlim_cur != RLIM_INFINITY && files.rlim_cur < wanted) {
+            struct rlimit raised = files;
+            raised.rlim_cur = wanted;
+            if (setrlimit(RLIMIT_NOFILE, &raised) == 0) {
+                files = raised;
+            }
+        }
+        descriptors = files.rlim_cur == RLIM_INFINITY ? MaxDescriptors : int(qMin(files.rlim_cur, rlim_t(MaxDescriptors)));
+    }
+#endif
+
+    // IANA's 49152-65535 is what Windows and macOS use unless reconfigured.
+    QFile range("/proc/sys/net/ipv4/ip_local_port_range");
+    if (range.open(QIODevice::ReadOnly)) {
+        const QStringList bounds = QString::fromLatin1(range.readAll()).simplified().split(' ');
+        bool ok1 = false;
+        bool ok2 = false;
+        int first = bounds.value(0).toInt(&ok1);
+        int last = bounds.value(1).toInt(&ok2);
+        if (ok1 && ok2 && first > 0 && first <= last && last <= 65535) {
+            ephemeralFirst = first;
+            ephemeralLast = last;
+        }
+    }
+
+    limit = qMax(MinWindow, qMin(descriptors - ReservedDescriptors, ephemeralPorts()));
+    windowSize = limit;
+}
+
+int SocketBudget::available()
+{
+    const qint64 now = clock.elapsed();
+    while (!timeWaits.isEmpty() && now - timeWaits.head() >= TimeWaitMs) {
+        timeWaits.dequeue();
+    }
+    return qMax(1, qMin(windowSize, ephemeralPorts() - timeWaits.size()));
+}
+
+bool SocketBudget::acquire(const CancellationToken *cancel)
+{
+    QMutexLocker locker(&mutex);
+    forever {
+        if (cancel && cancel->isCancelled()) {
+            return false;
+        }
+        if (active < available()) {
+            ++active;
+            return true;
+        }
+        // Timed, so expiring TIME_WAIT ports and cancellation are noticed.
+        released.wait(&mutex, CancelSliceMs);
+    }
+}
+
+void SocketBudget::release(bool timeWait)
+{
+    QMutexLocker locker(&mutex);
+    --active;
+    if (timeWait) {
+        timeWaits.enqueue(clock.elapsed());
+    }
+    if (windowSize < limit && clock.elapsed() - lastExhausted >= ExhaustionCooldownMs) {
+        ++windowSize;
+    }
+    released.wakeAll();
+}
+
+void SocketBudget::reportExhausted()
+{
+    ScanMetrics::instance()->add(ScanCounter::ResourceExhausted);
+
+    QMutexLocker locker(&mutex);
+    const qint64 now = clock.elapsed();
+    if (now - lastExhausted >= ExhaustionHoldMs) {
+        windowSize = qMax(MinWindow, qMin(windowSize, active) / 2);
+    }
+    lastExhausted = now;
+}
+
+bool SocketBudget::backOff(int retry, const CancellationToken *cancel)
+{
+    QMutexLocker locker(&mutex);
+    const qint64 until = clock.elapsed() + (FirstBackoffMs << qBound(0, retry - 1, 8));
+    forever {
+        if (cancel && cancel->isCancelled()) {
+            return false;
+        }
+        const qint64 left = until - clock.elapsed();
+        if (left <= 0) {
+            return true;
+        }
+        released.wait(&mutex, ulong(qMin<qint64>(left, CancelSliceMs)));
+    }
+}
+
+int SocketBudget::descriptorLimit() const
+{
+    QMutexLocker locker(&mutex);
+    return descriptors;
+}
+
+int SocketBudget::ephemeralPorts() const
+{
+    return ephemeralLast - ephemeralFirst + 1;
+}
+
+int SocketBudget::budget() const
+{
+    QMutexLocker locker(&mutex);
+    return limit;
+}
+
+int SocketBudget::window() const
+{
+    QMutexLocker locker(&mutex);
+    return windowSize;
+}
+
+int SocketBudget::inFlight() const
+{
+    QMutexLocker locker(&mutex);
+    return active;
+}
+
+QString SocketBudget::describe() const
+{
+    QMutexLocker locker(&mutex);
+    return QString("Socket budget: up to %1 sockets in flight (descriptor limit %2, ephemeral ports %3-%4)")
+        .arg(limit).arg(descriptors).arg(ephemeralFirst).arg(ephemeralLast);
+}
+
+SocketLease::SocketLease(const CancellationToken *cancel)
+    : acquired(SocketBudget::instance()->acquire(cancel))
+    , timeWait(false)
+{
+}
+
+SocketLease::~SocketLease()
+{
+    if (acquired) {
+        SocketBudget::instance()->release(timeWait);
+    }
+}
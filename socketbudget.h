@@ -0,0 +1,79 @@
+#ifndef SOCKETBUDGET_H
+#define SOCKETBUDGET_H
+#include <QString>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QQueue>
+
+class CancellationToken;
+
+// Process-wide cap on probe sockets. At startup it raises RLIMIT_NOFILE as
+// far as the hard limit allows and reads the ephemeral port range; the
+// budget is whichever runs out first, less a reserve for the rest of the
+// process. Graceful closes are remembered for the TIME_WAIT period, since
+// their local ports can't be reused until then.
+//
+// Hitting EMFILE or EADDRNOTAVAIL anyway (other processes use ports and
+// descriptors too) halves the window of sockets allowed in flight; it grows
+// back by one per probe once a second has passed without exhaustion.
+class SocketBudget
+{
+public:
+    static SocketBudget *instance();
+
+    // Blocks while the window is full. False if the token was cancelled first.
+    bool acquire(const CancellationToken *cancel);
+    // timeWait: the socket was closed gracefully and its port lingers.
+    void release(bool timeWait);
+    void reportExhausted();
+    // Before retrying a probe that ran out: waits a while, doubling with
+    // each retry, so other probes' sockets close and the narrowed window
+    // takes hold. False if the token was cancelled first.
+    bool backOff(int retry, const CancellationToken *cancel);
+
+    int descriptorLimit() const;
+    int ephemeralPorts() const;
+    int budget() const;
+    int window() const;
+    int inFlight() const;
+    QString describe() const;
+
+private:
+    SocketBudget();
+    void discover();
+    int available();
+
+    mutable QMutex mutex;
+    QWaitCondition released;
+    QElapsedTimer clock;
+    QQueue<qint64> timeWaits;
+
+    int descriptors;
+    int ephemeralFirst;
+    int ephemeralLast;
+    int limit;
+    int windowSize;
+    int active;
+    qint64 lastExhausted;
+};
+
+// Holds one socket's place in the budget for its lifetime.
+class SocketLease
+{
+public:
+    explicit SocketLease(const CancellationToken *cancel);
+    ~SocketLease();
+
+    bool isValid() const { return acquired; }
+    // Call before the socket goes away when it was closed gracefully.
+    void setTimeWait(bool lingers) { timeWait = lingers; }
+
+private:
+    Q_DISABLE_COPY(SocketLease)
+
+    bool acquired;
+    bool timeWait;
+};
+
+#endif
@@ -0,0 +1,378 @@
+#include "targetgenerator.h"
+#include <QFile>
+#include <QRegularExpression>
+#include <cstring>
+
+// "low" alone: the ::1 to ::ff that hand-numbered hosts mostly use.
+static const quint64 DefaultLowLast = 0xff;
+// A prefix this small (a /112 or longer) is cheap enough to sweep whole.
+static const int MaxSweepBits = 16;
+static const qint64 MaxHitlistLine = 4096;
+
+static const char *const HitlistScheme = "hitlist:";
+
+static Q_IPV6ADDR maskedPrefix(const Q_IPV6ADDR &address, int length)
+{
+    Q_IPV6ADDR masked = address;
+    for (int i = 0; i < 16; ++i) {
+        const int bits = qBound(0, length - i * 8, 8);
+        masked[i] &= quint8(0xff00 >> bits);
+    }
+    return masked;
+}
+
+// ORs the interface identifier into the low 64 bits.
+static Q_IPV6ADDR withIdentifier(const Q_IPV6ADDR &prefix, quint64 identifier)
+{
+    Q_IPV6ADDR address = prefix;
+    for (int i = 15; i >= 8; --i) {
+        address[i] |= quint8(identifier & 0xff);
+        identifier >>= 8;
+    }
+    return address;
+}
+
+static QString stripBrackets(const QString &host)
+{
+    if (host.startsWith('[') && host.endsWith(']')) {
+        return host.mid(1, host.size() - 2);
+    }
+    return host;
+}
+
+TargetGenerator::TargetGenerator(int limit)
+    : maxTargets(qMax(1, limit))
+    , skippedLines(0)
+{
+}
+
+bool TargetGenerator::expand(const QString &expressions, QStringList &targets, QString *errorString)
+{
+    TargetGenerator generator;
+    if (!generator.add(expressions, errorString)) {
+        return false;
+    }
+    targets = generator.targets();
+    return true;
+}
+
+bool TargetGenerator::isValidHost(const QString &host)
+{
+    const QString bare = stripBrackets(host);
+    if (!QHostAddress(bare).isNull()) {
+        return true;
+    }
+
+    static const QRegularExpression hostnameRegex("^[a-zA-Z0-9]([a-zA-Z0-9\\-]{0,61}[a-zA-Z0-9])?(\\.[a-zA-Z0-9]([a-zA-Z0-9\\-]{0,61}[a-zA-Z0-9])?)*$");
+    return hostnameRegex.match(bare).hasMatch();
+}
+
+bool TargetGenerator::add(const QString &expressions, QString *errorString)
+{
+    static const QRegularExpression separators("[,\\s]+");
+    for (const QString &expression : expressions.split(separators, Qt::SkipEmptyParts)) {
+        if (!addOne(expression, errorString)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TargetGenerator::clear()
+{
+    list.clear();
+    seen.clear();
+    skippedLines = 0;
+}
+
+QStringList TargetGenerator::targets() const
+{
+    return list;
+}
+
+int TargetGenerator::count() const
+{
+    return list.size();
+}
+
+int TargetGenerator::skipped() const
+{
+    return skippedLines;
+}
+
+bool TargetGenerator::addOne(const QString &expression, QString *errorString)
+{
+    if (expression.startsWith(HitlistScheme)) {
+        QString fileName = expression.mid(int(std::strlen(HitlistScheme)));
+        Pattern pattern;
+        // File names may hold an '@' too; only a known pattern after it counts.
+        const int at = fileName.lastIndexOf('@');
+        if (at > 0 && QRegularExpression("^(low|eui64|v4)\\b").match(fileName.mid(at + 1)).hasMatch()) {
+            if (!parsePattern(fileName.mid(at + 1), pattern, errorString)) {
+                return false;
+            }
+            fileName.truncate(at);
+        }
+        return addHitlist(fileName, pattern, errorString);
+    }
+
+    QString base = expression;
+    Pattern pattern;
+    const int at = base.indexOf('@');
+    if (at >= 0) {
+        if (!parsePattern(base.mid(at + 1), pattern, errorString)) {
+            return false;
+        }
+        base.truncate(at);
+    }
+
+    if (!base.contains('/')) {
+        if (pattern.kind != Pattern::None) {
+            if (errorString) *errorString = QString("%1: a pattern needs a prefix such as /64").arg(expression);
+            return false;
+        }
+        if (!isValidHost(base)) {
+            if (errorString) *errorString = QString("Invalid target: %1").arg(expression);
+            return false;
+        }
+        const QString host = stripBrackets(base);
+        const QHostAddress address(host);
+        if (!reserve(1, errorString)) {
+            return false;
+        }
+        // Literal addresses in canonical form, so duplicates are caught.
+        append(address.isNull() ? host : address.toString());
+        return true;
+    }
+
+    const QPair<QHostAddress, int> subnet = QHostAddress::parseSubnet(stripBrackets(base));
+    if (subnet.first.isNull()) {
+        if (errorString) *errorString = QString("Invalid prefix: %1").arg(base);
+        return false;
+    }
+
+    if (subnet.first.protocol() == QAbstractSocket::IPv4Protocol) {
+        if (pattern.kind != Pattern::None) {
+            if (errorString) *errorString = QString("%1: patterns only apply to IPv6 prefixes").arg(expression);
+            return false;
+        }
+        const quint64 size = quint64(1) << (32 - subnet.second);
+        if (!reserve(size, errorString)) {
+            return false;
+        }
+        const quint32 network = subnet.first.toIPv4Address();
+        for (quint64 i = 0; i < size; ++i) {
+            append(QHostAddress(quint32(network + i)).toString());
+        }
+        return true;
+    }
+
+    if (pattern.kind == Pattern::None) {
+        if (128 - subnet.second > MaxSweepBits) {
+            if (errorString) {
+                *errorString = QString("%1: a /%2 is far too large to sweep; add a pattern such as @low or use a hitlist")
+                                   .arg(expression).arg(subnet.second);
+            }
+            return false;
+        }
+        pattern.kind = Pattern::Low;
+        pattern.first = 0;
+        pattern.last = (quint64(1) << (128 - subnet.second)) - 1;
+    }
+    return addPrefix(subnet.first.toIPv6Address(), subnet.second, pattern, errorString);
+}
+
+bool TargetGenerator::addHitlist(const QString &fileName, const Pattern &pattern, QString *errorString)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        if (errorString) *errorString = QString("%1: %2").arg(fileName, file.errorString());
+        return false;
+    }
+
+    // Published hitlists sometimes carry extra columns after the address.
+    static const QRegularExpression columns("[\\s,;]+");
+    // The /64s the hitlist names, in first-seen order, for the pattern pass.
+    QList<Q_IPV6ADDR> prefixes;
+    QSet<QByteArray> prefixSeen;
+
+    while (!file.atEnd()) {
+        QString line = QString::fromLatin1(file.readLine(MaxHitlistLine));
+        const int comment = line.indexOf('#');
+        if (comment >= 0) {
+            line.truncate(comment);
+        }
+        line = line.trimmed();
+        if (line.isEmpty()) continue;
+
+        const QHostAddress address(stripBrackets(line.section(columns, 0, 0)));
+        if (address.isNull()) {
+            ++skippedLines;
+            continue;
+        }
+        if (!reserve(1, errorString)) {
+            return false;
+        }
+        append(address.toString());
+
+        if (pattern.kind != Pattern::None && address.protocol() == QAbstractSocket::IPv6Protocol) {
+            const Q_IPV6ADDR prefix = maskedPrefix(address.toIPv6Address(), 64);
+            const QByteArray key(reinterpret_cast<const char *>(prefix.c), 8);
+            if (!prefixSeen.contains(key)) {
+                prefixSeen.insert(key);
+                prefixes.append(prefix);
+            }
+        }
+    }
+
+    for (const Q_IPV6ADDR &prefix : prefixes) {
+        if (!addPrefix(prefix, 64, pattern, errorString)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TargetGenerator::addPrefix(const Q_IPV6ADDR &prefix, int length, const Pattern &pattern, QString *errorString)
+{
+    const int hostBits = 128 - length;
+    const QString where = QString("%1/%2").arg(QHostAddress(prefix).toString()).arg(length);
+    switch (pattern.kind) {
+    case Pattern::Low:
+        if (hostBits < 64 && pattern.last >= (quint64(1) << hostBits)) {
+            if (errorString) *errorString = QString("%1: low identifiers up to %2 don't fit").arg(where).arg(pattern.last);
+            return false;
+        }
+        break;
+    case Pattern::Eui64:
+        if (length > 64) {
+            if (errorString) *errorString = QString("%1: EUI-64 identifiers need a /64 or shorter").arg(where);
+            return false;
+        }
+        break;
+    case Pattern::V4:
+        if (length > 96) {
+            if (errorString) *errorString = QString("%1: embedded IPv4 needs a /96 or shorter").arg(where);
+            return false;
+        }
+        break;
+    case Pattern::None:
+        return true;
+    }
+
+    // The span of a full 64-bit range doesn't fit in 64 bits; check it
+    // against the limit before counting the last value in.
+    const quint64 span = pattern.last - pattern.first;
+    if (span >= quint64(maxTargets)) {
+        if (errorString) *errorString = QString("Targets expand to more than %1 hosts").arg(maxTargets);
+        return false;
+    }
+    if (!reserve(span + 1, errorString)) {
+        return false;
+    }
+
+    const Q_IPV6ADDR network = maskedPrefix(prefix, length);
+    for (quint64 offset = 0; offset <= span; ++offset) {
+        const quint64 value = pattern.first + offset;
+        quint64 identifier = value;
+        if (pattern.kind == Pattern::Eui64) {
+            // MAC aa:bb:cc:dd:ee:ff -> (aa^02)bb:ccff:fedd:eeff, as SLAAC derives it.
+            quint8 mac[6];
+            std::memcpy(mac, pattern.mac, sizeof(mac));
+            quint64 rest = value;
+            for (int i = 5; i >= pattern.macBytes; --i) {
+                mac[i] = quint8(rest & 0xff);
+                rest >>= 8;
+            }
+            const quint8 bytes[8] = { quint8(mac[0] ^ 0x02), mac[1], mac[2], 0xff, 0xfe, mac[3], mac[4], mac[5] };
+            identifier = 0;
+            for (quint8 byte : bytes) {
+                identifier = (identifier << 8) | byte;
+            }
+        }
+        append(QHostAddress(withIdentifier(network, identifier)).toString());
+    }
+    return true;
+}
+
+bool TargetGenerator::parsePattern(const QString &text, Pattern &pattern, QString *errorString)
+{
+    const QString kind = text.section(':', 0, 0);
+    const QString argument = text.section(':', 1);
+
+    if (kind == "low") {
+        pattern.kind = Pattern::Low;
+        pattern.first = 1;
+        pattern.last = DefaultLowLast;
+        if (argument.isEmpty()) {
+            return true;
+        }
+        bool ok1 = true;
+        bool ok2 = true;
+        if (argument.contains('-')) {
+            pattern.first = argument.section('-', 0, 0).toULongLong(&ok1, 0);
+            pattern.last = argument.section('-', 1).toULongLong(&ok2, 0);
+        } else {
+            pattern.last = argument.toULongLong(&ok2, 0);
+        }
+        if (!ok1 || !ok2 || pattern.first > pattern.last) {
+            if (errorString) *errorString = QString("Invalid low-byte range: %1").arg(text);
+            return false;
+        }
+        return true;
+    }
+
+    if (kind == "eui64") {
+        const QStringList bytes = argument.split(QRegularExpression("[:-]"), Qt::SkipEmptyParts);
+        if (bytes.size() < 3 || bytes.size() > 6) {
+            if (errorString) *errorString = QString("%1: give a vendor OUI of 3 to 6 MAC bytes, e.g. eui64:00:1a:2b").arg(text);
+            return false;
+        }
+        for (int i = 0; i < bytes.size(); ++i) {
+            bool ok = false;
+            const uint byte = bytes.at(i).toUInt(&ok, 16);
+            if (!ok || byte > 0xff) {
+                if (errorString) *errorString = QString("Invalid MAC byte in %1: %2").arg(text, bytes.at(i));
+                return false;
+            }
+            pattern.mac[i] = quint8(byte);
+        }
+        pattern.kind = Pattern::Eui64;
+        pattern.macBytes = bytes.size();
+        pattern.first = 0;
+        pattern.last = (quint64(1) << (8 * (6 - pattern.macBytes))) - 1;
+        return true;
+    }
+
+    if (kind == "v4") {
+        const QPair<QHostAddress, int> subnet = argument.contains('/') ? QHostAddress::parseSubnet(argument)
+                                                                       : qMakePair(QHostAddress(argument), 32);
+        if (subnet.first.isNull() || subnet.first.protocol() != QAbstractSocket::IPv4Protocol) {
+            if (errorString) *errorString = QString("Invalid IPv4 block in %1").arg(text);
+            return false;
+        }
+        pattern.kind = Pattern::V4;
+        pattern.first = subnet.first.toIPv4Address();
+        pattern.last = pattern.first + (quint64(1) << (32 - subnet.second)) - 1;
+        return true;
+    }
+
+    if (errorString) *errorString = QString("Unknown pattern @%1 (use low, eui64 or v4)").arg(text);
+    return false;
+}
+
+bool TargetGenerator::reserve(quint64 more, QString *errorString) const
+{
+    if (more <= quint64(maxTargets) - quint64(list.size())) {
+        return true;
+    }
+    if (errorString) *errorString = QString("Targets expand to more than %1 hosts").arg(maxTargets);
+    return false;
+}
+
+void TargetGenerator::append(const QString &target)
+{
+    if (seen.contains(target)) return;
+    seen.insert(target);
+    list.append(target);
+}
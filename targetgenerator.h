@@ -0,0 +1,68 @@
+#ifndef TARGETGENERATOR_H
+#define TARGETGENERATOR_H
+#include <QString>
+#include <QStringList>
+#include <QSet>
+#include <QHostAddress>
+
+// Expands target expressions into hosts to scan. An IPv6 prefix can't be
+// swept, so it is only accepted with a pattern of likely interface
+// identifiers, or through a hitlist of addresses known to be in use:
+//
+//   scanme.example.com, 10.0.0.1, 2001:db8::1, [fe80::1%eth0]
+//   10.0.0.0/24                               every address of the block
+//   2001:db8:1:2::/64@low                     ::1 to ::ff
+//   2001:db8:1:2::/64@low:1-4096              any range of low identifiers
+//   2001:db8:1:2::/64@eui64:00:1a:2b          every NIC of a vendor OUI, EUI-64 style
+//   2001:db8:1:2::/64@eui64:00:1a:2b:3c       ... with more of the MAC fixed
+//   2001:db8:1:2::/64@v4:10.1.2.0/24          IPv4 addresses in the low 32 bits
+//   hitlist:/data/ipv6-hitlist.txt            one address per line, # comments
+//   hitlist:/data/ipv6-hitlist.txt@low:1-16   and the pattern in each /64 it names
+//
+// Expressions are separated by commas or whitespace. Targets come out once
+// each, in the order first seen, and never more than the limit, so a typo
+// in a prefix length can't queue millions of scans.
+class TargetGenerator
+{
+public:
+    explicit TargetGenerator(int limit = DefaultLimit);
+
+    bool add(const QString &expressions, QString *errorString = nullptr);
+    void clear();
+
+    QStringList targets() const;
+    int count() const;
+    // Hitlist lines that held no address.
+    int skipped() const;
+
+    static bool expand(const QString &expressions, QStringList &targets, QString *errorString = nullptr);
+    // A literal address (optionally in brackets) or a DNS name.
+    static bool isValidHost(const QString &host);
+
+    static const int DefaultLimit = 1 << 20;
+
+private:
+    struct Pattern
+    {
+        enum Kind { None, Low, Eui64, V4 } kind = None;
+        quint64 first = 0;
+        quint64 last = 0;
+        // Eui64: the leading MAC bytes given; the rest count from first to last.
+        quint8 mac[6] = {};
+        int macBytes = 0;
+    };
+
+    bool addOne(const QString &expression, QString *errorString);
+    bool addHitlist(const QString &fileName, const Pattern &pattern, QString *errorString);
+    bool addPrefix(const Q_IPV6ADDR &prefix, int length, const Pattern &pattern, QString *errorString);
+    static bool parsePattern(const QString &text, Pattern &pattern, QString *errorString);
+    bool reserve(quint64 more, QString *errorString) const;
+    void append(const QString &target);
+
+    int maxTargets;
+    QStringList list;
+    QSet<QString> seen;
+    int skippedLines;
+};
+
+#endif
@@ -0,0 +1,8 @@
+#!/bin/sh
+# Stands in for nmap: ignores its arguments and writes a recorded -oX run
+# to stdout a few lines at a time, as nmap streams it.
+# $NMAP_REPLAY names the recording.
+[ -r "$NMAP_REPLAY" ] || { echo "nmap-replay: set NMAP_REPLAY to an -oX file" >&2; exit 2; }
+while IFS= read -r line || [ -n "$line" ]; do
+    printf '%s\n' "$line"
+done < "$NMAP_REPLAY"
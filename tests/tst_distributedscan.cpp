@@ -0,0 +1,133 @@
+#include <QtTest>
+#include <QTcpSocket>
+#include <QNetworkInterface>
+#include "distributedscan.h"
+#include "simulatednetwork.h"
+
+class TestDistributedScan : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void scansThroughLocalhostWorker();
+    void rejectsWrongToken();
+    void barePortListensOnLoopback();
+    void refusesWildcardWithoutToken();
+
+private:
+    static QSharedPointer<ProbeTransport> network();
+};
+
+QSharedPointer<ProbeTransport> TestDistributedScan::network()
+{
+    SimulatedHost host;
+    host.rttMean = 1.0;
+    host.rttJitter = 0.0;
+    host.distribution = RttDistribution::Fixed;
+    host.ports.insert(22, SimulatedPortState::Open);
+    host.ports.insert(80, SimulatedPortState::Open);
+    QSharedPointer<SimulatedNetwork> network(new SimulatedNetwork);
+    network->setDefaultHost(host);
+    return network;
+}
+
+void TestDistributedScan::scansThroughLocalhostWorker()
+{
+    PortSet ports;
+    QVERIFY(PortSet::parse("1-100", ports));
+
+    ScanCoordinator coordinator;
+    coordinator.setScan({ "10.0.0.1" }, ports, ScanType::TCP_SYN, TimingTemplate::T5_INSANE, 32);
+    coordinator.setToken("secret");
+    QString error;
+    QVERIFY2(coordinator.listen("127.0.0.1:0", &error), qPrintable(error));
+    QVERIFY(coordinator.serverPort() != 0);
+
+    QSet<int> open;
+    int results = 0;
+    connect(&coordinator, &ScanCoordinator::result,
+            [&open, &results](const QString &, int port, const QString &status) {
+        ++results;
+        if (status == "Open") open.insert(port);
+    });
+    QSignalSpy finished(&coordinator, &ScanCoordinator::finished);
+
+    ScanWorker worker;
+    worker.setName("test");
+    worker.setToken("secret");
+    worker.setTransport(network());
+    QVERIFY2(worker.connectTo(QString("127.0.0.1:%1").arg(coordinator.serverPort()), &error), qPrintable(error));
+
+    QVERIFY(finished.wait(20000));
+    QCOMPARE(coordinator.completedUnits(), coordinator.unitCount());
+    QCOMPARE(coordinator.completedProbes(), quint64(100));
+    QCOMPARE(results, 100);
+    QCOMPARE(open, QSet<int>({ 22, 80 }));
+}
+
+void TestDistributedScan::rejectsWrongToken()
+{
+    PortSet ports;
+    QVERIFY(PortSet::parse("1-10", ports));
+
+    ScanCoordinator coordinator;
+    coordinator.setScan({ "10.0.0.1" }, ports, ScanType::TCP_SYN, TimingTemplate::T5_INSANE);
+    coordinator.setToken("secret");
+    QString error;
+    QVERIFY2(coordinator.listen("127.0.0.1:0", &error), qPrintable(error));
+
+    int results = 0;
+    connect(&coordinator, &ScanCoordinator::result, [&results]() { ++results; });
+
+    ScanWorker worker;
+    worker.setToken("guess");
+    worker.setTransport(network());
+    QSignalSpy workerFinished(&worker, &ScanWorker::finished);
+    QVERIFY2(worker.connectTo(QString("127.0.0.1:%1").arg(coordinator.serverPort()), &error), qPrintable(error));
+
+    // The coordinator hangs up, and the worker never got a unit to scan.
+    QVERIFY(workerFinished.wait(5000));
+    QCOMPARE(coordinator.workerCount(), 0);
+    QCOMPARE(coordinator.completedUnits(), 0);
+    QCOMPARE(results, 0);
+    QVERIFY(!coordinator.isFinished());
+}
+
+void TestDistributedScan::barePortListensOnLoopback()
+{
+    PortSet ports;
+    QVERIFY(PortSet::parse("1", ports));
+
+    ScanCoordinator coordinator;
+    coordinator.setScan({ "10.0.0.1" }, ports, ScanType::TCP_SYN, TimingTemplate::T5_INSANE);
+    QString error;
+    // No token: loopback is allowed without one.
+    QVERIFY2(coordinator.listen("0", &error), qPrintable(error));
+    QVERIFY(coordinator.serverPort() != 0);
+
+    QTcpSocket probe;
+    probe.connectToHost(QHostAddress::LocalHost, coordinator.serverPort());
+    QVERIFY(probe.waitForConnected(5000));
+
+    // Anything the machine answers on besides loopback must be refused.
+    for (const QHostAddress &address : QNetworkInterface::allAddresses()) {
+        if (address.isLoopback() || address.protocol() != QAbstractSocket::IPv4Protocol) continue;
+        QTcpSocket outside;
+        outside.connectToHost(address, coordinator.serverPort());
+        QVERIFY(!outside.waitForConnected(1000));
+    }
+}
+
+void TestDistributedScan::refusesWildcardWithoutToken()
+{
+    ScanCoordinator coordinator;
+    QString error;
+    QVERIFY(!coordinator.listen("0.0.0.0:0", &error));
+    QVERIFY(!error.isEmpty());
+
+    coordinator.setToken("secret");
+    QVERIFY2(coordinator.listen("0.0.0.0:0", &error), qPrintable(error));
+}
+
+QTEST_GUILESS_MAIN(TestDistributedScan)
+#include "tst_distributedscan.moc"
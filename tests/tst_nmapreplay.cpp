@@ -0,0 +1,130 @@
+#include <QtTest>
+#include <QFile>
+#include "nmapxml.h"
+#include "portscanner.h"
+
+// Replays a recorded `nmap -sT -p 1-100 -sV -oX -` run: 22 and 80 open, 25
+// filtered, the other 97 folded into one closed <extraports>.
+static const char *const Recording = CYBERSCANNER_TEST_DATA "/nmap-connect-1-100.xml";
+static const char *const ReplayScript = CYBERSCANNER_TEST_DATA "/nmap-replay.sh";
+
+class TestNmapReplay : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void parsesRecordingInChunks();
+    void holdsHostUntilItCloses();
+    void scansThroughReplayedNmap();
+
+private:
+    static QByteArray recording();
+};
+
+QByteArray TestNmapReplay::recording()
+{
+    QFile file(Recording);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    return file.readAll();
+}
+
+void TestNmapReplay::parsesRecordingInChunks()
+{
+    const QByteArray xml = recording();
+    QVERIFY(!xml.isEmpty());
+
+    // Odd-sized chunks split elements and attributes the way pipe reads do.
+    NmapXmlParser parser;
+    parser.setProtocol("tcp");
+    QVector<NmapHostReport> hosts;
+    for (int offset = 0; offset < xml.size(); offset += 7) {
+        parser.addData(xml.mid(offset, 7));
+        hosts += parser.takeHosts();
+    }
+
+    QVERIFY2(!parser.hasError(), qPrintable(parser.errorString()));
+    QVERIFY(parser.isFinished());
+    QCOMPARE(parser.task(), QString("Service scan"));
+    QCOMPARE(parser.percent(), 100.0);
+
+    QCOMPARE(hosts.size(), 1);
+    const NmapHostReport &host = hosts.first();
+    QCOMPARE(host.address, QString("192.0.2.10"));
+    QCOMPARE(host.ports.size(), 3);
+
+    QCOMPARE(host.ports.at(0).port, 22);
+    QCOMPARE(host.ports.at(0).state, PortState::Open);
+    QCOMPARE(host.ports.at(0).service, QString("ssh"));
+    QCOMPARE(host.ports.at(0).banner, QString("OpenSSH 9.6p1 Ubuntu 3ubuntu13 Ubuntu Linux; protocol 2.0"));
+    QCOMPARE(host.ports.at(0).responseTime, 4);
+    QCOMPARE(host.ports.at(1).port, 25);
+    QCOMPARE(host.ports.at(1).state, PortState::Filtered);
+    QCOMPARE(host.ports.at(2).port, 80);
+    QCOMPARE(host.ports.at(2).banner, QString("nginx 1.24.0 Ubuntu"));
+
+    QCOMPARE(host.extraPorts.size(), 1);
+    QCOMPARE(host.extraPorts.first().state, PortState::Closed);
+    QCOMPARE(host.extraPorts.first().count, 97);
+}
+
+void TestNmapReplay::holdsHostUntilItCloses()
+{
+    const QByteArray xml = recording();
+    const int hostEnd = xml.indexOf("</host>");
+    QVERIFY(hostEnd > 0);
+
+    NmapXmlParser parser;
+    parser.addData(xml.left(hostEnd));
+    QVERIFY(!parser.hasError());
+    QVERIFY(parser.takeHosts().isEmpty());
+    QVERIFY(!parser.isFinished());
+
+    parser.addData(xml.mid(hostEnd));
+    QCOMPARE(parser.takeHosts().size(), 1);
+    QVERIFY(parser.isFinished());
+}
+
+void TestNmapReplay::scansThroughReplayedNmap()
+{
+#ifdef Q_OS_WIN
+    QSKIP("The replay script needs a POSIX shell");
+#endif
+    qputenv("NMAP_REPLAY", Recording);
+
+    PortSet ports;
+    QVERIFY(PortSet::parse("1-100", ports));
+
+    PortScanner scanner;
+    scanner.setScanEngine(ScanEngine::Nmap);
+    scanner.setNmapProgram(ReplayScript);
+
+    QHash<int, PortState> states;
+    connect(&scanner, &PortScanner::portResults, [&states](const QVector<ProbeResult> &results) {
+        for (const ProbeResult &result : results) {
+            states.insert(result.port, result.state);
+        }
+    });
+    QStringList errors;
+    connect(&scanner, &PortScanner::scanError, [&errors](const QString &error) { errors << error; });
+    QSignalSpy finished(&scanner, &PortScanner::scanFinished);
+
+    scanner.startScan("192.0.2.10", ports, ScanType::TCP_CONNECT, TimingTemplate::T4_AGGRESSIVE,
+                      false, false, false);
+    QVERIFY(finished.wait(10000));
+
+    QVERIFY2(errors.isEmpty(), qPrintable(errors.join("; ")));
+    QCOMPARE(states.size(), 100);
+    QCOMPARE(states.value(22), PortState::Open);
+    QCOMPARE(states.value(80), PortState::Open);
+    QCOMPARE(states.value(25), PortState::Filtered);
+    int closed = 0;
+    for (PortState state : qAsConst(states)) {
+        if (state == PortState::Closed) ++closed;
+    }
+    QCOMPARE(closed, 97);
+}
+
+QTEST_GUILESS_MAIN(TestNmapReplay)
+#include "tst_nmapreplay.moc"
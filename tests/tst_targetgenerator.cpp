@@ -0,0 +1,114 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include "targetgenerator.h"
+
+class TestTargetGenerator : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void rejectsFullLowRange();
+    void endsLowRangeAtTopIdentifier();
+    void derivesEui64Identifiers();
+    void embedsIpv4Block();
+    void splitsHitlistPattern();
+
+private:
+    static QHostAddress address(const QString &text) { return QHostAddress(text); }
+};
+
+void TestTargetGenerator::rejectsFullLowRange()
+{
+    // last - first + 1 wraps to 0 for the full range; it must not slip past
+    // the limit, nor loop forever.
+    TargetGenerator generator;
+    QString error;
+    QVERIFY(!generator.add("2001:db8::/64@low:0-0xffffffffffffffff", &error));
+    QVERIFY(error.contains("more than"));
+    QCOMPARE(generator.count(), 0);
+
+    TargetGenerator small(100);
+    QVERIFY(!small.add("2001:db8::/64@low:1-101", &error));
+    QVERIFY(small.add("2001:db8::/64@low:1-100", &error));
+    QCOMPARE(small.count(), 100);
+}
+
+void TestTargetGenerator::endsLowRangeAtTopIdentifier()
+{
+    TargetGenerator generator;
+    QString error;
+    QVERIFY2(generator.add("2001:db8::/64@low:0xfffffffffffffff0-0xffffffffffffffff", &error), qPrintable(error));
+    const QStringList targets = generator.targets();
+    QCOMPARE(targets.size(), 16);
+    QCOMPARE(address(targets.first()), address("2001:db8::ffff:ffff:ffff:fff0"));
+    QCOMPARE(address(targets.last()), address("2001:db8::ffff:ffff:ffff:ffff"));
+}
+
+void TestTargetGenerator::derivesEui64Identifiers()
+{
+    // MAC 00:1a:2b:3c:4d:5e -> 021a:2bff:fe3c:4d5e, as SLAAC derives it.
+    TargetGenerator generator;
+    QString error;
+    QVERIFY2(generator.add("2001:db8:1:2::/64@eui64:00:1a:2b:3c:4d:5e", &error), qPrintable(error));
+    QCOMPARE(generator.count(), 1);
+    QCOMPARE(address(generator.targets().first()), address("2001:db8:1:2:21a:2bff:fe3c:4d5e"));
+
+    // The MAC bytes not given count through every value.
+    generator.clear();
+    QVERIFY2(generator.add("2001:db8:1:2::/64@eui64:00:1a:2b:3c:4d", &error), qPrintable(error));
+    QCOMPARE(generator.count(), 256);
+    QCOMPARE(address(generator.targets().first()), address("2001:db8:1:2:21a:2bff:fe3c:4d00"));
+    QCOMPARE(address(generator.targets().last()), address("2001:db8:1:2:21a:2bff:fe3c:4dff"));
+
+    QVERIFY(!generator.add("2001:db8:1:2::/80@eui64:00:1a:2b", &error));
+    QVERIFY(!generator.add("2001:db8:1:2::/64@eui64:00:1a", &error));
+}
+
+void TestTargetGenerator::embedsIpv4Block()
+{
+    TargetGenerator generator;
+    QString error;
+    QVERIFY2(generator.add("2001:db8::/96@v4:10.1.2.0/30", &error), qPrintable(error));
+    const QStringList targets = generator.targets();
+    QCOMPARE(targets.size(), 4);
+    QCOMPARE(address(targets.at(0)), address("2001:db8::a01:200"));
+    QCOMPARE(address(targets.at(3)), address("2001:db8::a01:203"));
+
+    QVERIFY(!generator.add("2001:db8::/112@v4:10.1.2.0/30", &error));
+    QVERIFY(!generator.add("10.0.0.0/24@v4:10.1.2.0/30", &error));
+}
+
+void TestTargetGenerator::splitsHitlistPattern()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    // An '@' in the file name isn't a pattern; only a known one after the last '@' is.
+    const QString fileName = dir.filePath("hosts@site.txt");
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Text));
+    file.write("# published hitlist\n"
+               "2001:db8:a::5 icmp,tcp80\n"
+               "not-an-address\n"
+               "2001:db8:a::9\n"
+               "10.0.0.1\n");
+    file.close();
+
+    TargetGenerator plain;
+    QString error;
+    QVERIFY2(plain.add("hitlist:" + fileName, &error), qPrintable(error));
+    QCOMPARE(plain.count(), 3);
+    QCOMPARE(plain.skipped(), 1);
+
+    TargetGenerator patterned;
+    QVERIFY2(patterned.add("hitlist:" + fileName + "@low:1-2", &error), qPrintable(error));
+    const QStringList targets = patterned.targets();
+    // The listed addresses first, then the pattern once in the one /64 named.
+    QCOMPARE(targets.size(), 5);
+    QCOMPARE(address(targets.at(0)), address("2001:db8:a::5"));
+    QCOMPARE(address(targets.at(2)), address("10.0.0.1"));
+    QCOMPARE(address(targets.at(3)), address("2001:db8:a::1"));
+    QCOMPARE(address(targets.at(4)), address("2001:db8:a::2"));
+}
+
+QTEST_GUILESS_MAIN(TestTargetGenerator)
+#include "tst_targetgenerator.moc"